@@ -464,7 +464,7 @@ void ApiVulkanSample::update_overlay(float delta_time)
 	}
 }
 
-void ApiVulkanSample::draw_ui(const VkCommandBuffer command_buffer)
+void ApiVulkanSample::draw_ui(const VkCommandBuffer command_buffer, VkPipeline ui_pipeline)
 {
 	if (gui)
 	{
@@ -473,7 +473,14 @@ void ApiVulkanSample::draw_ui(const VkCommandBuffer command_buffer)
 		vkCmdSetViewport(command_buffer, 0, 1, &viewport);
 		vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 
-		gui->draw(command_buffer);
+		if (ui_pipeline != VK_NULL_HANDLE)
+		{
+			gui->draw(command_buffer, ui_pipeline);
+		}
+		else
+		{
+			gui->draw(command_buffer);
+		}
 	}
 }
 
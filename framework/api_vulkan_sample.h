@@ -304,8 +304,9 @@ class ApiVulkanSample : public vkb::VulkanSample
 	/**
 	 * @brief If the gui is enabled, then record the drawing commands to a command buffer
 	 * @param command_buffer A valid command buffer that is ready to be recorded to
+	 * @param ui_pipeline Pipeline of the gui for a render pass other than the global one (see Gui::create_pipeline)
 	 */
-	void draw_ui(const VkCommandBuffer command_buffer);
+	void draw_ui(const VkCommandBuffer command_buffer, VkPipeline ui_pipeline = VK_NULL_HANDLE);
 
 	/**
 	 * @brief Prepare the frame for workload submission, acquires the next image from the swap chain and 
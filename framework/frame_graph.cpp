@@ -0,0 +1,194 @@
+/* Copyright (c) 2020, Tatsuya Yatagawa
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 the "License";
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frame_graph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <utility>
+
+namespace vkb
+{
+namespace
+{
+VkDeviceSize align_up(VkDeviceSize offset, VkDeviceSize alignment)
+{
+	return alignment > 1 ? (offset + alignment - 1) / alignment * alignment : offset;
+}
+
+bool lifetimes_overlap(const FrameGraph::Resource &a, const FrameGraph::Resource &b)
+{
+	return a.first_pass <= b.last_pass && b.first_pass <= a.last_pass;
+}
+
+bool ranges_overlap(const FrameGraph::Resource &a, const FrameGraph::Resource &b)
+{
+	return a.heap == b.heap &&
+	       a.offset < b.offset + b.requirements.size &&
+	       b.offset < a.offset + a.requirements.size;
+}
+}        // namespace
+
+uint32_t FrameGraph::add_pass(const std::string &name)
+{
+	passes.push_back(name);
+	return static_cast<uint32_t>(passes.size() - 1);
+}
+
+uint32_t FrameGraph::add_resource(const std::string &name, const VkMemoryRequirements &requirements, uint32_t memory_type_index)
+{
+	Resource resource;
+	resource.name              = name;
+	resource.requirements      = requirements;
+	resource.memory_type_index = memory_type_index;
+	resources.push_back(resource);
+	return static_cast<uint32_t>(resources.size() - 1);
+}
+
+void FrameGraph::use(uint32_t resource, uint32_t pass)
+{
+	assert(resource < resources.size() && pass < passes.size());
+
+	Resource &r  = resources[resource];
+	r.first_pass = std::min(r.first_pass, pass);
+	r.last_pass  = std::max(r.last_pass, pass);
+}
+
+void FrameGraph::compile()
+{
+	heaps.clear();
+	aliasing_passes.assign(passes.size(), false);
+
+	for (auto &r : resources)
+	{
+		if (r.first_pass > r.last_pass)
+		{
+			r.first_pass = 0;
+			r.last_pass  = passes.empty() ? 0 : static_cast<uint32_t>(passes.size() - 1);
+		}
+	}
+
+	// Larger resources are placed first, so that smaller ones fill the gaps between them
+	std::vector<uint32_t> order(resources.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+		return resources[a].requirements.size > resources[b].requirements.size;
+	});
+
+	std::vector<uint32_t> placed;
+	for (uint32_t index : order)
+	{
+		Resource &r = resources[index];
+
+		auto heap = std::find_if(heaps.begin(), heaps.end(), [&r](const Heap &h) { return h.memory_type_index == r.memory_type_index; });
+		if (heap == heaps.end())
+		{
+			heaps.push_back({r.memory_type_index, 0});
+			heap = heaps.end() - 1;
+		}
+		r.heap = static_cast<uint32_t>(heap - heaps.begin());
+
+		// Ranges taken by the resources alive at the same time
+		std::vector<std::pair<VkDeviceSize, VkDeviceSize>> taken;
+		for (uint32_t other : placed)
+		{
+			const Resource &o = resources[other];
+			if (o.heap == r.heap && lifetimes_overlap(r, o))
+			{
+				taken.emplace_back(o.offset, o.offset + o.requirements.size);
+			}
+		}
+		std::sort(taken.begin(), taken.end());
+
+		// Lowest gap that the resource fits in
+		VkDeviceSize offset = 0;
+		for (const auto &range : taken)
+		{
+			if (offset + r.requirements.size <= range.first)
+			{
+				break;
+			}
+			offset = std::max(offset, align_up(range.second, r.requirements.alignment));
+		}
+		r.offset   = offset;
+		heap->size = std::max(heap->size, offset + r.requirements.size);
+
+		placed.push_back(index);
+	}
+
+	// Memory written by a pass for the first time in the frame may still be accessed by an earlier pass
+	for (const auto &r : resources)
+	{
+		for (const auto &o : resources)
+		{
+			if (o.last_pass < r.first_pass && ranges_overlap(r, o))
+			{
+				aliasing_passes[r.first_pass] = true;
+			}
+		}
+	}
+}
+
+void FrameGraph::clear()
+{
+	passes.clear();
+	resources.clear();
+	heaps.clear();
+	aliasing_passes.clear();
+}
+
+bool FrameGraph::aliases_before(uint32_t pass) const
+{
+	return pass < aliasing_passes.size() && aliasing_passes[pass];
+}
+
+const std::vector<FrameGraph::Heap> &FrameGraph::get_heaps() const
+{
+	return heaps;
+}
+
+const FrameGraph::Resource &FrameGraph::get_resource(uint32_t resource) const
+{
+	return resources.at(resource);
+}
+
+const std::string &FrameGraph::get_pass_name(uint32_t pass) const
+{
+	return passes.at(pass);
+}
+
+VkDeviceSize FrameGraph::get_dedicated_size() const
+{
+	VkDeviceSize size = 0;
+	for (const auto &r : resources)
+	{
+		size += r.requirements.size;
+	}
+	return size;
+}
+
+VkDeviceSize FrameGraph::get_heap_size() const
+{
+	VkDeviceSize size = 0;
+	for (const auto &heap : heaps)
+	{
+		size += heap.size;
+	}
+	return size;
+}
+}        // namespace vkb
@@ -0,0 +1,127 @@
+/* Copyright (c) 2020, Tatsuya Yatagawa
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 the "License";
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/vk_common.h"
+
+namespace vkb
+{
+/**
+ * @brief Passes of a frame and the transient resources that they use
+ *        Passes are added in their execution order, and a resource is alive from the first to the last pass
+ *        that uses it. Resources of the same memory type whose lifetimes do not overlap are placed at
+ *        overlapping ranges of a shared heap, so that a heap only holds the resources alive at the same time.
+ *        Resources kept across frames must not be added.
+ */
+class FrameGraph
+{
+  public:
+	/// Memory shared by the resources of a memory type
+	struct Heap
+	{
+		uint32_t memory_type_index{0};
+
+		VkDeviceSize size{0};
+	};
+
+	/// Transient resource, and its placement after "compile"
+	struct Resource
+	{
+		std::string name;
+
+		VkMemoryRequirements requirements{};
+
+		uint32_t memory_type_index{0};
+
+		uint32_t first_pass{~0u};
+
+		uint32_t last_pass{0};
+
+		uint32_t heap{0};
+
+		VkDeviceSize offset{0};
+	};
+
+	/**
+	 * @brief Adds a pass executed after the passes added so far
+	 * @param name The name of the pass
+	 * @returns The index of the pass
+	 */
+	uint32_t add_pass(const std::string &name);
+
+	/**
+	 * @brief Adds a transient resource
+	 * @param name The name of the resource
+	 * @param requirements The memory requirements of the resource
+	 * @param memory_type_index The memory type that the resource is bound to
+	 * @returns The index of the resource
+	 */
+	uint32_t add_resource(const std::string &name, const VkMemoryRequirements &requirements, uint32_t memory_type_index);
+
+	/**
+	 * @brief Declares that a pass reads or writes a resource
+	 */
+	void use(uint32_t resource, uint32_t pass);
+
+	/**
+	 * @brief Places the resources into heaps
+	 *        From the largest one, each resource takes the lowest offset that does not overlap the resources
+	 *        alive at the same time. A resource used by no pass is alive over the whole frame.
+	 */
+	void compile();
+
+	/**
+	 * @brief Removes all the passes and resources
+	 */
+	void clear();
+
+	/**
+	 * @returns Whether a resource first used by the pass takes memory of a resource used by an earlier pass,
+	 *          i.e., whether the pass must wait for the earlier passes before it writes the memory
+	 */
+	bool aliases_before(uint32_t pass) const;
+
+	const std::vector<Heap> &get_heaps() const;
+
+	const Resource &get_resource(uint32_t resource) const;
+
+	const std::string &get_pass_name(uint32_t pass) const;
+
+	/**
+	 * @returns Memory of the resources when each of them has its own allocation
+	 */
+	VkDeviceSize get_dedicated_size() const;
+
+	/**
+	 * @returns Memory of the heaps
+	 */
+	VkDeviceSize get_heap_size() const;
+
+  private:
+	std::vector<std::string> passes;
+
+	std::vector<Resource> resources;
+
+	std::vector<Heap> heaps;
+
+	std::vector<bool> aliasing_passes;
+};
+}        // namespace vkb
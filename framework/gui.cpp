@@ -281,6 +281,11 @@ void Gui::prepare(const VkPipelineCache pipeline_cache, const VkRenderPass rende
 	    vkb::initializers::write_descriptor_set(descriptor_set, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &font_descriptor)};
 	vkUpdateDescriptorSets(sample.get_render_context().get_device().get_handle(), static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
 
+	pipeline = create_pipeline(pipeline_cache, render_pass, shader_stages);
+}
+
+VkPipeline Gui::create_pipeline(const VkPipelineCache pipeline_cache, const VkRenderPass render_pass, const std::vector<VkPipelineShaderStageCreateInfo> &shader_stages, uint32_t subpass)
+{
 	// Setup graphics pipeline for UI rendering
 	VkPipelineInputAssemblyStateCreateInfo input_assembly_state =
 	    vkb::initializers::pipeline_input_assembly_state_create_info(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
@@ -328,7 +333,7 @@ void Gui::prepare(const VkPipelineCache pipeline_cache, const VkRenderPass rende
 	pipeline_create_info.pDynamicState       = &dynamic_state;
 	pipeline_create_info.stageCount          = static_cast<uint32_t>(shader_stages.size());
 	pipeline_create_info.pStages             = shader_stages.data();
-	pipeline_create_info.subpass             = 0;
+	pipeline_create_info.subpass             = subpass;
 
 	// Vertex bindings an attributes based on ImGui vertex definition
 	std::vector<VkVertexInputBindingDescription> vertex_input_bindings = {
@@ -347,8 +352,10 @@ void Gui::prepare(const VkPipelineCache pipeline_cache, const VkRenderPass rende
 
 	pipeline_create_info.pVertexInputState = &vertex_input_state_create_info;
 
-	VK_CHECK(vkCreateGraphicsPipelines(sample.get_render_context().get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipeline));
-}        // namespace vkb
+	VkPipeline ui_pipeline;
+	VK_CHECK(vkCreateGraphicsPipelines(sample.get_render_context().get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &ui_pipeline));
+	return ui_pipeline;
+}
 
 void Gui::update(const float delta_time)
 {
@@ -636,6 +643,11 @@ void Gui::draw(CommandBuffer &command_buffer)
 }
 
 void Gui::draw(VkCommandBuffer command_buffer)
+{
+	draw(command_buffer, pipeline);
+}
+
+void Gui::draw(VkCommandBuffer command_buffer, VkPipeline ui_pipeline)
 {
 	if (!visible)
 	{
@@ -652,7 +664,7 @@ void Gui::draw(VkCommandBuffer command_buffer)
 		return;
 	}
 
-	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ui_pipeline);
 	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout->get_handle(), 0, 1, &descriptor_set, 0, NULL);
 
 	// Push constants
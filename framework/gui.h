@@ -252,6 +252,16 @@ class Gui
 
 	void prepare(const VkPipelineCache pipeline_cache, const VkRenderPass render_pass, const std::vector<VkPipelineShaderStageCreateInfo> &shader_stages);
 
+	/**
+	 * @brief Creates a pipeline of the Gui for another render pass (destroyed by the caller)
+	 * @param pipeline_cache The pipeline cache
+	 * @param render_pass The render pass in which the Gui is drawn
+	 * @param shader_stages The shader stages of the Gui
+	 * @param subpass The subpass of the render pass in which the Gui is drawn
+	 * @return The pipeline to be passed to draw
+	 */
+	VkPipeline create_pipeline(const VkPipelineCache pipeline_cache, const VkRenderPass render_pass, const std::vector<VkPipelineShaderStageCreateInfo> &shader_stages, uint32_t subpass = 0);
+
 	/**
 	 * @brief Handles resizing of the window
 	 * @param width New width of the window
@@ -285,6 +295,13 @@ class Gui
 	 */
 	void draw(VkCommandBuffer command_buffer);
 
+	/**
+	 * @brief Draws the Gui with a pipeline made by create_pipeline
+	 * @param command_buffer Command buffer to register draw-commands
+	 * @param ui_pipeline Pipeline compatible with the render pass in use
+	 */
+	void draw(VkCommandBuffer command_buffer, VkPipeline ui_pipeline);
+
 	/**
 	 * @brief Shows an overlay top window with app info and maybe stats
 	 * @param app_name Application name
@@ -0,0 +1,155 @@
+/* Copyright (c) 2020, Tatsuya Yatagawa
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 the "License";
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sh_projection.h"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include <ctpl_stl.h>
+
+VKBP_DISABLE_WARNINGS()
+#include <glm/gtc/constants.hpp>
+VKBP_ENABLE_WARNINGS()
+
+namespace vkb
+{
+namespace
+{
+// Normalization constants of the real spherical harmonics
+constexpr double SH_Y00 = 0.282094791773878;        // 1 / (2 sqrt(pi))
+constexpr double SH_Y1  = 0.488602511902920;        // sqrt(3 / (4 pi))
+constexpr double SH_Y2  = 1.092548430592079;        // sqrt(15 / (4 pi))
+constexpr double SH_Y20 = 0.315391565252520;        // sqrt(5 / (16 pi))
+constexpr double SH_Y22 = 0.546274215296040;        // sqrt(15 / (16 pi))
+
+using SH9 = std::array<glm::dvec3, 9>;
+
+/**
+ * @brief Integrates the rows [row_begin, row_end) of the map
+ *        Within a row, the basis functions only depend on phi through cos(phi), sin(phi), cos(2 phi)
+ *        and sin(2 phi), so each row reduces to five weighted sums of the texels.
+ */
+SH9 project_rows(const float *pixels, uint32_t width, uint32_t height, uint32_t row_begin, uint32_t row_end,
+                 const std::vector<glm::vec4> &phi_terms)
+{
+	const double d_theta = glm::pi<double>() / height;
+	const double d_phi   = 2.0 * glm::pi<double>() / width;
+
+	SH9 coefs = {};
+	for (uint32_t v = row_begin; v < row_end; v++)
+	{
+		const glm::vec4 *row = reinterpret_cast<const glm::vec4 *>(pixels) + static_cast<size_t>(v) * width;
+
+		// Sums of the texels weighted by 1, cos(phi), sin(phi), cos(2 phi) and sin(2 phi) (RGBA lanes)
+		glm::vec4 sum_1(0.0f);
+		glm::vec4 sum_c(0.0f);
+		glm::vec4 sum_s(0.0f);
+		glm::vec4 sum_c2(0.0f);
+		glm::vec4 sum_s2(0.0f);
+		for (uint32_t u = 0; u < width; u++)
+		{
+			const glm::vec4 &radiance = row[u];
+			const glm::vec4 &terms    = phi_terms[u];
+			sum_1 += radiance;
+			sum_c += radiance * terms.x;
+			sum_s += radiance * terms.y;
+			sum_c2 += radiance * terms.z;
+			sum_s2 += radiance * terms.w;
+		}
+
+		// Solid angle of the texels of this row
+		const double theta     = (v + 0.5) * d_theta;
+		const double sin_theta = std::sin(theta);
+		const double cos_theta = std::cos(theta);
+		const double weight    = sin_theta * d_theta * d_phi;
+
+		const glm::dvec3 s_1  = glm::dvec3(sum_1) * weight;
+		const glm::dvec3 s_c  = glm::dvec3(sum_c) * weight;
+		const glm::dvec3 s_s  = glm::dvec3(sum_s) * weight;
+		const glm::dvec3 s_c2 = glm::dvec3(sum_c2) * weight;
+		const glm::dvec3 s_s2 = glm::dvec3(sum_s2) * weight;
+
+		coefs[0] += SH_Y00 * s_1;
+		coefs[1] += SH_Y1 * sin_theta * s_s;
+		coefs[2] += SH_Y1 * cos_theta * s_1;
+		coefs[3] += SH_Y1 * sin_theta * s_c;
+		coefs[4] += SH_Y22 * sin_theta * sin_theta * s_s2;
+		coefs[5] += SH_Y2 * sin_theta * cos_theta * s_s;
+		coefs[6] += SH_Y20 * (3.0 * cos_theta * cos_theta - 1.0) * s_1;
+		coefs[7] += SH_Y2 * sin_theta * cos_theta * s_c;
+		coefs[8] += SH_Y22 * sin_theta * sin_theta * s_c2;
+	}
+
+	return coefs;
+}
+}        // namespace
+
+std::array<glm::vec3, 9> project_sh9(const float *pixels, uint32_t width, uint32_t height)
+{
+	std::array<glm::vec3, 9> result = {};
+	if (pixels == nullptr || width == 0 || height == 0)
+	{
+		return result;
+	}
+
+	// Terms of phi are shared by all the rows
+	std::vector<glm::vec4> phi_terms(width);
+	for (uint32_t u = 0; u < width; u++)
+	{
+		const double phi = 2.0 * glm::pi<double>() * (u + 0.5) / width;
+		phi_terms[u]     = glm::vec4(std::cos(phi), std::sin(phi), std::cos(2.0 * phi), std::sin(2.0 * phi));
+	}
+
+	// Blocks of rows are integrated in parallel, and the partial sums are reduced in double precision
+	auto thread_count = std::thread::hardware_concurrency();
+	thread_count      = thread_count == 0 ? 1 : thread_count;
+	thread_count      = std::min(thread_count, height);
+	ctpl::thread_pool thread_pool(thread_count);
+
+	const uint32_t rows_per_task = (height + thread_count - 1) / thread_count;
+
+	std::vector<std::future<SH9>> futures;
+	for (uint32_t row_begin = 0; row_begin < height; row_begin += rows_per_task)
+	{
+		const uint32_t row_end = std::min(row_begin + rows_per_task, height);
+		futures.push_back(thread_pool.push(
+		    [=, &phi_terms](size_t) {
+			    return project_rows(pixels, width, height, row_begin, row_end, phi_terms);
+		    }));
+	}
+
+	SH9 coefs = {};
+	for (auto &fut : futures)
+	{
+		const SH9 partial = fut.get();
+		for (size_t k = 0; k < coefs.size(); k++)
+		{
+			coefs[k] += partial[k];
+		}
+	}
+
+	for (size_t k = 0; k < coefs.size(); k++)
+	{
+		result[k] = glm::vec3(coefs[k]);
+	}
+	return result;
+}
+}        // namespace vkb
@@ -0,0 +1,42 @@
+/* Copyright (c) 2020, Tatsuya Yatagawa
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 the "License";
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "common/error.h"
+
+VKBP_DISABLE_WARNINGS()
+#include "common/glm_common.h"
+VKBP_ENABLE_WARNINGS()
+
+namespace vkb
+{
+/**
+ * @brief Projects an equirectangular environment map onto the real spherical harmonics of bands 0 to 2
+ *        Texel (u, v) is the direction (sin(theta) cos(phi), sin(theta) sin(phi), cos(theta)) with
+ *        theta = pi (v + 0.5) / height and phi = 2 pi (u + 0.5) / width, weighted by its solid angle.
+ *        Rows are integrated in parallel, and each row is reduced with 4-wide accumulators over RGBA.
+ * @param pixels RGBA floats of the map, from the top row (theta = 0)
+ * @param width The width of the map
+ * @param height The height of the map
+ * @returns RGB coefficients ordered as L00, L1-1, L10, L11, L2-2, L2-1, L20, L21, L22
+ */
+std::array<glm::vec3, 9> project_sh9(const float *pixels, uint32_t width, uint32_t height);
+}        // namespace vkb
@@ -14,6 +14,7 @@
 #include <cmath>
 #include <memory>
 #include <algorithm>
+#include <vector>
 
 #include <glm/glm.hpp>
 
@@ -90,4 +91,59 @@ inline void gaussBlur(float *bytes, const glm::vec4 &sigma, int width, int heigh
     }
 }
 
+// Coefficients of recursive Gaussian filter by Young and van Vliet (1995).
+// Returns (B, b1 / b0, b2 / b0, b3 / b0) as "gauss_filter_recursive.comp" does.
+inline glm::vec4 recursiveGaussCoefs(float sigma) {
+    const float s = std::max(0.5f, sigma);
+    const float q = s >= 2.5f ? 0.98711f * s - 0.96330f : 3.97156f - 4.14554f * std::sqrt(1.0f - 0.26891f * s);
+    const float q2 = q * q;
+    const float q3 = q2 * q;
+    const float b0 = 1.57825f + 2.44413f * q + 1.4281f * q2 + 0.422205f * q3;
+    const float b1 = 2.44413f * q + 2.85619f * q2 + 1.26661f * q3;
+    const float b2 = -(1.4281f * q2 + 1.26661f * q3);
+    const float b3 = 0.422205f * q3;
+    return glm::vec4(1.0f - (b1 + b2 + b3) / b0, b1 / b0, b2 / b0, b3 / b0);
+}
+
+// L1 errors of the windowed kernel (truncated to "ksize" taps) and the
+// recursive filter against the exact Gaussian, measured with their impulse responses.
+inline glm::vec2 gaussKernelErrors(float sigma, int ksize) {
+    const int radius = (ksize - 1) / 2;
+    const int support = std::max(radius, (int)std::ceil(6.0f * sigma));
+    const int n = 2 * support + 1;
+
+    // Windowed kernel (normalized in the filter by the sum of weights)
+    std::vector<float> windowed(n, 0.0f);
+    float sumWgt = 0.0f;
+    for (int k = -radius; k <= radius; k++) {
+        windowed[k + support] = gauss((float)k, sigma);
+        sumWgt += windowed[k + support];
+    }
+
+    // Recursive filter (causal and anti-causal passes)
+    const glm::vec4 c = recursiveGaussCoefs(sigma);
+    std::vector<float> causal(n, 0.0f), recursive(n, 0.0f);
+    for (int i = 0; i < n; i++) {
+        const float x = i == support ? 1.0f : 0.0f;
+        causal[i] = c.x * x;
+        for (int j = 1; j <= 3; j++) {
+            causal[i] += i - j >= 0 ? c[j] * causal[i - j] : 0.0f;
+        }
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        recursive[i] = c.x * causal[i];
+        for (int j = 1; j <= 3; j++) {
+            recursive[i] += i + j < n ? c[j] * recursive[i + j] : 0.0f;
+        }
+    }
+
+    glm::vec2 errors(0.0f, 0.0f);
+    for (int k = -support; k <= support; k++) {
+        const float g = gauss((float)k, sigma);
+        errors.x += std::abs(windowed[k + support] / sumWgt - g);
+        errors.y += std::abs(recursive[k + support] - g);
+    }
+    return errors;
+}
+
 #endif  // LINSSS_GAUSS_H
@@ -7,18 +7,186 @@
 #include "linsss.h"
 
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
 #include <stb_image.h>
 #include <stdexcept>
 #include <tinyply.h>
 
+#include <glm/gtc/constants.hpp>
 #include <glm/gtx/string_cast.hpp>
 
 #include "gauss.h"
+#include "platform/filesystem.h"
+#include "sh_projection.h"
+#include "timer.h"
+
+static constexpr uint32_t SHADOW_MAP_SIZE        = 2048;
+static constexpr uint32_t MAX_MIP_LEVELS         = 16;
+static constexpr float    ENVMAP_SCALE           = 2.0f;
+static constexpr uint32_t TSM_MIN_UPSAMPLE_RATIO = 2;
+
+// Workgroup size auto-tuner
+static constexpr uint32_t WORKGROUP_TUNER_WARMUP_FRAMES  = 4;
+static constexpr uint32_t WORKGROUP_TUNER_MEASURE_FRAMES = 16;
+static const VkExtent2D   WORKGROUP_TUNER_CANDIDATES[]   = {
+    {8, 8},
+    {16, 8},
+    {8, 16},
+    {16, 16},
+    {32, 8},
+    {8, 32},
+    {32, 16},
+    {32, 32}};
+
+// Tiled Gaussian filter (see "gauss_filter_tiled.comp")
+static constexpr uint32_t GAUSS_TILE_LENGTH     = 64;
+static constexpr uint32_t GAUSS_TILE_ROWS       = 4;
+static constexpr uint32_t MAX_GAUSS_KERNEL_SIZE = 64;
+
+// Single-pass Gaussian pyramid (see "gauss_pyramid.comp")
+static constexpr uint32_t GAUSS_PYRAMID_TILE_SIZE  = 16;
+static constexpr uint32_t GAUSS_PYRAMID_MAX_GROUPS = 512;
+
+// Tile lists of masked passes (see "tile_classify.comp")
+static constexpr uint32_t     TILE_LIST_TILE_SIZE   = 8;
+static constexpr VkDeviceSize TILE_LIST_HEADER_SIZE = 3 * MAX_MIP_LEVELS * sizeof(uint32_t);
+
+// Convergence of TSM accumulation (see "tsm_variance.comp")
+static constexpr uint32_t TSM_VARIANCE_TILE_SIZE = 8;
+static constexpr uint32_t TSM_MIN_FRAMES         = 16;
+
+// TSM convergence is compared at the RMSE of white noise sampling after TSM_CONVERGENCE_FRAMES frames.
+// The reference is white noise offset by TSM_REFERENCE_SEED, so that it is independent of the measured sequences.
+static constexpr uint32_t TSM_REFERENCE_FRAMES   = 4096;
+static constexpr uint32_t TSM_CONVERGENCE_FRAMES = 64;
+static constexpr float    TSM_REFERENCE_SEED     = 7919.5f;
+
+// Dynamic TSM resolution. The render area is a multiple of 1/TSM_RESOLUTION_STEPS of the TSM attachments,
+// and the GPU time of the TSM pass settles for TSM_RESOLUTION_SETTLE_FRAMES frames after each change.
+static constexpr uint32_t TSM_RESOLUTION_STEPS         = 8;
+static constexpr uint32_t TSM_MIN_RESOLUTION_STEPS     = 2;
+static constexpr uint32_t TSM_DEFAULT_RESOLUTION_STEPS = 4;        // i.e., surface / 4
+static constexpr uint32_t TSM_RESOLUTION_SETTLE_FRAMES = 32;
+
+// Radial profiles of TSM (see "prepare_tsm_profile")
+static constexpr uint32_t TSM_PROFILE_LUT_SIZE          = 256;
+static constexpr uint32_t TSM_PROFILE_CODES             = 64;
+static constexpr uint32_t TSM_PROFILE_KMEANS_ITERATIONS = 8;
+static constexpr uint32_t TSM_PROFILE_KMEANS_SAMPLES    = 16384;
+static constexpr float    TSM_PROFILE_MAX_SIGMAS        = 5.0f;
+
+// MIP levels of the light-space irradiance and position maps for TSM (2048^2 down to 16^2),
+// and the taps of each frame, which are specialization constants of "translucent_shadow_maps.glsl"
+static constexpr uint32_t TSM_MIP_LEVELS = 8;
+static constexpr uint32_t TSM_SAMPLES    = 8;
+static constexpr float    TSM_MAX_RADIUS = 0.1f;
+
+// Prefiltered environment (see "prefilter_environment"). Level i of the prefiltered map is for roughness
+// i / (ENV_PREFILTER_LEVELS - 1), and the direct pass reads the level of roughness sqrt(alpha) ("alpha" in "direct_pass.frag").
+static constexpr uint32_t ENV_PREFILTER_WIDTH   = 1024;
+static constexpr uint32_t ENV_PREFILTER_HEIGHT  = 512;
+static constexpr uint32_t ENV_PREFILTER_LEVELS  = 6;
+static constexpr uint32_t ENV_PREFILTER_SAMPLES = 512;
+static constexpr uint32_t ENV_PREFILTER_GROUP   = 8;
+static constexpr uint32_t BRDF_LUT_SIZE         = 128;
+
+// FNV-1a hash for dirty tracking
+static constexpr uint64_t HASH_SEED = 14695981039346656037ull;
+
+static uint64_t hash_bytes(uint64_t seed, const void *data, size_t size)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        seed ^= bytes[i];
+        seed *= 1099511628211ull;
+    }
+    return seed;
+}
+
+template <typename T>
+static uint64_t hash_value(uint64_t seed, const T &value)
+{
+    return hash_bytes(seed, &value, sizeof(T));
+}
+
+// Name of the environment map of the light type (nullptr for the point light)
+static const char *envmap_name(int light_type)
+{
+    switch (light_type)
+    {
+        case LightType::Uffizi:
+            return "uffizi";
+        case LightType::Grace:
+            return "grace";
+        default:
+            return nullptr;
+    }
+}
+
+static const char *frame_pass_name(int pass)
+{
+    switch (pass)
+    {
+        case FramePass::DirectPass:
+            return "direct pass";
+        case FramePass::IrradianceMipmap:
+            return "irradiance mipmap";
+        case FramePass::GaussianFilter:
+            return "Gaussian filter";
+        case FramePass::TSMPass:
+            return "TSM";
+        case FramePass::DeferredShading:
+            return "deferred shading";
+        case FramePass::PostprocessPass:
+            return "postprocess";
+        default:
+            return nullptr;
+    }
+}
+
+static bool is_device_extension_available(VkPhysicalDevice gpu, const char *extension)
+{
+    uint32_t extension_count = 0;
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(gpu, nullptr, &extension_count, nullptr));
+    std::vector<VkExtensionProperties> extensions(extension_count);
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(gpu, nullptr, &extension_count, extensions.data()));
+
+    return std::any_of(extensions.begin(), extensions.end(), [extension](const VkExtensionProperties &properties) {
+        return std::strcmp(properties.extensionName, extension) == 0;
+    });
+}
+
+// Formats of irradiance, position and normal of the light pass (undefined if they are not rendered)
+static std::array<VkFormat, 3> light_pass_formats(int format)
+{
+    switch (format)
+    {
+        case LightPassFormat::Compact:
+            return {VK_FORMAT_B10G11R11_UFLOAT_PACK32, VK_FORMAT_UNDEFINED, VK_FORMAT_UNDEFINED};
+        case LightPassFormat::DepthOnly:
+            return {VK_FORMAT_UNDEFINED, VK_FORMAT_UNDEFINED, VK_FORMAT_UNDEFINED};
+        default:
+            return {VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+    }
+}
 
-static constexpr uint32_t SHADOW_MAP_SIZE    = 2048;
-static constexpr uint32_t MAX_MIP_LEVELS     = 16;
-static constexpr float    ENVMAP_SCALE       = 2.0f;
-static constexpr int      TSM_UPSAMPLE_RATIO = 4;
+// Formats of diffuse, specular, position, normal and linear depth of the direct pass (undefined if they are not rendered)
+static std::array<VkFormat, 5> gbuffer_formats(int profile)
+{
+    switch (profile)
+    {
+        case GBufferProfile::Float16:
+            return {VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_UNDEFINED, VK_FORMAT_R16G16_SNORM, VK_FORMAT_UNDEFINED};
+        case GBufferProfile::Packed:
+            return {VK_FORMAT_B10G11R11_UFLOAT_PACK32, VK_FORMAT_B10G11R11_UFLOAT_PACK32, VK_FORMAT_UNDEFINED, VK_FORMAT_R16G16_SNORM, VK_FORMAT_UNDEFINED};
+        default:
+            return {VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+    }
+}
 
 LinSSScatter::LinSSScatter()
 {
@@ -27,6 +195,12 @@ LinSSScatter::LinSSScatter()
     rotation            = {180.0f, 0.0f, 0.0f};
     title               = "LinSSS";
     name                = "LinSSS";
+
+    // Half-precision arithmetic is used only if the device supports it
+    add_device_extension(VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME, true);
+
+    // Tuned workgroup sizes are saved for the device UUID if it can be queried (see "workgroup_sizes_filename")
+    add_instance_extension(VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME, true);
 }
 
 LinSSScatter::~LinSSScatter()
@@ -37,38 +211,74 @@ LinSSScatter::~LinSSScatter()
         // Note : Inherited destructor cleans up resources stored in base class
         vkDestroyPipeline(get_device().get_handle(), pipelines.light_pass, nullptr);
         vkDestroyPipeline(get_device().get_handle(), pipelines.direct_pass, nullptr);
-        vkDestroyPipeline(get_device().get_handle(), pipelines.gauss_filter, nullptr);
+        vkDestroyPipeline(get_device().get_handle(), pipelines.gauss_filter_tiled, nullptr);
+        vkDestroyPipeline(get_device().get_handle(), pipelines.gauss_filter_recursive, nullptr);
+        vkDestroyPipeline(get_device().get_handle(), pipelines.gauss_pyramid, nullptr);
+        vkDestroyPipeline(get_device().get_handle(), pipelines.gauss_pyramid_split, nullptr);
+        vkDestroyPipeline(get_device().get_handle(), pipelines.tile_classify, nullptr);
         vkDestroyPipeline(get_device().get_handle(), pipelines.linsss, nullptr);
         vkDestroyPipeline(get_device().get_handle(), pipelines.trans_sm, nullptr);
+        vkDestroyPipeline(get_device().get_handle(), pipelines.trans_sm_float16, nullptr);
+        vkDestroyPipeline(get_device().get_handle(), pipelines.tsm_variance, nullptr);
+        vkDestroyPipeline(get_device().get_handle(), pipelines.env_prefilter, nullptr);
+        vkDestroyPipeline(get_device().get_handle(), pipelines.brdf_lut, nullptr);
         vkDestroyPipeline(get_device().get_handle(), pipelines.background, nullptr);
         vkDestroyPipeline(get_device().get_handle(), pipelines.deferred, nullptr);
+        vkDestroyPipeline(get_device().get_handle(), pipelines.deferred_fused[0], nullptr);
+        vkDestroyPipeline(get_device().get_handle(), pipelines.deferred_fused[1], nullptr);
         vkDestroyPipeline(get_device().get_handle(), pipelines.postprocess, nullptr);
+        vkDestroyPipeline(get_device().get_handle(), pipelines.background_subpass, nullptr);
+        vkDestroyPipeline(get_device().get_handle(), pipelines.deferred_subpass, nullptr);
+        vkDestroyPipeline(get_device().get_handle(), pipelines.deferred_fused_subpass[0], nullptr);
+        vkDestroyPipeline(get_device().get_handle(), pipelines.deferred_fused_subpass[1], nullptr);
+        vkDestroyPipeline(get_device().get_handle(), pipelines.postprocess_subpass, nullptr);
+        vkDestroyPipeline(get_device().get_handle(), subpass_merge.ui_pipeline, nullptr);
+        for (auto &it : gauss_filter_pipelines)
+        {
+            vkDestroyPipeline(get_device().get_handle(), it.second, nullptr);
+        }
 
         vkDestroyDescriptorPool(get_device().get_handle(), descriptor_pools.light_pass, nullptr);
         vkDestroyDescriptorPool(get_device().get_handle(), descriptor_pools.direct_pass, nullptr);
         vkDestroyDescriptorPool(get_device().get_handle(), descriptor_pools.gauss_filter, nullptr);
+        vkDestroyDescriptorPool(get_device().get_handle(), descriptor_pools.gauss_pyramid, nullptr);
+        vkDestroyDescriptorPool(get_device().get_handle(), descriptor_pools.gauss_pyramid_split, nullptr);
+        vkDestroyDescriptorPool(get_device().get_handle(), descriptor_pools.tile_classify, nullptr);
         vkDestroyDescriptorPool(get_device().get_handle(), descriptor_pools.linsss, nullptr);
         vkDestroyDescriptorPool(get_device().get_handle(), descriptor_pools.trans_sm, nullptr);
+        vkDestroyDescriptorPool(get_device().get_handle(), descriptor_pools.tsm_variance, nullptr);
+        vkDestroyDescriptorPool(get_device().get_handle(), descriptor_pools.env_prefilter, nullptr);
         vkDestroyDescriptorPool(get_device().get_handle(), descriptor_pools.deferred, nullptr);
         vkDestroyDescriptorPool(get_device().get_handle(), descriptor_pools.postprocess, nullptr);
 
         vkDestroyPipelineLayout(get_device().get_handle(), pipeline_layouts.light_pass, nullptr);
         vkDestroyPipelineLayout(get_device().get_handle(), pipeline_layouts.direct_pass, nullptr);
         vkDestroyPipelineLayout(get_device().get_handle(), pipeline_layouts.gauss_filter, nullptr);
+        vkDestroyPipelineLayout(get_device().get_handle(), pipeline_layouts.gauss_pyramid, nullptr);
+        vkDestroyPipelineLayout(get_device().get_handle(), pipeline_layouts.gauss_pyramid_split, nullptr);
+        vkDestroyPipelineLayout(get_device().get_handle(), pipeline_layouts.tile_classify, nullptr);
         vkDestroyPipelineLayout(get_device().get_handle(), pipeline_layouts.linsss, nullptr);
         vkDestroyPipelineLayout(get_device().get_handle(), pipeline_layouts.trans_sm, nullptr);
+        vkDestroyPipelineLayout(get_device().get_handle(), pipeline_layouts.tsm_variance, nullptr);
+        vkDestroyPipelineLayout(get_device().get_handle(), pipeline_layouts.env_prefilter, nullptr);
         vkDestroyPipelineLayout(get_device().get_handle(), pipeline_layouts.deferred, nullptr);
         vkDestroyPipelineLayout(get_device().get_handle(), pipeline_layouts.postprocess, nullptr);
 
         vkDestroyDescriptorSetLayout(get_device().get_handle(), descriptor_set_layouts.light_pass, nullptr);
         vkDestroyDescriptorSetLayout(get_device().get_handle(), descriptor_set_layouts.direct_pass, nullptr);
         vkDestroyDescriptorSetLayout(get_device().get_handle(), descriptor_set_layouts.gauss_filter, nullptr);
+        vkDestroyDescriptorSetLayout(get_device().get_handle(), descriptor_set_layouts.gauss_pyramid, nullptr);
+        vkDestroyDescriptorSetLayout(get_device().get_handle(), descriptor_set_layouts.gauss_pyramid_split, nullptr);
+        vkDestroyDescriptorSetLayout(get_device().get_handle(), descriptor_set_layouts.tile_classify, nullptr);
         vkDestroyDescriptorSetLayout(get_device().get_handle(), descriptor_set_layouts.linsss, nullptr);
         vkDestroyDescriptorSetLayout(get_device().get_handle(), descriptor_set_layouts.trans_sm, nullptr);
+        vkDestroyDescriptorSetLayout(get_device().get_handle(), descriptor_set_layouts.tsm_variance, nullptr);
+        vkDestroyDescriptorSetLayout(get_device().get_handle(), descriptor_set_layouts.env_prefilter, nullptr);
         vkDestroyDescriptorSetLayout(get_device().get_handle(), descriptor_set_layouts.deferred, nullptr);
         vkDestroyDescriptorSetLayout(get_device().get_handle(), descriptor_set_layouts.postprocess, nullptr);
 
         destroy_custom_framebuffers();
+        destroy_merged_framebuffers();
         destroy_custom_render_passes();
     }
 
@@ -84,219 +294,219 @@ LinSSScatter::~LinSSScatter()
     cube.index_buffer.reset();
     uniform_buffer_vs.reset();
     uniform_buffer_fs.reset();
+    uniform_buffer_gbuffer.reset();
+    storage_buffer_gauss_kernel.reset();
+    storage_buffer_gauss_pyramid_counter.reset();
+    tile_lists.buffer.reset();
+    uniform_buffer_gauss_pyramid_cs.reset();
+    gauss_filter_timer.query_pool.reset();
+    light_pass_targets.query_pool.reset();
+    shadow_pcf.query_pool.reset();
+    subpass_merge.query_pool.reset();
+    subpass_merge.color_view.reset();
+    subpass_merge.color.reset();
+    tsm_accumulation.moments.reset();
+    tsm_accumulation.tile_errors.reset();
+    tsm_resolution.query_pool.reset();
+    tsm_profile.lut_view.reset();
+    tsm_profile.lut.reset();
+    tsm_profile.codes_view.reset();
+    tsm_profile.codes.reset();
+    vkDestroySampler(get_device().get_handle(), tsm_profile.sampler, nullptr);
+    vkDestroySampler(get_device().get_handle(), shadow_pcf.compare_sampler, nullptr);
+    env_prefilter.level_views.clear();
+    env_prefilter.prefiltered_view.reset();
+    env_prefilter.prefiltered.reset();
+    env_prefilter.radiance_view.reset();
+    env_prefilter.radiance.reset();
+    env_prefilter.brdf_lut_view.reset();
+    env_prefilter.brdf_lut.reset();
+    vkDestroySampler(get_device().get_handle(), env_prefilter.sampler, nullptr);
+    vkDestroySampler(get_device().get_handle(), env_prefilter.lut_sampler, nullptr);
 }
 
-void LinSSScatter::setup_custom_render_passes()
+void LinSSScatter::setup_light_pass_render_pass()
 {
-    // Setup additional render pass (light pass)
-    {
-        std::array<VkAttachmentDescription, 4> attachments = {};
-        // Color attachment #1
-        attachments[0].format         = VK_FORMAT_R32G32B32A32_SFLOAT;
-        attachments[0].samples        = VK_SAMPLE_COUNT_1_BIT;
-        attachments[0].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        attachments[0].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
-        attachments[0].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        attachments[0].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-        attachments[0].finalLayout    = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        // Color attachment #2
-        attachments[1].format         = VK_FORMAT_R32G32B32A32_SFLOAT;
-        attachments[1].samples        = VK_SAMPLE_COUNT_1_BIT;
-        attachments[1].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        attachments[1].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
-        attachments[1].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        attachments[1].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-        attachments[1].finalLayout    = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        // Color attachment #3
-        attachments[2].format         = VK_FORMAT_R32G32B32A32_SFLOAT;
-        attachments[2].samples        = VK_SAMPLE_COUNT_1_BIT;
-        attachments[2].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        attachments[2].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
-        attachments[2].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        attachments[2].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        attachments[2].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-        attachments[2].finalLayout    = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        // Depth attachment
-        attachments[3].format         = VK_FORMAT_D32_SFLOAT;
-        attachments[3].samples        = VK_SAMPLE_COUNT_1_BIT;
-        attachments[3].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        attachments[3].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
-        attachments[3].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        attachments[3].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        attachments[3].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-        attachments[3].finalLayout    = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
-
-        std::array<VkAttachmentReference, 3> color_references = {};
-        color_references[0].attachment                        = 0;
-        color_references[0].layout                            = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        color_references[1].attachment                        = 1;
-        color_references[1].layout                            = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        color_references[2].attachment                        = 2;
-        color_references[2].layout                            = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-        VkAttachmentReference depth_reference = {};
-        depth_reference.attachment            = 3;
-        depth_reference.layout                = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-        VkSubpassDescription subpass_description    = {};
-        subpass_description.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass_description.colorAttachmentCount    = color_references.size();
-        subpass_description.pColorAttachments       = color_references.data();
-        subpass_description.pDepthStencilAttachment = &depth_reference;
-        subpass_description.inputAttachmentCount    = 0;
-        subpass_description.pInputAttachments       = nullptr;
-        subpass_description.preserveAttachmentCount = 0;
-        subpass_description.pPreserveAttachments    = nullptr;
-        subpass_description.pResolveAttachments     = nullptr;
-
-        // Subpass dependencies for layout transitions
-        std::array<VkSubpassDependency, 2> dependencies;
-
-        dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
-        dependencies[0].dstSubpass      = 0;
-        dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-        dependencies[0].dstStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependencies[0].srcAccessMask   = VK_ACCESS_MEMORY_READ_BIT;
-        dependencies[0].dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-        dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-        dependencies[1].srcSubpass      = 0;
-        dependencies[1].dstSubpass      = VK_SUBPASS_EXTERNAL;
-        dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-        dependencies[1].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-        dependencies[1].dstAccessMask   = VK_ACCESS_MEMORY_READ_BIT;
-        dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-        VkRenderPassCreateInfo render_pass_create_info = {};
-        render_pass_create_info.sType                  = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        render_pass_create_info.attachmentCount        = static_cast<uint32_t>(attachments.size());
-        render_pass_create_info.pAttachments           = attachments.data();
-        render_pass_create_info.subpassCount           = 1;
-        render_pass_create_info.pSubpasses             = &subpass_description;
-        render_pass_create_info.dependencyCount        = static_cast<uint32_t>(dependencies.size());
-        render_pass_create_info.pDependencies          = dependencies.data();
-
-        VK_CHECK(vkCreateRenderPass(get_device().get_handle(), &render_pass_create_info, nullptr, &render_passes.light_pass));
-    }
+    // Color attachments of the rendered maps are followed by the depth attachment
+    const std::array<VkFormat, 3> formats = light_pass_formats(light_pass_targets.active_format);
 
-    // Setup additional render pass (direct)
+    std::vector<VkAttachmentDescription> attachments;
+    std::vector<VkAttachmentReference>   color_references;
+    for (VkFormat format : formats)
     {
-        std::array<VkAttachmentDescription, 6> attachments = {};
-        // Color attachment #1 (diffuse)
-        attachments[0].format         = VK_FORMAT_R32G32B32A32_SFLOAT;
-        attachments[0].samples        = VK_SAMPLE_COUNT_1_BIT;
-        attachments[0].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        attachments[0].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
-        attachments[0].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        attachments[0].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-        attachments[0].finalLayout    = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        // Color attachment #2 (specular)
-        attachments[1].format         = VK_FORMAT_R32G32B32A32_SFLOAT;
-        attachments[1].samples        = VK_SAMPLE_COUNT_1_BIT;
-        attachments[1].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        attachments[1].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
-        attachments[1].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        attachments[1].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-        attachments[1].finalLayout    = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        // Color attachment #3 (position)
-        attachments[2].format         = VK_FORMAT_R32G32B32A32_SFLOAT;
-        attachments[2].samples        = VK_SAMPLE_COUNT_1_BIT;
-        attachments[2].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        attachments[2].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
-        attachments[2].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        attachments[2].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        attachments[2].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-        attachments[2].finalLayout    = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        // Color attachment #4 (normal)
-        attachments[3].format         = VK_FORMAT_R32G32B32A32_SFLOAT;
-        attachments[3].samples        = VK_SAMPLE_COUNT_1_BIT;
-        attachments[3].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        attachments[3].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
-        attachments[3].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        attachments[3].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        attachments[3].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-        attachments[3].finalLayout    = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        // Color attachment #5 (depth)
-        attachments[4].format         = VK_FORMAT_R32G32B32A32_SFLOAT;
-        attachments[4].samples        = VK_SAMPLE_COUNT_1_BIT;
-        attachments[4].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        attachments[4].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
-        attachments[4].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        attachments[4].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        attachments[4].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-        attachments[4].finalLayout    = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        // Depth attachment
-        attachments[5].format         = VK_FORMAT_D32_SFLOAT;
-        attachments[5].samples        = VK_SAMPLE_COUNT_1_BIT;
-        attachments[5].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        attachments[5].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
-        attachments[5].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        attachments[5].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        attachments[5].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-        attachments[5].finalLayout    = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-        std::array<VkAttachmentReference, 5> color_references = {};
-        color_references[0].attachment                        = 0;
-        color_references[0].layout                            = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        color_references[1].attachment                        = 1;
-        color_references[1].layout                            = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        color_references[2].attachment                        = 2;
-        color_references[2].layout                            = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        color_references[3].attachment                        = 3;
-        color_references[3].layout                            = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        color_references[4].attachment                        = 4;
-        color_references[4].layout                            = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        if (format == VK_FORMAT_UNDEFINED)
+        {
+            continue;
+        }
 
-        VkAttachmentReference depth_reference = {};
-        depth_reference.attachment            = 5;
-        depth_reference.layout                = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        VkAttachmentDescription attachment = {};
+        attachment.format                  = format;
+        attachment.samples                 = VK_SAMPLE_COUNT_1_BIT;
+        attachment.loadOp                  = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        attachment.storeOp                 = VK_ATTACHMENT_STORE_OP_STORE;
+        attachment.stencilLoadOp           = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment.stencilStoreOp          = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment.initialLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
+        attachment.finalLayout             = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        color_references.push_back({static_cast<uint32_t>(attachments.size()), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+        attachments.push_back(attachment);
+    }
 
-        VkSubpassDescription subpass_description    = {};
-        subpass_description.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass_description.colorAttachmentCount    = color_references.size();
-        subpass_description.pColorAttachments       = color_references.data();
-        subpass_description.pDepthStencilAttachment = &depth_reference;
-        subpass_description.inputAttachmentCount    = 0;
-        subpass_description.pInputAttachments       = nullptr;
-        subpass_description.preserveAttachmentCount = 0;
-        subpass_description.pPreserveAttachments    = nullptr;
-        subpass_description.pResolveAttachments     = nullptr;
+    // Depth attachment
+    VkAttachmentDescription depth_attachment = {};
+    depth_attachment.format                  = VK_FORMAT_D32_SFLOAT;
+    depth_attachment.samples                 = VK_SAMPLE_COUNT_1_BIT;
+    depth_attachment.loadOp                  = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depth_attachment.storeOp                 = VK_ATTACHMENT_STORE_OP_STORE;
+    depth_attachment.stencilLoadOp           = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depth_attachment.stencilStoreOp          = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depth_attachment.initialLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
+    depth_attachment.finalLayout             = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+    VkAttachmentReference depth_reference = {};
+    depth_reference.attachment            = static_cast<uint32_t>(attachments.size());
+    depth_reference.layout                = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    attachments.push_back(depth_attachment);
+
+    VkSubpassDescription subpass_description    = {};
+    subpass_description.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass_description.colorAttachmentCount    = static_cast<uint32_t>(color_references.size());
+    subpass_description.pColorAttachments       = color_references.data();
+    subpass_description.pDepthStencilAttachment = &depth_reference;
+    subpass_description.inputAttachmentCount    = 0;
+    subpass_description.pInputAttachments       = nullptr;
+    subpass_description.preserveAttachmentCount = 0;
+    subpass_description.pPreserveAttachments    = nullptr;
+    subpass_description.pResolveAttachments     = nullptr;
+
+    // Subpass dependencies for layout transitions (depth is read by the direct pass, also in depth-only format)
+    std::array<VkSubpassDependency, 2> dependencies;
+
+    dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass      = 0;
+    dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    dependencies[0].dstStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask   = VK_ACCESS_MEMORY_READ_BIT;
+    dependencies[0].dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+    dependencies[1].srcSubpass      = 0;
+    dependencies[1].dstSubpass      = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    dependencies[1].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstAccessMask   = VK_ACCESS_MEMORY_READ_BIT;
+    dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+    VkRenderPassCreateInfo render_pass_create_info = {};
+    render_pass_create_info.sType                  = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_create_info.attachmentCount        = static_cast<uint32_t>(attachments.size());
+    render_pass_create_info.pAttachments           = attachments.data();
+    render_pass_create_info.subpassCount           = 1;
+    render_pass_create_info.pSubpasses             = &subpass_description;
+    render_pass_create_info.dependencyCount        = static_cast<uint32_t>(dependencies.size());
+    render_pass_create_info.pDependencies          = dependencies.data();
+
+    VK_CHECK(vkCreateRenderPass(get_device().get_handle(), &render_pass_create_info, nullptr, &render_passes.light_pass));
+}
 
-        // Subpass dependencies for layout transitions
-        std::array<VkSubpassDependency, 2> dependencies = {};
+void LinSSScatter::setup_direct_pass_render_pass()
+{
+    // Diffuse, specular, position, normal and linear depth are followed by the depth attachment. Targets that are
+    // not rendered in the active profile keep their color references as unused, so that the shader outputs stay.
+    const std::array<VkFormat, 5> formats     = gbuffer_formats(gbuffer_targets.active_profile);
+    const bool                    reconstruct = gbuffer_targets.active_profile != GBufferProfile::Float32;
+
+    std::vector<VkAttachmentDescription> attachments;
+    std::vector<VkAttachmentReference>   color_references;
+    for (VkFormat format : formats)
+    {
+        if (format == VK_FORMAT_UNDEFINED)
+        {
+            color_references.push_back({VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED});
+            continue;
+        }
 
-        dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
-        dependencies[0].dstSubpass      = 0;
-        dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-        dependencies[0].dstStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependencies[0].srcAccessMask   = VK_ACCESS_MEMORY_READ_BIT;
-        dependencies[0].dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-        dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+        VkAttachmentDescription attachment = {};
+        attachment.format                  = format;
+        attachment.samples                 = VK_SAMPLE_COUNT_1_BIT;
+        attachment.loadOp                  = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        attachment.storeOp                 = VK_ATTACHMENT_STORE_OP_STORE;
+        attachment.stencilLoadOp           = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment.stencilStoreOp          = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment.initialLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
+        attachment.finalLayout             = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        color_references.push_back({static_cast<uint32_t>(attachments.size()), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+        attachments.push_back(attachment);
+    }
 
-        dependencies[1].srcSubpass      = 0;
-        dependencies[1].dstSubpass      = VK_SUBPASS_EXTERNAL;
-        dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-        dependencies[1].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-        dependencies[1].dstAccessMask   = VK_ACCESS_MEMORY_READ_BIT;
-        dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+    // Depth attachment (stored and sampled only when position and depth are reconstructed from it)
+    VkAttachmentDescription depth_attachment = {};
+    depth_attachment.format                  = VK_FORMAT_D32_SFLOAT;
+    depth_attachment.samples                 = VK_SAMPLE_COUNT_1_BIT;
+    depth_attachment.loadOp                  = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depth_attachment.storeOp                 = reconstruct ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depth_attachment.stencilLoadOp           = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depth_attachment.stencilStoreOp          = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depth_attachment.initialLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
+    depth_attachment.finalLayout             = reconstruct ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference depth_reference = {};
+    depth_reference.attachment            = static_cast<uint32_t>(attachments.size());
+    depth_reference.layout                = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    attachments.push_back(depth_attachment);
+
+    VkSubpassDescription subpass_description    = {};
+    subpass_description.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass_description.colorAttachmentCount    = static_cast<uint32_t>(color_references.size());
+    subpass_description.pColorAttachments       = color_references.data();
+    subpass_description.pDepthStencilAttachment = &depth_reference;
+    subpass_description.inputAttachmentCount    = 0;
+    subpass_description.pInputAttachments       = nullptr;
+    subpass_description.preserveAttachmentCount = 0;
+    subpass_description.pPreserveAttachments    = nullptr;
+    subpass_description.pResolveAttachments     = nullptr;
+
+    // Subpass dependencies for layout transitions
+    std::array<VkSubpassDependency, 2> dependencies;
+
+    dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass      = 0;
+    dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    dependencies[0].dstStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask   = VK_ACCESS_MEMORY_READ_BIT;
+    dependencies[0].dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+    dependencies[1].srcSubpass      = 0;
+    dependencies[1].dstSubpass      = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    dependencies[1].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstAccessMask   = VK_ACCESS_MEMORY_READ_BIT;
+    dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+    VkRenderPassCreateInfo render_pass_create_info = {};
+    render_pass_create_info.sType                  = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_create_info.attachmentCount        = static_cast<uint32_t>(attachments.size());
+    render_pass_create_info.pAttachments           = attachments.data();
+    render_pass_create_info.subpassCount           = 1;
+    render_pass_create_info.pSubpasses             = &subpass_description;
+    render_pass_create_info.dependencyCount        = static_cast<uint32_t>(dependencies.size());
+    render_pass_create_info.pDependencies          = dependencies.data();
+
+    VK_CHECK(vkCreateRenderPass(get_device().get_handle(), &render_pass_create_info, nullptr, &render_passes.direct_pass));
+}
 
-        VkRenderPassCreateInfo render_pass_create_info = {};
-        render_pass_create_info.sType                  = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        render_pass_create_info.attachmentCount        = static_cast<uint32_t>(attachments.size());
-        render_pass_create_info.pAttachments           = attachments.data();
-        render_pass_create_info.subpassCount           = 1;
-        render_pass_create_info.pSubpasses             = &subpass_description;
-        render_pass_create_info.dependencyCount        = static_cast<uint32_t>(dependencies.size());
-        render_pass_create_info.pDependencies          = dependencies.data();
+void LinSSScatter::setup_custom_render_passes()
+{
+    // Setup additional render pass (light pass)
+    light_pass_targets.active_format = light_pass_format();
+    setup_light_pass_render_pass();
 
-        VK_CHECK(vkCreateRenderPass(get_device().get_handle(), &render_pass_create_info, nullptr, &render_passes.direct_pass));
-    }
+    // Setup additional render pass (direct)
+    gbuffer_targets.active_profile = gbuffer_profile();
+    setup_direct_pass_render_pass();
 
     // Translucent shadow maps
     {
@@ -443,198 +653,560 @@ void LinSSScatter::setup_custom_render_passes()
     }
 }
 
-void LinSSScatter::setup_custom_framebuffers()
+void LinSSScatter::setup_shadow_map_framebuffer()
 {
-    // FBO for reflective shadow maps
-    {
-        // Create image and image view
-        FBO &fbo = fbos.shadow_map;
-
-        fbo.images.clear();
-        fbo.images.emplace_back(get_device(),
-                                VkExtent3D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1},
-                                VK_FORMAT_R32G32B32A32_SFLOAT,
-                                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-                                VMA_MEMORY_USAGE_GPU_ONLY,
-                                VK_SAMPLE_COUNT_1_BIT,
-                                1);
-
-        fbo.images.emplace_back(get_device(),
-                                VkExtent3D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1},
-                                VK_FORMAT_R32G32B32A32_SFLOAT,
-                                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-                                VMA_MEMORY_USAGE_GPU_ONLY,
-                                VK_SAMPLE_COUNT_1_BIT,
-                                1);
+    FBO &fbo = fbos.shadow_map;
 
-        fbo.images.emplace_back(get_device(),
-                                VkExtent3D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1},
-                                VK_FORMAT_R32G32B32A32_SFLOAT,
-                                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-                                VMA_MEMORY_USAGE_GPU_ONLY,
-                                VK_SAMPLE_COUNT_1_BIT,
-                                1);
+    // Irradiance, position and normal are followed by depth. Maps that are not rendered in the active format
+    // are 1x1 placeholders, so that the views and the descriptor sets keep their layouts.
+    // Irradiance and position have MIP levels for TSM (see "generate_tsm_mipmaps").
+    const std::array<VkFormat, 3> formats = light_pass_formats(light_pass_targets.active_format);
 
-        fbo.images.emplace_back(get_device(),
-                                VkExtent3D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1},
-                                VK_FORMAT_D32_SFLOAT,
-                                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-                                VMA_MEMORY_USAGE_GPU_ONLY,
-                                VK_SAMPLE_COUNT_1_BIT,
-                                1);
+    fbo.views.clear();
+    fbo.images.clear();
+    for (uint32_t k = 0; k < formats.size(); k++)
+    {
+        if (formats[k] == VK_FORMAT_UNDEFINED)
+        {
+            fbo.images.emplace_back(get_device(),
+                                    VkExtent3D{1, 1, 1},
+                                    VK_FORMAT_R8G8B8A8_UNORM,
+                                    VK_IMAGE_USAGE_SAMPLED_BIT,
+                                    VMA_MEMORY_USAGE_GPU_ONLY,
+                                    VK_SAMPLE_COUNT_1_BIT,
+                                    1);
+        }
+        else
+        {
+            fbo.images.emplace_back(get_device(),
+                                    VkExtent3D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1},
+                                    formats[k],
+                                    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                    VMA_MEMORY_USAGE_GPU_ONLY,
+                                    VK_SAMPLE_COUNT_1_BIT,
+                                    k < 2 ? TSM_MIP_LEVELS : 1);
+        }
+    }
 
-        std::vector<VkImageView> attachments;
-        fbo.views.clear();
-        for (auto &image : fbo.images)
+    fbo.images.emplace_back(get_device(),
+                            VkExtent3D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1},
+                            VK_FORMAT_D32_SFLOAT,
+                            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                            VMA_MEMORY_USAGE_GPU_ONLY,
+                            VK_SAMPLE_COUNT_1_BIT,
+                            1);
+
+    // Attachments are the base levels, and views 4 and 5 have all the MIP levels of irradiance and position
+    std::vector<VkImageView> attachments;
+    fbo.views.reserve(fbo.images.size() + 2);
+    for (uint32_t k = 0; k < fbo.images.size(); k++)
+    {
+        vkb::core::Image    &image = fbo.images[k];
+        vkb::core::ImageView view{image, VK_IMAGE_VIEW_TYPE_2D, image.get_format(), 0, 0, 1, 1};
+        if (k == formats.size() || formats[k] != VK_FORMAT_UNDEFINED)
         {
-            vkb::core::ImageView view{image, VK_IMAGE_VIEW_TYPE_2D, image.get_format()};
             attachments.push_back(view.get_handle());
-            fbo.views.push_back(std::move(view));
         }
+        fbo.views.push_back(std::move(view));
+    }
+    fbo.views.emplace_back(fbo.images[0], VK_IMAGE_VIEW_TYPE_2D);
+    fbo.views.emplace_back(fbo.images[1], VK_IMAGE_VIEW_TYPE_2D);
 
-        VkFramebufferCreateInfo framebuffer_create_info = {};
-        framebuffer_create_info.sType                   = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebuffer_create_info.pNext                   = nullptr;
-        framebuffer_create_info.renderPass              = render_passes.light_pass;
-        framebuffer_create_info.attachmentCount         = attachments.size();
-        framebuffer_create_info.pAttachments            = attachments.data();
-        framebuffer_create_info.width                   = SHADOW_MAP_SIZE;
-        framebuffer_create_info.height                  = SHADOW_MAP_SIZE;
-        framebuffer_create_info.layers                  = 1;
-        VK_CHECK(vkCreateFramebuffer(get_device().get_handle(), &framebuffer_create_info, nullptr, &fbo.fb));
-
-        // Create sampler
-        VkSamplerCreateInfo sampler = vkb::initializers::sampler_create_info();
-        sampler.magFilter           = VK_FILTER_LINEAR;
-        sampler.minFilter           = VK_FILTER_LINEAR;
-        sampler.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-        sampler.addressModeU        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        sampler.addressModeV        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        sampler.addressModeW        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        sampler.mipLodBias          = 0.0f;
-        sampler.compareOp           = VK_COMPARE_OP_NEVER;
-        sampler.minLod              = 0.0f;
-        sampler.maxLod              = 1.0f;
-
-        if (get_device().get_gpu().get_features().samplerAnisotropy)
+    // Placeholders are bound as they are, and are never written
+    std::vector<VkImage> placeholders;
+    for (uint32_t k = 0; k < formats.size(); k++)
+    {
+        if (formats[k] == VK_FORMAT_UNDEFINED)
         {
-            // Use max. level of anisotropy for this example
-            sampler.maxAnisotropy    = get_device().get_gpu().get_properties().limits.maxSamplerAnisotropy;
-            sampler.anisotropyEnable = VK_TRUE;
+            placeholders.push_back(fbo.images[k].get_handle());
         }
-        else
+    }
+    init_placeholder_layouts(placeholders);
+
+    VkFramebufferCreateInfo framebuffer_create_info = {};
+    framebuffer_create_info.sType                   = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_create_info.pNext                   = nullptr;
+    framebuffer_create_info.renderPass              = render_passes.light_pass;
+    framebuffer_create_info.attachmentCount         = attachments.size();
+    framebuffer_create_info.pAttachments            = attachments.data();
+    framebuffer_create_info.width                   = SHADOW_MAP_SIZE;
+    framebuffer_create_info.height                  = SHADOW_MAP_SIZE;
+    framebuffer_create_info.layers                  = 1;
+    VK_CHECK(vkCreateFramebuffer(get_device().get_handle(), &framebuffer_create_info, nullptr, &fbo.fb));
+
+    // Memory of the render targets and bytes written by the light pass
+    const int    format      = light_pass_targets.active_format;
+    VkDeviceSize memory_size = 0;
+    VkDeviceSize write_size  = 0;
+    for (uint32_t k = 0; k < fbo.images.size(); k++)
+    {
+        if (k < formats.size() && formats[k] == VK_FORMAT_UNDEFINED)
         {
-            // The device does not support anisotropic filtering
-            sampler.maxAnisotropy    = 1.0;
-            sampler.anisotropyEnable = VK_FALSE;
+            continue;
         }
-        sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-        VK_CHECK(vkCreateSampler(get_device().get_handle(), &sampler, nullptr, &fbo.sampler));
+        VkMemoryRequirements memory_requirements;
+        vkGetImageMemoryRequirements(get_device().get_handle(), fbo.images[k].get_handle(), &memory_requirements);
+        memory_size += memory_requirements.size;
+        write_size += static_cast<VkDeviceSize>(SHADOW_MAP_SIZE) * SHADOW_MAP_SIZE * vkb::get_bits_per_pixel(fbo.images[k].get_format()) / 8;
     }
+    light_pass_targets.memory_mib[format] = static_cast<float>(memory_size) / (1024.0f * 1024.0f);
+    light_pass_targets.write_mib[format]  = static_cast<float>(write_size) / (1024.0f * 1024.0f);
 
-    // FBO for direct illumination
-    {
-        FBO &fbo = fbos.direct_pass;
-
-        fbo.images.clear();
+    // Create sampler
+    VkSamplerCreateInfo sampler = vkb::initializers::sampler_create_info();
+    sampler.magFilter           = VK_FILTER_LINEAR;
+    sampler.minFilter           = VK_FILTER_LINEAR;
+    sampler.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    sampler.addressModeU        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler.addressModeV        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler.addressModeW        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler.mipLodBias          = 0.0f;
+    sampler.compareOp           = VK_COMPARE_OP_NEVER;
+    sampler.minLod              = 0.0f;
+    sampler.maxLod              = static_cast<float>(TSM_MIP_LEVELS);
 
-        fbo.images.emplace_back(get_device(),
-                                VkExtent3D{get_render_context().get_surface_extent().width, get_render_context().get_surface_extent().height, 1},
-                                VK_FORMAT_R32G32B32A32_SFLOAT,
-                                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-                                VMA_MEMORY_USAGE_GPU_ONLY,
-                                VK_SAMPLE_COUNT_1_BIT,
-                                1);
+    if (get_device().get_gpu().get_features().samplerAnisotropy)
+    {
+        // Use max. level of anisotropy for this example
+        sampler.maxAnisotropy    = get_device().get_gpu().get_properties().limits.maxSamplerAnisotropy;
+        sampler.anisotropyEnable = VK_TRUE;
+    }
+    else
+    {
+        // The device does not support anisotropic filtering
+        sampler.maxAnisotropy    = 1.0;
+        sampler.anisotropyEnable = VK_FALSE;
+    }
+    sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    VK_CHECK(vkCreateSampler(get_device().get_handle(), &sampler, nullptr, &fbo.sampler));
+}
 
-        fbo.images.emplace_back(get_device(),
-                                VkExtent3D{get_render_context().get_surface_extent().width, get_render_context().get_surface_extent().height, 1},
-                                VK_FORMAT_R32G32B32A32_SFLOAT,
-                                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-                                VMA_MEMORY_USAGE_GPU_ONLY,
-                                VK_SAMPLE_COUNT_1_BIT,
-                                1);
+void LinSSScatter::prepare_shadow_compare_sampler()
+{
+    // Each tap of the comparison sampler returns the bilinearly weighted result of 2x2 depth tests
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(get_device().get_gpu().get_handle(), VK_FORMAT_D32_SFLOAT, &format_properties);
+    const bool linear_supported = (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0;
+    if (!linear_supported)
+    {
+        LOGW("Linear filtering of D32 is not supported. Hardware PCF takes single depth tests.");
+    }
 
-        fbo.images.emplace_back(get_device(),
-                                VkExtent3D{get_render_context().get_surface_extent().width, get_render_context().get_surface_extent().height, 1},
-                                VK_FORMAT_R32G32B32A32_SFLOAT,
-                                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-                                VMA_MEMORY_USAGE_GPU_ONLY,
-                                VK_SAMPLE_COUNT_1_BIT,
-                                1);
+    // Outside of the shadow map is lit (depth 1.0 passes the test)
+    VkSamplerCreateInfo sampler = vkb::initializers::sampler_create_info();
+    sampler.magFilter           = linear_supported ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+    sampler.minFilter           = linear_supported ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+    sampler.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler.addressModeU        = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    sampler.addressModeV        = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    sampler.addressModeW        = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    sampler.mipLodBias          = 0.0f;
+    sampler.compareEnable       = VK_TRUE;
+    sampler.compareOp           = VK_COMPARE_OP_LESS_OR_EQUAL;
+    sampler.minLod              = 0.0f;
+    sampler.maxLod              = 0.0f;
+    sampler.maxAnisotropy       = 1.0f;
+    sampler.anisotropyEnable    = VK_FALSE;
+    sampler.borderColor         = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    VK_CHECK(vkCreateSampler(get_device().get_handle(), &sampler, nullptr, &shadow_pcf.compare_sampler));
+}
 
-        fbo.images.emplace_back(get_device(),
-                                VkExtent3D{get_render_context().get_surface_extent().width, get_render_context().get_surface_extent().height, 1},
-                                VK_FORMAT_R32G32B32A32_SFLOAT,
-                                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-                                VMA_MEMORY_USAGE_GPU_ONLY,
-                                VK_SAMPLE_COUNT_1_BIT,
-                                1);
+void LinSSScatter::setup_direct_pass_framebuffer()
+{
+    FBO &fbo = fbos.direct_pass;
+
+    // Targets that are not rendered are 1x1 placeholders, so that view indices stay the same for every profile
+    const std::array<VkFormat, 5> formats     = gbuffer_formats(gbuffer_targets.active_profile);
+    const bool                    reconstruct = gbuffer_targets.active_profile != GBufferProfile::Float32;
+    const VkExtent3D              extent      = {get_render_context().get_surface_extent().width, get_render_context().get_surface_extent().height, 1};
+
+    fbo.images.clear();
+    fbo.images.reserve(formats.size() + 1);
+    for (uint32_t k = 0; k < formats.size(); k++)
+    {
+        if (formats[k] == VK_FORMAT_UNDEFINED)
+        {
+            fbo.images.emplace_back(get_device(),
+                                    VkExtent3D{1, 1, 1},
+                                    VK_FORMAT_R8G8B8A8_UNORM,
+                                    VK_IMAGE_USAGE_SAMPLED_BIT,
+                                    VMA_MEMORY_USAGE_GPU_ONLY,
+                                    VK_SAMPLE_COUNT_1_BIT,
+                                    1);
+            continue;
+        }
 
+        // Diffuse is only read until it is copied to the MIP pyramid of the Gaussian filter
+        if (k == 0)
+        {
+            emplace_transient_image(fbo, TransientImage::DirectDiffuse);
+            continue;
+        }
         fbo.images.emplace_back(get_device(),
-                                VkExtent3D{get_render_context().get_surface_extent().width, get_render_context().get_surface_extent().height, 1},
-                                VK_FORMAT_R32G32B32A32_SFLOAT,
+                                extent,
+                                formats[k],
                                 VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
                                 VMA_MEMORY_USAGE_GPU_ONLY,
                                 VK_SAMPLE_COUNT_1_BIT,
                                 1);
+    }
 
+    // Depth is kept only when positions are reconstructed from it
+    if (reconstruct)
+    {
         fbo.images.emplace_back(get_device(),
-                                VkExtent3D{get_render_context().get_surface_extent().width, get_render_context().get_surface_extent().height, 1},
+                                extent,
                                 VK_FORMAT_D32_SFLOAT,
-                                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
                                 VMA_MEMORY_USAGE_GPU_ONLY,
                                 VK_SAMPLE_COUNT_1_BIT,
                                 1);
+    }
+    else
+    {
+        emplace_transient_image(fbo, TransientImage::DirectDepth);
+    }
 
-        std::vector<VkImageView> attachments;
-        fbo.views.clear();
-        for (auto &image : fbo.images)
+    std::vector<VkImageView> attachments;
+    fbo.views.clear();
+    fbo.views.reserve(fbo.images.size());
+    for (uint32_t k = 0; k < fbo.images.size(); k++)
+    {
+        vkb::core::Image    &image = fbo.images[k];
+        vkb::core::ImageView view{image, VK_IMAGE_VIEW_TYPE_2D, image.get_format()};
+        if (k == formats.size() || formats[k] != VK_FORMAT_UNDEFINED)
         {
-            vkb::core::ImageView view{image, VK_IMAGE_VIEW_TYPE_2D, image.get_format()};
             attachments.push_back(view.get_handle());
-            fbo.views.push_back(std::move(view));
         }
+        fbo.views.push_back(std::move(view));
+    }
 
-        VkFramebufferCreateInfo framebuffer_create_info = {};
-        framebuffer_create_info.sType                   = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebuffer_create_info.pNext                   = nullptr;
-        framebuffer_create_info.renderPass              = render_passes.direct_pass;
-        framebuffer_create_info.attachmentCount         = static_cast<uint32_t>(attachments.size());
-        framebuffer_create_info.pAttachments            = attachments.data();
-        framebuffer_create_info.width                   = get_render_context().get_surface_extent().width;
-        framebuffer_create_info.height                  = get_render_context().get_surface_extent().height;
-        framebuffer_create_info.layers                  = 1;
-        VK_CHECK(vkCreateFramebuffer(get_device().get_handle(), &framebuffer_create_info, nullptr, &fbo.fb));
+    // Placeholders are bound as they are, and are never written
+    std::vector<VkImage> placeholders;
+    for (uint32_t k = 0; k < formats.size(); k++)
+    {
+        if (formats[k] == VK_FORMAT_UNDEFINED)
+        {
+            placeholders.push_back(fbo.images[k].get_handle());
+        }
+    }
+    init_placeholder_layouts(placeholders);
+
+    VkFramebufferCreateInfo framebuffer_create_info = {};
+    framebuffer_create_info.sType                   = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_create_info.pNext                   = nullptr;
+    framebuffer_create_info.renderPass              = render_passes.direct_pass;
+    framebuffer_create_info.attachmentCount         = static_cast<uint32_t>(attachments.size());
+    framebuffer_create_info.pAttachments            = attachments.data();
+    framebuffer_create_info.width                   = extent.width;
+    framebuffer_create_info.height                  = extent.height;
+    framebuffer_create_info.layers                  = 1;
+    VK_CHECK(vkCreateFramebuffer(get_device().get_handle(), &framebuffer_create_info, nullptr, &fbo.fb));
+
+    // Memory of the G-buffer and bytes written by the direct pass (depth is counted only when it is stored)
+    const int    profile     = gbuffer_targets.active_profile;
+    VkDeviceSize memory_size = 0;
+    VkDeviceSize write_size  = 0;
+    for (uint32_t k = 0; k < fbo.images.size(); k++)
+    {
+        if (k < formats.size() && formats[k] == VK_FORMAT_UNDEFINED)
+        {
+            continue;
+        }
+        VkMemoryRequirements memory_requirements;
+        vkGetImageMemoryRequirements(get_device().get_handle(), fbo.images[k].get_handle(), &memory_requirements);
+        memory_size += memory_requirements.size;
+        if (k < formats.size() || reconstruct)
+        {
+            write_size += static_cast<VkDeviceSize>(extent.width) * extent.height * vkb::get_bits_per_pixel(fbo.images[k].get_format()) / 8;
+        }
+    }
+    gbuffer_targets.memory_mib[profile] = static_cast<float>(memory_size) / (1024.0f * 1024.0f);
+    gbuffer_targets.write_mib[profile]  = static_cast<float>(write_size) / (1024.0f * 1024.0f);
 
-        // Create sampler
-        VkSamplerCreateInfo sampler = vkb::initializers::sampler_create_info();
-        sampler.magFilter           = VK_FILTER_LINEAR;
-        sampler.minFilter           = VK_FILTER_LINEAR;
-        sampler.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-        sampler.addressModeU        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        sampler.addressModeV        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        sampler.addressModeW        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        sampler.mipLodBias          = 0.0f;
-        sampler.compareOp           = VK_COMPARE_OP_NEVER;
-        sampler.minLod              = 0.0f;
-        sampler.maxLod              = 1.0f;
+    // Create sampler
+    VkSamplerCreateInfo sampler = vkb::initializers::sampler_create_info();
+    sampler.magFilter           = VK_FILTER_LINEAR;
+    sampler.minFilter           = VK_FILTER_LINEAR;
+    sampler.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    sampler.addressModeU        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler.addressModeV        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler.addressModeW        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler.mipLodBias          = 0.0f;
+    sampler.compareOp           = VK_COMPARE_OP_NEVER;
+    sampler.minLod              = 0.0f;
+    sampler.maxLod              = 1.0f;
 
-        if (get_device().get_gpu().get_features().samplerAnisotropy)
+    if (get_device().get_gpu().get_features().samplerAnisotropy)
+    {
+        // Use max. level of anisotropy for this example
+        sampler.maxAnisotropy    = get_device().get_gpu().get_properties().limits.maxSamplerAnisotropy;
+        sampler.anisotropyEnable = VK_TRUE;
+    }
+    else
+    {
+        // The device does not support anisotropic filtering
+        sampler.maxAnisotropy    = 1.0;
+        sampler.anisotropyEnable = VK_FALSE;
+    }
+    sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    VK_CHECK(vkCreateSampler(get_device().get_handle(), &sampler, nullptr, &fbo.sampler));
+
+    // Depth is not interpolated across silhouettes, and linear filtering of D32 is optional
+    VkSamplerCreateInfo depth_sampler = vkb::initializers::sampler_create_info();
+    depth_sampler.magFilter           = VK_FILTER_NEAREST;
+    depth_sampler.minFilter           = VK_FILTER_NEAREST;
+    depth_sampler.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    depth_sampler.addressModeU        = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    depth_sampler.addressModeV        = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    depth_sampler.addressModeW        = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    depth_sampler.mipLodBias          = 0.0f;
+    depth_sampler.compareOp           = VK_COMPARE_OP_NEVER;
+    depth_sampler.minLod              = 0.0f;
+    depth_sampler.maxLod              = 0.0f;
+    depth_sampler.maxAnisotropy       = 1.0f;
+    depth_sampler.anisotropyEnable    = VK_FALSE;
+    depth_sampler.borderColor         = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    VK_CHECK(vkCreateSampler(get_device().get_handle(), &depth_sampler, nullptr, &gbuffer_targets.depth_sampler));
+}
+
+VkDescriptorImageInfo LinSSScatter::gbuffer_depth_descriptor()
+{
+    // Linear depth target of the float profile, or the depth buffer that the other profiles reconstruct from
+    VkDescriptorImageInfo desc_depth_texture = {};
+    if (gbuffer_targets.active_profile == GBufferProfile::Float32)
+    {
+        desc_depth_texture.sampler     = fbos.direct_pass.sampler;
+        desc_depth_texture.imageView   = fbos.direct_pass.views[4].get_handle();
+        desc_depth_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+    else
+    {
+        desc_depth_texture.sampler     = gbuffer_targets.depth_sampler;
+        desc_depth_texture.imageView   = fbos.direct_pass.views[5].get_handle();
+        desc_depth_texture.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    }
+    return desc_depth_texture;
+}
+
+void LinSSScatter::prepare_transient_images()
+{
+    const uint32_t width      = get_render_context().get_surface_extent().width;
+    const uint32_t height     = get_render_context().get_surface_extent().height;
+    const uint32_t tsm_width  = width / TSM_MIN_UPSAMPLE_RATIO;
+    const uint32_t tsm_height = height / TSM_MIN_UPSAMPLE_RATIO;
+    const uint32_t mip_levels = max_mip_levels_surface();
+
+    // Diffuse of the direct pass is a storage image only with the RGBA32F G-buffer
+    const VkFormat    diffuse_format = gbuffer_formats(gbuffer_targets.active_profile)[0];
+    VkImageUsageFlags diffuse_usage  = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    if (diffuse_format == VK_FORMAT_R32G32B32A32_SFLOAT)
+    {
+        diffuse_usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+
+    auto image_info = [](uint32_t image_width, uint32_t image_height, VkFormat format, VkImageUsageFlags usage, uint32_t levels) {
+        VkImageCreateInfo image_create_info = vkb::initializers::image_create_info();
+        image_create_info.imageType         = VK_IMAGE_TYPE_2D;
+        image_create_info.format            = format;
+        image_create_info.mipLevels         = levels;
+        image_create_info.arrayLayers       = 1;
+        image_create_info.samples           = VK_SAMPLE_COUNT_1_BIT;
+        image_create_info.tiling            = VK_IMAGE_TILING_OPTIMAL;
+        image_create_info.sharingMode       = VK_SHARING_MODE_EXCLUSIVE;
+        image_create_info.initialLayout     = VK_IMAGE_LAYOUT_UNDEFINED;
+        image_create_info.extent            = VkExtent3D{image_width, image_height, 1};
+        image_create_info.usage             = usage;
+        return image_create_info;
+    };
+
+    std::array<VkImageCreateInfo, 8> &infos = transient_images.infos;
+    infos[TransientImage::DirectDiffuse]    = image_info(width, height, diffuse_format, diffuse_usage, 1);
+    infos[TransientImage::DirectDepth]      = image_info(width, height, VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 1);
+    infos[TransientImage::GaussInput]       = image_info(width, height, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, mip_levels);
+    infos[TransientImage::GaussBuffer]      = image_info(width, height, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, mip_levels);
+    infos[TransientImage::TSMDepth0]        = image_info(tsm_width, tsm_height, VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 1);
+    infos[TransientImage::TSMDepth1]        = image_info(tsm_width, tsm_height, VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 1);
+    infos[TransientImage::DeferredColor]    = image_info(width, height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 1);
+    infos[TransientImage::DeferredDepth]    = image_info(width, height, VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 1);
+
+    // Passes of a frame in the order of "build_command_buffers" (see "FramePass"). The light pass, tile classification
+    // and LinSSS accumulation use no transient image. Passes skipped by the caches only shorten the lifetimes.
+    vkb::FrameGraph &graph = transient_images.graph;
+    graph.clear();
+    for (int pass = FramePass::DirectPass; pass <= FramePass::PostprocessPass; pass++)
+    {
+        [[maybe_unused]] const uint32_t index = graph.add_pass(frame_pass_name(pass));
+        assert(index == static_cast<uint32_t>(pass));
+    }
+
+    // Name, and first and last passes of each transient image
+    struct Lifetime
+    {
+        const char *name       = nullptr;
+        int         first_pass = FramePass::DirectPass;
+        int         last_pass  = FramePass::DirectPass;
+    };
+    std::array<Lifetime, 8> lifetimes;
+    lifetimes[TransientImage::DirectDiffuse] = {"direct diffuse", FramePass::DirectPass, FramePass::IrradianceMipmap};
+    lifetimes[TransientImage::DirectDepth]   = {"direct depth", FramePass::DirectPass, FramePass::DirectPass};
+    lifetimes[TransientImage::GaussInput]    = {"Gaussian input", FramePass::IrradianceMipmap, FramePass::GaussianFilter};
+    lifetimes[TransientImage::GaussBuffer]   = {"Gaussian buffer", FramePass::GaussianFilter, FramePass::GaussianFilter};
+    lifetimes[TransientImage::TSMDepth0]     = {"TSM depth (ping)", FramePass::TSMPass, FramePass::TSMPass};
+    lifetimes[TransientImage::TSMDepth1]     = {"TSM depth (pong)", FramePass::TSMPass, FramePass::TSMPass};
+    lifetimes[TransientImage::DeferredColor] = {"deferred color", FramePass::DeferredShading, FramePass::PostprocessPass};
+    lifetimes[TransientImage::DeferredDepth] = {"deferred depth", FramePass::DeferredShading, FramePass::DeferredShading};
+
+    // Depth of the reduced G-buffer profiles is read by later passes and by the irradiance cache, so it is kept
+    const bool keep_direct_depth = gbuffer_targets.active_profile != GBufferProfile::Float32;
+
+    // Merged subpasses shade into the transient attachment of the swapchain pass, so "fbos.deferred" is left empty
+    const bool merged_subpasses = subpass_merge.active_mode == PostprocessMode::MergedSubpasses;
+
+    std::array<uint32_t, 8> resources = {};
+    for (uint32_t k = 0; k < infos.size(); k++)
+    {
+        VkImage &image = transient_images.images[k];
+        image          = VK_NULL_HANDLE;
+        if ((k == TransientImage::DirectDepth && keep_direct_depth) ||
+            ((k == TransientImage::DeferredColor || k == TransientImage::DeferredDepth) && merged_subpasses))
         {
-            // Use max. level of anisotropy for this example
-            sampler.maxAnisotropy    = get_device().get_gpu().get_properties().limits.maxSamplerAnisotropy;
-            sampler.anisotropyEnable = VK_TRUE;
+            continue;
         }
-        else
+        VK_CHECK(vkCreateImage(get_device().get_handle(), &infos[k], nullptr, &image));
+
+        VkMemoryRequirements memory_requirements;
+        vkGetImageMemoryRequirements(get_device().get_handle(), image, &memory_requirements);
+        const uint32_t memory_type = get_device().get_memory_type(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        resources[k] = graph.add_resource(lifetimes[k].name, memory_requirements, memory_type);
+        graph.use(resources[k], lifetimes[k].first_pass);
+        graph.use(resources[k], lifetimes[k].last_pass);
+    }
+    graph.compile();
+
+    // One heap for each memory type, and images are bound at their offsets
+    transient_images.heaps.clear();
+    for (const auto &heap : graph.get_heaps())
+    {
+        VkMemoryAllocateInfo memory_allocate_info = vkb::initializers::memory_allocate_info();
+        memory_allocate_info.allocationSize       = heap.size;
+        memory_allocate_info.memoryTypeIndex      = heap.memory_type_index;
+
+        VkDeviceMemory memory;
+        VK_CHECK(vkAllocateMemory(get_device().get_handle(), &memory_allocate_info, nullptr, &memory));
+        transient_images.heaps.push_back(memory);
+    }
+
+    for (uint32_t k = 0; k < infos.size(); k++)
+    {
+        if (transient_images.images[k] == VK_NULL_HANDLE)
         {
-            // The device does not support anisotropic filtering
-            sampler.maxAnisotropy    = 1.0;
-            sampler.anisotropyEnable = VK_FALSE;
+            continue;
         }
-        sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-        VK_CHECK(vkCreateSampler(get_device().get_handle(), &sampler, nullptr, &fbo.sampler));
+        const vkb::FrameGraph::Resource &resource = graph.get_resource(resources[k]);
+        VK_CHECK(vkBindImageMemory(get_device().get_handle(), transient_images.images[k], transient_images.heaps[resource.heap], resource.offset));
+        LOGD("Transient image \"{}\": heap {}, offset {:.1f} MiB, {} to {}", resource.name, resource.heap,
+             static_cast<float>(resource.offset) / (1024.0f * 1024.0f), graph.get_pass_name(resource.first_pass), graph.get_pass_name(resource.last_pass));
+    }
+
+    LOGI("Transient images: {:.1f} MiB in {} heap(s), {:.1f} MiB without aliasing",
+         static_cast<float>(graph.get_heap_size()) / (1024.0f * 1024.0f), graph.get_heaps().size(),
+         static_cast<float>(graph.get_dedicated_size()) / (1024.0f * 1024.0f));
+}
+
+void LinSSScatter::destroy_transient_images()
+{
+    // Wrappers in the FBOs do not own the images (see "emplace_transient_image"), and views are destroyed first
+    for (FBO *fbo : {&fbos.direct_pass, &fbos.gauss_filter_buffer, &fbos.trans_sm[0], &fbos.trans_sm[1], &fbos.deferred})
+    {
+        fbo->views.clear();
+        fbo->images.clear();
+    }
+    for (VkImage &image : transient_images.images)
+    {
+        vkDestroyImage(get_device().get_handle(), image, nullptr);
+        image = VK_NULL_HANDLE;
+    }
+    for (VkDeviceMemory memory : transient_images.heaps)
+    {
+        vkFreeMemory(get_device().get_handle(), memory, nullptr);
+    }
+    transient_images.heaps.clear();
+}
+
+void LinSSScatter::emplace_transient_image(FBO &fbo, int image)
+{
+    const VkImageCreateInfo &info = transient_images.infos[image];
+    fbo.images.emplace_back(get_device(), transient_images.images[image], info.extent, info.format, info.usage);
+}
+
+void LinSSScatter::insert_aliasing_barrier(VkCommandBuffer command_buffer, int pass)
+{
+    // Images that start at this pass take memory of images used by earlier passes, and are then transitioned
+    // from the undefined layout. Earlier accesses must complete before the memory is written again.
+    if (!transient_images.graph.aliases_before(pass))
+    {
+        return;
+    }
+
+    VkMemoryBarrier memory_barrier = vkb::initializers::memory_barrier();
+    memory_barrier.srcAccessMask   = VK_ACCESS_MEMORY_WRITE_BIT;
+    memory_barrier.dstAccessMask   = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    vkCmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        0,
+        1,
+        &memory_barrier,
+        0,
+        nullptr,
+        0,
+        nullptr);
+}
+
+void LinSSScatter::update_render_target_footprint()
+{
+    // Render targets live for the whole run, so their sum is the peak. Transient images are wrapped without memory.
+    VkDeviceSize own_size = 0;
+    for (const FBO *fbo : {&fbos.shadow_map, &fbos.direct_pass, &fbos.gauss_filter_buffer, &fbos.gauss_pyramid_split,
+                           &fbos.linsss, &fbos.trans_sm[0], &fbos.trans_sm[1], &fbos.deferred})
+    {
+        for (const auto &image : fbo->images)
+        {
+            if (image.get_memory() != VK_NULL_HANDLE)
+            {
+                VkMemoryRequirements memory_requirements;
+                vkGetImageMemoryRequirements(get_device().get_handle(), image.get_handle(), &memory_requirements);
+                own_size += memory_requirements.size;
+            }
+        }
+    }
+    for (VkImage image : {G_ast_Phi_texture.image, tsm_texture.image})
+    {
+        VkMemoryRequirements memory_requirements;
+        vkGetImageMemoryRequirements(get_device().get_handle(), image, &memory_requirements);
+        own_size += memory_requirements.size;
     }
 
+    const vkb::FrameGraph &graph   = transient_images.graph;
+    transient_images.memory_mib    = static_cast<float>(own_size + graph.get_heap_size()) / (1024.0f * 1024.0f);
+    transient_images.unaliased_mib = static_cast<float>(own_size + graph.get_dedicated_size()) / (1024.0f * 1024.0f);
+    LOGI("Render targets: {:.1f} MiB at peak, {:.1f} MiB without aliasing", transient_images.memory_mib, transient_images.unaliased_mib);
+}
+
+void LinSSScatter::setup_custom_framebuffers()
+{
+    // Transient images are wrapped by the FBOs below
+    prepare_transient_images();
+
+    // FBO for reflective shadow maps
+    setup_shadow_map_framebuffer();
+
+    // FBO for direct illumination
+    setup_direct_pass_framebuffer();
+
     // FBO for Gaussian filter buffer
     {
         // Since this is just a buffer for Gaussian filtering,
@@ -643,28 +1215,16 @@ void LinSSScatter::setup_custom_framebuffers()
 
         fbo.images.clear();
 
+        // Both are transient, and the wrapped images need explicit MIP counts for their views
         const uint32_t mip_levels = max_mip_levels_surface();
-        fbo.images.emplace_back(get_device(),
-                                VkExtent3D{get_render_context().get_surface_extent().width, get_render_context().get_surface_extent().height, 1},
-                                VK_FORMAT_R32G32B32A32_SFLOAT,
-                                VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-                                VMA_MEMORY_USAGE_GPU_ONLY,
-                                VK_SAMPLE_COUNT_1_BIT,
-                                mip_levels);
-
-        fbo.images.emplace_back(get_device(),
-                                VkExtent3D{get_render_context().get_surface_extent().width, get_render_context().get_surface_extent().height, 1},
-                                VK_FORMAT_R32G32B32A32_SFLOAT,
-                                VK_IMAGE_USAGE_STORAGE_BIT,
-                                VMA_MEMORY_USAGE_GPU_ONLY,
-                                VK_SAMPLE_COUNT_1_BIT,
-                                mip_levels);
+        emplace_transient_image(fbo, TransientImage::GaussInput);
+        emplace_transient_image(fbo, TransientImage::GaussBuffer);
 
         std::vector<VkImageView> attachments;
         fbo.views.clear();
         for (auto &image : fbo.images)
         {
-            vkb::core::ImageView view{image, VK_IMAGE_VIEW_TYPE_2D, image.get_format()};
+            vkb::core::ImageView view{image, VK_IMAGE_VIEW_TYPE_2D, image.get_format(), 0, 0, mip_levels, 1};
             attachments.push_back(view.get_handle());
             fbo.views.push_back(std::move(view));
         }
@@ -762,44 +1322,88 @@ void LinSSScatter::setup_custom_framebuffers()
         VK_CHECK(vkCreateSampler(get_device().get_handle(), &sampler, nullptr, &G_ast_Phi_texture.sampler));
     }
 
-    // FBO for LinSSS accumulation
+    // Channel-separated irradiance pyramid
     {
-        FBO &fbo = fbos.linsss;
+        FBO &fbo = fbos.gauss_pyramid_split;
 
+        fbo.views.clear();
         fbo.images.clear();
 
-        const uint32_t mip_levels = std::ceil(std::log2(std::max(width, height)));
+        const uint32_t mip_levels = max_mip_levels_surface();
         fbo.images.emplace_back(get_device(),
                                 VkExtent3D{get_render_context().get_surface_extent().width, get_render_context().get_surface_extent().height, 1},
-                                VK_FORMAT_R32G32B32A32_SFLOAT,
+                                pyramid_split_format,
                                 VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
                                 VMA_MEMORY_USAGE_GPU_ONLY,
                                 VK_SAMPLE_COUNT_1_BIT,
-                                1);
+                                mip_levels,
+                                3);
 
-        std::vector<VkImageView> attachments;
-        fbo.views.clear();
-        for (auto &image : fbo.images)
+        // View of all MIP levels for sampling, followed by views of each MIP level for storage
+        fbo.views.reserve(mip_levels + 1);
+        fbo.views.emplace_back(fbo.images[0], VK_IMAGE_VIEW_TYPE_2D_ARRAY, pyramid_split_format, 0, 0, mip_levels, 3);
+        for (uint32_t i = 0; i < mip_levels; i++)
         {
-            vkb::core::ImageView view{image, VK_IMAGE_VIEW_TYPE_2D, image.get_format()};
-            attachments.push_back(view.get_handle());
-            fbo.views.push_back(std::move(view));
+            fbo.views.emplace_back(fbo.images[0], VK_IMAGE_VIEW_TYPE_2D_ARRAY, pyramid_split_format, i, 0, 1, 3);
         }
+        fbo.fb = VK_NULL_HANDLE;
 
-        // Create sampler
+        // Sampler (same filtering as G * Phi texture)
         VkSamplerCreateInfo sampler = vkb::initializers::sampler_create_info();
         sampler.magFilter           = VK_FILTER_LINEAR;
         sampler.minFilter           = VK_FILTER_LINEAR;
-        sampler.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_NEAREST;
-        sampler.addressModeU        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        sampler.addressModeV        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        sampler.addressModeW        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        sampler.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        sampler.addressModeU        = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler.addressModeV        = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler.addressModeW        = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
         sampler.mipLodBias          = 0.0f;
         sampler.compareOp           = VK_COMPARE_OP_NEVER;
         sampler.minLod              = 0.0f;
-        sampler.maxLod              = 1.0f;
+        sampler.maxLod              = (float) mip_levels;
+        sampler.maxAnisotropy       = 1.0f;
+        sampler.anisotropyEnable    = VK_FALSE;
+        sampler.borderColor         = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+        VK_CHECK(vkCreateSampler(get_device().get_handle(), &sampler, nullptr, &fbo.sampler));
+    }
 
-        if (get_device().get_gpu().get_features().samplerAnisotropy)
+    // FBO for LinSSS accumulation
+    {
+        FBO &fbo = fbos.linsss;
+
+        fbo.images.clear();
+
+        const uint32_t mip_levels = std::ceil(std::log2(std::max(width, height)));
+        fbo.images.emplace_back(get_device(),
+                                VkExtent3D{get_render_context().get_surface_extent().width, get_render_context().get_surface_extent().height, 1},
+                                VK_FORMAT_R32G32B32A32_SFLOAT,
+                                VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                VMA_MEMORY_USAGE_GPU_ONLY,
+                                VK_SAMPLE_COUNT_1_BIT,
+                                1);
+
+        std::vector<VkImageView> attachments;
+        fbo.views.clear();
+        for (auto &image : fbo.images)
+        {
+            vkb::core::ImageView view{image, VK_IMAGE_VIEW_TYPE_2D, image.get_format()};
+            attachments.push_back(view.get_handle());
+            fbo.views.push_back(std::move(view));
+        }
+
+        // Create sampler
+        VkSamplerCreateInfo sampler = vkb::initializers::sampler_create_info();
+        sampler.magFilter           = VK_FILTER_LINEAR;
+        sampler.minFilter           = VK_FILTER_LINEAR;
+        sampler.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        sampler.addressModeU        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        sampler.addressModeV        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        sampler.addressModeW        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        sampler.mipLodBias          = 0.0f;
+        sampler.compareOp           = VK_COMPARE_OP_NEVER;
+        sampler.minLod              = 0.0f;
+        sampler.maxLod              = 1.0f;
+
+        if (get_device().get_gpu().get_features().samplerAnisotropy)
         {
             // Use max. level of anisotropy for this example
             sampler.maxAnisotropy    = get_device().get_gpu().get_properties().limits.maxSamplerAnisotropy;
@@ -817,8 +1421,9 @@ void LinSSScatter::setup_custom_framebuffers()
 
     // Transcluent shadow maps
     {
-        const uint32_t tsm_width  = get_render_context().get_surface_extent().width / TSM_UPSAMPLE_RATIO;
-        const uint32_t tsm_height = get_render_context().get_surface_extent().height / TSM_UPSAMPLE_RATIO;
+        // Attachments of the maximum resolution (TSM is rendered into a part of them, see "tsm_render_extent")
+        const uint32_t tsm_width  = get_render_context().get_surface_extent().width / TSM_MIN_UPSAMPLE_RATIO;
+        const uint32_t tsm_height = get_render_context().get_surface_extent().height / TSM_MIN_UPSAMPLE_RATIO;
         // Ping
         {
             FBO &fbo = fbos.trans_sm[0];
@@ -832,13 +1437,7 @@ void LinSSScatter::setup_custom_framebuffers()
                                     VK_SAMPLE_COUNT_1_BIT,
                                     1);
 
-            fbo.images.emplace_back(get_device(),
-                                    VkExtent3D{tsm_width, tsm_height, 1},
-                                    VK_FORMAT_D32_SFLOAT,
-                                    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-                                    VMA_MEMORY_USAGE_GPU_ONLY,
-                                    VK_SAMPLE_COUNT_1_BIT,
-                                    1);
+            emplace_transient_image(fbo, TransientImage::TSMDepth0);
 
             std::vector<VkImageView> attachments;
             fbo.views.clear();
@@ -933,13 +1532,7 @@ void LinSSScatter::setup_custom_framebuffers()
                                     VK_SAMPLE_COUNT_1_BIT,
                                     1);
 
-            fbo.images.emplace_back(get_device(),
-                                    VkExtent3D{tsm_width, tsm_height, 1},
-                                    VK_FORMAT_D32_SFLOAT,
-                                    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-                                    VMA_MEMORY_USAGE_GPU_ONLY,
-                                    VK_SAMPLE_COUNT_1_BIT,
-                                    1);
+            emplace_transient_image(fbo, TransientImage::TSMDepth1);
 
             std::vector<VkImageView> attachments;
             fbo.views.clear();
@@ -1094,41 +1687,34 @@ void LinSSScatter::setup_custom_framebuffers()
         FBO &fbo = fbos.deferred;
 
         fbo.images.clear();
-        fbo.images.emplace_back(get_device(),
-                                VkExtent3D{get_render_context().get_surface_extent().width, get_render_context().get_surface_extent().height, 1},
-                                VK_FORMAT_R8G8B8A8_UNORM,
-                                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-                                VMA_MEMORY_USAGE_GPU_ONLY,
-                                VK_SAMPLE_COUNT_1_BIT,
-                                1);
-
-        fbo.images.emplace_back(get_device(),
-                                VkExtent3D{get_render_context().get_surface_extent().width, get_render_context().get_surface_extent().height, 1},
-                                VK_FORMAT_D32_SFLOAT,
-                                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-                                VMA_MEMORY_USAGE_GPU_ONLY,
-                                VK_SAMPLE_COUNT_1_BIT,
-                                1);
-
-        std::vector<VkImageView> attachments;
         fbo.views.clear();
-        for (auto &image : fbo.images)
+        fbo.fb = VK_NULL_HANDLE;
+
+        // Merged subpasses have no image here (see "prepare_transient_images")
+        if (subpass_merge.active_mode == PostprocessMode::SeparatePasses)
         {
-            vkb::core::ImageView view{image, VK_IMAGE_VIEW_TYPE_2D, image.get_format()};
-            attachments.push_back(view.get_handle());
-            fbo.views.push_back(std::move(view));
-        }
+            emplace_transient_image(fbo, TransientImage::DeferredColor);
+            emplace_transient_image(fbo, TransientImage::DeferredDepth);
+
+            std::vector<VkImageView> attachments;
+            for (auto &image : fbo.images)
+            {
+                vkb::core::ImageView view{image, VK_IMAGE_VIEW_TYPE_2D, image.get_format()};
+                attachments.push_back(view.get_handle());
+                fbo.views.push_back(std::move(view));
+            }
 
-        VkFramebufferCreateInfo framebuffer_create_info = {};
-        framebuffer_create_info.sType                   = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebuffer_create_info.pNext                   = nullptr;
-        framebuffer_create_info.renderPass              = render_passes.deferred;
-        framebuffer_create_info.attachmentCount         = attachments.size();
-        framebuffer_create_info.pAttachments            = attachments.data();
-        framebuffer_create_info.width                   = get_render_context().get_surface_extent().width;
-        framebuffer_create_info.height                  = get_render_context().get_surface_extent().height;
-        framebuffer_create_info.layers                  = 1;
-        VK_CHECK(vkCreateFramebuffer(get_device().get_handle(), &framebuffer_create_info, nullptr, &fbo.fb));
+            VkFramebufferCreateInfo framebuffer_create_info = {};
+            framebuffer_create_info.sType                   = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebuffer_create_info.pNext                   = nullptr;
+            framebuffer_create_info.renderPass              = render_passes.deferred;
+            framebuffer_create_info.attachmentCount         = attachments.size();
+            framebuffer_create_info.pAttachments            = attachments.data();
+            framebuffer_create_info.width                   = get_render_context().get_surface_extent().width;
+            framebuffer_create_info.height                  = get_render_context().get_surface_extent().height;
+            framebuffer_create_info.layers                  = 1;
+            VK_CHECK(vkCreateFramebuffer(get_device().get_handle(), &framebuffer_create_info, nullptr, &fbo.fb));
+        }
 
         // Create sampler
         VkSamplerCreateInfo sampler = vkb::initializers::sampler_create_info();
@@ -1158,6 +1744,8 @@ void LinSSScatter::setup_custom_framebuffers()
         sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
         VK_CHECK(vkCreateSampler(get_device().get_handle(), &sampler, nullptr, &fbo.sampler));
     }
+
+    update_render_target_footprint();
 }
 
 // Enable physical device features required for this example
@@ -1168,6 +1756,52 @@ void LinSSScatter::request_gpu_features(vkb::PhysicalDevice &gpu)
     {
         gpu.get_mutable_requested_features().samplerAnisotropy = VK_TRUE;
     }
+
+    // Single-pass Gaussian pyramid indexes MIP level images in a workgroup
+    if (gpu.get_features().shaderStorageImageArrayDynamicIndexing)
+    {
+        gpu.get_mutable_requested_features().shaderStorageImageArrayDynamicIndexing = VK_TRUE;
+    }
+
+    // Channel-separated irradiance pyramid is stored in R16F if it can be written by compute shaders
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(gpu.get_handle(), VK_FORMAT_R16_SFLOAT, &format_properties);
+    const VkFormatFeatureFlags split_format_features = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    if (gpu.get_features().shaderStorageImageExtendedFormats &&
+        (format_properties.optimalTilingFeatures & split_format_features) == split_format_features)
+    {
+        gpu.get_mutable_requested_features().shaderStorageImageExtendedFormats = VK_TRUE;
+        pyramid_split_format                                                   = VK_FORMAT_R16_SFLOAT;
+    }
+
+    // Compact light pass renders to B10G11R11 irradiance, which is also downsampled by blits.
+    // Reduced G-buffer profiles of the direct pass use the same format and RG16 normals.
+    const VkFormatFeatureFlags irr_features  = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    const VkFormatFeatureFlags norm_features = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    VkFormatProperties         irr_format_properties;
+    VkFormatProperties         norm_format_properties;
+    vkGetPhysicalDeviceFormatProperties(gpu.get_handle(), VK_FORMAT_B10G11R11_UFLOAT_PACK32, &irr_format_properties);
+    vkGetPhysicalDeviceFormatProperties(gpu.get_handle(), VK_FORMAT_R16G16_SNORM, &norm_format_properties);
+    light_pass_targets.compact_supported = (irr_format_properties.optimalTilingFeatures & irr_features) == irr_features &&
+                                           (norm_format_properties.optimalTilingFeatures & norm_features) == norm_features;
+    if (!light_pass_targets.compact_supported)
+    {
+        LOGW("Compact light pass and G-buffer formats are not supported on this device.");
+    }
+
+    // Half-precision arithmetic (images and buffers keep 32-bit formats, so 16-bit storage is not needed)
+    if (gpu.get_instance().is_enabled(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) &&
+        is_device_extension_available(gpu.get_handle(), VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME))
+    {
+        auto &float16_int8_features = gpu.request_extension_features<VkPhysicalDeviceShaderFloat16Int8FeaturesKHR>(
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_FLOAT16_INT8_FEATURES_KHR);
+        float16_int8_features.shaderInt8 = VK_FALSE;
+        float16_supported                = float16_int8_features.shaderFloat16 == VK_TRUE;
+    }
+    if (!float16_supported)
+    {
+        LOGW("Half-precision arithmetic is not supported on this device. 32-bit shaders are used.");
+    }
 }
 
 // Load envmap texture
@@ -1298,7 +1932,7 @@ void LinSSScatter::prepare_texture(LinSSScatter::Texture &texture, const std::st
     // Set initial layout of the image to undefined
     image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     image_create_info.extent        = VkExtent3D{texture.width, texture.height, 1};
-    image_create_info.usage         = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    image_create_info.usage         = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
     VK_CHECK(vkCreateImage(get_device().get_handle(), &image_create_info, nullptr, &texture.image));
 
     vkGetImageMemoryRequirements(get_device().get_handle(), texture.image, &memory_requirements);
@@ -1467,29 +2101,62 @@ void LinSSScatter::generate_mipmap(VkCommandBuffer command_buffer, VkImage image
             VK_PIPELINE_STAGE_TRANSFER_BIT,
             {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
 
-        // Setup image copy
-        VkImageCopy image_copy                   = {};
-        image_copy.extent                        = VkExtent3D{image_width, image_height, 1};
-        image_copy.srcOffset                     = {0, 0, 0};
-        image_copy.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-        image_copy.srcSubresource.mipLevel       = 0;
-        image_copy.srcSubresource.baseArrayLayer = 0;
-        image_copy.srcSubresource.layerCount     = 1;
-        image_copy.dstOffset                     = {0, 0, 0};
-        image_copy.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-        image_copy.dstSubresource.mipLevel       = 0;
-        image_copy.dstSubresource.baseArrayLayer = 0;
-        image_copy.dstSubresource.layerCount     = 1;
-
-        // Image blit
-        vkCmdCopyImage(
-            command_buffer,
-            image,
-            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            fbos.gauss_filter_buffer.images[0].get_handle(),
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1,
-            &image_copy);
+        if (format == fbos.gauss_filter_buffer.images[0].get_format())
+        {
+            // Setup image copy
+            VkImageCopy image_copy                   = {};
+            image_copy.extent                        = VkExtent3D{image_width, image_height, 1};
+            image_copy.srcOffset                     = {0, 0, 0};
+            image_copy.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+            image_copy.srcSubresource.mipLevel       = 0;
+            image_copy.srcSubresource.baseArrayLayer = 0;
+            image_copy.srcSubresource.layerCount     = 1;
+            image_copy.dstOffset                     = {0, 0, 0};
+            image_copy.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+            image_copy.dstSubresource.mipLevel       = 0;
+            image_copy.dstSubresource.baseArrayLayer = 0;
+            image_copy.dstSubresource.layerCount     = 1;
+
+            // Image copy
+            vkCmdCopyImage(
+                command_buffer,
+                image,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                fbos.gauss_filter_buffer.images[0].get_handle(),
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1,
+                &image_copy);
+        }
+        else
+        {
+            // Reduced G-buffer profiles are converted to the float pyramid by a 1:1 blit
+            const int32_t w = static_cast<int32_t>(image_width);
+            const int32_t h = static_cast<int32_t>(image_height);
+
+            VkImageBlit image_blit                   = {};
+            image_blit.srcOffsets[0]                 = {0, 0, 0};
+            image_blit.srcOffsets[1]                 = {w, h, 1};
+            image_blit.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+            image_blit.srcSubresource.mipLevel       = 0;
+            image_blit.srcSubresource.baseArrayLayer = 0;
+            image_blit.srcSubresource.layerCount     = 1;
+            image_blit.dstOffsets[0]                 = {0, 0, 0};
+            image_blit.dstOffsets[1]                 = {w, h, 1};
+            image_blit.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+            image_blit.dstSubresource.mipLevel       = 0;
+            image_blit.dstSubresource.baseArrayLayer = 0;
+            image_blit.dstSubresource.layerCount     = 1;
+
+            vkCmdBlitImage(
+                command_buffer,
+                image,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                fbos.gauss_filter_buffer.images[0].get_handle(),
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1,
+                &image_blit,
+                VK_FILTER_NEAREST);
+        }
 
         // Post-copy barrier
         vkb::insert_image_memory_barrier(
@@ -1572,8 +2239,100 @@ void LinSSScatter::generate_mipmap(VkCommandBuffer command_buffer, VkImage image
         {VK_IMAGE_ASPECT_COLOR_BIT, 0, mip_levels, 0, 1});
 }
 
+void LinSSScatter::generate_tsm_mipmaps(VkCommandBuffer command_buffer)
+{
+    // Irradiance and position of the light pass are downsampled by linear blits. Irradiance and the alpha
+    // of position are zero outside the mesh, so that the coarse levels are weighted by the coverage.
+    // Position of the compact format is reconstructed from depth, and has no MIP levels.
+    const std::array<VkFormat, 3> formats = light_pass_formats(light_pass_targets.active_format);
+    for (uint32_t k = 0; k < 2; k++)
+    {
+        if (formats[k] == VK_FORMAT_UNDEFINED)
+        {
+            continue;
+        }
+
+        VkImage image = fbos.shadow_map.images[k].get_handle();
+
+        vkb::insert_image_memory_barrier(
+            command_buffer,
+            image,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_ACCESS_TRANSFER_READ_BIT,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+        vkb::insert_image_memory_barrier(
+            command_buffer,
+            image,
+            0,
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            {VK_IMAGE_ASPECT_COLOR_BIT, 1, TSM_MIP_LEVELS - 1, 0, 1});
+
+        // Copy image by climbing MIP levels
+        int32_t mipmap_size = static_cast<int32_t>(SHADOW_MAP_SIZE);
+        for (uint32_t i = 0; i < TSM_MIP_LEVELS - 1; i++)
+        {
+            VkImageBlit image_blit                   = {};
+            image_blit.srcOffsets[0]                 = {0, 0, 0};
+            image_blit.srcOffsets[1]                 = {mipmap_size, mipmap_size, 1};
+            image_blit.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+            image_blit.srcSubresource.mipLevel       = i;
+            image_blit.srcSubresource.baseArrayLayer = 0;
+            image_blit.srcSubresource.layerCount     = 1;
+            image_blit.dstOffsets[0]                 = {0, 0, 0};
+            image_blit.dstOffsets[1]                 = {mipmap_size / 2, mipmap_size / 2, 1};
+            image_blit.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+            image_blit.dstSubresource.mipLevel       = i + 1;
+            image_blit.dstSubresource.baseArrayLayer = 0;
+            image_blit.dstSubresource.layerCount     = 1;
+            mipmap_size /= 2;
+
+            vkCmdBlitImage(
+                command_buffer,
+                image,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                image,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1,
+                &image_blit,
+                VK_FILTER_LINEAR);
+
+            vkb::insert_image_memory_barrier(
+                command_buffer,
+                image,
+                VK_ACCESS_TRANSFER_WRITE_BIT,
+                VK_ACCESS_TRANSFER_READ_BIT,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                {VK_IMAGE_ASPECT_COLOR_BIT, i + 1, 1, 0, 1});
+        }
+
+        vkb::insert_image_memory_barrier(
+            command_buffer,
+            image,
+            VK_ACCESS_TRANSFER_READ_BIT,
+            VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, TSM_MIP_LEVELS, 0, 1});
+    }
+}
+
 void LinSSScatter::destroy_custom_render_passes()
 {
+    vkDestroyRenderPass(get_device().get_handle(), subpass_merge.render_pass, nullptr);
     vkDestroyRenderPass(get_device().get_handle(), render_passes.light_pass, nullptr);
     vkDestroyRenderPass(get_device().get_handle(), render_passes.direct_pass, nullptr);
     vkDestroyRenderPass(get_device().get_handle(), render_passes.deferred, nullptr);
@@ -1592,6 +2351,7 @@ void LinSSScatter::destroy_custom_framebuffers()
         FBO &fbo = fbos.direct_pass;
         vkDestroyFramebuffer(get_device().get_handle(), fbo.fb, nullptr);
         vkDestroySampler(get_device().get_handle(), fbo.sampler, nullptr);
+        vkDestroySampler(get_device().get_handle(), gbuffer_targets.depth_sampler, nullptr);
     }
 
     {
@@ -1609,6 +2369,11 @@ void LinSSScatter::destroy_custom_framebuffers()
         }
     }
 
+    {
+        FBO &fbo = fbos.gauss_pyramid_split;
+        vkDestroySampler(get_device().get_handle(), fbo.sampler, nullptr);
+    }
+
     {
         FBO &fbo = fbos.linsss;
         vkDestroySampler(get_device().get_handle(), fbo.sampler, nullptr);
@@ -1627,6 +2392,8 @@ void LinSSScatter::destroy_custom_framebuffers()
         vkDestroyFramebuffer(get_device().get_handle(), fbo.fb, nullptr);
         vkDestroySampler(get_device().get_handle(), fbo.sampler, nullptr);
     }
+
+    destroy_transient_images();
 }
 
 void LinSSScatter::destroy_texture(LinSSScatter::Texture texture)
@@ -1648,8 +2415,28 @@ void LinSSScatter::destroy_bssrdf(LinSSScatter::BSSRDF bssrdf)
     vkFreeMemory(get_device().get_handle(), bssrdf.device_memory_G_ast_W, nullptr);
 }
 
-void LinSSScatter::gauss_filter_to_mipmap_compute(VkCommandBuffer command_buffer, uint32_t image_width, uint32_t image_height, uint32_t mip_levels)
+void LinSSScatter::gauss_filter_to_mipmap_compute(VkCommandBuffer command_buffer, uint32_t image_width, uint32_t image_height, uint32_t mip_levels, uint32_t first_query)
 {
+    // Fall back to the windowed filter when the selected one cannot run
+    int mode = gauss_filter_mode;
+    if (mode == GaussFilterMode::Tiled && !gauss_tiled_supported)
+        mode = GaussFilterMode::Windowed;
+    if (mode == GaussFilterMode::SinglePass && !gauss_pyramid_supported)
+        mode = GaussFilterMode::Windowed;
+    if (bssrdf.recursive_filter)
+        mode = GaussFilterMode::Recursive;
+    gauss_filter_timer.mode = mode;
+
+    // Only the windowed filter is dispatched over the covered tiles
+    const bool use_tile_lists = enable_tile_lists && mode == GaussFilterMode::Windowed;
+
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+    if (gauss_filter_timer.query_pool)
+    {
+        query_pool = gauss_filter_timer.query_pool->get_handle();
+        vkCmdResetQueryPool(command_buffer, query_pool, first_query, gauss_filter_timer.queries_per_frame);
+    }
+
     // Copy first MIP level
     vkb::insert_image_memory_barrier(
         command_buffer,
@@ -1707,6 +2494,58 @@ void LinSSScatter::gauss_filter_to_mipmap_compute(VkCommandBuffer command_buffer
         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
         {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
 
+    if (query_pool != VK_NULL_HANDLE)
+    {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, query_pool, first_query);
+    }
+
+    // All the MIP levels are filtered in a single dispatch
+    if (mode == GaussFilterMode::SinglePass)
+    {
+        gauss_pyramid_compute(command_buffer, image_width, image_height, mip_levels);
+
+        if (query_pool != VK_NULL_HANDLE)
+        {
+            vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, query_pool, first_query + mip_levels - 1);
+        }
+        return;
+    }
+
+    // Tiles out of the lists are not written, so the filtered MIP levels are cleared in advance
+    VkImageLayout        old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkAccessFlags        src_access = 0;
+    VkPipelineStageFlags src_stage  = VK_PIPELINE_STAGE_HOST_BIT;
+    if (use_tile_lists)
+    {
+        const VkClearColorValue       clear_color{{0.0f, 0.0f, 0.0f, 1.0f}};
+        const VkImageSubresourceRange filtered_levels = {VK_IMAGE_ASPECT_COLOR_BIT, 1, mip_levels - 1, 0, 1};
+        for (VkImage image : {fbos.gauss_filter_buffer.images[1].get_handle(), G_ast_Phi_texture.image})
+        {
+            vkb::insert_image_memory_barrier(
+                command_buffer,
+                image,
+                0,
+                VK_ACCESS_TRANSFER_WRITE_BIT,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_GENERAL,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                filtered_levels);
+
+            vkCmdClearColorImage(command_buffer, image, VK_IMAGE_LAYOUT_GENERAL, &clear_color, 1, &filtered_levels);
+        }
+
+        old_layout = VK_IMAGE_LAYOUT_GENERAL;
+        src_access = VK_ACCESS_TRANSFER_WRITE_BIT;
+        src_stage  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
+
+    // Setup shared by all the levels is timed separately from the first level
+    if (query_pool != VK_NULL_HANDLE)
+    {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, query_pool, first_query + MAX_MIP_LEVELS + 2);
+    }
+
     // Skip a filter for the base MIP level.
     // It's just a copy for incident irradiance map.
     uint32_t mipmap_width  = image_width;
@@ -1722,34 +2561,77 @@ void LinSSScatter::gauss_filter_to_mipmap_compute(VkCommandBuffer command_buffer
         vkb::insert_image_memory_barrier(
             command_buffer,
             fbos.gauss_filter_buffer.images[1].get_handle(),
-            0,
+            src_access,
             VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT,
-            VK_IMAGE_LAYOUT_UNDEFINED,
+            old_layout,
             VK_IMAGE_LAYOUT_GENERAL,
-            VK_PIPELINE_STAGE_HOST_BIT,
+            src_stage,
             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
             {VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1});
 
         vkb::insert_image_memory_barrier(
             command_buffer,
             G_ast_Phi_texture.image,
-            0,
+            src_access,
             VK_ACCESS_SHADER_WRITE_BIT,
-            VK_IMAGE_LAYOUT_UNDEFINED,
+            old_layout,
             VK_IMAGE_LAYOUT_GENERAL,
-            VK_PIPELINE_STAGE_HOST_BIT,
+            src_stage,
             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
             {VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1});
 
         // Dispatch
-        const uint32_t local_size  = 32;
-        const uint32_t num_group_x = (mipmap_width + local_size - 1) / local_size;
-        const uint32_t num_group_y = (mipmap_height + local_size - 1) / local_size;
-        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.gauss_filter);
+        uint32_t   num_horz_group_x, num_horz_group_y;
+        uint32_t   num_vert_group_x, num_vert_group_y;
+        VkPipeline horz_pipeline, vert_pipeline;
+        if (mode == GaussFilterMode::Tiled)
+        {
+            // Workgroups are laid out along the filter direction
+            num_horz_group_x = (mipmap_width + GAUSS_TILE_LENGTH - 1) / GAUSS_TILE_LENGTH;
+            num_horz_group_y = (mipmap_height + GAUSS_TILE_ROWS - 1) / GAUSS_TILE_ROWS;
+            num_vert_group_x = (mipmap_width + GAUSS_TILE_ROWS - 1) / GAUSS_TILE_ROWS;
+            num_vert_group_y = (mipmap_height + GAUSS_TILE_LENGTH - 1) / GAUSS_TILE_LENGTH;
+            horz_pipeline    = pipelines.gauss_filter_tiled;
+            vert_pipeline    = pipelines.gauss_filter_tiled;
+        }
+        else if (mode == GaussFilterMode::Recursive)
+        {
+            // A thread for each row (horizontal) or column (vertical)
+            const uint32_t local_size = 64;
+            num_horz_group_x          = (mipmap_height + local_size - 1) / local_size;
+            num_horz_group_y          = 1;
+            num_vert_group_x          = (mipmap_width + local_size - 1) / local_size;
+            num_vert_group_y          = 1;
+            horz_pipeline             = pipelines.gauss_filter_recursive;
+            vert_pipeline             = pipelines.gauss_filter_recursive;
+        }
+        else
+        {
+            // Specialized pipelines for each direction and kernel radius
+            const int        radius     = static_cast<int>(bssrdf.ksize - 1) / 2;
+            const VkExtent2D local_size = gauss_filter_local_size();
+            num_horz_group_x            = (mipmap_width + local_size.width - 1) / local_size.width;
+            num_horz_group_y            = (mipmap_height + local_size.height - 1) / local_size.height;
+            num_vert_group_x            = num_horz_group_x;
+            num_vert_group_y            = num_horz_group_y;
+            horz_pipeline               = get_gauss_filter_pipeline(0, radius);
+            vert_pipeline               = get_gauss_filter_pipeline(1, radius);
+        }
+
+        // Both passes share the descriptor set, and the direction is given by push constants
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layouts.gauss_filter, 0, 1, &descriptor_sets.gauss_filter[i], 0, nullptr);
+
+        // Tiles of this MIP level are listed after the per-tile flags
+        push_const_gauss_cs.tile_base = use_tile_lists ? tile_lists.total_tiles + tile_lists.level_offsets[i] : 0;
 
         // Horizontal filter
-        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layouts.gauss_filter, 0, 1, &descriptor_sets.gauss_horz_filter[i], 0, nullptr);
-        vkCmdDispatch(command_buffer, num_group_x, num_group_y, 1);
+        push_const_gauss_cs.direction = 0;
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, horz_pipeline);
+        vkCmdPushConstants(command_buffer, pipeline_layouts.gauss_filter, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_const_gauss_cs), &push_const_gauss_cs);
+        if (use_tile_lists)
+            vkCmdDispatchIndirect(command_buffer, tile_lists.buffer->get_handle(), 3 * sizeof(uint32_t) * i);
+        else
+            vkCmdDispatch(command_buffer, num_horz_group_x, num_horz_group_y, 1);
 
         vkb::insert_image_memory_barrier(
             command_buffer,
@@ -1763,8 +2645,13 @@ void LinSSScatter::gauss_filter_to_mipmap_compute(VkCommandBuffer command_buffer
             {VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1});
 
         // Vertical filter
-        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layouts.gauss_filter, 0, 1, &descriptor_sets.gauss_vert_filter[i], 0, nullptr);
-        vkCmdDispatch(command_buffer, num_group_x, num_group_y, 1);
+        push_const_gauss_cs.direction = 1;
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, vert_pipeline);
+        vkCmdPushConstants(command_buffer, pipeline_layouts.gauss_filter, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_const_gauss_cs), &push_const_gauss_cs);
+        if (use_tile_lists)
+            vkCmdDispatchIndirect(command_buffer, tile_lists.buffer->get_handle(), 3 * sizeof(uint32_t) * i);
+        else
+            vkCmdDispatch(command_buffer, num_vert_group_x, num_vert_group_y, 1);
 
         vkb::insert_image_memory_barrier(
             command_buffer,
@@ -1776,1175 +2663,3464 @@ void LinSSScatter::gauss_filter_to_mipmap_compute(VkCommandBuffer command_buffer
             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
             {VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1});
+
+        if (query_pool != VK_NULL_HANDLE)
+        {
+            vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, query_pool, first_query + i);
+        }
     }
 }
 
-void LinSSScatter::linsss_accumulate_compute(VkCommandBuffer command_buffer)
+void LinSSScatter::gauss_pyramid_compute(VkCommandBuffer command_buffer, uint32_t image_width, uint32_t image_height, uint32_t mip_levels)
 {
-    // Bind descriptor set
-    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layouts.linsss, 0, 1, &descriptor_sets.linsss, 0, nullptr);
+    // Clear tile counter
+    vkCmdFillBuffer(command_buffer, storage_buffer_gauss_pyramid_counter->get_handle(), 0, sizeof(uint32_t), 0);
 
-    // Image memory barrier
-    vkb::insert_image_memory_barrier(
+    VkBufferMemoryBarrier buffer_memory_barrier = vkb::initializers::buffer_memory_barrier();
+    buffer_memory_barrier.srcAccessMask         = VK_ACCESS_TRANSFER_WRITE_BIT;
+    buffer_memory_barrier.dstAccessMask         = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    buffer_memory_barrier.buffer                = storage_buffer_gauss_pyramid_counter->get_handle();
+    buffer_memory_barrier.offset                = 0;
+    buffer_memory_barrier.size                  = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(
         command_buffer,
-        fbos.linsss.images[0].get_handle(),
-        VK_ACCESS_SHADER_READ_BIT,
-        VK_ACCESS_SHADER_WRITE_BIT,
-        VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
-
-    // Dispatch
-    const uint32_t local_size  = 32;
-    const uint32_t num_group_x = (width + local_size - 1) / local_size;
-    const uint32_t num_group_y = (height + local_size - 1) / local_size;
-    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.linsss);
-    vkCmdDispatch(command_buffer, num_group_x, num_group_y, 1);
+        0,
+        0, nullptr,
+        1, &buffer_memory_barrier,
+        0, nullptr);
 
+    // Change image layout of all the filtered MIP levels at once
     vkb::insert_image_memory_barrier(
         command_buffer,
-        fbos.linsss.images[0].get_handle(),
+        G_ast_Phi_texture.image,
+        0,
         VK_ACCESS_SHADER_WRITE_BIT,
-        VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
         VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_HOST_BIT,
         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
-}
+        {VK_IMAGE_ASPECT_COLOR_BIT, 1, mip_levels - 1, 0, 1});
 
-void LinSSScatter::build_command_buffers()
-{
-    // Update descriptor set
-    update_descriptor_set();
+    // Count tiles of all the MIP levels (the same order as the shader)
+    uint32_t num_tiles     = 0;
+    uint32_t mipmap_width  = image_width;
+    uint32_t mipmap_height = image_height;
+    for (uint32_t i = 1; i < mip_levels; i++)
+    {
+        if (mipmap_width > 1)
+            mipmap_width /= 2;
+        if (mipmap_height > 1)
+            mipmap_height /= 2;
 
-    // Build command buffer
-    VkCommandBufferBeginInfo command_buffer_begin_info = vkb::initializers::command_buffer_begin_info();
+        const uint32_t num_tile_x = (mipmap_width + GAUSS_PYRAMID_TILE_SIZE - 1) / GAUSS_PYRAMID_TILE_SIZE;
+        const uint32_t num_tile_y = (mipmap_height + GAUSS_PYRAMID_TILE_SIZE - 1) / GAUSS_PYRAMID_TILE_SIZE;
+        num_tiles += num_tile_x * num_tile_y;
+    }
 
-    VkClearValue light_pass_clear_values[4];
-    light_pass_clear_values[0].color        = default_clear_color;
-    light_pass_clear_values[1].color        = default_clear_color;
-    light_pass_clear_values[2].color        = default_clear_color;
-    light_pass_clear_values[3].depthStencil = {1.0f, 0};
+    // Dispatch persistent workgroups
+    const uint32_t num_groups = std::max(1u, std::min(num_tiles, GAUSS_PYRAMID_MAX_GROUPS));
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.gauss_pyramid);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layouts.gauss_pyramid, 0, 1, &descriptor_sets.gauss_pyramid, 0, nullptr);
+    vkCmdDispatch(command_buffer, num_groups, 1, 1);
 
-    VkRenderPassBeginInfo render_light_pass_begin_info    = vkb::initializers::render_pass_begin_info();
-    render_light_pass_begin_info.renderPass               = render_passes.light_pass;
-    render_light_pass_begin_info.renderArea.offset.x      = 0;
-    render_light_pass_begin_info.renderArea.offset.y      = 0;
-    render_light_pass_begin_info.renderArea.extent.width  = SHADOW_MAP_SIZE;
-    render_light_pass_begin_info.renderArea.extent.height = SHADOW_MAP_SIZE;
-    render_light_pass_begin_info.clearValueCount          = 4;
-    render_light_pass_begin_info.pClearValues             = light_pass_clear_values;
+    vkb::insert_image_memory_barrier(
+        command_buffer,
+        G_ast_Phi_texture.image,
+        VK_ACCESS_SHADER_WRITE_BIT,
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        {VK_IMAGE_ASPECT_COLOR_BIT, 1, mip_levels - 1, 0, 1});
+}
 
-    VkClearValue direct_pass_clear_values[6];
-    direct_pass_clear_values[0].color        = default_clear_color;
-    direct_pass_clear_values[1].color        = default_clear_color;
-    direct_pass_clear_values[2].color        = default_clear_color;
-    direct_pass_clear_values[3].color        = default_clear_color;
-    direct_pass_clear_values[4].color        = default_clear_color;
-    direct_pass_clear_values[5].depthStencil = {1.0f, 0};
+bool LinSSScatter::gauss_pyramid_split_compute(VkCommandBuffer command_buffer)
+{
+    // Nothing reads the split array in the interleaved layout
+    if (pyramid_layout != PyramidLayout::Split)
+    {
+        return false;
+    }
 
-    VkRenderPassBeginInfo render_direct_pass_begin_info    = vkb::initializers::render_pass_begin_info();
-    render_direct_pass_begin_info.renderPass               = render_passes.direct_pass;
-    render_direct_pass_begin_info.renderArea.offset.x      = 0;
-    render_direct_pass_begin_info.renderArea.offset.y      = 0;
-    render_direct_pass_begin_info.renderArea.extent.width  = width;
-    render_direct_pass_begin_info.renderArea.extent.height = height;
-    render_direct_pass_begin_info.clearValueCount          = 6;
-    render_direct_pass_begin_info.pClearValues             = direct_pass_clear_values;
+    VkImage           split_image  = fbos.gauss_pyramid_split.images[0].get_handle();
+    const VkExtent3D &extent       = fbos.gauss_pyramid_split.images[0].get_extent();
+    const uint32_t    image_width  = extent.width;
+    const uint32_t    image_height = extent.height;
+    const uint32_t    mip_levels   = max_mip_levels_surface();
 
-    VkClearValue clear_values[2];
-    clear_values[0].color        = default_clear_color;
-    clear_values[1].depthStencil = {1.0f, 0};
+    vkb::insert_image_memory_barrier(
+        command_buffer,
+        split_image,
+        0,
+        VK_ACCESS_SHADER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        {VK_IMAGE_ASPECT_COLOR_BIT, 0, mip_levels, 0, 3});
 
-    VkRenderPassBeginInfo render_tsm_pass_begin_info    = vkb::initializers::render_pass_begin_info();
-    render_tsm_pass_begin_info.renderPass               = render_passes.trans_sm;
-    render_tsm_pass_begin_info.renderArea.offset.x      = 0;
-    render_tsm_pass_begin_info.renderArea.offset.y      = 0;
-    render_tsm_pass_begin_info.renderArea.extent.width  = width / TSM_UPSAMPLE_RATIO;
-    render_tsm_pass_begin_info.renderArea.extent.height = height / TSM_UPSAMPLE_RATIO;
-    render_tsm_pass_begin_info.clearValueCount          = 2;
-    render_tsm_pass_begin_info.pClearValues             = clear_values;
+    // Each MIP level is copied by a separate dispatch
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.gauss_pyramid_split);
+    for (uint32_t i = 0; i < mip_levels; i++)
+    {
+        const uint32_t mipmap_width  = std::max(image_width >> i, 1u);
+        const uint32_t mipmap_height = std::max(image_height >> i, 1u);
+        const int      level         = static_cast<int>(i);
 
-    VkRenderPassBeginInfo render_deferred_pass_begin_info    = vkb::initializers::render_pass_begin_info();
-    render_deferred_pass_begin_info.renderPass               = render_passes.deferred;
-    render_deferred_pass_begin_info.renderArea.offset.x      = 0;
-    render_deferred_pass_begin_info.renderArea.offset.y      = 0;
-    render_deferred_pass_begin_info.renderArea.extent.width  = width;
-    render_deferred_pass_begin_info.renderArea.extent.height = height;
-    render_deferred_pass_begin_info.clearValueCount          = 2;
-    render_deferred_pass_begin_info.pClearValues             = clear_values;
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layouts.gauss_pyramid_split, 0, 1, &descriptor_sets.gauss_pyramid_split[i], 0, nullptr);
+        vkCmdPushConstants(command_buffer, pipeline_layouts.gauss_pyramid_split, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(int), &level);
 
-    VkRenderPassBeginInfo render_postprocess_begin_info    = vkb::initializers::render_pass_begin_info();
-    render_postprocess_begin_info.renderPass               = render_pass;
-    render_postprocess_begin_info.renderArea.offset.x      = 0;
-    render_postprocess_begin_info.renderArea.offset.y      = 0;
-    render_postprocess_begin_info.renderArea.extent.width  = width;
-    render_postprocess_begin_info.renderArea.extent.height = height;
-    render_postprocess_begin_info.clearValueCount          = 2;
-    render_postprocess_begin_info.pClearValues             = clear_values;
+        const uint32_t local_size  = 16;
+        const uint32_t num_group_x = (mipmap_width + local_size - 1) / local_size;
+        const uint32_t num_group_y = (mipmap_height + local_size - 1) / local_size;
+        vkCmdDispatch(command_buffer, num_group_x, num_group_y, 1);
+    }
 
-    VkDeviceSize offsets[1] = {0};
+    vkb::insert_image_memory_barrier(
+        command_buffer,
+        split_image,
+        VK_ACCESS_SHADER_WRITE_BIT,
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        {VK_IMAGE_ASPECT_COLOR_BIT, 0, mip_levels, 0, 3});
+    return true;
+}
 
-    for (int32_t i = 0; i < draw_cmd_buffers.size(); ++i)
+void LinSSScatter::prepare_tile_lists()
+{
+    // Base MIP level has the same size as the direct pass
+    const VkExtent2D extent     = get_render_context().get_surface_extent();
+    const uint32_t   mip_levels = std::min(static_cast<uint32_t>(std::ceil(std::log2(std::max(extent.width, extent.height)))), MAX_MIP_LEVELS);
+
+    // Offsets of the tiles for each MIP level (the same order as the shader)
+    tile_lists.level_offsets.resize(mip_levels);
+    tile_lists.total_tiles = 0;
+    for (uint32_t i = 0; i < mip_levels; i++)
     {
-        // BEGIN
-        VK_CHECK(vkBeginCommandBuffer(draw_cmd_buffers[i], &command_buffer_begin_info));
-        {
-            // Begin render pass (light pass)
-            render_light_pass_begin_info.framebuffer = fbos.shadow_map.fb;
-            vkCmdBeginRenderPass(draw_cmd_buffers[i], &render_light_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-            {
-                // Viewport
-                VkViewport viewport = vkb::initializers::viewport((float) SHADOW_MAP_SIZE, (float) SHADOW_MAP_SIZE, 0.0f, 1.0f);
-                vkCmdSetViewport(draw_cmd_buffers[i], 0, 1, &viewport);
+        const uint32_t mipmap_width  = std::max(extent.width >> i, 1u);
+        const uint32_t mipmap_height = std::max(extent.height >> i, 1u);
+        const uint32_t num_tile_x    = (mipmap_width + TILE_LIST_TILE_SIZE - 1) / TILE_LIST_TILE_SIZE;
+        const uint32_t num_tile_y    = (mipmap_height + TILE_LIST_TILE_SIZE - 1) / TILE_LIST_TILE_SIZE;
+        tile_lists.level_offsets[i]  = tile_lists.total_tiles;
+        tile_lists.total_tiles += num_tile_x * num_tile_y;
+    }
 
-                // Scissor
-                VkRect2D scissor = vkb::initializers::rect2D(SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 0, 0);
-                vkCmdSetScissor(draw_cmd_buffers[i], 0, 1, &scissor);
+    // Dispatch arguments, followed by a flag and a list entry for each tile
+    tile_lists.buffer = std::make_unique<vkb::core::Buffer>(get_device(),
+                                                            TILE_LIST_HEADER_SIZE + 2 * sizeof(uint32_t) * tile_lists.total_tiles,
+                                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                            VMA_MEMORY_USAGE_GPU_ONLY);
+}
 
-                // Pipeline layout
-                vkCmdBindDescriptorSets(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.light_pass, 0, 1, &descriptor_sets.light_pass, 0, nullptr);
+void LinSSScatter::tile_classify_compute(VkCommandBuffer command_buffer)
+{
+    VkBuffer buffer = tile_lists.buffer->get_handle();
 
-                // Draw
-                if (ubo_fs.light_type == LightType::Point)
-                {
-                    vkCmdBindPipeline(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.light_pass);
-                    vkCmdBindVertexBuffers(draw_cmd_buffers[i], 0, 1, model.vertex_buffer->get(), offsets);
-                    vkCmdBindIndexBuffer(draw_cmd_buffers[i], model.index_buffer->get_handle(), 0, VK_INDEX_TYPE_UINT32);
-                    vkCmdDrawIndexed(draw_cmd_buffers[i], model.index_count, 1, 0, 0, 0);
-                }
-            }
-            // End render pass (light pass)
-            vkCmdEndRenderPass(draw_cmd_buffers[i]);
+    // Reset dispatch arguments (no tiles in X, one workgroup in Y and Z) and per-tile flags
+    std::array<uint32_t, 3 * MAX_MIP_LEVELS> dispatch_args;
+    for (uint32_t i = 0; i < MAX_MIP_LEVELS; i++)
+    {
+        dispatch_args[3 * i + 0] = 0;
+        dispatch_args[3 * i + 1] = 1;
+        dispatch_args[3 * i + 2] = 1;
+    }
+    vkCmdUpdateBuffer(command_buffer, buffer, 0, TILE_LIST_HEADER_SIZE, dispatch_args.data());
+    vkCmdFillBuffer(command_buffer, buffer, TILE_LIST_HEADER_SIZE, sizeof(uint32_t) * tile_lists.total_tiles, 0);
 
-            // Begin render pass (direct pass)
-            render_direct_pass_begin_info.framebuffer = fbos.direct_pass.fb;
-            vkCmdBeginRenderPass(draw_cmd_buffers[i], &render_direct_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-            {
-                // Viewport
-                VkViewport viewport = vkb::initializers::viewport((float) width, (float) height, 0.0f, 1.0f);
-                vkCmdSetViewport(draw_cmd_buffers[i], 0, 1, &viewport);
-
-                // Scissor
-                VkRect2D scissor = vkb::initializers::rect2D(width, height, 0, 0);
-                vkCmdSetScissor(draw_cmd_buffers[i], 0, 1, &scissor);
-
-                // Pipeline layout
-                vkCmdBindDescriptorSets(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.direct_pass, 0, 1, &descriptor_sets.direct_pass, 0, nullptr);
-
-                // Draw
-                vkCmdBindPipeline(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.direct_pass);
-                vkCmdBindVertexBuffers(draw_cmd_buffers[i], 0, 1, model.vertex_buffer->get(), offsets);
-                vkCmdBindIndexBuffer(draw_cmd_buffers[i], model.index_buffer->get_handle(), 0, VK_INDEX_TYPE_UINT32);
-                vkCmdDrawIndexed(draw_cmd_buffers[i], model.index_count, 1, 0, 0, 0);
-            }
-            // End render pass (direct pass)
-            vkCmdEndRenderPass(draw_cmd_buffers[i]);
+    VkBufferMemoryBarrier buffer_memory_barrier = vkb::initializers::buffer_memory_barrier();
+    buffer_memory_barrier.srcAccessMask         = VK_ACCESS_TRANSFER_WRITE_BIT;
+    buffer_memory_barrier.dstAccessMask         = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    buffer_memory_barrier.buffer                = buffer;
+    buffer_memory_barrier.offset                = 0;
+    buffer_memory_barrier.size                  = VK_WHOLE_SIZE;
 
-            // Generate MIP Map
-            {
-                vkb::core::Image &image        = fbos.direct_pass.images[0];
-                const uint32_t    image_width  = image.get_extent().width;
-                const uint32_t    image_height = image.get_extent().height;
-                const uint32_t    mip_levels   = std::ceil(std::log2(std::max(image_width, image_height)));
-                generate_mipmap(draw_cmd_buffers[i], image.get_handle(), image_width, image_height, image.get_format(), mip_levels);
-            }
+    vkCmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        0, nullptr,
+        1, &buffer_memory_barrier,
+        0, nullptr);
+
+    // A workgroup for each tile of the base MIP level
+    const VkExtent3D &extent                    = fbos.direct_pass.images[0].get_extent();
+    push_const_tile_classify_cs.level_zero_size = glm::ivec2(extent.width, extent.height);
+    push_const_tile_classify_cs.num_levels      = static_cast<int>(tile_lists.level_offsets.size());
+    push_const_tile_classify_cs.total_tiles     = tile_lists.total_tiles;
+
+    const uint32_t num_group_x = (extent.width + TILE_LIST_TILE_SIZE - 1) / TILE_LIST_TILE_SIZE;
+    const uint32_t num_group_y = (extent.height + TILE_LIST_TILE_SIZE - 1) / TILE_LIST_TILE_SIZE;
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.tile_classify);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layouts.tile_classify, 0, 1, &descriptor_sets.tile_classify, 0, nullptr);
+    vkCmdPushConstants(command_buffer, pipeline_layouts.tile_classify, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_const_tile_classify_cs), &push_const_tile_classify_cs);
+    vkCmdDispatch(command_buffer, num_group_x, num_group_y, 1);
 
-            // Change image layout
-            vkb::insert_image_memory_barrier(
-                draw_cmd_buffers[i],
-                fbos.shadow_map.images[0].get_handle(),
-                0,
-                VK_ACCESS_SHADER_READ_BIT,
-                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+    // Lists are read by the masked passes, and the arguments by indirect dispatches
+    buffer_memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    buffer_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
 
-            vkb::insert_image_memory_barrier(
-                draw_cmd_buffers[i],
-                fbos.shadow_map.images[1].get_handle(),
-                0,
-                VK_ACCESS_SHADER_READ_BIT,
-                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+    vkCmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+        0,
+        0, nullptr,
+        1, &buffer_memory_barrier,
+        0, nullptr);
+}
 
-            vkb::insert_image_memory_barrier(
-                draw_cmd_buffers[i],
-                fbos.shadow_map.images[2].get_handle(),
-                0,
-                VK_ACCESS_SHADER_READ_BIT,
-                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+void LinSSScatter::prepare_tsm_accumulation()
+{
+    // Buffers cover the TSM attachments, i.e., the maximum render area
+    const VkExtent3D &extent = fbos.trans_sm[0].images[0].get_extent();
+    const uint32_t    width  = extent.width;
+    const uint32_t    height = extent.height;
+
+    tsm_accumulation.num_tiles_x = (width + TSM_VARIANCE_TILE_SIZE - 1) / TSM_VARIANCE_TILE_SIZE;
+    tsm_accumulation.num_tiles_y = (height + TSM_VARIANCE_TILE_SIZE - 1) / TSM_VARIANCE_TILE_SIZE;
+
+    tsm_accumulation.moments     = std::make_unique<vkb::core::Buffer>(get_device(),
+                                                                       sizeof(glm::vec4) * width * height,
+                                                                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                                       VMA_MEMORY_USAGE_GPU_ONLY);
+    tsm_accumulation.tile_errors = std::make_unique<vkb::core::Buffer>(get_device(),
+                                                                       sizeof(uint32_t) * tsm_accumulation.num_tiles_x * tsm_accumulation.num_tiles_y,
+                                                                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                                       VMA_MEMORY_USAGE_GPU_TO_CPU);
+
+    // Moments are restarted by the shader, but must not hold NaNs
+    VkCommandBuffer command_buffer = get_device().create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    vkCmdFillBuffer(command_buffer, tsm_accumulation.moments->get_handle(), 0, VK_WHOLE_SIZE, 0);
+    vkCmdFillBuffer(command_buffer, tsm_accumulation.tile_errors->get_handle(), 0, VK_WHOLE_SIZE, 0);
+    get_device().flush_command_buffer(command_buffer, queue, true);
 
-            vkb::insert_image_memory_barrier(
-                draw_cmd_buffers[i],
-                fbos.direct_pass.images[1].get_handle(),
-                0,
-                VK_ACCESS_SHADER_READ_BIT,
-                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+    tsm_accumulation.frames    = 0;
+    tsm_accumulation.converged = false;
+}
 
-            vkb::insert_image_memory_barrier(
-                draw_cmd_buffers[i],
-                fbos.direct_pass.images[2].get_handle(),
-                0,
-                VK_ACCESS_SHADER_READ_BIT,
-                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+void LinSSScatter::tsm_variance_compute(VkCommandBuffer command_buffer)
+{
+    // Moments are updated in place over frames
+    VkBufferMemoryBarrier buffer_memory_barrier = vkb::initializers::buffer_memory_barrier();
+    buffer_memory_barrier.srcAccessMask         = VK_ACCESS_SHADER_WRITE_BIT;
+    buffer_memory_barrier.dstAccessMask         = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    buffer_memory_barrier.buffer                = tsm_accumulation.moments->get_handle();
+    buffer_memory_barrier.offset                = 0;
+    buffer_memory_barrier.size                  = VK_WHOLE_SIZE;
 
-            vkb::insert_image_memory_barrier(
-                draw_cmd_buffers[i],
-                fbos.direct_pass.images[3].get_handle(),
-                0,
-                VK_ACCESS_SHADER_READ_BIT,
-                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+    vkCmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        0, nullptr,
+        1, &buffer_memory_barrier,
+        0, nullptr);
 
-            vkb::insert_image_memory_barrier(
-                draw_cmd_buffers[i],
-                fbos.direct_pass.images[4].get_handle(),
-                0,
-                VK_ACCESS_SHADER_READ_BIT,
-                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+    // Tiles of the current render area
+    const VkExtent2D extent      = tsm_render_extent();
+    tsm_accumulation.num_tiles_x = (extent.width + TSM_VARIANCE_TILE_SIZE - 1) / TSM_VARIANCE_TILE_SIZE;
+    tsm_accumulation.num_tiles_y = (extent.height + TSM_VARIANCE_TILE_SIZE - 1) / TSM_VARIANCE_TILE_SIZE;
 
-            // Compute pass (gauss filter)
-            {
-                vkb::core::Image &image        = fbos.direct_pass.images[0];
-                const uint32_t    image_width  = image.get_extent().width;
-                const uint32_t    image_height = image.get_extent().height;
-                const uint32_t    mip_levels   = std::ceil(std::log2(std::max(image_width, image_height)));
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.tsm_variance);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layouts.tsm_variance, 0, 1, &descriptor_sets.tsm_variance, 0, nullptr);
+    vkCmdPushConstants(command_buffer, pipeline_layouts.tsm_variance, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(VkExtent2D), &extent);
+    vkCmdDispatch(command_buffer, tsm_accumulation.num_tiles_x, tsm_accumulation.num_tiles_y, 1);
 
-                gauss_filter_to_mipmap_compute(draw_cmd_buffers[i], image_width, image_height, mip_levels);
-            }
+    // Tile errors are read by the host after the frame
+    buffer_memory_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    buffer_memory_barrier.buffer        = tsm_accumulation.tile_errors->get_handle();
 
-            // Compute pass (linsss accumulate)
-            {
-                linsss_accumulate_compute(draw_cmd_buffers[i]);
-            }
+    vkCmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        0, nullptr,
+        1, &buffer_memory_barrier,
+        0, nullptr);
+}
 
-            // Translucent shadow maps
-            const int ping_index = i % 2;
-            const int pong_index = 1 - ping_index;
+void LinSSScatter::update_tsm_accumulation()
+{
+    // Accumulation restarts whenever TSM is turned on
+    if (!enable_tsm)
+    {
+        tsm_accumulation.frames    = 0;
+        tsm_accumulation.converged = false;
+        return;
+    }
+    if (tsm_accumulation.converged)
+    {
+        return;
+    }
+    tsm_accumulation.frames += 1;
+
+    // Tiles without the object have zero errors. GPU_TO_CPU memory may be non-coherent.
+    vmaInvalidateAllocation(get_device().get_memory_allocator(), tsm_accumulation.tile_errors->get_allocation(), 0, VK_WHOLE_SIZE);
+    const float   *tile_errors     = reinterpret_cast<const float *>(tsm_accumulation.tile_errors->map());
+    const uint32_t num_tiles       = tsm_accumulation.num_tiles_x * tsm_accumulation.num_tiles_y;
+    uint32_t       converged_tiles = 0;
+    tsm_accumulation.max_error     = 0.0f;
+    for (uint32_t i = 0; i < num_tiles; i++)
+    {
+        tsm_accumulation.max_error = std::max(tsm_accumulation.max_error, tile_errors[i]);
+        converged_tiles += tile_errors[i] <= tsm_accumulation.error_threshold ? 1 : 0;
+    }
+    tsm_accumulation.converged_tiles = num_tiles > 0 ? static_cast<float>(converged_tiles) / num_tiles : 1.0f;
 
-            // When TSM is enabled
-            if (enable_tsm)
-            {
-                vkb::insert_image_memory_barrier(
-                    draw_cmd_buffers[i],
-                    fbos.trans_sm[ping_index].images[0].get_handle(),
-                    VK_ACCESS_TRANSFER_WRITE_BIT,
-                    VK_ACCESS_SHADER_READ_BIT,
-                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                    VK_PIPELINE_STAGE_TRANSFER_BIT,
-                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                    {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+    // Convergence measurement keeps accumulating
+    if (tsm_convergence.stage != 0)
+    {
+        return;
+    }
 
-                vkb::insert_image_memory_barrier(
-                    draw_cmd_buffers[i],
-                    fbos.trans_sm[pong_index].images[0].get_handle(),
-                    VK_ACCESS_TRANSFER_WRITE_BIT,
-                    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                    VK_PIPELINE_STAGE_TRANSFER_BIT,
-                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                    {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+    switch (tsm_accumulation.stop_condition)
+    {
+        case TSMStopCondition::SampleCount:
+            tsm_accumulation.converged = tsm_accumulation.frames >= static_cast<uint32_t>(tsm_accumulation.max_frames);
+            break;
+        case TSMStopCondition::ErrorThreshold:
+            tsm_accumulation.converged = tsm_accumulation.frames >= TSM_MIN_FRAMES &&
+                                         tsm_accumulation.max_error <= tsm_accumulation.error_threshold;
+            break;
+        default:
+            break;
+    }
 
-                render_tsm_pass_begin_info.framebuffer = fbos.trans_sm[pong_index].fb;
-                vkCmdBeginRenderPass(draw_cmd_buffers[i], &render_tsm_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-                {
-                    // Viewport
-                    VkViewport viewport = vkb::initializers::viewport((float) width / TSM_UPSAMPLE_RATIO, (float) height / TSM_UPSAMPLE_RATIO, 0.0f, 1.0f);
-                    vkCmdSetViewport(draw_cmd_buffers[i], 0, 1, &viewport);
+    // TSM draw is removed from the frame until the accumulation is cleared
+    if (tsm_accumulation.converged)
+    {
+        build_command_buffers();
+    }
+}
 
-                    // Scissor
-                    VkRect2D scissor = vkb::initializers::rect2D(width / TSM_UPSAMPLE_RATIO, height / TSM_UPSAMPLE_RATIO, 0, 0);
-                    vkCmdSetScissor(draw_cmd_buffers[i], 0, 1, &scissor);
+VkExtent2D LinSSScatter::tsm_render_extent() const
+{
+    const VkExtent3D &extent = fbos.trans_sm[0].images[0].get_extent();
+    return {std::max(1u, extent.width * tsm_resolution.steps / TSM_RESOLUTION_STEPS),
+            std::max(1u, extent.height * tsm_resolution.steps / TSM_RESOLUTION_STEPS)};
+}
 
-                    // Pipeline layout
-                    vkCmdBindDescriptorSets(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.trans_sm, 0, 1, &descriptor_sets.trans_sm[pong_index], 0, nullptr);
+void LinSSScatter::prepare_tsm_resolution()
+{
+    const VkPhysicalDeviceLimits &limits = get_device().get_gpu().get_properties().limits;
+    if (!limits.timestampComputeAndGraphics)
+    {
+        LOGW("Timestamp queries are not supported. TSM resolution is fixed.");
+        return;
+    }
 
-                    // Draw
-                    vkCmdBindPipeline(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.trans_sm);
-                    vkCmdBindVertexBuffers(draw_cmd_buffers[i], 0, 1, model.vertex_buffer->get(), offsets);
-                    vkCmdBindIndexBuffer(draw_cmd_buffers[i], model.index_buffer->get_handle(), 0, VK_INDEX_TYPE_UINT32);
-                    vkCmdDrawIndexed(draw_cmd_buffers[i], model.index_count, 1, 0, 0, 0);
-                }
-                vkCmdEndRenderPass(draw_cmd_buffers[i]);
+    // Two timestamps around the TSM pass
+    VkQueryPoolCreateInfo query_pool_create_info = {};
+    query_pool_create_info.sType                 = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_create_info.queryType             = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_create_info.queryCount            = 2 * static_cast<uint32_t>(draw_cmd_buffers.size());
+    tsm_resolution.query_pool                    = std::make_unique<vkb::QueryPool>(get_device(), query_pool_create_info);
+    tsm_resolution.timestamp_period              = limits.timestampPeriod;
+}
 
-                vkb::insert_image_memory_barrier(
-                    draw_cmd_buffers[i],
-                    fbos.trans_sm[ping_index].images[0].get_handle(),
-                    VK_ACCESS_SHADER_READ_BIT,
-                    VK_ACCESS_TRANSFER_WRITE_BIT,
-                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                    VK_PIPELINE_STAGE_TRANSFER_BIT,
-                    {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+void LinSSScatter::update_tsm_resolution()
+{
+    // Timestamps are written only while TSM is accumulated
+    if (!tsm_resolution.timed)
+    {
+        return;
+    }
 
-                vkb::insert_image_memory_barrier(
-                    draw_cmd_buffers[i],
-                    fbos.trans_sm[pong_index].images[0].get_handle(),
-                    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                    VK_ACCESS_TRANSFER_READ_BIT,
-                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                    VK_PIPELINE_STAGE_TRANSFER_BIT,
-                    {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
-            }
-            else
-            {
-                VkClearColorValue       clear_color{{0.0f, 0.0f, 0.0f, 1.0f}};
-                VkImageSubresourceRange subresource_range{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    std::array<uint64_t, 2> timestamps;
+    VkResult                result = tsm_resolution.query_pool->get_results(
+        2 * current_buffer,
+        2,
+        sizeof(uint64_t) * 2,
+        timestamps.data(),
+        sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS)
+    {
+        return;
+    }
 
-                vkCmdClearColorImage(
-                    draw_cmd_buffers[i],
-                    fbos.trans_sm[pong_index].images[0].get_handle(),
-                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                    &clear_color,
-                    1,
-                    &subresource_range);
+    const float elapsed_ms = static_cast<float>(timestamps[1] - timestamps[0]) * tsm_resolution.timestamp_period * 1.0e-6f;
+    tsm_resolution.tsm_ms  = tsm_resolution.frames == 0 ? elapsed_ms : tsm_resolution.tsm_ms * 0.9f + elapsed_ms * 0.1f;
+    tsm_resolution.frames += 1;
 
-                vkb::insert_image_memory_barrier(
-                    draw_cmd_buffers[i],
-                    fbos.trans_sm[pong_index].images[0].get_handle(),
-                    VK_ACCESS_TRANSFER_WRITE_BIT,
-                    VK_ACCESS_TRANSFER_READ_BIT,
-                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                    VK_PIPELINE_STAGE_TRANSFER_BIT,
-                    VK_PIPELINE_STAGE_TRANSFER_BIT,
-                    {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
-            }
+    // GPU time per megapixel for each evaluation of the radial profiles
+    const VkExtent2D extent  = tsm_render_extent();
+    const float      mpix    = static_cast<float>(extent.width * extent.height) * 1.0e-6f;
+    float           &profile = tsm_profile.ms_per_mpix[tsm_profile.enabled ? 1 : 0];
+    float           &mipmap  = tsm_mipmap.ms_per_mpix[tsm_mipmap.enabled ? 1 : 0];
+    profile                  = profile == 0.0f ? elapsed_ms / mpix : profile * 0.9f + elapsed_ms / mpix * 0.1f;
+    mipmap                   = mipmap == 0.0f ? elapsed_ms / mpix : mipmap * 0.9f + elapsed_ms / mpix * 0.1f;
 
-            // Copy image to texture
-            {
-                vkb::insert_image_memory_barrier(
-                    draw_cmd_buffers[i],
-                    tsm_texture.image,
-                    0,
-                    VK_ACCESS_TRANSFER_WRITE_BIT,
-                    VK_IMAGE_LAYOUT_UNDEFINED,
-                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                    VK_PIPELINE_STAGE_HOST_BIT,
-                    VK_PIPELINE_STAGE_TRANSFER_BIT,
-                    {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+    // Resolution is kept while GPU time settles and while convergence is measured
+    if (!tsm_resolution.enabled || tsm_resolution.frames < TSM_RESOLUTION_SETTLE_FRAMES || tsm_convergence.stage != 0)
+    {
+        return;
+    }
 
-                VkImageCopy image_copy                   = {};
-                image_copy.extent                        = VkExtent3D{width / TSM_UPSAMPLE_RATIO, height / TSM_UPSAMPLE_RATIO, 1};
-                image_copy.srcOffset                     = {0, 0, 0};
-                image_copy.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-                image_copy.srcSubresource.mipLevel       = 0;
-                image_copy.srcSubresource.baseArrayLayer = 0;
-                image_copy.srcSubresource.layerCount     = 1;
-                image_copy.dstOffset                     = {0, 0, 0};
-                image_copy.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-                image_copy.dstSubresource.mipLevel       = 0;
-                image_copy.dstSubresource.baseArrayLayer = 0;
-                image_copy.dstSubresource.layerCount     = 1;
-
-                vkCmdCopyImage(
-                    draw_cmd_buffers[i],
-                    fbos.trans_sm[pong_index].images[0].get_handle(),
-                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                    tsm_texture.image,
-                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                    1,
-                    &image_copy);
+    // GPU time of the TSM pass is roughly proportional to the render area
+    uint32_t steps = tsm_resolution.steps;
+    if (tsm_resolution.tsm_ms > tsm_resolution.budget_ms)
+    {
+        steps = std::max(steps - 1, TSM_MIN_RESOLUTION_STEPS);
+    }
+    else if (steps < TSM_RESOLUTION_STEPS)
+    {
+        // Margin against oscillation between two steps
+        const float area_ratio = static_cast<float>((steps + 1) * (steps + 1)) / static_cast<float>(steps * steps);
+        if (tsm_resolution.tsm_ms * area_ratio < 0.9f * tsm_resolution.budget_ms)
+        {
+            steps += 1;
+        }
+    }
 
-                vkb::insert_image_memory_barrier(
-                    draw_cmd_buffers[i],
-                    tsm_texture.image,
-                    VK_ACCESS_TRANSFER_WRITE_BIT,
-                    VK_ACCESS_SHADER_READ_BIT,
-                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                    VK_PIPELINE_STAGE_TRANSFER_BIT,
-                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                    {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
-            }
+    if (steps != tsm_resolution.steps)
+    {
+        set_tsm_resolution_steps(steps);
+    }
+}
 
-            vkb::insert_image_memory_barrier(
-                draw_cmd_buffers[i],
-                fbos.trans_sm[pong_index].images[0].get_handle(),
-                VK_ACCESS_TRANSFER_READ_BIT,
-                VK_ACCESS_TRANSFER_WRITE_BIT,
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                VK_PIPELINE_STAGE_TRANSFER_BIT,
-                VK_PIPELINE_STAGE_TRANSFER_BIT,
-                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+void LinSSScatter::update_tsm_mipmap_stats()
+{
+    // Taps of a frame are 2 pi r / TSM_SAMPLES apart on the circle of radius r, and read the MIP level
+    // of that spacing (see "tapLod" in "translucent_shadow_maps.glsl"). The texels covered by the disk
+    // of a fragment over the frames are a proxy of the working set in the texture cache.
+    const uint32_t num_bins    = 256;
+    const float    size        = static_cast<float>(SHADOW_MAP_SIZE);
+    const float    dr          = TSM_MAX_RADIUS / num_bins;
+    double         mean_lod    = 0.0;
+    double         texels      = 0.0;
+    double         base_texels = 0.0;
+    for (uint32_t i = 0; i < num_bins; i++)
+    {
+        const float r   = (static_cast<float>(i) + 0.5f) * dr;
+        const float pdf = tsm_radius_importance ? 3.0f * r * r / (TSM_MAX_RADIUS * TSM_MAX_RADIUS * TSM_MAX_RADIUS) : 1.0f / TSM_MAX_RADIUS;
 
-            // Begin render pass (deferred shading)
-            render_deferred_pass_begin_info.framebuffer = fbos.deferred.fb;
-            vkCmdBeginRenderPass(draw_cmd_buffers[i], &render_deferred_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-            {
-                // Viewport
-                VkViewport viewport = vkb::initializers::viewport((float) width, (float) height, 0.0f, 1.0f);
-                vkCmdSetViewport(draw_cmd_buffers[i], 0, 1, &viewport);
-
-                // Scissor
-                VkRect2D scissor = vkb::initializers::rect2D(width, height, 0, 0);
-                vkCmdSetScissor(draw_cmd_buffers[i], 0, 1, &scissor);
-
-                // Pipeline layout
-                vkCmdBindDescriptorSets(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.deferred, 0, 1, &descriptor_sets.deferred, 0, nullptr);
-
-                // Background
-                vkCmdBindPipeline(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.background);
-                vkCmdBindVertexBuffers(draw_cmd_buffers[i], 0, 1, cube.vertex_buffer->get(), offsets);
-                vkCmdBindIndexBuffer(draw_cmd_buffers[i], cube.index_buffer->get_handle(), 0, VK_INDEX_TYPE_UINT32);
-                vkCmdDrawIndexed(draw_cmd_buffers[i], cube.index_count, 1, 0, 0, 0);
-
-                // Object
-                vkCmdBindPipeline(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.deferred);
-                vkCmdBindVertexBuffers(draw_cmd_buffers[i], 0, 1, model.vertex_buffer->get(), offsets);
-                vkCmdBindIndexBuffer(draw_cmd_buffers[i], model.index_buffer->get_handle(), 0, VK_INDEX_TYPE_UINT32);
-                vkCmdDrawIndexed(draw_cmd_buffers[i], model.index_count, 1, 0, 0, 0);
-            }
-            // End render pass (camera pass)
-            vkCmdEndRenderPass(draw_cmd_buffers[i]);
+        float lod = 0.0f;
+        if (tsm_mipmap.enabled)
+        {
+            const float spacing = 2.0f * glm::pi<float>() * r * size / static_cast<float>(TSM_SAMPLES);
+            lod                 = glm::clamp(std::log2(std::max(spacing, 1.0f)) + tsm_mipmap.mip_bias, 0.0f, static_cast<float>(TSM_MIP_LEVELS - 1));
+        }
 
-            // Change image layout (color : deferred)
-            vkb::insert_image_memory_barrier(
-                draw_cmd_buffers[i],
-                fbos.deferred.images[0].get_handle(),
-                0,
-                VK_ACCESS_SHADER_READ_BIT,
-                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+        const double annulus = 2.0 * glm::pi<double>() * r * dr * size * size;
+        mean_lod += lod * pdf * dr;
+        texels += annulus / std::exp2(2.0 * lod);
+        base_texels += annulus;
+    }
 
-            // Postprocess
-            render_postprocess_begin_info.framebuffer = framebuffers[i];
-            vkCmdBeginRenderPass(draw_cmd_buffers[i], &render_postprocess_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-            {
-                // Viewport
-                VkViewport viewport = vkb::initializers::viewport((float) width, (float) height, 0.0f, 1.0f);
-                vkCmdSetViewport(draw_cmd_buffers[i], 0, 1, &viewport);
+    // Position reconstructed from depth is read from the base level (see "light_pass_formats")
+    const std::array<VkFormat, 3> formats   = light_pass_formats(light_pass_targets.active_format);
+    const bool                    pos_mips  = formats[1] != VK_FORMAT_UNDEFINED;
+    const double                  irr_bytes = formats[0] != VK_FORMAT_UNDEFINED ? vkb::get_bits_per_pixel(formats[0]) / 8.0 : 0.0;
+    const double                  pos_bytes = vkb::get_bits_per_pixel(pos_mips ? formats[1] : VK_FORMAT_D32_SFLOAT) / 8.0;
 
-                // Scissor
-                VkRect2D scissor = vkb::initializers::rect2D(width, height, 0, 0);
-                vkCmdSetScissor(draw_cmd_buffers[i], 0, 1, &scissor);
+    tsm_mipmap.mean_lod         = static_cast<float>(mean_lod);
+    tsm_mipmap.working_set_kib  = static_cast<float>((texels * irr_bytes + (pos_mips ? texels : base_texels) * pos_bytes) / 1024.0);
+    tsm_mipmap.base_working_kib = static_cast<float>(base_texels * (irr_bytes + pos_bytes) / 1024.0);
+}
 
-                // Pipeline layout
-                vkCmdBindDescriptorSets(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.postprocess, 0, 1, &descriptor_sets.postprocess, 0, nullptr);
+void LinSSScatter::set_tsm_resolution_steps(uint32_t steps)
+{
+    tsm_resolution.steps  = steps;
+    tsm_resolution.frames = 0;
 
-                // Draw
-                vkCmdBindPipeline(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.postprocess);
-                vkCmdBindVertexBuffers(draw_cmd_buffers[i], 0, 1, rect.vertex_buffer->get(), offsets);
-                vkCmdBindIndexBuffer(draw_cmd_buffers[i], rect.index_buffer->get_handle(), 0, VK_INDEX_TYPE_UINT32);
-                vkCmdDrawIndexed(draw_cmd_buffers[i], rect.index_count, 1, 0, 0, 0);
+    const VkExtent2D extent = tsm_render_extent();
+    LOGI("TSM resolution: {}x{}", extent.width, extent.height);
 
-                // UI
-                draw_ui(draw_cmd_buffers[i]);
-            }
-            // End render pass (postprocess)
-            vkCmdEndRenderPass(draw_cmd_buffers[i]);
-        }
-        // END
-        VK_CHECK(vkEndCommandBuffer(draw_cmd_buffers[i]));
+    // Attachments are kept, and only the render area is recorded again
+    clear_tsm_accumulation();
+    build_command_buffers();
+}
+
+void LinSSScatter::prepare_timestamp_queries()
+{
+    const VkPhysicalDeviceLimits &limits = get_device().get_gpu().get_properties().limits;
+    if (!limits.timestampComputeAndGraphics)
+    {
+        LOGW("Timestamp queries are not supported. Gaussian filter timings are disabled.");
+        return;
     }
+
+    // One timestamp before the filter and one after each MIP level,
+    // followed by two timestamps for LinSSS accumulation and one after the setup shared by the levels
+    gauss_filter_timer.queries_per_frame = MAX_MIP_LEVELS + 3;
+    gauss_filter_timer.timestamp_period  = limits.timestampPeriod;
+    for (auto &level_ms : gauss_filter_timer.level_ms)
+    {
+        level_ms.assign(MAX_MIP_LEVELS, 0.0f);
+    }
+
+    VkQueryPoolCreateInfo query_pool_create_info = {};
+    query_pool_create_info.sType                 = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_create_info.queryType             = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_create_info.queryCount            = gauss_filter_timer.queries_per_frame * static_cast<uint32_t>(draw_cmd_buffers.size());
+    gauss_filter_timer.query_pool                = std::make_unique<vkb::QueryPool>(get_device(), query_pool_create_info);
+
+    // Two timestamps around the light pass for each command buffer
+    query_pool_create_info.queryCount   = 2 * static_cast<uint32_t>(draw_cmd_buffers.size());
+    light_pass_targets.query_pool       = std::make_unique<vkb::QueryPool>(get_device(), query_pool_create_info);
+    light_pass_targets.timestamp_period = limits.timestampPeriod;
+
+    // Two timestamps around the direct pass (shadow filter) for each command buffer
+    shadow_pcf.query_pool       = std::make_unique<vkb::QueryPool>(get_device(), query_pool_create_info);
+    shadow_pcf.timestamp_period = limits.timestampPeriod;
+
+    // Three timestamps around deferred shading and postprocess for each command buffer
+    query_pool_create_info.queryCount = 3 * static_cast<uint32_t>(draw_cmd_buffers.size());
+    subpass_merge.query_pool          = std::make_unique<vkb::QueryPool>(get_device(), query_pool_create_info);
+    subpass_merge.timestamp_period    = limits.timestampPeriod;
 }
 
-void LinSSScatter::draw()
+void LinSSScatter::fetch_light_pass_queries()
 {
-    ApiVulkanSample::prepare_frame();
+    if (!light_pass_targets.query_pool || irradiance_cache.reuse || shadow_cache.reuse)
+    {
+        return;
+    }
 
-    // Command buffer to be sumitted to the queue
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers    = &draw_cmd_buffers[current_buffer];
+    std::array<uint64_t, 2> timestamps;
+    VkResult                result = light_pass_targets.query_pool->get_results(
+        2 * current_buffer,
+        2,
+        sizeof(uint64_t) * 2,
+        timestamps.data(),
+        sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS)
+    {
+        return;
+    }
 
-    // Submit to queue
-    VK_CHECK(vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE));
+    const float elapsed_ms = static_cast<float>(timestamps[1] - timestamps[0]) * light_pass_targets.timestamp_period * 1.0e-6f;
+    float      &ms         = light_pass_targets.ms[light_pass_targets.active_format];
+    ms                     = ms == 0.0f ? elapsed_ms : ms * 0.95f + elapsed_ms * 0.05f;
+}
 
-    ApiVulkanSample::submit_frame();
+void LinSSScatter::fetch_direct_pass_queries()
+{
+    if (!shadow_pcf.query_pool || irradiance_cache.reuse)
+    {
+        return;
+    }
+
+    std::array<uint64_t, 2> timestamps;
+    VkResult                result = shadow_pcf.query_pool->get_results(
+        2 * current_buffer,
+        2,
+        sizeof(uint64_t) * 2,
+        timestamps.data(),
+        sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS)
+    {
+        return;
+    }
+
+    const float elapsed_ms = static_cast<float>(timestamps[1] - timestamps[0]) * shadow_pcf.timestamp_period * 1.0e-6f;
+    float      &ms         = shadow_pcf.ms[ubo_fs.shadow_filter];
+    ms                     = ms == 0.0f ? elapsed_ms : ms * 0.95f + elapsed_ms * 0.05f;
+
+    // Same pass, tracked per G-buffer profile
+    float &gbuffer_ms = gbuffer_targets.ms[gbuffer_targets.active_profile];
+    gbuffer_ms        = gbuffer_ms == 0.0f ? elapsed_ms : gbuffer_ms * 0.95f + elapsed_ms * 0.05f;
 }
 
-void LinSSScatter::load_model(const std::string &filename)
+void LinSSScatter::fetch_postprocess_queries()
 {
-    // Mesh model
+    if (!subpass_merge.query_pool)
     {
-        // Load .ply file
-        using tinyply::PlyData;
-        using tinyply::PlyFile;
+        return;
+    }
 
-        std::unordered_map<LinSSScatterVertexStructure, uint32_t> uniqueVertices;
-        std::vector<LinSSScatterVertexStructure>                  vertices;
-        std::vector<uint32_t>                                     indices;
+    // Merged subpasses overlap, so that only their total is timed (see "build_command_buffers")
+    const bool              separate       = subpass_merge.active_mode == PostprocessMode::SeparatePasses;
+    const uint32_t          num_timestamps = separate ? 3 : 2;
+    std::array<uint64_t, 3> timestamps;
+    VkResult                result = subpass_merge.query_pool->get_results(
+        3 * current_buffer,
+        num_timestamps,
+        sizeof(uint64_t) * num_timestamps,
+        timestamps.data(),
+        sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS)
+    {
+        return;
+    }
 
-        try
-        {
-            // Open
-            std::ifstream reader(filename.c_str(), std::ios::binary);
-            if (reader.fail())
-            {
-                LOGE("Failed to open file: {}", vkb::to_string(filename));
-                abort();
-            }
+    auto &mode_ms = subpass_merge.ms[subpass_merge.active_mode];
+    for (uint32_t k = separate ? 0 : 2; k < 3; k++)
+    {
+        const uint64_t begin      = k < 2 ? timestamps[k] : timestamps[0];
+        const uint64_t end        = k < 2 ? timestamps[k + 1] : timestamps[num_timestamps - 1];
+        const float    elapsed_ms = static_cast<float>(end - begin) * subpass_merge.timestamp_period * 1.0e-6f;
+        float         &ms         = mode_ms[k];
+        ms                        = ms == 0.0f ? elapsed_ms : ms * 0.95f + elapsed_ms * 0.05f;
+    }
+}
 
-            // Read header
-            PlyFile file;
-            file.parse_header(reader);
+void LinSSScatter::update_light_pass_format()
+{
+    const int format = light_pass_format();
+    if (format == light_pass_targets.active_format)
+    {
+        return;
+    }
 
-            // Request vertex data
-            std::shared_ptr<PlyData> vert_data, norm_data, uv_data, face_data;
-            try
-            {
-                vert_data = file.request_properties_from_element("vertex", {"x", "y", "z"});
-            }
-            catch (const std::invalid_argument &e)
-            {
-                LOGW("tinyply exception: {}", e.what());
-            }
+    // Render pass, render targets and pipeline of the light pass are created again (queue is idle after "draw")
+    vkDestroyPipeline(get_device().get_handle(), pipelines.light_pass, nullptr);
+    vkDestroyFramebuffer(get_device().get_handle(), fbos.shadow_map.fb, nullptr);
+    vkDestroySampler(get_device().get_handle(), fbos.shadow_map.sampler, nullptr);
+    vkDestroyRenderPass(get_device().get_handle(), render_passes.light_pass, nullptr);
 
-            try
-            {
-                norm_data = file.request_properties_from_element("vertex", {"nx", "ny", "nz"});
-            }
-            catch (const std::invalid_argument &e)
-            {
-                LOGW("tinyply exception: {}", e.what());
-            }
+    light_pass_targets.active_format = format;
+    setup_light_pass_render_pass();
+    setup_shadow_map_framebuffer();
+    prepare_light_pass_pipeline();
+    update_render_target_footprint();
+    LOGI("Light pass targets: {:.1f} MiB, {:.1f} MiB written per frame",
+         light_pass_targets.memory_mib[format], light_pass_targets.write_mib[format]);
+
+    update_tsm_mipmap_stats();
+    invalidate_irradiance_cache();
+    invalidate_shadow_cache();
+    clear_tsm_accumulation();
+    build_command_buffers();
+}
 
-            try
-            {
-                uv_data = file.request_properties_from_element("vertex", {"u", "v"});
-            }
-            catch (const std::invalid_argument &e)
-            {
-                LOGW("tinyply exception: {}", e.what());
-            }
+void LinSSScatter::update_gbuffer_profile()
+{
+    const int profile = gbuffer_profile();
+    if (profile == gbuffer_targets.active_profile)
+    {
+        return;
+    }
 
-            try
-            {
-                face_data = file.request_properties_from_element("face", {"vertex_indices"}, 3);
-            }
-            catch (const std::invalid_argument &e)
-            {
-                LOGW("tinyply exception: {}", e.what());
-            }
+    // Render pass and pipeline of the direct pass are created again (queue is idle after "draw"). All the render
+    // targets are created again, since the G-buffer changes the transient images and their placement in the heaps.
+    vkDestroyPipeline(get_device().get_handle(), pipelines.direct_pass, nullptr);
+    destroy_custom_framebuffers();
+    vkDestroyRenderPass(get_device().get_handle(), render_passes.direct_pass, nullptr);
 
-            // Read vertex data
-            file.read(reader);
+    gbuffer_targets.active_profile = profile;
+    setup_direct_pass_render_pass();
+    setup_custom_framebuffers();
+    prepare_direct_pass_pipeline();
+    update_uniform_buffers();
+    LOGI("G-buffer targets: {:.1f} MiB, {:.1f} MiB written per frame",
+         gbuffer_targets.memory_mib[profile], gbuffer_targets.write_mib[profile]);
 
-            // Copy vertex data
-            const size_t       numVerts = vert_data->count;
-            std::vector<float> raw_vertices, raw_normals, raw_uv;
-            if (vert_data)
-            {
-                raw_vertices.resize(numVerts * 3);
-                std::memcpy(raw_vertices.data(), vert_data->buffer.get(), sizeof(float) * numVerts * 3);
-            }
+    invalidate_irradiance_cache();
+    invalidate_shadow_cache();
+    clear_tsm_accumulation();
+    build_command_buffers();
+}
 
-            if (norm_data)
-            {
-                raw_normals.resize(numVerts * 3);
-                std::memcpy(raw_normals.data(), norm_data->buffer.get(), sizeof(float) * numVerts * 3);
-            }
+void LinSSScatter::update_postprocess_mode()
+{
+    if (subpass_merge.mode == subpass_merge.active_mode)
+    {
+        return;
+    }
 
-            if (uv_data)
-            {
-                raw_uv.resize(numVerts * 2);
-                std::memcpy(raw_uv.data(), uv_data->buffer.get(), sizeof(float) * numVerts * 2);
-            }
+    // Render targets are created again (queue is idle after "draw"), since merged subpasses need no deferred
+    // color and depth in the frame graph. Both pipelines of the swapchain pass are kept.
+    destroy_custom_framebuffers();
 
-            const size_t          numFaces = face_data->count;
-            std::vector<uint32_t> raw_indices(numFaces * 3);
-            std::memcpy(raw_indices.data(), face_data->buffer.get(), sizeof(uint32_t) * numFaces * 3);
+    subpass_merge.active_mode = subpass_merge.mode;
+    setup_custom_framebuffers();
 
-            for (uint32_t i : raw_indices)
-            {
-                glm::vec3 pos, normal;
-                glm::vec2 uv;
+    invalidate_irradiance_cache();
+    invalidate_shadow_cache();
+    clear_tsm_accumulation();
+    build_command_buffers();
+}
 
-                if (vert_data)
-                {
-                    pos = glm::vec3(raw_vertices[i * 3 + 0], raw_vertices[i * 3 + 1], raw_vertices[i * 3 + 2]);
-                    uv  = glm::vec2(pos.x, pos.y) * 0.5f + 0.5f;        // TODO: uv is simply computed from vertex position.
-                }
+void LinSSScatter::fetch_timestamp_queries()
+{
+    const uint32_t mip_levels = gauss_filter_timer.mip_levels;
+    if (!gauss_filter_timer.query_pool || mip_levels == 0 || irradiance_cache.reuse)
+    {
+        return;
+    }
 
-                if (norm_data)
-                {
-                    normal = glm::vec3(raw_normals[i * 3 + 0], raw_normals[i * 3 + 1], raw_normals[i * 3 + 2]);
-                }
+    // Single-pass pyramid only writes the first and the last timestamps
+    const int      mode        = gauss_filter_timer.mode;
+    const uint32_t first_query = current_buffer * gauss_filter_timer.queries_per_frame;
+    const uint32_t num_queries = mode == GaussFilterMode::SinglePass ? 1 : mip_levels;
+
+    std::vector<uint64_t> timestamps(mip_levels);
+    VkResult              result = gauss_filter_timer.query_pool->get_results(
+        first_query,
+        num_queries,
+        sizeof(uint64_t) * num_queries,
+        timestamps.data(),
+        sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT);
+    if (result == VK_SUCCESS && mode == GaussFilterMode::SinglePass)
+    {
+        result = gauss_filter_timer.query_pool->get_results(
+            first_query + mip_levels - 1,
+            1,
+            sizeof(uint64_t),
+            &timestamps[mip_levels - 1],
+            sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT);
+    }
+    if (result != VK_SUCCESS)
+    {
+        return;
+    }
 
-                LinSSScatterVertexStructure vtx(pos, uv, normal);
-                if (uniqueVertices.count(vtx) == 0)
-                {
-                    uniqueVertices[vtx] = static_cast<uint32_t>(vertices.size());
-                    vertices.push_back(vtx);
-                }
-                indices.push_back(uniqueVertices[vtx]);
-            }
-        }
-        catch (const std::exception &e)
+    // Exponential moving average of elapsed time
+    const float to_ms = gauss_filter_timer.timestamp_period * 1.0e-6f;
+    if (mode != GaussFilterMode::SinglePass)
+    {
+        // Level 1 starts after the setup (clearing of the levels for tile lists)
+        uint64_t setup_end = timestamps[0];
+        result             = gauss_filter_timer.query_pool->get_results(
+            first_query + MAX_MIP_LEVELS + 2,
+            1,
+            sizeof(uint64_t),
+            &setup_end,
+            sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT);
+        if (result != VK_SUCCESS)
         {
-            std::cerr << "Caught tinyply exception: " << e.what() << std::endl;
+            return;
         }
 
-        // Create vertex/index buffers
-        model.index_count       = static_cast<uint32_t>(indices.size());
-        auto vertex_buffer_size = vkb::to_u32(vertices.size() * sizeof(LinSSScatterVertexStructure));
-        auto index_buffer_size  = vkb::to_u32(indices.size() * sizeof(uint32_t));
-
-        // Create buffers
-        // For the sake of simplicity we won't stage the vertex data to the gpu memory
-        // Vertex buffer
-        model.vertex_buffer = std::make_unique<vkb::core::Buffer>(get_device(),
-                                                                  vertex_buffer_size,
-                                                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                                                                  VMA_MEMORY_USAGE_CPU_TO_GPU);
-        model.vertex_buffer->update(vertices.data(), vertex_buffer_size);
+        const float setup_ms              = static_cast<float>(setup_end - timestamps[0]) * to_ms;
+        gauss_filter_timer.setup_ms[mode] = gauss_filter_timer.setup_ms[mode] * 0.95f + setup_ms * 0.05f;
 
-        model.index_buffer = std::make_unique<vkb::core::Buffer>(get_device(),
-                                                                 index_buffer_size,
-                                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                                                                 VMA_MEMORY_USAGE_CPU_TO_GPU);
-        model.index_buffer->update(indices.data(), index_buffer_size);
+        std::vector<float> &level_ms = gauss_filter_timer.level_ms[mode];
+        for (uint32_t i = 1; i < mip_levels; i++)
+        {
+            const uint64_t start      = i == 1 ? setup_end : timestamps[i - 1];
+            const float    elapsed_ms = static_cast<float>(timestamps[i] - start) * to_ms;
+            level_ms[i]               = level_ms[i] * 0.95f + elapsed_ms * 0.05f;
+        }
     }
-}
 
-void LinSSScatter::prepare_primitive_objects()
-{
-    // Rect
+    const float total_ms              = static_cast<float>(timestamps[mip_levels - 1] - timestamps[0]) * to_ms;
+    gauss_filter_timer.total_ms[mode] = gauss_filter_timer.total_ms[mode] * 0.95f + total_ms * 0.05f;
+
+    // LinSSS accumulation
+    std::array<uint64_t, 2> linsss_timestamps;
+    result = gauss_filter_timer.query_pool->get_results(
+        first_query + MAX_MIP_LEVELS,
+        2,
+        sizeof(uint64_t) * 2,
+        linsss_timestamps.data(),
+        sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS)
     {
-        static const float rect_vertices[4][3] = {
-            {-1.0f, -1.0f, 0.0f},
-            {-1.0f, 1.0f, 0.0f},
-            {1.0f, -1.0f, 0.0f},
-            {1.0f, 1.0f, 0.0f}};
+        return;
+    }
 
-        static const uint32_t rect_indices[2][3] = {
-            {0, 3, 1},
-            {0, 2, 3}};
+    const float linsss_ms                        = static_cast<float>(linsss_timestamps[1] - linsss_timestamps[0]) * to_ms;
+    gauss_filter_timer.linsss_ms[pyramid_layout] = gauss_filter_timer.linsss_ms[pyramid_layout] * 0.95f + linsss_ms * 0.05f;
 
-        rect.index_count            = 2 * 3;
-        uint32_t vertex_buffer_size = sizeof(float) * 4 * 3;
-        uint32_t index_buffer_size  = sizeof(uint32_t) * 2 * 3;
+    update_workgroup_tuner(total_ms, linsss_ms);
+}
 
-        rect.vertex_buffer = std::make_unique<vkb::core::Buffer>(get_device(),
-                                                                 vertex_buffer_size,
-                                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                                                                 VMA_MEMORY_USAGE_CPU_TO_GPU);
-        rect.vertex_buffer->update((uint8_t *) &rect_vertices[0][0], vertex_buffer_size);
+std::string LinSSScatter::workgroup_sizes_filename()
+{
+    // Best workgroup sizes depend on both the device and the driver. The pipeline cache UUID,
+    // which also changes with the driver, is used if the device UUID cannot be queried.
+    const auto &gpu        = get_device().get_gpu();
+    const auto &properties = gpu.get_properties();
+
+    VkPhysicalDeviceIDPropertiesKHR id_properties = {};
+    id_properties.sType                           = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES_KHR;
+    const uint8_t *device_uuid                    = properties.pipelineCacheUUID;
+    if (gpu.get_instance().is_enabled(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) &&
+        gpu.get_instance().is_enabled(VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME))
+    {
+        VkPhysicalDeviceProperties2KHR properties2 = {};
+        properties2.sType                          = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+        properties2.pNext                          = &id_properties;
+        vkGetPhysicalDeviceProperties2KHR(gpu.get_handle(), &properties2);
+        device_uuid = id_properties.deviceUUID;
+    }
 
-        rect.index_buffer = std::make_unique<vkb::core::Buffer>(get_device(),
-                                                                index_buffer_size,
-                                                                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                                                                VMA_MEMORY_USAGE_CPU_TO_GPU);
-        rect.index_buffer->update((uint8_t *) &rect_indices[0][0], index_buffer_size);
+    std::string uuid;
+    for (uint32_t i = 0; i < VK_UUID_SIZE; i++)
+    {
+        char hex[3];
+        snprintf(hex, sizeof(hex), "%02x", device_uuid[i]);
+        uuid += hex;
     }
+    return "linsss_workgroup_sizes_" + uuid + "_" + std::to_string(properties.driverVersion) + ".bin";
+}
 
-    // Cube
+void LinSSScatter::load_workgroup_sizes()
+{
+    const std::string filename = workgroup_sizes_filename();
+    if (!vkb::fs::is_file(vkb::fs::path::get(vkb::fs::path::Type::Temp) + filename))
     {
-        static const float cube_vertices[8][3] = {
-            {-1.0f, -1.0f, -1.0f},
-            {-1.0f, -1.0f, 1.0f},
-            {-1.0f, 1.0f, -1.0f},
-            {1.0f, -1.0f, -1.0f},
-            {-1.0f, 1.0f, 1.0f},
-            {1.0f, -1.0f, 1.0f},
-            {1.0f, 1.0f, -1.0f},
-            {1.0f, 1.0f, 1.0f}};
+        return;
+    }
 
-        static const uint32_t cube_indices[12][3] = {
-            {0, 6, 2},
-            {0, 3, 6},
-            {1, 7, 5},
-            {1, 4, 7},
-            {0, 4, 1},
-            {0, 2, 4},
-            {3, 7, 6},
-            {3, 5, 7},
-            {0, 5, 3},
-            {0, 1, 5},
-            {2, 7, 4},
-            {2, 6, 7}};
+    std::array<uint32_t, 4> sizes;
+    const auto              data = vkb::fs::read_temp(filename);
+    if (data.size() != sizeof(sizes))
+    {
+        LOGW("Invalid workgroup size file: {}", filename);
+        return;
+    }
+    std::memcpy(sizes.data(), data.data(), sizeof(sizes));
+    if (std::find(sizes.begin(), sizes.end(), 0u) != sizes.end())
+    {
+        LOGW("Invalid workgroup size file: {}", filename);
+        return;
+    }
 
-        cube.index_count            = 12 * 3;
-        uint32_t vertex_buffer_size = sizeof(float) * 8 * 3;
-        uint32_t index_buffer_size  = sizeof(uint32_t) * 12 * 3;
+    workgroup_sizes.gauss_filter = {sizes[0], sizes[1]};
+    workgroup_sizes.linsss       = {sizes[2], sizes[3]};
+    LOGI("Workgroup sizes: gauss filter = {}x{}, linsss = {}x{}", sizes[0], sizes[1], sizes[2], sizes[3]);
+}
 
-        cube.vertex_buffer = std::make_unique<vkb::core::Buffer>(get_device(),
-                                                                 vertex_buffer_size,
-                                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                                                                 VMA_MEMORY_USAGE_CPU_TO_GPU);
-        cube.vertex_buffer->update((uint8_t *) &cube_vertices[0][0], vertex_buffer_size);
+void LinSSScatter::save_workgroup_sizes()
+{
+    const std::array<uint32_t, 4> sizes = {
+        workgroup_sizes.gauss_filter.width,
+        workgroup_sizes.gauss_filter.height,
+        workgroup_sizes.linsss.width,
+        workgroup_sizes.linsss.height};
+
+    std::vector<uint8_t> data(sizeof(sizes));
+    std::memcpy(data.data(), sizes.data(), sizeof(sizes));
+    vkb::fs::write_temp(data, workgroup_sizes_filename());
+}
 
-        cube.index_buffer = std::make_unique<vkb::core::Buffer>(get_device(),
-                                                                index_buffer_size,
-                                                                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                                                                VMA_MEMORY_USAGE_CPU_TO_GPU);
-        cube.index_buffer->update((uint8_t *) &cube_indices[0][0], index_buffer_size);
+void LinSSScatter::apply_workgroup_sizes()
+{
+    // Queue is idle after "submit_frame"
+    for (auto &it : gauss_filter_pipelines)
+    {
+        vkDestroyPipeline(get_device().get_handle(), it.second, nullptr);
     }
+    gauss_filter_pipelines.clear();
+
+    vkDestroyPipeline(get_device().get_handle(), pipelines.linsss, nullptr);
+    pipelines.linsss = create_linsss_pipeline();
+
+    build_command_buffers();
 }
 
-void LinSSScatter::prepare_bssrdf(const std::string &filename)
+void LinSSScatter::start_workgroup_tuning()
 {
-    // Load BSSRDF
-    std::ifstream reader(filename.c_str(), std::ios::in | std::ios::binary);
-    if (reader.fail())
+    if (!gauss_filter_timer.query_pool)
     {
-        LOGE("Failed to open file: {}", filename);
+        LOGW("Workgroup sizes cannot be tuned without timestamp queries.");
+        return;
+    }
+    if (bssrdf.recursive_filter)
+    {
+        LOGW("Workgroup sizes cannot be tuned while the wide BSSRDF profile uses the recursive filter.");
+        return;
     }
 
-    uint32_t area_width, area_height, n_gauss, ksize;
-    reader.read((char *) &area_width, sizeof(uint32_t));
-    reader.read((char *) &area_height, sizeof(uint32_t));
-    reader.read((char *) &n_gauss, sizeof(uint32_t));
-    reader.read((char *) &ksize, sizeof(uint32_t));
-
-    // Load weights
-    auto buffer = std::make_unique<double[]>(n_gauss * 3);
-    auto data_W = std::make_unique<float[]>(area_width * area_height * n_gauss * 4);
-    for (int y = 0; y < area_height; y++)
+    // Candidates supported by the device
+    const VkPhysicalDeviceLimits &limits = get_device().get_gpu().get_properties().limits;
+    workgroup_tuner.candidates.clear();
+    for (const VkExtent2D &size : WORKGROUP_TUNER_CANDIDATES)
     {
-        for (int x = 0; x < area_width; x++)
+        if (size.width <= limits.maxComputeWorkGroupSize[0] &&
+            size.height <= limits.maxComputeWorkGroupSize[1] &&
+            size.width * size.height <= limits.maxComputeWorkGroupInvocations)
         {
-            reader.read((char *) buffer.get(), sizeof(double) * n_gauss * 3);
-            for (int h = 0; h < n_gauss; h++)
-            {
-                const int idx       = (h * area_height + (area_height - y - 1)) * area_width + x;
-                data_W[idx * 4 + 0] = std::max(0.0f, static_cast<float>(buffer[h * 3 + 0]));
-                data_W[idx * 4 + 1] = std::max(0.0f, static_cast<float>(buffer[h * 3 + 1]));
-                data_W[idx * 4 + 2] = std::max(0.0f, static_cast<float>(buffer[h * 3 + 2]));
-                data_W[idx * 4 + 3] = 1.0f;
-            }
+            workgroup_tuner.candidates.push_back(size);
         }
     }
-
-    // Load beta (inverse of sigma)
-    bssrdf.sigmas.resize(n_gauss);
-    reader.read((char *) buffer.get(), sizeof(double) * n_gauss * 3);
-    for (int i = 0; i < n_gauss; i++)
+    if (workgroup_tuner.candidates.empty())
     {
-        const float r       = static_cast<float>(buffer[i * 3 + 0]);
-        const float g       = static_cast<float>(buffer[i * 3 + 1]);
-        const float b       = static_cast<float>(buffer[i * 3 + 2]);
-        const float sigma_r = std::sqrt(1.0f / std::max(1.0e-4f, r));
-        const float sigma_g = std::sqrt(1.0f / std::max(1.0e-4f, g));
-        const float sigma_b = std::sqrt(1.0f / std::max(1.0e-4f, b));
-        bssrdf.sigmas[i]    = glm::vec4(sigma_r, sigma_g, sigma_b, 1.0f);
+        return;
     }
-    bssrdf.width   = area_width;
-    bssrdf.height  = area_height;
-    bssrdf.n_gauss = n_gauss;
-    bssrdf.ksize   = ksize;
 
-    reader.close();
+    workgroup_tuner.active    = true;
+    workgroup_tuner.candidate = 0;
+    workgroup_tuner.frame     = 0;
+    workgroup_tuner.gauss_filter_ms.assign(workgroup_tuner.candidates.size(), 0.0f);
+    workgroup_tuner.linsss_ms.assign(workgroup_tuner.candidates.size(), 0.0f);
+
+    // Only the windowed filter has a tunable workgroup size, and tile lists fix it to the tile size.
+    // The modes are restored in "stop_workgroup_tuning".
+    workgroup_tuner.gauss_filter_mode = gauss_filter_mode;
+    workgroup_tuner.linsss_mode       = linsss_mode;
+    workgroup_tuner.tile_lists        = enable_tile_lists;
+    workgroup_tuner.gauss_filter_size = workgroup_sizes.gauss_filter;
+    workgroup_tuner.linsss_size       = workgroup_sizes.linsss;
+
+    gauss_filter_mode            = GaussFilterMode::Windowed;
+    linsss_mode                  = LinsssMode::Separate;
+    enable_tile_lists            = false;
+    workgroup_sizes.gauss_filter = workgroup_tuner.candidates[0];
+    workgroup_sizes.linsss       = workgroup_tuner.candidates[0];
+    apply_workgroup_sizes();
+}
 
-    // Copy weights
-    auto data_G_ast_W = std::make_unique<float[]>(area_width * area_height * n_gauss * 4);
-    std::memcpy(data_G_ast_W.get(), data_W.get(), sizeof(float) * area_width * area_height * n_gauss * 4);
+void LinSSScatter::update_workgroup_tuner(float gauss_filter_ms, float linsss_ms)
+{
+    if (!workgroup_tuner.active)
+    {
+        return;
+    }
 
-    // Apply Guassian filter to weight maps
-    for (int i = 0; i < n_gauss; i++)
+    // Another filter is used when the BSSRDF or the filter mode is changed during tuning
+    if (gauss_filter_timer.mode != GaussFilterMode::Windowed)
     {
-        gaussBlur(&data_G_ast_W[i * area_width * area_height * 4], bssrdf.sigmas[i], area_width, area_height, 4);
+        LOGW("Workgroup tuning is canceled since the windowed Gaussian filter is not used.");
+        workgroup_sizes.gauss_filter = workgroup_tuner.gauss_filter_size;
+        workgroup_sizes.linsss       = workgroup_tuner.linsss_size;
+        stop_workgroup_tuning();
+        return;
     }
 
-    // 3D texture support in Vulkan is mandatory (in contrast to OpenGL) so no need to check if it's supported
-    VkFormatProperties formatProperties;
-    vkGetPhysicalDeviceFormatProperties(get_device().get_gpu().get_handle(), VK_FORMAT_R32G32B32A32_SFLOAT, &formatProperties);
-    // Check if format supports transfer
-    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_TRANSFER_DST_BIT))
+    // Skip first frames after switching pipelines
+    const uint32_t candidate = workgroup_tuner.candidate;
+    if (workgroup_tuner.frame >= WORKGROUP_TUNER_WARMUP_FRAMES)
     {
-        LOGE("Error: Device does not support flag TRANSFER_DST for selected texture format!");
+        workgroup_tuner.gauss_filter_ms[candidate] += gauss_filter_ms / WORKGROUP_TUNER_MEASURE_FRAMES;
+        workgroup_tuner.linsss_ms[candidate] += linsss_ms / WORKGROUP_TUNER_MEASURE_FRAMES;
+    }
+    workgroup_tuner.frame += 1;
+    if (workgroup_tuner.frame < WORKGROUP_TUNER_WARMUP_FRAMES + WORKGROUP_TUNER_MEASURE_FRAMES)
+    {
+        return;
     }
 
-    // Check if GPU supports requested 3D texture dimensions
-    uint32_t maxImageDimension3D(get_device().get_gpu().get_properties().limits.maxImageDimension3D);
-    if (area_width > maxImageDimension3D || area_height > maxImageDimension3D || n_gauss > maxImageDimension3D)
+    // Next candidate
+    workgroup_tuner.frame = 0;
+    workgroup_tuner.candidate += 1;
+    if (workgroup_tuner.candidate < workgroup_tuner.candidates.size())
     {
-        LOGE("Error: Requested texture dimensions is greater than supported 3D texture dimension!");
+        workgroup_sizes.gauss_filter = workgroup_tuner.candidates[workgroup_tuner.candidate];
+        workgroup_sizes.linsss       = workgroup_tuner.candidates[workgroup_tuner.candidate];
+        apply_workgroup_sizes();
+        return;
     }
 
-    // Prepare staging buffer
-    VkMemoryAllocateInfo memory_allocate_info = vkb::initializers::memory_allocate_info();
-    VkMemoryRequirements memory_requirements  = {};
+    // Pick the fastest ones for each shader
+    const auto &gauss_filter_ms_list = workgroup_tuner.gauss_filter_ms;
+    const auto &linsss_ms_list       = workgroup_tuner.linsss_ms;
+    const auto  best_gauss_filter    = std::min_element(gauss_filter_ms_list.begin(), gauss_filter_ms_list.end()) - gauss_filter_ms_list.begin();
+    const auto  best_linsss          = std::min_element(linsss_ms_list.begin(), linsss_ms_list.end()) - linsss_ms_list.begin();
+    workgroup_sizes.gauss_filter     = workgroup_tuner.candidates[best_gauss_filter];
+    workgroup_sizes.linsss           = workgroup_tuner.candidates[best_linsss];
+    stop_workgroup_tuning();
+    save_workgroup_sizes();
+
+    LOGI("Workgroup sizes: gauss filter = {}x{} ({:.3f} ms), linsss = {}x{} ({:.3f} ms)",
+         workgroup_sizes.gauss_filter.width, workgroup_sizes.gauss_filter.height, gauss_filter_ms_list[best_gauss_filter],
+         workgroup_sizes.linsss.width, workgroup_sizes.linsss.height, linsss_ms_list[best_linsss]);
+}
 
-    VkBuffer       staging_buffer;
-    VkDeviceMemory staging_memory;
+void LinSSScatter::stop_workgroup_tuning()
+{
+    workgroup_tuner.active = false;
+    gauss_filter_mode      = workgroup_tuner.gauss_filter_mode;
+    linsss_mode            = workgroup_tuner.linsss_mode;
+    enable_tile_lists      = workgroup_tuner.tile_lists;
+    apply_workgroup_sizes();
+}
 
-    VkBufferCreateInfo buffer_create_info = vkb::initializers::buffer_create_info();
-    buffer_create_info.size               = area_width * area_height * n_gauss * sizeof(float) * 4;
-    buffer_create_info.usage              = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    buffer_create_info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
-    VK_CHECK(vkCreateBuffer(get_device().get_handle(), &buffer_create_info, nullptr, &staging_buffer));
+void LinSSScatter::update_irradiance_cache()
+{
+    // View (camera and geometry)
+    uint64_t view_hash = HASH_SEED;
+    view_hash          = hash_value(view_hash, ubo_vs);
+    view_hash          = hash_value(view_hash, width);
+    view_hash          = hash_value(view_hash, height);
+    view_hash          = hash_value(view_hash, model.index_buffer->get_handle());
+
+    // Light
+    uint64_t light_hash = HASH_SEED;
+    light_hash          = hash_value(light_hash, ubo_sm_vs);
+    light_hash          = hash_value(light_hash, ubo_fs);
+    light_hash          = hash_value(light_hash, envmap_texture.view);
+
+    // Material (BSSRDF and filter parameters)
+    uint64_t material_hash = HASH_SEED;
+    material_hash          = hash_value(material_hash, ubo_linsss_cs);
+    material_hash          = hash_value(material_hash, push_const_gauss_cs.sigma);
+    material_hash          = hash_value(material_hash, gauss_filter_mode);
+    material_hash          = hash_value(material_hash, pyramid_layout);
+    material_hash          = hash_value(material_hash, linsss_mode);
+    material_hash          = hash_value(material_hash, enable_float16);
+    material_hash          = hash_value(material_hash, bssrdf.view_W);
+    material_hash          = hash_value(material_hash, bssrdf.view_G_ast_W);
+    material_hash          = hash_value(material_hash, bssrdf.recursive_filter);
+    material_hash          = hash_value(material_hash, Ks_texture.view);
+
+    const bool changed = view_hash != irradiance_cache.view_hash ||
+                         light_hash != irradiance_cache.light_hash ||
+                         material_hash != irradiance_cache.material_hash;
+    irradiance_cache.view_hash     = view_hash;
+    irradiance_cache.light_hash    = light_hash;
+    irradiance_cache.material_hash = material_hash;
+
+    // Workgroup size tuning needs timings of every frame
+    if (changed || !irradiance_cache.enabled || workgroup_tuner.active)
+    {
+        irradiance_cache.valid = false;
+    }
 
-    vkGetBufferMemoryRequirements(get_device().get_handle(), staging_buffer, &memory_requirements);
-    memory_allocate_info.allocationSize  = memory_requirements.size;
-    memory_allocate_info.memoryTypeIndex = get_device().get_memory_type(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    VK_CHECK(vkAllocateMemory(get_device().get_handle(), &memory_allocate_info, nullptr, &staging_memory));
-    VK_CHECK(vkBindBufferMemory(get_device().get_handle(), staging_buffer, staging_memory, 0));
+    const bool reuse = irradiance_cache.valid;
+    if (reuse != irradiance_cache.reuse)
+    {
+        irradiance_cache.reuse = reuse;
+        build_command_buffers();
+    }
 
-    // 3D texture for blurred weights
+    // Results are up to date once this frame is submitted
+    irradiance_cache.valid = true;
+    irradiance_cache.total_frames += 1;
+    if (reuse)
     {
-        // Copy CPU data to GPU
-        uint8_t *data;
-        VK_CHECK(vkMapMemory(get_device().get_handle(), staging_memory, 0, memory_requirements.size, 0, (void **) &data));
+        irradiance_cache.skipped_frames += 1;
+    }
+}
 
-        uint32_t texture_size = area_width * area_height * n_gauss * sizeof(float) * 4;
-        std::memcpy(data, data_W.get(), texture_size);
-        vkUnmapMemory(get_device().get_handle(), staging_memory);
+void LinSSScatter::invalidate_irradiance_cache()
+{
+    irradiance_cache.valid = false;
+}
 
-        // Setup buffer copy region
-        VkBufferImageCopy buffer_copy_region               = {};
-        buffer_copy_region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-        buffer_copy_region.imageSubresource.mipLevel       = 0;
-        buffer_copy_region.imageSubresource.baseArrayLayer = 0;
-        buffer_copy_region.imageSubresource.layerCount     = 1;
-        buffer_copy_region.imageExtent.width               = area_width;
-        buffer_copy_region.imageExtent.height              = area_height;
-        buffer_copy_region.imageExtent.depth               = n_gauss;
-        buffer_copy_region.bufferOffset                    = 0;
+void LinSSScatter::update_shadow_cache()
+{
+    // Inputs of the light pass (light and model transforms, mesh and render targets)
+    uint64_t hash = HASH_SEED;
+    hash          = hash_value(hash, ubo_sm_vs);
+    hash          = hash_value(hash, ubo_fs.light_type);
+    hash          = hash_value(hash, model.index_buffer->get_handle());
+    hash          = hash_value(hash, light_pass_targets.active_format);
+
+    if (hash != shadow_cache.hash || !shadow_cache.enabled)
+    {
+        shadow_cache.valid = false;
+    }
+    shadow_cache.hash = hash;
 
-        VkImageCreateInfo image_create_info = vkb::initializers::image_create_info();
-        image_create_info.imageType         = VK_IMAGE_TYPE_3D;
-        image_create_info.format            = VK_FORMAT_R32G32B32A32_SFLOAT;
-        image_create_info.mipLevels         = 1;
-        image_create_info.arrayLayers       = 1;
-        image_create_info.samples           = VK_SAMPLE_COUNT_1_BIT;
-        image_create_info.tiling            = VK_IMAGE_TILING_OPTIMAL;
-        image_create_info.sharingMode       = VK_SHARING_MODE_EXCLUSIVE;
-        image_create_info.initialLayout     = VK_IMAGE_LAYOUT_UNDEFINED;
-        image_create_info.extent            = {area_width, area_height, n_gauss};
-        image_create_info.usage             = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-        VK_CHECK(vkCreateImage(get_device().get_handle(), &image_create_info, nullptr, &bssrdf.image_W));
+    const bool reuse = shadow_cache.valid;
+    if (reuse != shadow_cache.reuse)
+    {
+        shadow_cache.reuse = reuse;
+        build_command_buffers();
+    }
 
-        vkGetImageMemoryRequirements(get_device().get_handle(), bssrdf.image_W, &memory_requirements);
-        memory_allocate_info.allocationSize  = memory_requirements.size;
-        memory_allocate_info.memoryTypeIndex = get_device().get_memory_type(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        VK_CHECK(vkAllocateMemory(get_device().get_handle(), &memory_allocate_info, nullptr, &bssrdf.device_memory_W));
-        VK_CHECK(vkBindImageMemory(get_device().get_handle(), bssrdf.image_W, bssrdf.device_memory_W, 0));
+    // Light pass is recorded only while irradiance is not reused
+    if (!irradiance_cache.reuse)
+    {
+        shadow_cache.valid = true;
+        if (!reuse)
+        {
+            shadow_cache.total_updates += 1;
+            shadow_cache.window_updates += 1;
+        }
+    }
 
-        VkCommandBuffer copy_command = device->create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    // Updates per second (see "render")
+    if (shadow_cache.window_seconds >= 1.0f)
+    {
+        shadow_cache.updates_per_second = shadow_cache.window_updates / shadow_cache.window_seconds;
+        shadow_cache.window_updates     = 0;
+        shadow_cache.window_seconds     = 0.0f;
+    }
+}
 
-        vkb::insert_image_memory_barrier(
-            copy_command,
-            bssrdf.image_W,
-            0,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_PIPELINE_STAGE_HOST_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+void LinSSScatter::invalidate_shadow_cache()
+{
+    shadow_cache.valid = false;
+}
 
-        vkCmdCopyBufferToImage(
-            copy_command,
-            staging_buffer,
-            bssrdf.image_W,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1,
-            &buffer_copy_region);
+void LinSSScatter::init_placeholder_layouts(const std::vector<VkImage> &images)
+{
+    // 1x1 placeholders of absent render targets stay in the layout of the descriptors that bind them
+    if (images.empty())
+    {
+        return;
+    }
 
+    VkCommandBuffer command_buffer = get_device().create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    for (VkImage image : images)
+    {
         vkb::insert_image_memory_barrier(
-            copy_command,
-            bssrdf.image_W,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
+            command_buffer,
+            image,
+            0,
             VK_ACCESS_SHADER_READ_BIT,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_UNDEFINED,
             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
             {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+    }
+    get_device().flush_command_buffer(command_buffer, queue, true);
+}
 
-        device->flush_command_buffer(copy_command, queue, true);
+void LinSSScatter::read_color_image(const vkb::core::Image &image, VkImageLayout layout, std::vector<glm::vec4> &pixels)
+{
+    // Queue is idle, and the image is left in the given layout (RGBA32F is assumed)
+    const VkExtent3D   extent = image.get_extent();
+    const VkDeviceSize size   = static_cast<VkDeviceSize>(extent.width) * extent.height * sizeof(glm::vec4);
 
-        // Image view
-        VkImageViewCreateInfo view_create_info           = vkb::initializers::image_view_create_info();
-        view_create_info.image                           = bssrdf.image_W;
-        view_create_info.viewType                        = VK_IMAGE_VIEW_TYPE_3D;
-        view_create_info.format                          = VK_FORMAT_R32G32B32A32_SFLOAT;
-        view_create_info.components                      = {VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A};
-        view_create_info.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-        view_create_info.subresourceRange.baseMipLevel   = 0;
-        view_create_info.subresourceRange.levelCount     = 1;
-        view_create_info.subresourceRange.baseArrayLayer = 0;
-        view_create_info.subresourceRange.layerCount     = 1;
-        VK_CHECK(vkCreateImageView(get_device().get_handle(), &view_create_info, nullptr, &bssrdf.view_W));
+    vkb::core::Buffer staging_buffer{get_device(), size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU};
+
+    VkCommandBuffer command_buffer = get_device().create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    vkb::insert_image_memory_barrier(
+        command_buffer,
+        image.get_handle(),
+        VK_ACCESS_MEMORY_WRITE_BIT,
+        VK_ACCESS_TRANSFER_READ_BIT,
+        layout,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+    VkBufferImageCopy copy_region = {};
+    copy_region.imageSubresource  = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    copy_region.imageExtent       = extent;
+    vkCmdCopyImageToBuffer(command_buffer, image.get_handle(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, staging_buffer.get_handle(), 1, &copy_region);
+
+    vkb::insert_image_memory_barrier(
+        command_buffer,
+        image.get_handle(),
+        VK_ACCESS_TRANSFER_READ_BIT,
+        VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        layout,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+    get_device().flush_command_buffer(command_buffer, queue, true);
+
+    pixels.resize(static_cast<size_t>(extent.width) * extent.height);
+    vmaInvalidateAllocation(get_device().get_memory_allocator(), staging_buffer.get_allocation(), 0, VK_WHOLE_SIZE);
+    std::memcpy(pixels.data(), staging_buffer.map(), size);
+    staging_buffer.unmap();
+}
+
+void LinSSScatter::start_float16_error_measurement()
+{
+    // The reference is rendered with 32-bit floats in the next frame, and then the half-precision path
+    float16_error.stage        = 1;
+    float16_error.restore      = enable_float16;
+    float16_error.restore_mode = linsss_mode;
+    float16_error.valid        = false;
+    linsss_mode                = LinsssMode::Separate;
+    enable_float16             = false;
+    apply_workgroup_sizes();
+}
+
+void LinSSScatter::update_float16_error_measurement()
+{
+    if (float16_error.stage == 0)
+    {
+        return;
     }
 
-    // 3D texture for blurred weights
+    if (float16_error.stage == 1)
     {
-        // Copy CPU data to GPU
-        uint8_t *data;
-        VK_CHECK(vkMapMemory(get_device().get_handle(), staging_memory, 0, memory_requirements.size, 0, (void **) &data));
+        read_color_image(fbos.linsss.images[0], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, float16_error.reference);
+        float16_error.stage = 2;
+        enable_float16      = true;
+        apply_workgroup_sizes();
+        return;
+    }
 
-        uint32_t texture_size = area_width * area_height * n_gauss * sizeof(float) * 4;
-        std::memcpy(data, data_G_ast_W.get(), texture_size);
-        vkUnmapMemory(get_device().get_handle(), staging_memory);
+    std::vector<glm::vec4> pixels;
+    read_color_image(fbos.linsss.images[0], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, pixels);
 
-        // Setup buffer copy region
-        VkBufferImageCopy buffer_copy_region               = {};
-        buffer_copy_region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-        buffer_copy_region.imageSubresource.mipLevel       = 0;
-        buffer_copy_region.imageSubresource.baseArrayLayer = 0;
-        buffer_copy_region.imageSubresource.layerCount     = 1;
-        buffer_copy_region.imageExtent.width               = area_width;
-        buffer_copy_region.imageExtent.height              = area_height;
-        buffer_copy_region.imageExtent.depth               = n_gauss;
-        buffer_copy_region.bufferOffset                    = 0;
+    // Relative errors are averaged over the pixels lit by subsurface scattering
+    float  max_abs_error  = 0.0f;
+    double sum_rel_error  = 0.0;
+    size_t num_lit_pixels = 0;
+    for (size_t i = 0; i < pixels.size() && i < float16_error.reference.size(); i++)
+    {
+        const glm::vec3 reference = glm::vec3(float16_error.reference[i]);
+        const glm::vec3 error     = glm::abs(glm::vec3(pixels[i]) - reference);
+        max_abs_error             = std::max(max_abs_error, std::max(error.x, std::max(error.y, error.z)));
 
-        VkImageCreateInfo image_create_info = vkb::initializers::image_create_info();
-        image_create_info.imageType         = VK_IMAGE_TYPE_3D;
-        image_create_info.format            = VK_FORMAT_R32G32B32A32_SFLOAT;
-        image_create_info.mipLevels         = 1;
-        image_create_info.arrayLayers       = 1;
-        image_create_info.samples           = VK_SAMPLE_COUNT_1_BIT;
-        image_create_info.tiling            = VK_IMAGE_TILING_OPTIMAL;
-        image_create_info.sharingMode       = VK_SHARING_MODE_EXCLUSIVE;
-        image_create_info.initialLayout     = VK_IMAGE_LAYOUT_UNDEFINED;
-        image_create_info.extent            = {area_width, area_height, n_gauss};
-        image_create_info.usage             = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-        VK_CHECK(vkCreateImage(get_device().get_handle(), &image_create_info, nullptr, &bssrdf.image_G_ast_W));
+        const float luminance = reference.x + reference.y + reference.z;
+        if (luminance > 1.0e-4f)
+        {
+            sum_rel_error += (error.x + error.y + error.z) / luminance;
+            num_lit_pixels += 1;
+        }
+    }
 
-        vkGetImageMemoryRequirements(get_device().get_handle(), bssrdf.image_G_ast_W, &memory_requirements);
-        memory_allocate_info.allocationSize  = memory_requirements.size;
-        memory_allocate_info.memoryTypeIndex = get_device().get_memory_type(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        VK_CHECK(vkAllocateMemory(get_device().get_handle(), &memory_allocate_info, nullptr, &bssrdf.device_memory_G_ast_W));
-        VK_CHECK(vkBindImageMemory(get_device().get_handle(), bssrdf.image_G_ast_W, bssrdf.device_memory_G_ast_W, 0));
+    float16_error.max_abs_error  = max_abs_error;
+    float16_error.mean_rel_error = num_lit_pixels > 0 ? static_cast<float>(100.0 * sum_rel_error / num_lit_pixels) : 0.0f;
+    float16_error.valid          = true;
+    float16_error.stage          = 0;
+    float16_error.reference.clear();
 
-        VkCommandBuffer copy_command = device->create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    enable_float16 = float16_error.restore;
+    linsss_mode    = float16_error.restore_mode;
+    apply_workgroup_sizes();
 
-        vkb::insert_image_memory_barrier(
-            copy_command,
-            bssrdf.image_G_ast_W,
-            0,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_PIPELINE_STAGE_HOST_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+    LOGI("Half precision error against 32-bit floats: max {:.3e}, mean {:.3f}% ({} pixels)",
+         float16_error.max_abs_error, float16_error.mean_rel_error, num_lit_pixels);
+}
 
-        vkCmdCopyBufferToImage(
-            copy_command,
-            staging_buffer,
-            bssrdf.image_G_ast_W,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1,
-            &buffer_copy_region);
+void LinSSScatter::start_shadow_filter_measurement()
+{
+    // Shadows are cast only by the point light
+    if (ubo_fs.light_type != LightType::Point)
+    {
+        LOGW("Shadow filter error is measured only with the point light.");
+        return;
+    }
 
-        vkb::insert_image_memory_barrier(
-            copy_command,
-            bssrdf.image_G_ast_W,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            VK_ACCESS_SHADER_READ_BIT,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+    // Specular is read back as RGBA32F
+    if (gbuffer_targets.active_profile != GBufferProfile::Float32)
+    {
+        LOGW("Shadow filter error is measured only with the RGBA32F G-buffer.");
+        return;
+    }
 
-        device->flush_command_buffer(copy_command, queue, true);
+    // The reference is rendered in the next frame, and then each filter (only the filter mode of the UBO changes)
+    shadow_pcf.stage     = 1;
+    shadow_pcf.restore   = ubo_fs.shadow_filter;
+    shadow_pcf.valid     = false;
+    ubo_fs.shadow_filter = ShadowFilter::Reference;
+    update_ubo_fs();
+}
 
-        // Image view
-        VkImageViewCreateInfo view_create_info           = vkb::initializers::image_view_create_info();
-        view_create_info.image                           = bssrdf.image_G_ast_W;
-        view_create_info.viewType                        = VK_IMAGE_VIEW_TYPE_3D;
-        view_create_info.format                          = VK_FORMAT_R32G32B32A32_SFLOAT;
-        view_create_info.components                      = {VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A};
-        view_create_info.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-        view_create_info.subresourceRange.baseMipLevel   = 0;
-        view_create_info.subresourceRange.levelCount     = 1;
-        view_create_info.subresourceRange.baseArrayLayer = 0;
-        view_create_info.subresourceRange.layerCount     = 1;
-        VK_CHECK(vkCreateImageView(get_device().get_handle(), &view_create_info, nullptr, &bssrdf.view_G_ast_W));
+void LinSSScatter::update_shadow_filter_measurement()
+{
+    if (shadow_pcf.stage == 0)
+    {
+        return;
     }
 
-    // Clean up staging resources
-    vkFreeMemory(get_device().get_handle(), staging_memory, nullptr);
-    vkDestroyBuffer(get_device().get_handle(), staging_buffer, nullptr);
+    // Measurement is dropped when the G-buffer profile changes in the middle
+    if (gbuffer_targets.active_profile != GBufferProfile::Float32)
+    {
+        shadow_pcf.stage     = 0;
+        ubo_fs.shadow_filter = shadow_pcf.restore;
+        update_ubo_fs();
+        return;
+    }
 
-    // Sampler
-    VkSamplerCreateInfo sampler_create_info = vkb::initializers::sampler_create_info();
-    sampler_create_info.magFilter           = VK_FILTER_LINEAR;
-    sampler_create_info.minFilter           = VK_FILTER_LINEAR;
-    sampler_create_info.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-    sampler_create_info.addressModeU        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    sampler_create_info.addressModeV        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    sampler_create_info.addressModeW        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    sampler_create_info.mipLodBias          = 0.0f;
-    sampler_create_info.compareOp           = VK_COMPARE_OP_NEVER;
-    sampler_create_info.minLod              = 0.0f;
-    sampler_create_info.maxLod              = 1.0f;
-    sampler_create_info.borderColor         = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-    if (get_device().get_gpu().get_features().samplerAnisotropy)
+    // Specular of the direct pass is proportional to the visibility, and is left in the shader-read layout
+    const vkb::core::Image &image = fbos.direct_pass.images[1];
+    if (shadow_pcf.stage == 1)
     {
-        // Use max. level of anisotropy for this example
-        sampler_create_info.maxAnisotropy    = get_device().get_gpu().get_properties().limits.maxSamplerAnisotropy;
-        sampler_create_info.anisotropyEnable = VK_TRUE;
+        read_color_image(image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, shadow_pcf.reference);
+        shadow_pcf.stage     = 2;
+        ubo_fs.shadow_filter = ShadowFilter::Jittered;
+        update_ubo_fs();
+        return;
     }
-    else
+
+    std::vector<glm::vec4> pixels;
+    read_color_image(image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, pixels);
+
+    // Relative L1 error over the image, so that wrongly lit and wrongly shadowed pixels are both counted
+    double sum_error     = 0.0;
+    double sum_reference = 0.0;
+    for (size_t i = 0; i < pixels.size() && i < shadow_pcf.reference.size(); i++)
     {
-        // The device does not support anisotropic filtering
-        sampler_create_info.maxAnisotropy    = 1.0;
-        sampler_create_info.anisotropyEnable = VK_FALSE;
+        const glm::vec3 reference = glm::vec3(shadow_pcf.reference[i]);
+        const glm::vec3 error     = glm::abs(glm::vec3(pixels[i]) - reference);
+        sum_error += error.x + error.y + error.z;
+        sum_reference += reference.x + reference.y + reference.z;
     }
-    VK_CHECK(vkCreateSampler(device->get_handle(), &sampler_create_info, nullptr, &bssrdf.sampler));
 
-    // Print information
-    for (int i = 0; i < bssrdf.n_gauss; i++)
+    const int filter             = shadow_pcf.stage - 2;
+    shadow_pcf.rel_error[filter] = sum_reference > 0.0 ? static_cast<float>(100.0 * sum_error / sum_reference) : 0.0f;
+
+    if (shadow_pcf.stage == 2)
     {
-        LOGI("BSSRDF sigma[{}]: {}", vkb::to_string(i), glm::to_string(bssrdf.sigmas[i]));
+        shadow_pcf.stage     = 3;
+        ubo_fs.shadow_filter = ShadowFilter::HardwarePCF;
+        update_ubo_fs();
+        return;
     }
+
+    shadow_pcf.valid     = true;
+    shadow_pcf.stage     = 0;
+    ubo_fs.shadow_filter = shadow_pcf.restore;
+    update_ubo_fs();
+    shadow_pcf.reference.clear();
+
+    LOGI("Shadow filter error against the reference: jittered {:.3f}%, hardware PCF {:.3f}%",
+         shadow_pcf.rel_error[0], shadow_pcf.rel_error[1]);
+    LOGI("Direct pass: jittered {:.3f} ms, hardware PCF {:.3f} ms, reference {:.3f} ms",
+         shadow_pcf.ms[0], shadow_pcf.ms[1], shadow_pcf.ms[2]);
 }
 
-void LinSSScatter::setup_descriptor_set_layout()
+void LinSSScatter::start_tsm_convergence_measurement()
 {
-    // Light pass
+    // Reference is accumulated with importance sampled white noise, then each scheme starts from scratch
+    tsm_convergence.stage             = 1;
+    tsm_convergence.frame             = 0;
+    tsm_convergence.sampling          = tsm_sampling;
+    tsm_convergence.radius_importance = tsm_radius_importance;
+    tsm_convergence.valid             = false;
+    tsm_convergence.rmse[0].clear();
+    tsm_convergence.rmse[1].clear();
+
+    enable_tsm            = true;
+    tsm_sampling          = TSMSampling::WhiteNoise;
+    tsm_radius_importance = true;
+    clear_tsm_accumulation();
+    build_command_buffers();
+}
+
+void LinSSScatter::update_tsm_convergence_measurement()
+{
+    if (tsm_convergence.stage == 0)
     {
-        std::vector<VkDescriptorSetLayoutBinding> set_layout_bindings =
-            {
-                // Binding 0 : Vertex shader uniform buffer
+        return;
+    }
+
+    // The frame is accumulated into the "pong" image of the current command buffer
+    tsm_convergence.frame += 1;
+    const vkb::core::Image &image = fbos.trans_sm[1 - current_buffer % 2].images[0];
+
+    if (tsm_convergence.stage == 1)
+    {
+        if (tsm_convergence.frame < TSM_REFERENCE_FRAMES)
+        {
+            return;
+        }
+
+        read_color_image(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, tsm_convergence.reference);
+        tsm_convergence.stage = 2;
+        tsm_convergence.frame = 0;
+        tsm_sampling          = TSMSampling::WhiteNoise;
+        tsm_radius_importance = false;
+        clear_tsm_accumulation();
+        return;
+    }
+
+    // RMSE of the sample mean (alpha is one plus the number of frames)
+    std::vector<glm::vec4> pixels;
+    read_color_image(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, pixels);
+
+    const VkExtent2D  tsm_extent        = tsm_render_extent();
+    const VkExtent3D &tsm_max           = image.get_extent();
+    double            sum_squared_error = 0.0;
+    uint32_t          num_lit_pixels    = 0;
+    for (size_t i = 0; i < pixels.size() && i < tsm_convergence.reference.size(); i++)
+    {
+        // Texels outside the render area keep stale values (see "clear_tsm_accumulation")
+        const glm::vec4 &reference = tsm_convergence.reference[i];
+        if (i % tsm_max.width >= tsm_extent.width || i / tsm_max.width >= tsm_extent.height ||
+            reference.x + reference.y + reference.z <= 0.0f)
+        {
+            continue;
+        }
+
+        const glm::vec3 error = glm::vec3(pixels[i]) / std::max(pixels[i].w - 1.0f, 1.0f) -
+                                glm::vec3(reference) / std::max(reference.w - 1.0f, 1.0f);
+        sum_squared_error += glm::dot(error, error) / 3.0f;
+        num_lit_pixels += 1;
+    }
+
+    const int scheme = tsm_convergence.stage - 2;
+    tsm_convergence.rmse[scheme].push_back(num_lit_pixels > 0 ? static_cast<float>(std::sqrt(sum_squared_error / num_lit_pixels)) : 0.0f);
+    if (tsm_convergence.frame < TSM_CONVERGENCE_FRAMES)
+    {
+        return;
+    }
+
+    if (tsm_convergence.stage == 2)
+    {
+        tsm_convergence.stage = 3;
+        tsm_convergence.frame = 0;
+        tsm_sampling          = TSMSampling::LowDiscrepancy;
+        tsm_radius_importance = true;
+        clear_tsm_accumulation();
+        return;
+    }
+
+    // Frames for each scheme to reach the final RMSE of white noise (TSM_CONVERGENCE_FRAMES + 1 if not reached)
+    tsm_convergence.target_rmse = tsm_convergence.rmse[0].back();
+    for (int k = 0; k < 2; k++)
+    {
+        const auto &rmse          = tsm_convergence.rmse[k];
+        const auto  it            = std::find_if(rmse.begin(), rmse.end(), [&](float e) { return e <= tsm_convergence.target_rmse; });
+        tsm_convergence.frames[k] = static_cast<uint32_t>(it - rmse.begin()) + 1;
+    }
+    tsm_convergence.valid = true;
+    tsm_convergence.stage = 0;
+    tsm_convergence.reference.clear();
+
+    tsm_sampling          = tsm_convergence.sampling;
+    tsm_radius_importance = tsm_convergence.radius_importance;
+    clear_tsm_accumulation();
+
+    LOGI("TSM frames to reach RMSE {:.3e}: white noise {}, R2 + IGN {}",
+         tsm_convergence.target_rmse, tsm_convergence.frames[0], tsm_convergence.frames[1]);
+}
+
+void LinSSScatter::linsss_accumulate_compute(VkCommandBuffer command_buffer, uint32_t first_query)
+{
+    // Fused mode only makes the pyramid visible to deferred shading
+    if (linsss_mode == LinsssMode::Fused)
+    {
+        VkImage pyramid_image = G_ast_Phi_texture.image;
+        if (gauss_pyramid_split_compute(command_buffer))
+        {
+            pyramid_image = fbos.gauss_pyramid_split.images[0].get_handle();
+        }
+
+        vkb::insert_image_memory_barrier(
+            command_buffer,
+            pyramid_image,
+            VK_ACCESS_SHADER_WRITE_BIT,
+            VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS});
+        return;
+    }
+
+    // Bind descriptor set
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layouts.linsss, 0, 1, &descriptor_sets.linsss, 0, nullptr);
+
+    // Image memory barrier
+    if (enable_tile_lists)
+    {
+        // Pixels out of the covered tiles are not written
+        const VkClearColorValue       clear_color{{0.0f, 0.0f, 0.0f, 1.0f}};
+        const VkImageSubresourceRange subresource_range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+        vkb::insert_image_memory_barrier(
+            command_buffer,
+            fbos.linsss.images[0].get_handle(),
+            VK_ACCESS_SHADER_READ_BIT,
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_GENERAL,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            subresource_range);
+
+        vkCmdClearColorImage(command_buffer, fbos.linsss.images[0].get_handle(), VK_IMAGE_LAYOUT_GENERAL, &clear_color, 1, &subresource_range);
+
+        vkb::insert_image_memory_barrier(
+            command_buffer,
+            fbos.linsss.images[0].get_handle(),
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_ACCESS_SHADER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_GENERAL,
+            VK_IMAGE_LAYOUT_GENERAL,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            subresource_range);
+    }
+    else
+    {
+        vkb::insert_image_memory_barrier(
+            command_buffer,
+            fbos.linsss.images[0].get_handle(),
+            VK_ACCESS_SHADER_READ_BIT,
+            VK_ACCESS_SHADER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_GENERAL,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+    }
+
+    // Dispatch
+    const VkExtent2D local_size  = linsss_local_size();
+    const uint32_t   num_group_x = (width + local_size.width - 1) / local_size.width;
+    const uint32_t   num_group_y = (height + local_size.height - 1) / local_size.height;
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.linsss);
+
+    VkQueryPool query_pool = gauss_filter_timer.query_pool ? gauss_filter_timer.query_pool->get_handle() : VK_NULL_HANDLE;
+    if (query_pool != VK_NULL_HANDLE)
+    {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, first_query + MAX_MIP_LEVELS);
+    }
+
+    // Split pass is timed together with the accumulation
+    if (gauss_pyramid_split_compute(command_buffer))
+    {
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layouts.linsss, 0, 1, &descriptor_sets.linsss, 0, nullptr);
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.linsss);
+    }
+
+    if (enable_tile_lists)
+    {
+        // Tiles of the base MIP level are listed after the per-tile flags
+        const uint32_t tile_base = tile_lists.total_tiles + tile_lists.level_offsets[0];
+        vkCmdPushConstants(command_buffer, pipeline_layouts.linsss, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &tile_base);
+        vkCmdDispatchIndirect(command_buffer, tile_lists.buffer->get_handle(), 0);
+    }
+    else
+    {
+        vkCmdDispatch(command_buffer, num_group_x, num_group_y, 1);
+    }
+
+    if (query_pool != VK_NULL_HANDLE)
+    {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, query_pool, first_query + MAX_MIP_LEVELS + 1);
+    }
+
+    vkb::insert_image_memory_barrier(
+        command_buffer,
+        fbos.linsss.images[0].get_handle(),
+        VK_ACCESS_SHADER_WRITE_BIT,
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+}
+
+void LinSSScatter::draw_deferred_shading(VkCommandBuffer command_buffer, VkPipeline background_pipeline, VkPipeline object_pipeline, VkPipeline fused_pipeline, const glm::vec2 &tsm_uv_scale)
+{
+    VkDeviceSize offsets[1] = {0};
+
+    // Viewport
+    VkViewport viewport = vkb::initializers::viewport((float) width, (float) height, 0.0f, 1.0f);
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+    // Scissor
+    VkRect2D scissor = vkb::initializers::rect2D(width, height, 0, 0);
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    // Pipeline layout
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.deferred, 0, 1, &descriptor_sets.deferred, 0, nullptr);
+    vkCmdPushConstants(command_buffer, pipeline_layouts.deferred, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(glm::vec2), &tsm_uv_scale);
+
+    // Background
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, background_pipeline);
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, cube.vertex_buffer->get(), offsets);
+    vkCmdBindIndexBuffer(command_buffer, cube.index_buffer->get_handle(), 0, VK_INDEX_TYPE_UINT32);
+    vkCmdDrawIndexed(command_buffer, cube.index_count, 1, 0, 0, 0);
+
+    // Object
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, linsss_mode == LinsssMode::Fused ? fused_pipeline : object_pipeline);
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, model.vertex_buffer->get(), offsets);
+    vkCmdBindIndexBuffer(command_buffer, model.index_buffer->get_handle(), 0, VK_INDEX_TYPE_UINT32);
+    vkCmdDrawIndexed(command_buffer, model.index_count, 1, 0, 0, 0);
+}
+
+void LinSSScatter::draw_postprocess(VkCommandBuffer command_buffer, VkPipeline postprocess_pipeline, VkPipeline ui_pipeline)
+{
+    VkDeviceSize offsets[1] = {0};
+
+    // Viewport
+    VkViewport viewport = vkb::initializers::viewport((float) width, (float) height, 0.0f, 1.0f);
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+    // Scissor
+    VkRect2D scissor = vkb::initializers::rect2D(width, height, 0, 0);
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    // Pipeline layout
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.postprocess, 0, 1, &descriptor_sets.postprocess, 0, nullptr);
+
+    // Draw
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, postprocess_pipeline);
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, rect.vertex_buffer->get(), offsets);
+    vkCmdBindIndexBuffer(command_buffer, rect.index_buffer->get_handle(), 0, VK_INDEX_TYPE_UINT32);
+    vkCmdDrawIndexed(command_buffer, rect.index_count, 1, 0, 0, 0);
+
+    // UI
+    draw_ui(command_buffer, ui_pipeline);
+}
+
+void LinSSScatter::build_command_buffers()
+{
+    // Update descriptor set
+    update_descriptor_set();
+
+    // Build command buffer
+    VkCommandBufferBeginInfo command_buffer_begin_info = vkb::initializers::command_buffer_begin_info();
+
+    // Clear values of the rendered maps followed by depth. Alpha of position is coverage (see "generate_tsm_mipmaps").
+    const std::array<VkFormat, 3> light_formats = light_pass_formats(light_pass_targets.active_format);
+    std::vector<VkClearValue>     light_pass_clear_values;
+    for (uint32_t k = 0; k < light_formats.size(); k++)
+    {
+        if (light_formats[k] != VK_FORMAT_UNDEFINED)
+        {
+            VkClearValue clear_value;
+            clear_value.color = k == 1 ? VkClearColorValue{{0.0f, 0.0f, 0.0f, 0.0f}} : default_clear_color;
+            light_pass_clear_values.push_back(clear_value);
+        }
+    }
+    VkClearValue depth_clear_value;
+    depth_clear_value.depthStencil = {1.0f, 0};
+    light_pass_clear_values.push_back(depth_clear_value);
+
+    VkRenderPassBeginInfo render_light_pass_begin_info    = vkb::initializers::render_pass_begin_info();
+    render_light_pass_begin_info.renderPass               = render_passes.light_pass;
+    render_light_pass_begin_info.renderArea.offset.x      = 0;
+    render_light_pass_begin_info.renderArea.offset.y      = 0;
+    render_light_pass_begin_info.renderArea.extent.width  = SHADOW_MAP_SIZE;
+    render_light_pass_begin_info.renderArea.extent.height = SHADOW_MAP_SIZE;
+    render_light_pass_begin_info.clearValueCount          = static_cast<uint32_t>(light_pass_clear_values.size());
+    render_light_pass_begin_info.pClearValues             = light_pass_clear_values.data();
+
+    // Clear values of the G-buffer targets in use followed by depth
+    const std::array<VkFormat, 5> gbuffer_formats_in_use = gbuffer_formats(gbuffer_targets.active_profile);
+    const bool                    gbuffer_reconstruct    = gbuffer_targets.active_profile != GBufferProfile::Float32;
+    std::vector<VkClearValue>     direct_pass_clear_values;
+    for (VkFormat format : gbuffer_formats_in_use)
+    {
+        if (format != VK_FORMAT_UNDEFINED)
+        {
+            VkClearValue clear_value;
+            clear_value.color = default_clear_color;
+            direct_pass_clear_values.push_back(clear_value);
+        }
+    }
+    direct_pass_clear_values.push_back(depth_clear_value);
+
+    VkRenderPassBeginInfo render_direct_pass_begin_info    = vkb::initializers::render_pass_begin_info();
+    render_direct_pass_begin_info.renderPass               = render_passes.direct_pass;
+    render_direct_pass_begin_info.renderArea.offset.x      = 0;
+    render_direct_pass_begin_info.renderArea.offset.y      = 0;
+    render_direct_pass_begin_info.renderArea.extent.width  = width;
+    render_direct_pass_begin_info.renderArea.extent.height = height;
+    render_direct_pass_begin_info.clearValueCount          = static_cast<uint32_t>(direct_pass_clear_values.size());
+    render_direct_pass_begin_info.pClearValues             = direct_pass_clear_values.data();
+
+    VkClearValue clear_values[2];
+    clear_values[0].color        = default_clear_color;
+    clear_values[1].depthStencil = {1.0f, 0};
+
+    // Swapchain pass of merged subpasses has the transient deferred color between its color and depth (see "setup_render_pass")
+    VkClearValue merged_clear_values[3];
+    merged_clear_values[0].color        = default_clear_color;
+    merged_clear_values[1].color        = default_clear_color;
+    merged_clear_values[2].depthStencil = {1.0f, 0};
+
+    // TSM is rendered into a part of its attachments (see "update_tsm_resolution")
+    const VkExtent2D  tsm_extent   = tsm_render_extent();
+    const VkExtent3D &tsm_max      = fbos.trans_sm[0].images[0].get_extent();
+    const glm::vec2   tsm_uv_scale = glm::vec2(tsm_extent.width, tsm_extent.height) / glm::vec2(tsm_max.width, tsm_max.height);
+    tsm_resolution.timed           = tsm_resolution.query_pool && enable_tsm && !tsm_accumulation.converged;
+
+    VkRenderPassBeginInfo render_tsm_pass_begin_info    = vkb::initializers::render_pass_begin_info();
+    render_tsm_pass_begin_info.renderPass               = render_passes.trans_sm;
+    render_tsm_pass_begin_info.renderArea.offset.x      = 0;
+    render_tsm_pass_begin_info.renderArea.offset.y      = 0;
+    render_tsm_pass_begin_info.renderArea.extent        = tsm_extent;
+    render_tsm_pass_begin_info.clearValueCount          = 2;
+    render_tsm_pass_begin_info.pClearValues             = clear_values;
+
+    VkRenderPassBeginInfo render_deferred_pass_begin_info    = vkb::initializers::render_pass_begin_info();
+    render_deferred_pass_begin_info.renderPass               = render_passes.deferred;
+    render_deferred_pass_begin_info.renderArea.offset.x      = 0;
+    render_deferred_pass_begin_info.renderArea.offset.y      = 0;
+    render_deferred_pass_begin_info.renderArea.extent.width  = width;
+    render_deferred_pass_begin_info.renderArea.extent.height = height;
+    render_deferred_pass_begin_info.clearValueCount          = 2;
+    render_deferred_pass_begin_info.pClearValues             = clear_values;
+
+    VkRenderPassBeginInfo render_postprocess_begin_info    = vkb::initializers::render_pass_begin_info();
+    render_postprocess_begin_info.renderPass               = render_pass;
+    render_postprocess_begin_info.renderArea.offset.x      = 0;
+    render_postprocess_begin_info.renderArea.offset.y      = 0;
+    render_postprocess_begin_info.renderArea.extent.width  = width;
+    render_postprocess_begin_info.renderArea.extent.height = height;
+    render_postprocess_begin_info.clearValueCount          = 2;
+    render_postprocess_begin_info.pClearValues             = clear_values;
+
+    VkRenderPassBeginInfo render_merged_begin_info    = vkb::initializers::render_pass_begin_info();
+    render_merged_begin_info.renderPass               = subpass_merge.render_pass;
+    render_merged_begin_info.renderArea.offset.x      = 0;
+    render_merged_begin_info.renderArea.offset.y      = 0;
+    render_merged_begin_info.renderArea.extent.width  = width;
+    render_merged_begin_info.renderArea.extent.height = height;
+    render_merged_begin_info.clearValueCount          = 3;
+    render_merged_begin_info.pClearValues             = merged_clear_values;
+
+    VkDeviceSize offsets[1] = {0};
+
+    for (int32_t i = 0; i < draw_cmd_buffers.size(); ++i)
+    {
+        // BEGIN
+        VK_CHECK(vkBeginCommandBuffer(draw_cmd_buffers[i], &command_buffer_begin_info));
+        {
+            // Light pass, irradiance pyramid and LinSSS accumulation are reused while the scene is static
+            if (!irradiance_cache.reuse)
+            {
+                // Light pass is skipped while the light, the model transform and the mesh are unchanged
+                if (!shadow_cache.reuse)
+                {
+                    // GPU time of the light pass (see "fetch_light_pass_queries")
+                    VkQueryPool light_pass_query_pool = light_pass_targets.query_pool ? light_pass_targets.query_pool->get_handle() : VK_NULL_HANDLE;
+                    if (light_pass_query_pool != VK_NULL_HANDLE)
+                    {
+                        vkCmdResetQueryPool(draw_cmd_buffers[i], light_pass_query_pool, 2 * i, 2);
+                        vkCmdWriteTimestamp(draw_cmd_buffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, light_pass_query_pool, 2 * i);
+                    }
+
+                    // Begin render pass (light pass)
+                    render_light_pass_begin_info.framebuffer = fbos.shadow_map.fb;
+                    vkCmdBeginRenderPass(draw_cmd_buffers[i], &render_light_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+                    {
+                        // Viewport
+                        VkViewport viewport = vkb::initializers::viewport((float) SHADOW_MAP_SIZE, (float) SHADOW_MAP_SIZE, 0.0f, 1.0f);
+                        vkCmdSetViewport(draw_cmd_buffers[i], 0, 1, &viewport);
+
+                        // Scissor
+                        VkRect2D scissor = vkb::initializers::rect2D(SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 0, 0);
+                        vkCmdSetScissor(draw_cmd_buffers[i], 0, 1, &scissor);
+
+                        // Pipeline layout
+                        vkCmdBindDescriptorSets(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.light_pass, 0, 1, &descriptor_sets.light_pass, 0, nullptr);
+
+                        // Draw
+                        if (ubo_fs.light_type == LightType::Point)
+                        {
+                            vkCmdBindPipeline(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.light_pass);
+                            vkCmdBindVertexBuffers(draw_cmd_buffers[i], 0, 1, model.vertex_buffer->get(), offsets);
+                            vkCmdBindIndexBuffer(draw_cmd_buffers[i], model.index_buffer->get_handle(), 0, VK_INDEX_TYPE_UINT32);
+                            vkCmdDrawIndexed(draw_cmd_buffers[i], model.index_count, 1, 0, 0, 0);
+                        }
+                    }
+                    // End render pass (light pass)
+                    vkCmdEndRenderPass(draw_cmd_buffers[i]);
+
+                    if (light_pass_query_pool != VK_NULL_HANDLE)
+                    {
+                        vkCmdWriteTimestamp(draw_cmd_buffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, light_pass_query_pool, 2 * i + 1);
+                    }
+                }
+
+                // GPU time of the direct pass, i.e., of the shadow filter (see "fetch_direct_pass_queries")
+                VkQueryPool direct_pass_query_pool = shadow_pcf.query_pool ? shadow_pcf.query_pool->get_handle() : VK_NULL_HANDLE;
+                if (direct_pass_query_pool != VK_NULL_HANDLE)
+                {
+                    vkCmdResetQueryPool(draw_cmd_buffers[i], direct_pass_query_pool, 2 * i, 2);
+                    vkCmdWriteTimestamp(draw_cmd_buffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, direct_pass_query_pool, 2 * i);
+                }
+
+                // Begin render pass (direct pass)
+                render_direct_pass_begin_info.framebuffer = fbos.direct_pass.fb;
+                vkCmdBeginRenderPass(draw_cmd_buffers[i], &render_direct_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+                {
+                    // Viewport
+                    VkViewport viewport = vkb::initializers::viewport((float) width, (float) height, 0.0f, 1.0f);
+                    vkCmdSetViewport(draw_cmd_buffers[i], 0, 1, &viewport);
+
+                    // Scissor
+                    VkRect2D scissor = vkb::initializers::rect2D(width, height, 0, 0);
+                    vkCmdSetScissor(draw_cmd_buffers[i], 0, 1, &scissor);
+
+                    // Pipeline layout
+                    vkCmdBindDescriptorSets(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.direct_pass, 0, 1, &descriptor_sets.direct_pass, 0, nullptr);
+
+                    // Draw
+                    vkCmdBindPipeline(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.direct_pass);
+                    vkCmdBindVertexBuffers(draw_cmd_buffers[i], 0, 1, model.vertex_buffer->get(), offsets);
+                    vkCmdBindIndexBuffer(draw_cmd_buffers[i], model.index_buffer->get_handle(), 0, VK_INDEX_TYPE_UINT32);
+                    vkCmdDrawIndexed(draw_cmd_buffers[i], model.index_count, 1, 0, 0, 0);
+                }
+                // End render pass (direct pass)
+                vkCmdEndRenderPass(draw_cmd_buffers[i]);
+
+                if (direct_pass_query_pool != VK_NULL_HANDLE)
+                {
+                    vkCmdWriteTimestamp(draw_cmd_buffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, direct_pass_query_pool, 2 * i + 1);
+                }
+
+                // Generate MIP Map
+                insert_aliasing_barrier(draw_cmd_buffers[i], FramePass::IrradianceMipmap);
+                {
+                    vkb::core::Image &image        = fbos.direct_pass.images[0];
+                    const uint32_t    image_width  = image.get_extent().width;
+                    const uint32_t    image_height = image.get_extent().height;
+                    const uint32_t    mip_levels   = std::ceil(std::log2(std::max(image_width, image_height)));
+                    generate_mipmap(draw_cmd_buffers[i], image.get_handle(), image_width, image_height, image.get_format(), mip_levels);
+                }
+
+                // Light-pass outputs are left in their read-only layouts while they are reused
+                if (!shadow_cache.reuse)
+                {
+                    // MIP levels of irradiance and position for TSM (also changes their layouts)
+                    generate_tsm_mipmaps(draw_cmd_buffers[i]);
+
+                    // Change image layout
+                    if (light_formats[2] != VK_FORMAT_UNDEFINED)
+                    {
+                        vkb::insert_image_memory_barrier(
+                            draw_cmd_buffers[i],
+                            fbos.shadow_map.images[2].get_handle(),
+                            0,
+                            VK_ACCESS_SHADER_READ_BIT,
+                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+                    }
+                }
+
+                vkb::insert_image_memory_barrier(
+                    draw_cmd_buffers[i],
+                    fbos.direct_pass.images[1].get_handle(),
+                    0,
+                    VK_ACCESS_SHADER_READ_BIT,
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+                // Position, normal and linear depth are read by the compute passes (reduced profiles read the depth buffer)
+                for (uint32_t k = 2; k < gbuffer_formats_in_use.size(); k++)
+                {
+                    if (gbuffer_formats_in_use[k] == VK_FORMAT_UNDEFINED)
+                    {
+                        continue;
+                    }
+                    vkb::insert_image_memory_barrier(
+                        draw_cmd_buffers[i],
+                        fbos.direct_pass.images[k].get_handle(),
+                        0,
+                        VK_ACCESS_SHADER_READ_BIT,
+                        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+                }
+
+                if (gbuffer_reconstruct)
+                {
+                    // Layout is already read-only after the render pass, so that only the writes are made visible
+                    vkb::insert_image_memory_barrier(
+                        draw_cmd_buffers[i],
+                        fbos.direct_pass.images[5].get_handle(),
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                        VK_ACCESS_SHADER_READ_BIT,
+                        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                        {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1});
+                }
+
+                // Compute pass (tile classification)
+                if (enable_tile_lists)
+                {
+                    tile_classify_compute(draw_cmd_buffers[i]);
+                }
+
+                // Compute pass (gauss filter)
+                insert_aliasing_barrier(draw_cmd_buffers[i], FramePass::GaussianFilter);
+                {
+                    vkb::core::Image &image        = fbos.direct_pass.images[0];
+                    const uint32_t    image_width  = image.get_extent().width;
+                    const uint32_t    image_height = image.get_extent().height;
+                    const uint32_t    mip_levels   = std::ceil(std::log2(std::max(image_width, image_height)));
+
+                    gauss_filter_timer.mip_levels = std::min(mip_levels, MAX_MIP_LEVELS);
+                    gauss_filter_to_mipmap_compute(draw_cmd_buffers[i], image_width, image_height, mip_levels, i * gauss_filter_timer.queries_per_frame);
+                }
+
+                // Compute pass (linsss accumulate)
+                {
+                    linsss_accumulate_compute(draw_cmd_buffers[i], i * gauss_filter_timer.queries_per_frame);
+                }
+            }
+
+            // Translucent shadow maps (a converged accumulation is kept in "tsm_texture")
+            if (!enable_tsm || !tsm_accumulation.converged)
+            {
+                const int ping_index = i % 2;
+                const int pong_index = 1 - ping_index;
+
+                // When TSM is enabled
+                if (enable_tsm)
+                {
+                    vkb::insert_image_memory_barrier(
+                        draw_cmd_buffers[i],
+                        fbos.trans_sm[ping_index].images[0].get_handle(),
+                        VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_ACCESS_SHADER_READ_BIT,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+                    vkb::insert_image_memory_barrier(
+                        draw_cmd_buffers[i],
+                        fbos.trans_sm[pong_index].images[0].get_handle(),
+                        VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+                    VkQueryPool query_pool = tsm_resolution.timed ? tsm_resolution.query_pool->get_handle() : VK_NULL_HANDLE;
+                    if (query_pool != VK_NULL_HANDLE)
+                    {
+                        vkCmdResetQueryPool(draw_cmd_buffers[i], query_pool, 2 * i, 2);
+                        vkCmdWriteTimestamp(draw_cmd_buffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, 2 * i);
+                    }
+
+                    insert_aliasing_barrier(draw_cmd_buffers[i], FramePass::TSMPass);
+                    render_tsm_pass_begin_info.framebuffer = fbos.trans_sm[pong_index].fb;
+                    vkCmdBeginRenderPass(draw_cmd_buffers[i], &render_tsm_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+                    {
+                        // Viewport
+                        VkViewport viewport = vkb::initializers::viewport((float) tsm_extent.width, (float) tsm_extent.height, 0.0f, 1.0f);
+                        vkCmdSetViewport(draw_cmd_buffers[i], 0, 1, &viewport);
+
+                        // Scissor
+                        VkRect2D scissor = vkb::initializers::rect2D(tsm_extent.width, tsm_extent.height, 0, 0);
+                        vkCmdSetScissor(draw_cmd_buffers[i], 0, 1, &scissor);
+
+                        // Pipeline layout
+                        vkCmdBindDescriptorSets(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.trans_sm, 0, 1, &descriptor_sets.trans_sm[pong_index], 0, nullptr);
+
+                        // Draw
+                        vkCmdBindPipeline(draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, enable_float16 ? pipelines.trans_sm_float16 : pipelines.trans_sm);
+                        vkCmdBindVertexBuffers(draw_cmd_buffers[i], 0, 1, model.vertex_buffer->get(), offsets);
+                        vkCmdBindIndexBuffer(draw_cmd_buffers[i], model.index_buffer->get_handle(), 0, VK_INDEX_TYPE_UINT32);
+                        vkCmdDrawIndexed(draw_cmd_buffers[i], model.index_count, 1, 0, 0, 0);
+                    }
+                    vkCmdEndRenderPass(draw_cmd_buffers[i]);
+
+                    if (query_pool != VK_NULL_HANDLE)
+                    {
+                        vkCmdWriteTimestamp(draw_cmd_buffers[i], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, query_pool, 2 * i + 1);
+                    }
+
+                    vkb::insert_image_memory_barrier(
+                        draw_cmd_buffers[i],
+                        fbos.trans_sm[ping_index].images[0].get_handle(),
+                        VK_ACCESS_SHADER_READ_BIT,
+                        VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+                    vkb::insert_image_memory_barrier(
+                        draw_cmd_buffers[i],
+                        fbos.trans_sm[pong_index].images[0].get_handle(),
+                        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                        VK_ACCESS_TRANSFER_READ_BIT,
+                        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+                }
+                else
+                {
+                    VkClearColorValue       clear_color{{0.0f, 0.0f, 0.0f, 1.0f}};
+                    VkImageSubresourceRange subresource_range{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+                    vkCmdClearColorImage(
+                        draw_cmd_buffers[i],
+                        fbos.trans_sm[pong_index].images[0].get_handle(),
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        &clear_color,
+                        1,
+                        &subresource_range);
+
+                    vkb::insert_image_memory_barrier(
+                        draw_cmd_buffers[i],
+                        fbos.trans_sm[pong_index].images[0].get_handle(),
+                        VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_ACCESS_TRANSFER_READ_BIT,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+                }
+
+                // Copy image to texture
+                {
+                    vkb::insert_image_memory_barrier(
+                        draw_cmd_buffers[i],
+                        tsm_texture.image,
+                        0,
+                        VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_UNDEFINED,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_PIPELINE_STAGE_HOST_BIT,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+                    VkImageCopy image_copy                   = {};
+                    image_copy.extent                        = VkExtent3D{tsm_extent.width, tsm_extent.height, 1};
+                    image_copy.srcOffset                     = {0, 0, 0};
+                    image_copy.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+                    image_copy.srcSubresource.mipLevel       = 0;
+                    image_copy.srcSubresource.baseArrayLayer = 0;
+                    image_copy.srcSubresource.layerCount     = 1;
+                    image_copy.dstOffset                     = {0, 0, 0};
+                    image_copy.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+                    image_copy.dstSubresource.mipLevel       = 0;
+                    image_copy.dstSubresource.baseArrayLayer = 0;
+                    image_copy.dstSubresource.layerCount     = 1;
+
+                    vkCmdCopyImage(
+                        draw_cmd_buffers[i],
+                        fbos.trans_sm[pong_index].images[0].get_handle(),
+                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                        tsm_texture.image,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        1,
+                        &image_copy);
+
+                    vkb::insert_image_memory_barrier(
+                        draw_cmd_buffers[i],
+                        tsm_texture.image,
+                        VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_ACCESS_SHADER_READ_BIT,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+                }
+
+                vkb::insert_image_memory_barrier(
+                    draw_cmd_buffers[i],
+                    fbos.trans_sm[pong_index].images[0].get_handle(),
+                    VK_ACCESS_TRANSFER_READ_BIT,
+                    VK_ACCESS_TRANSFER_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+                // Per-tile errors of the accumulation
+                if (enable_tsm)
+                {
+                    tsm_variance_compute(draw_cmd_buffers[i]);
+                }
+            }
+
+            // Timestamps around deferred shading and postprocess (see "fetch_postprocess_queries")
+            if (subpass_merge.query_pool)
+            {
+                vkCmdResetQueryPool(draw_cmd_buffers[i], subpass_merge.query_pool->get_handle(), 3 * i, 3);
+                vkCmdWriteTimestamp(draw_cmd_buffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, subpass_merge.query_pool->get_handle(), 3 * i);
+            }
+
+            if (subpass_merge.active_mode == PostprocessMode::SeparatePasses)
+            {
+                // Begin render pass (deferred shading)
+                insert_aliasing_barrier(draw_cmd_buffers[i], FramePass::DeferredShading);
+                render_deferred_pass_begin_info.framebuffer = fbos.deferred.fb;
+                vkCmdBeginRenderPass(draw_cmd_buffers[i], &render_deferred_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+                {
+                    draw_deferred_shading(draw_cmd_buffers[i], pipelines.background, pipelines.deferred, pipelines.deferred_fused[pyramid_layout], tsm_uv_scale);
+                }
+                // End render pass (camera pass)
+                vkCmdEndRenderPass(draw_cmd_buffers[i]);
+
+                // Change image layout (color : deferred)
+                vkb::insert_image_memory_barrier(
+                    draw_cmd_buffers[i],
+                    fbos.deferred.images[0].get_handle(),
+                    0,
+                    VK_ACCESS_SHADER_READ_BIT,
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+                if (subpass_merge.query_pool)
+                {
+                    vkCmdWriteTimestamp(draw_cmd_buffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, subpass_merge.query_pool->get_handle(), 3 * i + 1);
+                }
+
+                // Begin render pass (postprocess)
+                render_postprocess_begin_info.framebuffer = framebuffers[i];
+                vkCmdBeginRenderPass(draw_cmd_buffers[i], &render_postprocess_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+                {
+                    draw_postprocess(draw_cmd_buffers[i], pipelines.postprocess, VK_NULL_HANDLE);
+                }
+                // End render pass (postprocess)
+                vkCmdEndRenderPass(draw_cmd_buffers[i]);
+            }
+            else
+            {
+                // Deferred shading and postprocess in a single pass, so the shaded color stays on chip
+                render_merged_begin_info.framebuffer = subpass_merge.framebuffers[i];
+                vkCmdBeginRenderPass(draw_cmd_buffers[i], &render_merged_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+                {
+                    draw_deferred_shading(draw_cmd_buffers[i], pipelines.background_subpass, pipelines.deferred_subpass, pipelines.deferred_fused_subpass[pyramid_layout], tsm_uv_scale);
+                }
+                vkCmdNextSubpass(draw_cmd_buffers[i], VK_SUBPASS_CONTENTS_INLINE);
+                {
+                    draw_postprocess(draw_cmd_buffers[i], pipelines.postprocess_subpass, subpass_merge.ui_pipeline);
+                }
+                // End render pass (postprocess)
+                vkCmdEndRenderPass(draw_cmd_buffers[i]);
+            }
+
+            // Commands of merged subpasses overlap, so that they have no timestamp in between
+            if (subpass_merge.query_pool)
+            {
+                const uint32_t query = subpass_merge.active_mode == PostprocessMode::SeparatePasses ? 3 * i + 2 : 3 * i + 1;
+                vkCmdWriteTimestamp(draw_cmd_buffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, subpass_merge.query_pool->get_handle(), query);
+            }
+        }
+        // END
+        VK_CHECK(vkEndCommandBuffer(draw_cmd_buffers[i]));
+    }
+}
+
+void LinSSScatter::draw()
+{
+    ApiVulkanSample::prepare_frame();
+
+    // Switch command buffers when irradiance or the light pass can (or cannot) be reused
+    update_irradiance_cache();
+    update_shadow_cache();
+
+    // Accumulate TSM sampling. A pending reset is applied by the TSM pass of this frame,
+    // which ignores the previous accumulation, so that the images need not be cleared.
+    ubo_tsm_fs.seed               = glm::vec2(frame_count + (tsm_convergence.stage == 1 ? TSM_REFERENCE_SEED : 0.0f));
+    ubo_tsm_fs.sampling           = tsm_sampling;
+    ubo_tsm_fs.radius_importance  = tsm_radius_importance ? 1 : 0;
+    ubo_tsm_fs.reset              = tsm_reset_pending ? 1 : 0;
+    ubo_tsm_fs.profile_lut        = tsm_profile.enabled ? 1 : 0;
+    ubo_tsm_fs.profile_max_radius = tsm_profile.max_radius;
+    ubo_tsm_fs.mipmaps            = tsm_mipmap.enabled ? 1 : 0;
+    ubo_tsm_fs.mip_bias           = tsm_mipmap.mip_bias;
+    ubo_tsm_fs.pos_from_depth     = light_pass_targets.active_format == LightPassFormat::FullPrecision ? 0 : 1;
+    tsm_reset_pending             = false;
+    uniform_buffer_tsm_fs->convert_and_update(ubo_tsm_fs);
+
+    // Command buffer to be sumitted to the queue
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers    = &draw_cmd_buffers[current_buffer];
+
+    // Submit to queue
+    VK_CHECK(vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE));
+
+    ApiVulkanSample::submit_frame();
+
+    // Queue is idle after "submit_frame"
+    fetch_timestamp_queries();
+    fetch_light_pass_queries();
+    fetch_direct_pass_queries();
+    fetch_postprocess_queries();
+    update_float16_error_measurement();
+    update_shadow_filter_measurement();
+    update_tsm_convergence_measurement();
+    update_tsm_accumulation();
+    update_tsm_resolution();
+}
+
+void LinSSScatter::load_model(const std::string &filename)
+{
+    // Mesh model
+    {
+        // Load .ply file
+        using tinyply::PlyData;
+        using tinyply::PlyFile;
+
+        std::unordered_map<LinSSScatterVertexStructure, uint32_t> uniqueVertices;
+        std::vector<LinSSScatterVertexStructure>                  vertices;
+        std::vector<uint32_t>                                     indices;
+
+        try
+        {
+            // Open
+            std::ifstream reader(filename.c_str(), std::ios::binary);
+            if (reader.fail())
+            {
+                LOGE("Failed to open file: {}", vkb::to_string(filename));
+                abort();
+            }
+
+            // Read header
+            PlyFile file;
+            file.parse_header(reader);
+
+            // Request vertex data
+            std::shared_ptr<PlyData> vert_data, norm_data, uv_data, face_data;
+            try
+            {
+                vert_data = file.request_properties_from_element("vertex", {"x", "y", "z"});
+            }
+            catch (const std::invalid_argument &e)
+            {
+                LOGW("tinyply exception: {}", e.what());
+            }
+
+            try
+            {
+                norm_data = file.request_properties_from_element("vertex", {"nx", "ny", "nz"});
+            }
+            catch (const std::invalid_argument &e)
+            {
+                LOGW("tinyply exception: {}", e.what());
+            }
+
+            try
+            {
+                uv_data = file.request_properties_from_element("vertex", {"u", "v"});
+            }
+            catch (const std::invalid_argument &e)
+            {
+                LOGW("tinyply exception: {}", e.what());
+            }
+
+            try
+            {
+                face_data = file.request_properties_from_element("face", {"vertex_indices"}, 3);
+            }
+            catch (const std::invalid_argument &e)
+            {
+                LOGW("tinyply exception: {}", e.what());
+            }
+
+            // Read vertex data
+            file.read(reader);
+
+            // Copy vertex data
+            const size_t       numVerts = vert_data->count;
+            std::vector<float> raw_vertices, raw_normals, raw_uv;
+            if (vert_data)
+            {
+                raw_vertices.resize(numVerts * 3);
+                std::memcpy(raw_vertices.data(), vert_data->buffer.get(), sizeof(float) * numVerts * 3);
+            }
+
+            if (norm_data)
+            {
+                raw_normals.resize(numVerts * 3);
+                std::memcpy(raw_normals.data(), norm_data->buffer.get(), sizeof(float) * numVerts * 3);
+            }
+
+            if (uv_data)
+            {
+                raw_uv.resize(numVerts * 2);
+                std::memcpy(raw_uv.data(), uv_data->buffer.get(), sizeof(float) * numVerts * 2);
+            }
+
+            const size_t          numFaces = face_data->count;
+            std::vector<uint32_t> raw_indices(numFaces * 3);
+            std::memcpy(raw_indices.data(), face_data->buffer.get(), sizeof(uint32_t) * numFaces * 3);
+
+            for (uint32_t i : raw_indices)
+            {
+                glm::vec3 pos, normal;
+                glm::vec2 uv;
+
+                if (vert_data)
+                {
+                    pos = glm::vec3(raw_vertices[i * 3 + 0], raw_vertices[i * 3 + 1], raw_vertices[i * 3 + 2]);
+                    uv  = glm::vec2(pos.x, pos.y) * 0.5f + 0.5f;        // TODO: uv is simply computed from vertex position.
+                }
+
+                if (norm_data)
+                {
+                    normal = glm::vec3(raw_normals[i * 3 + 0], raw_normals[i * 3 + 1], raw_normals[i * 3 + 2]);
+                }
+
+                LinSSScatterVertexStructure vtx(pos, uv, normal);
+                if (uniqueVertices.count(vtx) == 0)
+                {
+                    uniqueVertices[vtx] = static_cast<uint32_t>(vertices.size());
+                    vertices.push_back(vtx);
+                }
+                indices.push_back(uniqueVertices[vtx]);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Caught tinyply exception: " << e.what() << std::endl;
+        }
+
+        // Create vertex/index buffers
+        model.index_count       = static_cast<uint32_t>(indices.size());
+        auto vertex_buffer_size = vkb::to_u32(vertices.size() * sizeof(LinSSScatterVertexStructure));
+        auto index_buffer_size  = vkb::to_u32(indices.size() * sizeof(uint32_t));
+
+        // Create buffers
+        // For the sake of simplicity we won't stage the vertex data to the gpu memory
+        // Vertex buffer
+        model.vertex_buffer = std::make_unique<vkb::core::Buffer>(get_device(),
+                                                                  vertex_buffer_size,
+                                                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                                                  VMA_MEMORY_USAGE_CPU_TO_GPU);
+        model.vertex_buffer->update(vertices.data(), vertex_buffer_size);
+
+        model.index_buffer = std::make_unique<vkb::core::Buffer>(get_device(),
+                                                                 index_buffer_size,
+                                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                                                                 VMA_MEMORY_USAGE_CPU_TO_GPU);
+        model.index_buffer->update(indices.data(), index_buffer_size);
+    }
+}
+
+void LinSSScatter::prepare_primitive_objects()
+{
+    // Rect
+    {
+        static const float rect_vertices[4][3] = {
+            {-1.0f, -1.0f, 0.0f},
+            {-1.0f, 1.0f, 0.0f},
+            {1.0f, -1.0f, 0.0f},
+            {1.0f, 1.0f, 0.0f}};
+
+        static const uint32_t rect_indices[2][3] = {
+            {0, 3, 1},
+            {0, 2, 3}};
+
+        rect.index_count            = 2 * 3;
+        uint32_t vertex_buffer_size = sizeof(float) * 4 * 3;
+        uint32_t index_buffer_size  = sizeof(uint32_t) * 2 * 3;
+
+        rect.vertex_buffer = std::make_unique<vkb::core::Buffer>(get_device(),
+                                                                 vertex_buffer_size,
+                                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                                                 VMA_MEMORY_USAGE_CPU_TO_GPU);
+        rect.vertex_buffer->update((uint8_t *) &rect_vertices[0][0], vertex_buffer_size);
+
+        rect.index_buffer = std::make_unique<vkb::core::Buffer>(get_device(),
+                                                                index_buffer_size,
+                                                                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                                                                VMA_MEMORY_USAGE_CPU_TO_GPU);
+        rect.index_buffer->update((uint8_t *) &rect_indices[0][0], index_buffer_size);
+    }
+
+    // Cube
+    {
+        static const float cube_vertices[8][3] = {
+            {-1.0f, -1.0f, -1.0f},
+            {-1.0f, -1.0f, 1.0f},
+            {-1.0f, 1.0f, -1.0f},
+            {1.0f, -1.0f, -1.0f},
+            {-1.0f, 1.0f, 1.0f},
+            {1.0f, -1.0f, 1.0f},
+            {1.0f, 1.0f, -1.0f},
+            {1.0f, 1.0f, 1.0f}};
+
+        static const uint32_t cube_indices[12][3] = {
+            {0, 6, 2},
+            {0, 3, 6},
+            {1, 7, 5},
+            {1, 4, 7},
+            {0, 4, 1},
+            {0, 2, 4},
+            {3, 7, 6},
+            {3, 5, 7},
+            {0, 5, 3},
+            {0, 1, 5},
+            {2, 7, 4},
+            {2, 6, 7}};
+
+        cube.index_count            = 12 * 3;
+        uint32_t vertex_buffer_size = sizeof(float) * 8 * 3;
+        uint32_t index_buffer_size  = sizeof(uint32_t) * 12 * 3;
+
+        cube.vertex_buffer = std::make_unique<vkb::core::Buffer>(get_device(),
+                                                                 vertex_buffer_size,
+                                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                                                 VMA_MEMORY_USAGE_CPU_TO_GPU);
+        cube.vertex_buffer->update((uint8_t *) &cube_vertices[0][0], vertex_buffer_size);
+
+        cube.index_buffer = std::make_unique<vkb::core::Buffer>(get_device(),
+                                                                index_buffer_size,
+                                                                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                                                                VMA_MEMORY_USAGE_CPU_TO_GPU);
+        cube.index_buffer->update((uint8_t *) &cube_indices[0][0], index_buffer_size);
+    }
+}
+
+void LinSSScatter::prepare_bssrdf(const std::string &filename)
+{
+    // Load BSSRDF
+    std::ifstream reader(filename.c_str(), std::ios::in | std::ios::binary);
+    if (reader.fail())
+    {
+        LOGE("Failed to open file: {}", filename);
+    }
+
+    uint32_t area_width, area_height, n_gauss, ksize;
+    reader.read((char *) &area_width, sizeof(uint32_t));
+    reader.read((char *) &area_height, sizeof(uint32_t));
+    reader.read((char *) &n_gauss, sizeof(uint32_t));
+    reader.read((char *) &ksize, sizeof(uint32_t));
+
+    // Load weights
+    auto buffer = std::make_unique<double[]>(n_gauss * 3);
+    auto data_W = std::make_unique<float[]>(area_width * area_height * n_gauss * 4);
+    for (int y = 0; y < area_height; y++)
+    {
+        for (int x = 0; x < area_width; x++)
+        {
+            reader.read((char *) buffer.get(), sizeof(double) * n_gauss * 3);
+            for (int h = 0; h < n_gauss; h++)
+            {
+                const int idx       = (h * area_height + (area_height - y - 1)) * area_width + x;
+                data_W[idx * 4 + 0] = std::max(0.0f, static_cast<float>(buffer[h * 3 + 0]));
+                data_W[idx * 4 + 1] = std::max(0.0f, static_cast<float>(buffer[h * 3 + 1]));
+                data_W[idx * 4 + 2] = std::max(0.0f, static_cast<float>(buffer[h * 3 + 2]));
+                data_W[idx * 4 + 3] = 1.0f;
+            }
+        }
+    }
+
+    // Load beta (inverse of sigma)
+    bssrdf.sigmas.resize(n_gauss);
+    reader.read((char *) buffer.get(), sizeof(double) * n_gauss * 3);
+    for (int i = 0; i < n_gauss; i++)
+    {
+        const float r       = static_cast<float>(buffer[i * 3 + 0]);
+        const float g       = static_cast<float>(buffer[i * 3 + 1]);
+        const float b       = static_cast<float>(buffer[i * 3 + 2]);
+        const float sigma_r = std::sqrt(1.0f / std::max(1.0e-4f, r));
+        const float sigma_g = std::sqrt(1.0f / std::max(1.0e-4f, g));
+        const float sigma_b = std::sqrt(1.0f / std::max(1.0e-4f, b));
+        bssrdf.sigmas[i]    = glm::vec4(sigma_r, sigma_g, sigma_b, 1.0f);
+    }
+    bssrdf.width   = area_width;
+    bssrdf.height  = area_height;
+    bssrdf.n_gauss = n_gauss;
+    bssrdf.ksize   = ksize;
+
+    reader.close();
+
+    // Copy weights
+    auto data_G_ast_W = std::make_unique<float[]>(area_width * area_height * n_gauss * 4);
+    std::memcpy(data_G_ast_W.get(), data_W.get(), sizeof(float) * area_width * area_height * n_gauss * 4);
+
+    // Apply Guassian filter to weight maps
+    for (int i = 0; i < n_gauss; i++)
+    {
+        gaussBlur(&data_G_ast_W[i * area_width * area_height * 4], bssrdf.sigmas[i], area_width, area_height, 4);
+    }
+
+    // 3D texture support in Vulkan is mandatory (in contrast to OpenGL) so no need to check if it's supported
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(get_device().get_gpu().get_handle(), VK_FORMAT_R32G32B32A32_SFLOAT, &formatProperties);
+    // Check if format supports transfer
+    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_TRANSFER_DST_BIT))
+    {
+        LOGE("Error: Device does not support flag TRANSFER_DST for selected texture format!");
+    }
+
+    // Check if GPU supports requested 3D texture dimensions
+    uint32_t maxImageDimension3D(get_device().get_gpu().get_properties().limits.maxImageDimension3D);
+    if (area_width > maxImageDimension3D || area_height > maxImageDimension3D || n_gauss > maxImageDimension3D)
+    {
+        LOGE("Error: Requested texture dimensions is greater than supported 3D texture dimension!");
+    }
+
+    // Prepare staging buffer
+    VkMemoryAllocateInfo memory_allocate_info = vkb::initializers::memory_allocate_info();
+    VkMemoryRequirements memory_requirements  = {};
+
+    VkBuffer       staging_buffer;
+    VkDeviceMemory staging_memory;
+
+    VkBufferCreateInfo buffer_create_info = vkb::initializers::buffer_create_info();
+    buffer_create_info.size               = area_width * area_height * n_gauss * sizeof(float) * 4;
+    buffer_create_info.usage              = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_create_info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK(vkCreateBuffer(get_device().get_handle(), &buffer_create_info, nullptr, &staging_buffer));
+
+    vkGetBufferMemoryRequirements(get_device().get_handle(), staging_buffer, &memory_requirements);
+    memory_allocate_info.allocationSize  = memory_requirements.size;
+    memory_allocate_info.memoryTypeIndex = get_device().get_memory_type(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    VK_CHECK(vkAllocateMemory(get_device().get_handle(), &memory_allocate_info, nullptr, &staging_memory));
+    VK_CHECK(vkBindBufferMemory(get_device().get_handle(), staging_buffer, staging_memory, 0));
+
+    // 3D texture for blurred weights
+    {
+        // Copy CPU data to GPU
+        uint8_t *data;
+        VK_CHECK(vkMapMemory(get_device().get_handle(), staging_memory, 0, memory_requirements.size, 0, (void **) &data));
+
+        uint32_t texture_size = area_width * area_height * n_gauss * sizeof(float) * 4;
+        std::memcpy(data, data_W.get(), texture_size);
+        vkUnmapMemory(get_device().get_handle(), staging_memory);
+
+        // Setup buffer copy region
+        VkBufferImageCopy buffer_copy_region               = {};
+        buffer_copy_region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        buffer_copy_region.imageSubresource.mipLevel       = 0;
+        buffer_copy_region.imageSubresource.baseArrayLayer = 0;
+        buffer_copy_region.imageSubresource.layerCount     = 1;
+        buffer_copy_region.imageExtent.width               = area_width;
+        buffer_copy_region.imageExtent.height              = area_height;
+        buffer_copy_region.imageExtent.depth               = n_gauss;
+        buffer_copy_region.bufferOffset                    = 0;
+
+        VkImageCreateInfo image_create_info = vkb::initializers::image_create_info();
+        image_create_info.imageType         = VK_IMAGE_TYPE_3D;
+        image_create_info.format            = VK_FORMAT_R32G32B32A32_SFLOAT;
+        image_create_info.mipLevels         = 1;
+        image_create_info.arrayLayers       = 1;
+        image_create_info.samples           = VK_SAMPLE_COUNT_1_BIT;
+        image_create_info.tiling            = VK_IMAGE_TILING_OPTIMAL;
+        image_create_info.sharingMode       = VK_SHARING_MODE_EXCLUSIVE;
+        image_create_info.initialLayout     = VK_IMAGE_LAYOUT_UNDEFINED;
+        image_create_info.extent            = {area_width, area_height, n_gauss};
+        image_create_info.usage             = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        VK_CHECK(vkCreateImage(get_device().get_handle(), &image_create_info, nullptr, &bssrdf.image_W));
+
+        vkGetImageMemoryRequirements(get_device().get_handle(), bssrdf.image_W, &memory_requirements);
+        memory_allocate_info.allocationSize  = memory_requirements.size;
+        memory_allocate_info.memoryTypeIndex = get_device().get_memory_type(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        VK_CHECK(vkAllocateMemory(get_device().get_handle(), &memory_allocate_info, nullptr, &bssrdf.device_memory_W));
+        VK_CHECK(vkBindImageMemory(get_device().get_handle(), bssrdf.image_W, bssrdf.device_memory_W, 0));
+
+        VkCommandBuffer copy_command = device->create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+        vkb::insert_image_memory_barrier(
+            copy_command,
+            bssrdf.image_W,
+            0,
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+        vkCmdCopyBufferToImage(
+            copy_command,
+            staging_buffer,
+            bssrdf.image_W,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1,
+            &buffer_copy_region);
+
+        vkb::insert_image_memory_barrier(
+            copy_command,
+            bssrdf.image_W,
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+        device->flush_command_buffer(copy_command, queue, true);
+
+        // Image view
+        VkImageViewCreateInfo view_create_info           = vkb::initializers::image_view_create_info();
+        view_create_info.image                           = bssrdf.image_W;
+        view_create_info.viewType                        = VK_IMAGE_VIEW_TYPE_3D;
+        view_create_info.format                          = VK_FORMAT_R32G32B32A32_SFLOAT;
+        view_create_info.components                      = {VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A};
+        view_create_info.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_create_info.subresourceRange.baseMipLevel   = 0;
+        view_create_info.subresourceRange.levelCount     = 1;
+        view_create_info.subresourceRange.baseArrayLayer = 0;
+        view_create_info.subresourceRange.layerCount     = 1;
+        VK_CHECK(vkCreateImageView(get_device().get_handle(), &view_create_info, nullptr, &bssrdf.view_W));
+    }
+
+    // 3D texture for blurred weights
+    {
+        // Copy CPU data to GPU
+        uint8_t *data;
+        VK_CHECK(vkMapMemory(get_device().get_handle(), staging_memory, 0, memory_requirements.size, 0, (void **) &data));
+
+        uint32_t texture_size = area_width * area_height * n_gauss * sizeof(float) * 4;
+        std::memcpy(data, data_G_ast_W.get(), texture_size);
+        vkUnmapMemory(get_device().get_handle(), staging_memory);
+
+        // Setup buffer copy region
+        VkBufferImageCopy buffer_copy_region               = {};
+        buffer_copy_region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        buffer_copy_region.imageSubresource.mipLevel       = 0;
+        buffer_copy_region.imageSubresource.baseArrayLayer = 0;
+        buffer_copy_region.imageSubresource.layerCount     = 1;
+        buffer_copy_region.imageExtent.width               = area_width;
+        buffer_copy_region.imageExtent.height              = area_height;
+        buffer_copy_region.imageExtent.depth               = n_gauss;
+        buffer_copy_region.bufferOffset                    = 0;
+
+        VkImageCreateInfo image_create_info = vkb::initializers::image_create_info();
+        image_create_info.imageType         = VK_IMAGE_TYPE_3D;
+        image_create_info.format            = VK_FORMAT_R32G32B32A32_SFLOAT;
+        image_create_info.mipLevels         = 1;
+        image_create_info.arrayLayers       = 1;
+        image_create_info.samples           = VK_SAMPLE_COUNT_1_BIT;
+        image_create_info.tiling            = VK_IMAGE_TILING_OPTIMAL;
+        image_create_info.sharingMode       = VK_SHARING_MODE_EXCLUSIVE;
+        image_create_info.initialLayout     = VK_IMAGE_LAYOUT_UNDEFINED;
+        image_create_info.extent            = {area_width, area_height, n_gauss};
+        image_create_info.usage             = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        VK_CHECK(vkCreateImage(get_device().get_handle(), &image_create_info, nullptr, &bssrdf.image_G_ast_W));
+
+        vkGetImageMemoryRequirements(get_device().get_handle(), bssrdf.image_G_ast_W, &memory_requirements);
+        memory_allocate_info.allocationSize  = memory_requirements.size;
+        memory_allocate_info.memoryTypeIndex = get_device().get_memory_type(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        VK_CHECK(vkAllocateMemory(get_device().get_handle(), &memory_allocate_info, nullptr, &bssrdf.device_memory_G_ast_W));
+        VK_CHECK(vkBindImageMemory(get_device().get_handle(), bssrdf.image_G_ast_W, bssrdf.device_memory_G_ast_W, 0));
+
+        VkCommandBuffer copy_command = device->create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+        vkb::insert_image_memory_barrier(
+            copy_command,
+            bssrdf.image_G_ast_W,
+            0,
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+        vkCmdCopyBufferToImage(
+            copy_command,
+            staging_buffer,
+            bssrdf.image_G_ast_W,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1,
+            &buffer_copy_region);
+
+        vkb::insert_image_memory_barrier(
+            copy_command,
+            bssrdf.image_G_ast_W,
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+        device->flush_command_buffer(copy_command, queue, true);
+
+        // Image view
+        VkImageViewCreateInfo view_create_info           = vkb::initializers::image_view_create_info();
+        view_create_info.image                           = bssrdf.image_G_ast_W;
+        view_create_info.viewType                        = VK_IMAGE_VIEW_TYPE_3D;
+        view_create_info.format                          = VK_FORMAT_R32G32B32A32_SFLOAT;
+        view_create_info.components                      = {VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A};
+        view_create_info.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_create_info.subresourceRange.baseMipLevel   = 0;
+        view_create_info.subresourceRange.levelCount     = 1;
+        view_create_info.subresourceRange.baseArrayLayer = 0;
+        view_create_info.subresourceRange.layerCount     = 1;
+        VK_CHECK(vkCreateImageView(get_device().get_handle(), &view_create_info, nullptr, &bssrdf.view_G_ast_W));
+    }
+
+    // Clean up staging resources
+    vkFreeMemory(get_device().get_handle(), staging_memory, nullptr);
+    vkDestroyBuffer(get_device().get_handle(), staging_buffer, nullptr);
+
+    // Sampler
+    VkSamplerCreateInfo sampler_create_info = vkb::initializers::sampler_create_info();
+    sampler_create_info.magFilter           = VK_FILTER_LINEAR;
+    sampler_create_info.minFilter           = VK_FILTER_LINEAR;
+    sampler_create_info.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    sampler_create_info.addressModeU        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_create_info.addressModeV        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_create_info.addressModeW        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_create_info.mipLodBias          = 0.0f;
+    sampler_create_info.compareOp           = VK_COMPARE_OP_NEVER;
+    sampler_create_info.minLod              = 0.0f;
+    sampler_create_info.maxLod              = 1.0f;
+    sampler_create_info.borderColor         = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    if (get_device().get_gpu().get_features().samplerAnisotropy)
+    {
+        // Use max. level of anisotropy for this example
+        sampler_create_info.maxAnisotropy    = get_device().get_gpu().get_properties().limits.maxSamplerAnisotropy;
+        sampler_create_info.anisotropyEnable = VK_TRUE;
+    }
+    else
+    {
+        // The device does not support anisotropic filtering
+        sampler_create_info.maxAnisotropy    = 1.0;
+        sampler_create_info.anisotropyEnable = VK_FALSE;
+    }
+    VK_CHECK(vkCreateSampler(device->get_handle(), &sampler_create_info, nullptr, &bssrdf.sampler));
+
+    // Print information
+    for (int i = 0; i < bssrdf.n_gauss; i++)
+    {
+        LOGI("BSSRDF sigma[{}]: {}", vkb::to_string(i), glm::to_string(bssrdf.sigmas[i]));
+    }
+
+    prepare_tsm_profile(data_W.get());
+}
+
+void LinSSScatter::prepare_tsm_profile(const float *weights)
+{
+    // Sum of Gaussians "diffRef" in "translucent_shadow_maps.glsl" is scaled by c = sigma scale / BSSRDF extent as
+    //   sum_h w_h G(r, c sigma_h) = c^-2 sum_h w_h G(r / c, sigma_h),
+    // so the profiles are tabulated for r / c once for each material.
+    const uint32_t num_texels = bssrdf.width * bssrdf.height;
+    const uint32_t n_gauss    = bssrdf.n_gauss;
+    const uint32_t dims       = n_gauss * 3;
+    const uint32_t num_codes  = std::min(TSM_PROFILE_CODES, num_texels);
+
+    float max_sigma = 0.0f;
+    for (uint32_t h = 0; h < n_gauss; h++)
+    {
+        max_sigma = std::max(max_sigma, std::max(bssrdf.sigmas[h].x, std::max(bssrdf.sigmas[h].y, bssrdf.sigmas[h].z)));
+    }
+    tsm_profile.max_radius = TSM_PROFILE_MAX_SIGMAS * max_sigma;
+
+    auto gauss_2d = [](float r, float sigma) {
+        return std::exp(-0.5f * r * r / (sigma * sigma)) / (2.0f * glm::pi<float>() * sigma * sigma);
+    };
+
+    // Columns are sampled at r = max_radius * u^2, which is denser for the peaks of small sigmas
+    auto column_radius = [&](uint32_t j) {
+        const float u = static_cast<float>(j) / (TSM_PROFILE_LUT_SIZE - 1);
+        return tsm_profile.max_radius * u * u;
+    };
+
+    // Weights are scaled by the L2 norms of the Gaussians (proportional to 1 / sigma),
+    // so that k-means minimizes the errors of the profiles rather than those of the weights.
+    std::vector<float> features(num_texels * dims);
+    for (uint32_t t = 0; t < num_texels; t++)
+    {
+        for (uint32_t h = 0; h < n_gauss; h++)
+        {
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                features[t * dims + h * 3 + c] = weights[(h * num_texels + t) * 4 + c] / bssrdf.sigmas[h][c];
+            }
+        }
+    }
+
+    // K-means clustering of the weights (initialized with evenly spaced texels)
+    std::vector<float>    centers(num_codes * dims);
+    std::vector<uint32_t> codes(num_texels, 0);
+    for (uint32_t k = 0; k < num_codes; k++)
+    {
+        const uint32_t t = static_cast<uint32_t>(static_cast<uint64_t>(k) * num_texels / num_codes);
+        std::copy_n(&features[t * dims], dims, &centers[k * dims]);
+    }
+
+    auto nearest_code = [&](uint32_t t) {
+        float    best_dist = std::numeric_limits<float>::max();
+        uint32_t best_code = 0;
+        for (uint32_t k = 0; k < num_codes; k++)
+        {
+            float dist = 0.0f;
+            for (uint32_t d = 0; d < dims; d++)
+            {
+                const float diff = features[t * dims + d] - centers[k * dims + d];
+                dist += diff * diff;
+            }
+            if (dist < best_dist)
+            {
+                best_dist = dist;
+                best_code = k;
+            }
+        }
+        return best_code;
+    };
+
+    // Centers are trained on a subset of the texels, and then all the texels are assigned
+    const uint32_t stride = std::max(1u, num_texels / TSM_PROFILE_KMEANS_SAMPLES);
+    for (uint32_t iter = 0; iter < TSM_PROFILE_KMEANS_ITERATIONS; iter++)
+    {
+        std::vector<float>    sums(num_codes * dims, 0.0f);
+        std::vector<uint32_t> counts(num_codes, 0);
+        for (uint32_t t = 0; t < num_texels; t += stride)
+        {
+            codes[t] = nearest_code(t);
+            for (uint32_t d = 0; d < dims; d++)
+            {
+                sums[codes[t] * dims + d] += features[t * dims + d];
+            }
+            counts[codes[t]] += 1;
+        }
+        for (uint32_t k = 0; k < num_codes; k++)
+        {
+            // Empty clusters keep their centers
+            for (uint32_t d = 0; d < dims && counts[k] > 0; d++)
+            {
+                centers[k * dims + d] = sums[k * dims + d] / counts[k];
+            }
+        }
+    }
+    for (uint32_t t = 0; t < num_texels; t++)
+    {
+        codes[t] = nearest_code(t);
+    }
+
+    // Profiles of the codes
+    std::vector<glm::vec4> lut(TSM_PROFILE_LUT_SIZE * num_codes, glm::vec4(0.0f));
+    for (uint32_t k = 0; k < num_codes; k++)
+    {
+        for (uint32_t j = 0; j < TSM_PROFILE_LUT_SIZE; j++)
+        {
+            const float r = column_radius(j);
+            for (uint32_t h = 0; h < n_gauss; h++)
+            {
+                for (uint32_t c = 0; c < 3; c++)
+                {
+                    const float sigma = bssrdf.sigmas[h][c];
+                    lut[k * TSM_PROFILE_LUT_SIZE + j][c] += centers[k * dims + h * 3 + c] * sigma * gauss_2d(r, sigma);
+                }
+            }
+        }
+    }
+
+    // Error of the quantized profiles against the exact ones (every 8th column)
+    double sum_squared_error = 0.0;
+    double sum_squared_norm  = 0.0;
+    for (uint32_t t = 0; t < num_texels; t++)
+    {
+        for (uint32_t j = 1; j < TSM_PROFILE_LUT_SIZE; j += 8)
+        {
+            // Area element r dr is proportional to u^3 du
+            const float r    = column_radius(j);
+            const float u    = static_cast<float>(j) / (TSM_PROFILE_LUT_SIZE - 1);
+            const float area = u * u * u;
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                float exact = 0.0f;
+                for (uint32_t h = 0; h < n_gauss; h++)
+                {
+                    exact += weights[(h * num_texels + t) * 4 + c] * gauss_2d(r, bssrdf.sigmas[h][c]);
+                }
+                const float diff = exact - lut[codes[t] * TSM_PROFILE_LUT_SIZE + j][c];
+                sum_squared_error += area * diff * diff;
+                sum_squared_norm += area * exact * exact;
+            }
+        }
+    }
+    tsm_profile.rel_error = sum_squared_norm > 0.0 ? static_cast<float>(std::sqrt(sum_squared_error / sum_squared_norm)) : 0.0f;
+
+    LOGI("TSM profile LUT: {} codes, relative error {:.3e}", num_codes, tsm_profile.rel_error);
+
+    // Upload LUT and code map (same layout as the weight texture)
+    std::vector<float> code_values(codes.begin(), codes.end());
+
+    tsm_profile.lut_view.reset();
+    tsm_profile.codes_view.reset();
+    tsm_profile.lut   = std::make_unique<vkb::core::Image>(get_device(),
+                                                         VkExtent3D{TSM_PROFILE_LUT_SIZE, num_codes, 1},
+                                                         VK_FORMAT_R32G32B32A32_SFLOAT,
+                                                         VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                                         VMA_MEMORY_USAGE_GPU_ONLY);
+    tsm_profile.codes = std::make_unique<vkb::core::Image>(get_device(),
+                                                           VkExtent3D{bssrdf.width, bssrdf.height, 1},
+                                                           VK_FORMAT_R32_SFLOAT,
+                                                           VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                                           VMA_MEMORY_USAGE_GPU_ONLY);
+
+    vkb::core::Buffer lut_staging(get_device(), sizeof(glm::vec4) * lut.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+    vkb::core::Buffer codes_staging(get_device(), sizeof(float) * code_values.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+    lut_staging.update(reinterpret_cast<const uint8_t *>(lut.data()), sizeof(glm::vec4) * lut.size());
+    codes_staging.update(reinterpret_cast<const uint8_t *>(code_values.data()), sizeof(float) * code_values.size());
+
+    VkCommandBuffer command_buffer = get_device().create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    for (const auto &upload : {std::make_pair(tsm_profile.lut.get(), &lut_staging), std::make_pair(tsm_profile.codes.get(), &codes_staging)})
+    {
+        const VkExtent3D &extent = upload.first->get_extent();
+
+        vkb::insert_image_memory_barrier(
+            command_buffer,
+            upload.first->get_handle(),
+            0,
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+        VkBufferImageCopy buffer_copy_region           = {};
+        buffer_copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        buffer_copy_region.imageSubresource.layerCount = 1;
+        buffer_copy_region.imageExtent                 = extent;
+        vkCmdCopyBufferToImage(command_buffer, upload.second->get_handle(), upload.first->get_handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buffer_copy_region);
+
+        vkb::insert_image_memory_barrier(
+            command_buffer,
+            upload.first->get_handle(),
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+    }
+    get_device().flush_command_buffer(command_buffer, queue, true);
+
+    tsm_profile.lut_view   = std::make_unique<vkb::core::ImageView>(*tsm_profile.lut, VK_IMAGE_VIEW_TYPE_2D);
+    tsm_profile.codes_view = std::make_unique<vkb::core::ImageView>(*tsm_profile.codes, VK_IMAGE_VIEW_TYPE_2D);
+
+    // Linear in distance; rows and codes are fetched at texel centers
+    if (tsm_profile.sampler == VK_NULL_HANDLE)
+    {
+        VkSamplerCreateInfo sampler_create_info = vkb::initializers::sampler_create_info();
+        sampler_create_info.magFilter           = VK_FILTER_LINEAR;
+        sampler_create_info.minFilter           = VK_FILTER_LINEAR;
+        sampler_create_info.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        sampler_create_info.addressModeU        = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_create_info.addressModeV        = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_create_info.addressModeW        = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_create_info.maxLod              = 0.0f;
+        sampler_create_info.maxAnisotropy       = 1.0f;
+        sampler_create_info.borderColor         = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+        VK_CHECK(vkCreateSampler(get_device().get_handle(), &sampler_create_info, nullptr, &tsm_profile.sampler));
+    }
+}
+
+void LinSSScatter::prepare_env_prefilter()
+{
+    // Radiance and prefiltered maps keep a fixed size, so that the descriptors do not change with the environment
+    const uint32_t radiance_levels = static_cast<uint32_t>(std::floor(std::log2(std::max(ENV_PREFILTER_WIDTH, ENV_PREFILTER_HEIGHT)))) + 1;
+
+    env_prefilter.radiance    = std::make_unique<vkb::core::Image>(get_device(),
+                                                                   VkExtent3D{ENV_PREFILTER_WIDTH, ENV_PREFILTER_HEIGHT, 1},
+                                                                   VK_FORMAT_R16G16B16A16_SFLOAT,
+                                                                   VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                                                   VMA_MEMORY_USAGE_GPU_ONLY,
+                                                                   VK_SAMPLE_COUNT_1_BIT,
+                                                                   radiance_levels);
+    env_prefilter.prefiltered = std::make_unique<vkb::core::Image>(get_device(),
+                                                                   VkExtent3D{ENV_PREFILTER_WIDTH, ENV_PREFILTER_HEIGHT, 1},
+                                                                   VK_FORMAT_R16G16B16A16_SFLOAT,
+                                                                   VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                                                   VMA_MEMORY_USAGE_GPU_ONLY,
+                                                                   VK_SAMPLE_COUNT_1_BIT,
+                                                                   ENV_PREFILTER_LEVELS);
+    env_prefilter.brdf_lut    = std::make_unique<vkb::core::Image>(get_device(),
+                                                                   VkExtent3D{BRDF_LUT_SIZE, BRDF_LUT_SIZE, 1},
+                                                                   VK_FORMAT_R16G16B16A16_SFLOAT,
+                                                                   VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                                                   VMA_MEMORY_USAGE_GPU_ONLY);
+
+    env_prefilter.radiance_view    = std::make_unique<vkb::core::ImageView>(*env_prefilter.radiance, VK_IMAGE_VIEW_TYPE_2D);
+    env_prefilter.prefiltered_view = std::make_unique<vkb::core::ImageView>(*env_prefilter.prefiltered, VK_IMAGE_VIEW_TYPE_2D);
+    env_prefilter.brdf_lut_view    = std::make_unique<vkb::core::ImageView>(*env_prefilter.brdf_lut, VK_IMAGE_VIEW_TYPE_2D);
+    for (uint32_t i = 0; i < ENV_PREFILTER_LEVELS; i++)
+    {
+        env_prefilter.level_views.emplace_back(*env_prefilter.prefiltered, VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_UNDEFINED, i, 0, 1, 1);
+    }
+    env_prefilter.lut_ready = false;
+
+    // Longitude wraps around, and latitude is clamped at the poles
+    VkSamplerCreateInfo sampler_create_info = vkb::initializers::sampler_create_info();
+    sampler_create_info.magFilter           = VK_FILTER_LINEAR;
+    sampler_create_info.minFilter           = VK_FILTER_LINEAR;
+    sampler_create_info.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    sampler_create_info.addressModeU        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_create_info.addressModeV        = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_create_info.addressModeW        = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_create_info.maxLod              = static_cast<float>(radiance_levels);
+    sampler_create_info.maxAnisotropy       = 1.0f;
+    sampler_create_info.borderColor         = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    VK_CHECK(vkCreateSampler(get_device().get_handle(), &sampler_create_info, nullptr, &env_prefilter.sampler));
+
+    sampler_create_info.mipmapMode   = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_create_info.maxLod       = 0.0f;
+    VK_CHECK(vkCreateSampler(get_device().get_handle(), &sampler_create_info, nullptr, &env_prefilter.lut_sampler));
+}
+
+void LinSSScatter::prefilter_environment()
+{
+    vkb::Timer timer;
+    timer.start();
+
+    const VkImage  radiance        = env_prefilter.radiance->get_handle();
+    const VkImage  prefiltered     = env_prefilter.prefiltered->get_handle();
+    const uint32_t radiance_levels = env_prefilter.radiance->get_subresource().mipLevel;
+
+    VkCommandBuffer command_buffer = get_device().create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+    // Radiance is converted to half float and downsampled by linear blits
+    vkb::insert_image_memory_barrier(
+        command_buffer,
+        envmap_texture.image,
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_ACCESS_TRANSFER_READ_BIT,
+        envmap_texture.image_layout,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+    vkb::insert_image_memory_barrier(
+        command_buffer,
+        radiance,
+        0,
+        VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        {VK_IMAGE_ASPECT_COLOR_BIT, 0, radiance_levels, 0, 1});
+
+    for (uint32_t i = 0; i < radiance_levels; i++)
+    {
+        const VkImage  src_image  = i == 0 ? envmap_texture.image : radiance;
+        const uint32_t src_width  = i == 0 ? envmap_texture.width : std::max(1u, ENV_PREFILTER_WIDTH >> (i - 1));
+        const uint32_t src_height = i == 0 ? envmap_texture.height : std::max(1u, ENV_PREFILTER_HEIGHT >> (i - 1));
+
+        VkImageBlit image_blit                   = {};
+        image_blit.srcOffsets[0]                 = {0, 0, 0};
+        image_blit.srcOffsets[1]                 = {static_cast<int32_t>(src_width), static_cast<int32_t>(src_height), 1};
+        image_blit.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        image_blit.srcSubresource.mipLevel       = i == 0 ? 0 : i - 1;
+        image_blit.srcSubresource.baseArrayLayer = 0;
+        image_blit.srcSubresource.layerCount     = 1;
+        image_blit.dstOffsets[0]                 = {0, 0, 0};
+        image_blit.dstOffsets[1]                 = {static_cast<int32_t>(std::max(1u, ENV_PREFILTER_WIDTH >> i)), static_cast<int32_t>(std::max(1u, ENV_PREFILTER_HEIGHT >> i)), 1};
+        image_blit.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        image_blit.dstSubresource.mipLevel       = i;
+        image_blit.dstSubresource.baseArrayLayer = 0;
+        image_blit.dstSubresource.layerCount     = 1;
+
+        vkCmdBlitImage(
+            command_buffer,
+            src_image,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            radiance,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1,
+            &image_blit,
+            VK_FILTER_LINEAR);
+
+        vkb::insert_image_memory_barrier(
+            command_buffer,
+            radiance,
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_ACCESS_TRANSFER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            {VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1});
+    }
+
+    vkb::insert_image_memory_barrier(
+        command_buffer,
+        envmap_texture.image,
+        VK_ACCESS_TRANSFER_READ_BIT,
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        envmap_texture.image_layout,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+    vkb::insert_image_memory_barrier(
+        command_buffer,
+        radiance,
+        VK_ACCESS_TRANSFER_READ_BIT,
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        {VK_IMAGE_ASPECT_COLOR_BIT, 0, radiance_levels, 0, 1});
+
+    // GGX convolution of each level
+    vkb::insert_image_memory_barrier(
+        command_buffer,
+        prefiltered,
+        0,
+        VK_ACCESS_SHADER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        {VK_IMAGE_ASPECT_COLOR_BIT, 0, ENV_PREFILTER_LEVELS, 0, 1});
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.env_prefilter);
+    for (uint32_t i = 0; i < ENV_PREFILTER_LEVELS; i++)
+    {
+        const uint32_t width  = std::max(1u, ENV_PREFILTER_WIDTH >> i);
+        const uint32_t height = std::max(1u, ENV_PREFILTER_HEIGHT >> i);
+
+        push_const_env_prefilter_cs.roughness   = static_cast<float>(i) / (ENV_PREFILTER_LEVELS - 1);
+        push_const_env_prefilter_cs.num_samples = ENV_PREFILTER_SAMPLES;
+
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layouts.env_prefilter, 0, 1, &descriptor_sets.env_prefilter[i], 0, nullptr);
+        vkCmdPushConstants(command_buffer, pipeline_layouts.env_prefilter, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_const_env_prefilter_cs), &push_const_env_prefilter_cs);
+        vkCmdDispatch(command_buffer, (width + ENV_PREFILTER_GROUP - 1) / ENV_PREFILTER_GROUP, (height + ENV_PREFILTER_GROUP - 1) / ENV_PREFILTER_GROUP, 1);
+    }
+
+    vkb::insert_image_memory_barrier(
+        command_buffer,
+        prefiltered,
+        VK_ACCESS_SHADER_WRITE_BIT,
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        {VK_IMAGE_ASPECT_COLOR_BIT, 0, ENV_PREFILTER_LEVELS, 0, 1});
+
+    // Split-sum BRDF LUT
+    if (!env_prefilter.lut_ready)
+    {
+        vkb::insert_image_memory_barrier(
+            command_buffer,
+            env_prefilter.brdf_lut->get_handle(),
+            0,
+            VK_ACCESS_SHADER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_GENERAL,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.brdf_lut);
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layouts.env_prefilter, 0, 1, &descriptor_sets.brdf_lut, 0, nullptr);
+        vkCmdDispatch(command_buffer, BRDF_LUT_SIZE / ENV_PREFILTER_GROUP, BRDF_LUT_SIZE / ENV_PREFILTER_GROUP, 1);
+
+        vkb::insert_image_memory_barrier(
+            command_buffer,
+            env_prefilter.brdf_lut->get_handle(),
+            VK_ACCESS_SHADER_WRITE_BIT,
+            VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_GENERAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+        env_prefilter.lut_ready = true;
+    }
+
+    get_device().flush_command_buffer(command_buffer, queue, true);
+
+    env_prefilter.ms = static_cast<float>(timer.stop<vkb::Timer::Milliseconds>());
+    LOGI("Prefiltered environment: {} levels, {:.2f} ms", ENV_PREFILTER_LEVELS, env_prefilter.ms);
+}
+
+void LinSSScatter::setup_descriptor_set_layout()
+{
+    // Light pass
+    {
+        std::vector<VkDescriptorSetLayoutBinding> set_layout_bindings =
+            {
+                // Binding 0 : Vertex shader uniform buffer
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    VK_SHADER_STAGE_VERTEX_BIT,
+                    0)};
+
+        VkDescriptorSetLayoutCreateInfo descriptor_layout_create_info =
+            vkb::initializers::descriptor_set_layout_create_info(
+                set_layout_bindings.data(),
+                static_cast<uint32_t>(set_layout_bindings.size()));
+
+        VK_CHECK(vkCreateDescriptorSetLayout(get_device().get_handle(), &descriptor_layout_create_info, nullptr, &descriptor_set_layouts.light_pass));
+
+        VkPipelineLayoutCreateInfo pipeline_layout_create_info =
+            vkb::initializers::pipeline_layout_create_info(
+                &descriptor_set_layouts.light_pass,
+                1);
+
+        VK_CHECK(vkCreatePipelineLayout(get_device().get_handle(), &pipeline_layout_create_info, nullptr, &pipeline_layouts.light_pass));
+    }
+
+    // Direct pass
+    {
+        std::vector<VkDescriptorSetLayoutBinding> set_layout_bindings =
+            {
+                // Binding 0 : Vertex shader uniform buffer
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    VK_SHADER_STAGE_VERTEX_BIT,
+                    0),
+                // Binding 1 : Fragment shader uniform buffer
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    1),
+                // Binding 2 : Fragment shader image sampler (Ks)
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    2),
+                // Binding 3 : Fragment shader image sampler (prefiltered envmap)
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    3),
+                // Binding 4 : Fragment shader depth buffer
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    4),
+                // Binding 5 : Fragment shader depth buffer (depth-compare sampler)
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    5),
+                // Binding 6 : Fragment shader image sampler (split-sum BRDF LUT)
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    6)};
+
+        VkDescriptorSetLayoutCreateInfo descriptor_layout_create_info =
+            vkb::initializers::descriptor_set_layout_create_info(
+                set_layout_bindings.data(),
+                static_cast<uint32_t>(set_layout_bindings.size()));
+
+        VK_CHECK(vkCreateDescriptorSetLayout(get_device().get_handle(), &descriptor_layout_create_info, nullptr, &descriptor_set_layouts.direct_pass));
+
+        VkPipelineLayoutCreateInfo pipeline_layout_create_info =
+            vkb::initializers::pipeline_layout_create_info(
+                &descriptor_set_layouts.direct_pass,
+                1);
+
+        VK_CHECK(vkCreatePipelineLayout(get_device().get_handle(), &pipeline_layout_create_info, nullptr, &pipeline_layouts.direct_pass));
+    }
+
+    // Gaussian filter
+    {
+        std::vector<VkDescriptorSetLayoutBinding> set_layout_bindings =
+            {
+                // Binding 0 : input image storage
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    0),
+                // Binding 0 : output image storage
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    1),
+                // Binding 1 : buffer image
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    2),
+                // Binding 3 is not used (sigma and direction are given by push constants)
+                // Binding 4-6 : image samplers (position, normal, depth)
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    4),
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    5),
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    6),
+                // Binding 7 : kernel table (used only by the tiled filter)
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    7),
+                // Binding 8 : tile lists (used only by the windowed filter)
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    8),
+                // Binding 9 : G-buffer decoding
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    9)};
+
+        VkDescriptorSetLayoutCreateInfo descriptor_layout_create_info =
+            vkb::initializers::descriptor_set_layout_create_info(
+                set_layout_bindings.data(),
+                static_cast<uint32_t>(set_layout_bindings.size()));
+
+        VK_CHECK(vkCreateDescriptorSetLayout(get_device().get_handle(), &descriptor_layout_create_info, nullptr, &descriptor_set_layouts.gauss_filter));
+
+        VkPipelineLayoutCreateInfo pipeline_layout_create_info =
+            vkb::initializers::pipeline_layout_create_info(
+                &descriptor_set_layouts.gauss_filter,
+                1);
+
+        // Push constants for sigma, direction and the first tile
+        VkPushConstantRange push_constant_range =
+            vkb::initializers::push_constant_range(
+                VK_SHADER_STAGE_COMPUTE_BIT,
+                sizeof(push_const_gauss_cs),
+                0);
+        pipeline_layout_create_info.pushConstantRangeCount = 1;
+        pipeline_layout_create_info.pPushConstantRanges    = &push_constant_range;
+
+        VK_CHECK(vkCreatePipelineLayout(get_device().get_handle(), &pipeline_layout_create_info, nullptr, &pipeline_layouts.gauss_filter));
+    }
+
+    // Gaussian pyramid (single pass)
+    {
+        std::vector<VkDescriptorSetLayoutBinding> set_layout_bindings =
+            {
+                // Binding 0 : input image storages (one for each MIP level)
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    0,
+                    MAX_MIP_LEVELS),
+                // Binding 1 : output image storages (one for each MIP level)
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    1,
+                    MAX_MIP_LEVELS),
+                // Binding 2 : uniform buffer object
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    2),
+                // Binding 3-5 : image samplers (position, normal, depth)
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    3),
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    4),
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    5),
+                // Binding 6 : kernel tables
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    6),
+                // Binding 7 : tile counter
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    7),
+                // Binding 8 : G-buffer decoding
                 vkb::initializers::descriptor_set_layout_binding(
                     VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                    VK_SHADER_STAGE_VERTEX_BIT,
-                    0)};
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    8)};
 
         VkDescriptorSetLayoutCreateInfo descriptor_layout_create_info =
             vkb::initializers::descriptor_set_layout_create_info(
                 set_layout_bindings.data(),
                 static_cast<uint32_t>(set_layout_bindings.size()));
 
-        VK_CHECK(vkCreateDescriptorSetLayout(get_device().get_handle(), &descriptor_layout_create_info, nullptr, &descriptor_set_layouts.light_pass));
+        VK_CHECK(vkCreateDescriptorSetLayout(get_device().get_handle(), &descriptor_layout_create_info, nullptr, &descriptor_set_layouts.gauss_pyramid));
 
         VkPipelineLayoutCreateInfo pipeline_layout_create_info =
             vkb::initializers::pipeline_layout_create_info(
-                &descriptor_set_layouts.light_pass,
+                &descriptor_set_layouts.gauss_pyramid,
                 1);
 
-        VK_CHECK(vkCreatePipelineLayout(get_device().get_handle(), &pipeline_layout_create_info, nullptr, &pipeline_layouts.light_pass));
+        VK_CHECK(vkCreatePipelineLayout(get_device().get_handle(), &pipeline_layout_create_info, nullptr, &pipeline_layouts.gauss_pyramid));
     }
 
-    // Direct pass
+    // Channel-separated Gaussian pyramid
     {
         std::vector<VkDescriptorSetLayoutBinding> set_layout_bindings =
             {
-                // Binding 0 : Vertex shader uniform buffer
-                vkb::initializers::descriptor_set_layout_binding(
-                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                    VK_SHADER_STAGE_VERTEX_BIT,
-                    0),
-                // Binding 1 : Fragment shader uniform buffer
-                vkb::initializers::descriptor_set_layout_binding(
-                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                    VK_SHADER_STAGE_FRAGMENT_BIT,
-                    1),
-                // Binding 2 : Fragment shader image sampler (Ks)
-                vkb::initializers::descriptor_set_layout_binding(
-                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                    VK_SHADER_STAGE_FRAGMENT_BIT,
-                    2),
-                // Binding 3 : Fragment shader image sampler (envmap)
+                // Binding 0 : image sampler for (G * Phi)
                 vkb::initializers::descriptor_set_layout_binding(
                     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                    VK_SHADER_STAGE_FRAGMENT_BIT,
-                    3),
-                // Binding 4 : Fragment shader depth buffer
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    0),
+                // Binding 1 : output image storage (a MIP level of R, G and B layers)
                 vkb::initializers::descriptor_set_layout_binding(
-                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                    VK_SHADER_STAGE_FRAGMENT_BIT,
-                    4)};
+                    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    1)};
 
         VkDescriptorSetLayoutCreateInfo descriptor_layout_create_info =
             vkb::initializers::descriptor_set_layout_create_info(
                 set_layout_bindings.data(),
                 static_cast<uint32_t>(set_layout_bindings.size()));
 
-        VK_CHECK(vkCreateDescriptorSetLayout(get_device().get_handle(), &descriptor_layout_create_info, nullptr, &descriptor_set_layouts.direct_pass));
+        VK_CHECK(vkCreateDescriptorSetLayout(get_device().get_handle(), &descriptor_layout_create_info, nullptr, &descriptor_set_layouts.gauss_pyramid_split));
 
         VkPipelineLayoutCreateInfo pipeline_layout_create_info =
             vkb::initializers::pipeline_layout_create_info(
-                &descriptor_set_layouts.direct_pass,
+                &descriptor_set_layouts.gauss_pyramid_split,
                 1);
 
-        VK_CHECK(vkCreatePipelineLayout(get_device().get_handle(), &pipeline_layout_create_info, nullptr, &pipeline_layouts.direct_pass));
+        // Push constants for MIP level
+        VkPushConstantRange push_constant_range =
+            vkb::initializers::push_constant_range(
+                VK_SHADER_STAGE_COMPUTE_BIT,
+                sizeof(int),
+                0);
+        pipeline_layout_create_info.pushConstantRangeCount = 1;
+        pipeline_layout_create_info.pPushConstantRanges    = &push_constant_range;
+
+        VK_CHECK(vkCreatePipelineLayout(get_device().get_handle(), &pipeline_layout_create_info, nullptr, &pipeline_layouts.gauss_pyramid_split));
     }
 
-    // Gaussian filter
+    // Tile classification
     {
         std::vector<VkDescriptorSetLayoutBinding> set_layout_bindings =
             {
-                // Binding 0 : input image storage
+                // Binding 0 : image sampler for depth
                 vkb::initializers::descriptor_set_layout_binding(
-                    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                     VK_SHADER_STAGE_COMPUTE_BIT,
                     0),
-                // Binding 0 : output image storage
+                // Binding 1 : tile lists
                 vkb::initializers::descriptor_set_layout_binding(
-                    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
                     VK_SHADER_STAGE_COMPUTE_BIT,
                     1),
-                // Binding 1 : buffer image
-                vkb::initializers::descriptor_set_layout_binding(
-                    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-                    VK_SHADER_STAGE_COMPUTE_BIT,
-                    2),
-                // Binding 2 : uniform buffer object
+                // Binding 2 : G-buffer decoding
                 vkb::initializers::descriptor_set_layout_binding(
                     VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
                     VK_SHADER_STAGE_COMPUTE_BIT,
-                    3),
-                // Binding 3-5 : image samplers (position, normal, depth)
-                vkb::initializers::descriptor_set_layout_binding(
-                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                    VK_SHADER_STAGE_COMPUTE_BIT,
-                    4),
-                vkb::initializers::descriptor_set_layout_binding(
-                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                    VK_SHADER_STAGE_COMPUTE_BIT,
-                    5),
-                vkb::initializers::descriptor_set_layout_binding(
-                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                    VK_SHADER_STAGE_COMPUTE_BIT,
-                    6)};
+                    2)};
 
         VkDescriptorSetLayoutCreateInfo descriptor_layout_create_info =
             vkb::initializers::descriptor_set_layout_create_info(
                 set_layout_bindings.data(),
                 static_cast<uint32_t>(set_layout_bindings.size()));
 
-        VK_CHECK(vkCreateDescriptorSetLayout(get_device().get_handle(), &descriptor_layout_create_info, nullptr, &descriptor_set_layouts.gauss_filter));
+        VK_CHECK(vkCreateDescriptorSetLayout(get_device().get_handle(), &descriptor_layout_create_info, nullptr, &descriptor_set_layouts.tile_classify));
 
         VkPipelineLayoutCreateInfo pipeline_layout_create_info =
             vkb::initializers::pipeline_layout_create_info(
-                &descriptor_set_layouts.gauss_filter,
+                &descriptor_set_layouts.tile_classify,
                 1);
 
-        VK_CHECK(vkCreatePipelineLayout(get_device().get_handle(), &pipeline_layout_create_info, nullptr, &pipeline_layouts.gauss_filter));
+        // Push constants for the size and the number of MIP levels
+        VkPushConstantRange push_constant_range =
+            vkb::initializers::push_constant_range(
+                VK_SHADER_STAGE_COMPUTE_BIT,
+                sizeof(push_const_tile_classify_cs),
+                0);
+        pipeline_layout_create_info.pushConstantRangeCount = 1;
+        pipeline_layout_create_info.pPushConstantRanges    = &push_constant_range;
+
+        VK_CHECK(vkCreatePipelineLayout(get_device().get_handle(), &pipeline_layout_create_info, nullptr, &pipeline_layouts.tile_classify));
     }
 
     // LinSSS accumulation
@@ -2988,7 +6164,22 @@ void LinSSScatter::setup_descriptor_set_layout()
                 vkb::initializers::descriptor_set_layout_binding(
                     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                     VK_SHADER_STAGE_COMPUTE_BIT,
-                    7)};
+                    7),
+                // Binding 8 : 2D array image sampler for channel-separated (G * Phi)
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    8),
+                // Binding 9 : tile lists
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    9),
+                // Binding 10 : G-buffer decoding
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    10)};
 
         VkDescriptorSetLayoutCreateInfo descriptor_layout_create_info =
             vkb::initializers::descriptor_set_layout_create_info(
@@ -3002,6 +6193,15 @@ void LinSSScatter::setup_descriptor_set_layout()
                 &descriptor_set_layouts.linsss,
                 1);
 
+        // Push constants for the first tile
+        VkPushConstantRange push_constant_range =
+            vkb::initializers::push_constant_range(
+                VK_SHADER_STAGE_COMPUTE_BIT,
+                sizeof(uint32_t),
+                0);
+        pipeline_layout_create_info.pushConstantRangeCount = 1;
+        pipeline_layout_create_info.pPushConstantRanges    = &push_constant_range;
+
         VK_CHECK(vkCreatePipelineLayout(get_device().get_handle(), &pipeline_layout_create_info, nullptr, &pipeline_layouts.linsss));
     }
 
@@ -3040,7 +6240,15 @@ void LinSSScatter::setup_descriptor_set_layout()
                 vkb::initializers::descriptor_set_layout_binding(
                     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                     VK_SHADER_STAGE_FRAGMENT_BIT,
-                    7)};
+                    7),
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    8),
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    9)};
 
         VkDescriptorSetLayoutCreateInfo descriptor_layout_create_info =
             vkb::initializers::descriptor_set_layout_create_info(
@@ -3057,6 +6265,89 @@ void LinSSScatter::setup_descriptor_set_layout()
         VK_CHECK(vkCreatePipelineLayout(get_device().get_handle(), &pipeline_layout_create_info, nullptr, &pipeline_layouts.trans_sm));
     }
 
+    // TSM variance
+    {
+        std::vector<VkDescriptorSetLayoutBinding> set_layout_bindings =
+            {
+                // Binding 0 : accumulated TSM
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    0),
+                // Binding 1 : per-pixel moments
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    1),
+                // Binding 2 : per-tile errors
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    2)};
+
+        VkDescriptorSetLayoutCreateInfo descriptor_layout_create_info =
+            vkb::initializers::descriptor_set_layout_create_info(
+                set_layout_bindings.data(),
+                static_cast<uint32_t>(set_layout_bindings.size()));
+
+        VK_CHECK(vkCreateDescriptorSetLayout(get_device().get_handle(), &descriptor_layout_create_info, nullptr, &descriptor_set_layouts.tsm_variance));
+
+        VkPipelineLayoutCreateInfo pipeline_layout_create_info =
+            vkb::initializers::pipeline_layout_create_info(
+                &descriptor_set_layouts.tsm_variance,
+                1);
+
+        // Push constants for the render area
+        VkPushConstantRange push_constant_range =
+            vkb::initializers::push_constant_range(
+                VK_SHADER_STAGE_COMPUTE_BIT,
+                sizeof(VkExtent2D),
+                0);
+        pipeline_layout_create_info.pushConstantRangeCount = 1;
+        pipeline_layout_create_info.pPushConstantRanges    = &push_constant_range;
+
+        VK_CHECK(vkCreatePipelineLayout(get_device().get_handle(), &pipeline_layout_create_info, nullptr, &pipeline_layouts.tsm_variance));
+    }
+
+    // Environment prefilter and BRDF LUT
+    {
+        std::vector<VkDescriptorSetLayoutBinding> set_layout_bindings =
+            {
+                // Binding 0 : radiance of the environment
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    0),
+                // Binding 1 : output image storage
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    VK_SHADER_STAGE_COMPUTE_BIT,
+                    1)};
+
+        VkDescriptorSetLayoutCreateInfo descriptor_layout_create_info =
+            vkb::initializers::descriptor_set_layout_create_info(
+                set_layout_bindings.data(),
+                static_cast<uint32_t>(set_layout_bindings.size()));
+
+        VK_CHECK(vkCreateDescriptorSetLayout(get_device().get_handle(), &descriptor_layout_create_info, nullptr, &descriptor_set_layouts.env_prefilter));
+
+        VkPipelineLayoutCreateInfo pipeline_layout_create_info =
+            vkb::initializers::pipeline_layout_create_info(
+                &descriptor_set_layouts.env_prefilter,
+                1);
+
+        // Push constants for roughness and number of samples
+        VkPushConstantRange push_constant_range =
+            vkb::initializers::push_constant_range(
+                VK_SHADER_STAGE_COMPUTE_BIT,
+                sizeof(push_const_env_prefilter_cs),
+                0);
+        pipeline_layout_create_info.pushConstantRangeCount = 1;
+        pipeline_layout_create_info.pPushConstantRanges    = &push_constant_range;
+
+        VK_CHECK(vkCreatePipelineLayout(get_device().get_handle(), &pipeline_layout_create_info, nullptr, &pipeline_layouts.env_prefilter));
+    }
+
     // Deferred shading
     {
         std::vector<VkDescriptorSetLayoutBinding> set_layout_bindings =
@@ -3095,7 +6386,40 @@ void LinSSScatter::setup_descriptor_set_layout()
                 vkb::initializers::descriptor_set_layout_binding(
                     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                     VK_SHADER_STAGE_FRAGMENT_BIT,
-                    6)};
+                    6),
+                // Binding 7 : Fragment shader uniform buffer (LinSSS accumulation)
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    7),
+                // Binding 8, 9 : Fragment shader 3D image samplers (W and G * W)
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    8),
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    9),
+                // Binding 10, 11 : Fragment shader image samplers (G * Phi in RGBA and split layouts)
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    10),
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    11),
+                // Binding 12 : Fragment shader position texture
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    12),
+                // Binding 13 : Fragment shader uniform buffer (G-buffer decoding)
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    13)};
 
         VkDescriptorSetLayoutCreateInfo descriptor_layout_create_info =
             vkb::initializers::descriptor_set_layout_create_info(
@@ -3109,6 +6433,15 @@ void LinSSScatter::setup_descriptor_set_layout()
                 &descriptor_set_layouts.deferred,
                 1);
 
+        // Push constants for the render area of TSM
+        VkPushConstantRange push_constant_range =
+            vkb::initializers::push_constant_range(
+                VK_SHADER_STAGE_FRAGMENT_BIT,
+                sizeof(glm::vec2),
+                0);
+        pipeline_layout_create_info.pushConstantRangeCount = 1;
+        pipeline_layout_create_info.pPushConstantRanges    = &push_constant_range;
+
         VK_CHECK(vkCreatePipelineLayout(get_device().get_handle(), &pipeline_layout_create_info, nullptr, &pipeline_layouts.deferred));
     }
 
@@ -3125,7 +6458,12 @@ void LinSSScatter::setup_descriptor_set_layout()
                 vkb::initializers::descriptor_set_layout_binding(
                     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                     VK_SHADER_STAGE_FRAGMENT_BIT,
-                    1)};
+                    1),
+                // Binding 2 : Fragment shader input attachment (merged subpasses)
+                vkb::initializers::descriptor_set_layout_binding(
+                    VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
+                    VK_SHADER_STAGE_FRAGMENT_BIT,
+                    2)};
 
         VkDescriptorSetLayoutCreateInfo descriptor_layout_create_info =
             vkb::initializers::descriptor_set_layout_create_info(
@@ -3141,16 +6479,102 @@ void LinSSScatter::setup_descriptor_set_layout()
 
         VK_CHECK(vkCreatePipelineLayout(get_device().get_handle(), &pipeline_layout_create_info, nullptr, &pipeline_layouts.postprocess));
     }
-}
+}
+
+void LinSSScatter::setup_descriptor_set()
+{
+    // Light pass
+    {
+        // Descriptor pool
+        std::vector<VkDescriptorPoolSize> pool_sizes =
+            {
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1)};
+
+        VkDescriptorPoolCreateInfo descriptor_pool_create_info =
+            vkb::initializers::descriptor_pool_create_info(
+                static_cast<uint32_t>(pool_sizes.size()),
+                pool_sizes.data(),
+                1);
+
+        VK_CHECK(vkCreateDescriptorPool(get_device().get_handle(), &descriptor_pool_create_info, nullptr, &descriptor_pools.light_pass));
+
+        // Memory allocation for descriptor set
+        VkDescriptorSetAllocateInfo alloc_info =
+            vkb::initializers::descriptor_set_allocate_info(
+                descriptor_pools.light_pass,
+                &descriptor_set_layouts.light_pass,
+                1);
+
+        VK_CHECK(vkAllocateDescriptorSets(get_device().get_handle(), &alloc_info, &descriptor_sets.light_pass));
+    }
+
+    // Direct pass
+    {
+        // Descriptor pool
+        std::vector<VkDescriptorPoolSize> pool_sizes =
+            {
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 5)};
+
+        VkDescriptorPoolCreateInfo descriptor_pool_create_info =
+            vkb::initializers::descriptor_pool_create_info(
+                static_cast<uint32_t>(pool_sizes.size()),
+                pool_sizes.data(),
+                1);
+
+        VK_CHECK(vkCreateDescriptorPool(get_device().get_handle(), &descriptor_pool_create_info, nullptr, &descriptor_pools.direct_pass));
+
+        // Memory allocation for descriptor set
+        VkDescriptorSetAllocateInfo alloc_info =
+            vkb::initializers::descriptor_set_allocate_info(
+                descriptor_pools.direct_pass,
+                &descriptor_set_layouts.direct_pass,
+                1);
+
+        VK_CHECK(vkAllocateDescriptorSets(get_device().get_handle(), &alloc_info, &descriptor_sets.direct_pass));
+    }
+
+    // Gaussian filter
+    {
+        // Descriptor pool
+        std::vector<VkDescriptorPoolSize> pool_sizes =
+            {
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3 * MAX_MIP_LEVELS),
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, MAX_MIP_LEVELS),
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3 * MAX_MIP_LEVELS),
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * MAX_MIP_LEVELS)};
+
+        VkDescriptorPoolCreateInfo descriptor_pool_create_info =
+            vkb::initializers::descriptor_pool_create_info(
+                static_cast<uint32_t>(pool_sizes.size()),
+                pool_sizes.data(),
+                MAX_MIP_LEVELS);
+
+        VK_CHECK(vkCreateDescriptorPool(get_device().get_handle(), &descriptor_pool_create_info, nullptr, &descriptor_pools.gauss_filter));
+
+        // Memory allocation for descriptor set
+        VkDescriptorSetAllocateInfo alloc_info =
+            vkb::initializers::descriptor_set_allocate_info(
+                descriptor_pools.gauss_filter,
+                &descriptor_set_layouts.gauss_filter,
+                1);
+
+        descriptor_sets.gauss_filter.resize(MAX_MIP_LEVELS);
+        for (uint32_t i = 0; i < MAX_MIP_LEVELS; i++)
+        {
+            VK_CHECK(vkAllocateDescriptorSets(get_device().get_handle(), &alloc_info, &descriptor_sets.gauss_filter[i]));
+        }
+    }
 
-void LinSSScatter::setup_descriptor_set()
-{
-    // Light pass
+    // Gaussian pyramid (single pass)
     {
         // Descriptor pool
         std::vector<VkDescriptorPoolSize> pool_sizes =
             {
-                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1)};
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2 * MAX_MIP_LEVELS),
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3),
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2)};
 
         VkDescriptorPoolCreateInfo descriptor_pool_create_info =
             vkb::initializers::descriptor_pool_create_info(
@@ -3158,75 +6582,73 @@ void LinSSScatter::setup_descriptor_set()
                 pool_sizes.data(),
                 1);
 
-        VK_CHECK(vkCreateDescriptorPool(get_device().get_handle(), &descriptor_pool_create_info, nullptr, &descriptor_pools.light_pass));
+        VK_CHECK(vkCreateDescriptorPool(get_device().get_handle(), &descriptor_pool_create_info, nullptr, &descriptor_pools.gauss_pyramid));
 
         // Memory allocation for descriptor set
         VkDescriptorSetAllocateInfo alloc_info =
             vkb::initializers::descriptor_set_allocate_info(
-                descriptor_pools.light_pass,
-                &descriptor_set_layouts.light_pass,
+                descriptor_pools.gauss_pyramid,
+                &descriptor_set_layouts.gauss_pyramid,
                 1);
 
-        VK_CHECK(vkAllocateDescriptorSets(get_device().get_handle(), &alloc_info, &descriptor_sets.light_pass));
+        VK_CHECK(vkAllocateDescriptorSets(get_device().get_handle(), &alloc_info, &descriptor_sets.gauss_pyramid));
     }
 
-    // Direct pass
+    // Channel-separated Gaussian pyramid
     {
         // Descriptor pool
         std::vector<VkDescriptorPoolSize> pool_sizes =
             {
-                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
-                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3)};
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_MIP_LEVELS),
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MAX_MIP_LEVELS)};
 
         VkDescriptorPoolCreateInfo descriptor_pool_create_info =
             vkb::initializers::descriptor_pool_create_info(
                 static_cast<uint32_t>(pool_sizes.size()),
                 pool_sizes.data(),
-                1);
+                MAX_MIP_LEVELS);
 
-        VK_CHECK(vkCreateDescriptorPool(get_device().get_handle(), &descriptor_pool_create_info, nullptr, &descriptor_pools.direct_pass));
+        VK_CHECK(vkCreateDescriptorPool(get_device().get_handle(), &descriptor_pool_create_info, nullptr, &descriptor_pools.gauss_pyramid_split));
 
-        // Memory allocation for descriptor set
+        // Memory allocation for descriptor sets (one for each MIP level)
         VkDescriptorSetAllocateInfo alloc_info =
             vkb::initializers::descriptor_set_allocate_info(
-                descriptor_pools.direct_pass,
-                &descriptor_set_layouts.direct_pass,
+                descriptor_pools.gauss_pyramid_split,
+                &descriptor_set_layouts.gauss_pyramid_split,
                 1);
 
-        VK_CHECK(vkAllocateDescriptorSets(get_device().get_handle(), &alloc_info, &descriptor_sets.direct_pass));
+        descriptor_sets.gauss_pyramid_split.resize(MAX_MIP_LEVELS);
+        for (uint32_t i = 0; i < MAX_MIP_LEVELS; i++)
+        {
+            VK_CHECK(vkAllocateDescriptorSets(get_device().get_handle(), &alloc_info, &descriptor_sets.gauss_pyramid_split[i]));
+        }
     }
 
-    // Gaussian filter
+    // Tile classification
     {
         // Descriptor pool
         std::vector<VkDescriptorPoolSize> pool_sizes =
             {
-                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3 * MAX_MIP_LEVELS * 2),
-                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 * MAX_MIP_LEVELS * 2),
-                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3 * MAX_MIP_LEVELS * 2)};
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1),
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1)};
 
         VkDescriptorPoolCreateInfo descriptor_pool_create_info =
             vkb::initializers::descriptor_pool_create_info(
                 static_cast<uint32_t>(pool_sizes.size()),
                 pool_sizes.data(),
-                MAX_MIP_LEVELS * 2);
+                1);
 
-        VK_CHECK(vkCreateDescriptorPool(get_device().get_handle(), &descriptor_pool_create_info, nullptr, &descriptor_pools.gauss_filter));
+        VK_CHECK(vkCreateDescriptorPool(get_device().get_handle(), &descriptor_pool_create_info, nullptr, &descriptor_pools.tile_classify));
 
         // Memory allocation for descriptor set
         VkDescriptorSetAllocateInfo alloc_info =
             vkb::initializers::descriptor_set_allocate_info(
-                descriptor_pools.gauss_filter,
-                &descriptor_set_layouts.gauss_filter,
+                descriptor_pools.tile_classify,
+                &descriptor_set_layouts.tile_classify,
                 1);
 
-        descriptor_sets.gauss_horz_filter.resize(MAX_MIP_LEVELS);
-        descriptor_sets.gauss_vert_filter.resize(MAX_MIP_LEVELS);
-        for (uint32_t i = 0; i < MAX_MIP_LEVELS; i++)
-        {
-            VK_CHECK(vkAllocateDescriptorSets(get_device().get_handle(), &alloc_info, &descriptor_sets.gauss_horz_filter[i]));
-            VK_CHECK(vkAllocateDescriptorSets(get_device().get_handle(), &alloc_info, &descriptor_sets.gauss_vert_filter[i]));
-        }
+        VK_CHECK(vkAllocateDescriptorSets(get_device().get_handle(), &alloc_info, &descriptor_sets.tile_classify));
     }
 
     // LinSSS accumulation
@@ -3234,8 +6656,9 @@ void LinSSScatter::setup_descriptor_set()
         // Descriptor pool
         std::vector<VkDescriptorPoolSize> pool_sizes = {
             vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1),
-            vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
-            vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6)};
+            vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
+            vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 7),
+            vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1)};
 
         VkDescriptorPoolCreateInfo descriptor_pool_create_info =
             vkb::initializers::descriptor_pool_create_info(
@@ -3261,7 +6684,7 @@ void LinSSScatter::setup_descriptor_set()
         std::vector<VkDescriptorPoolSize> pool_sizes =
             {
                 vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3 * 2),
-                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 5 * 2)};
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 7 * 2)};
 
         VkDescriptorPoolCreateInfo descriptor_pool_create_info =
             vkb::initializers::descriptor_pool_create_info(
@@ -3282,13 +6705,71 @@ void LinSSScatter::setup_descriptor_set()
         VK_CHECK(vkAllocateDescriptorSets(get_device().get_handle(), &alloc_info, &descriptor_sets.trans_sm[1]));
     }
 
+    // TSM variance
+    {
+        // Descriptor pool
+        std::vector<VkDescriptorPoolSize> pool_sizes =
+            {
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2)};
+
+        VkDescriptorPoolCreateInfo descriptor_pool_create_info =
+            vkb::initializers::descriptor_pool_create_info(
+                static_cast<uint32_t>(pool_sizes.size()),
+                pool_sizes.data(),
+                1);
+
+        VK_CHECK(vkCreateDescriptorPool(get_device().get_handle(), &descriptor_pool_create_info, nullptr, &descriptor_pools.tsm_variance));
+
+        // Memory allocation for descriptor set
+        VkDescriptorSetAllocateInfo alloc_info =
+            vkb::initializers::descriptor_set_allocate_info(
+                descriptor_pools.tsm_variance,
+                &descriptor_set_layouts.tsm_variance,
+                1);
+
+        VK_CHECK(vkAllocateDescriptorSets(get_device().get_handle(), &alloc_info, &descriptor_sets.tsm_variance));
+    }
+
+    // Environment prefilter and BRDF LUT
+    {
+        // Descriptor pool (one set for each prefiltered level, and one for the LUT)
+        const uint32_t num_sets = ENV_PREFILTER_LEVELS + 1;
+
+        std::vector<VkDescriptorPoolSize> pool_sizes =
+            {
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, num_sets),
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, num_sets)};
+
+        VkDescriptorPoolCreateInfo descriptor_pool_create_info =
+            vkb::initializers::descriptor_pool_create_info(
+                static_cast<uint32_t>(pool_sizes.size()),
+                pool_sizes.data(),
+                num_sets);
+
+        VK_CHECK(vkCreateDescriptorPool(get_device().get_handle(), &descriptor_pool_create_info, nullptr, &descriptor_pools.env_prefilter));
+
+        // Memory allocation for descriptor sets
+        std::vector<VkDescriptorSetLayout> set_layouts(num_sets, descriptor_set_layouts.env_prefilter);
+        VkDescriptorSetAllocateInfo        alloc_info =
+            vkb::initializers::descriptor_set_allocate_info(
+                descriptor_pools.env_prefilter,
+                set_layouts.data(),
+                num_sets);
+
+        std::vector<VkDescriptorSet> sets(num_sets);
+        VK_CHECK(vkAllocateDescriptorSets(get_device().get_handle(), &alloc_info, sets.data()));
+        descriptor_sets.env_prefilter.assign(sets.begin(), sets.begin() + ENV_PREFILTER_LEVELS);
+        descriptor_sets.brdf_lut = sets.back();
+    }
+
     // Deferred shading
     {
         // Descriptor pool
         std::vector<VkDescriptorPoolSize> pool_sizes =
             {
-                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
-                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 5)};
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4),
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 10)};
 
         VkDescriptorPoolCreateInfo descriptor_pool_create_info =
             vkb::initializers::descriptor_pool_create_info(
@@ -3314,7 +6795,8 @@ void LinSSScatter::setup_descriptor_set()
         std::vector<VkDescriptorPoolSize> pool_sizes =
             {
                 vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
-                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)};
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
+                vkb::initializers::descriptor_pool_size(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1)};
 
         VkDescriptorPoolCreateInfo descriptor_pool_create_info =
             vkb::initializers::descriptor_pool_create_info(
@@ -3335,6 +6817,23 @@ void LinSSScatter::setup_descriptor_set()
     }
 }
 
+void LinSSScatter::update_envmap_descriptor()
+{
+    // Background of deferred shading reads the original envmap, which is created again when the environment changes.
+    // The prefiltered levels are resampled to a fixed size and are only for the specular of the direct pass.
+    VkDescriptorImageInfo desc_envmap_texture;
+    desc_envmap_texture.imageView   = envmap_texture.view;
+    desc_envmap_texture.sampler     = envmap_texture.sampler;
+    desc_envmap_texture.imageLayout = envmap_texture.image_layout;
+
+    VkWriteDescriptorSet write_descriptor_set = vkb::initializers::write_descriptor_set(
+        descriptor_sets.deferred,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        2,
+        &desc_envmap_texture);
+    vkUpdateDescriptorSets(get_device().get_handle(), 1, &write_descriptor_set, 0, nullptr);
+}
+
 void LinSSScatter::update_descriptor_set()
 {
     // Light pass
@@ -3358,11 +6857,6 @@ void LinSSScatter::update_descriptor_set()
         VkDescriptorBufferInfo desc_ubo_vs = create_descriptor(*uniform_buffer_vs);
         VkDescriptorBufferInfo desc_ubo_fs = create_descriptor(*uniform_buffer_fs);
 
-        VkDescriptorImageInfo desc_envmap_texture;
-        desc_envmap_texture.imageView   = envmap_texture.view;
-        desc_envmap_texture.sampler     = envmap_texture.sampler;
-        desc_envmap_texture.imageLayout = envmap_texture.image_layout;
-
         VkDescriptorImageInfo desc_Ks_texture;
         desc_Ks_texture.imageView   = Ks_texture.view;
         desc_Ks_texture.sampler     = Ks_texture.sampler;
@@ -3373,6 +6867,19 @@ void LinSSScatter::update_descriptor_set()
         desc_depth_buffer.sampler     = fbos.shadow_map.sampler;
         desc_depth_buffer.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
 
+        VkDescriptorImageInfo desc_depth_compare = desc_depth_buffer;
+        desc_depth_compare.sampler               = shadow_pcf.compare_sampler;
+
+        VkDescriptorImageInfo desc_prefiltered_envmap;
+        desc_prefiltered_envmap.imageView   = env_prefilter.prefiltered_view->get_handle();
+        desc_prefiltered_envmap.sampler     = env_prefilter.sampler;
+        desc_prefiltered_envmap.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkDescriptorImageInfo desc_brdf_lut;
+        desc_brdf_lut.imageView   = env_prefilter.brdf_lut_view->get_handle();
+        desc_brdf_lut.sampler     = env_prefilter.lut_sampler;
+        desc_brdf_lut.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
         // Descriptor set write information
         std::vector<VkWriteDescriptorSet> write_descriptor_sets =
             {
@@ -3394,18 +6901,30 @@ void LinSSScatter::update_descriptor_set()
                     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                     2,
                     &desc_Ks_texture),
-                // Binding 3 : Fragment shader, envmap texture sampler
+                // Binding 3 : Fragment shader, prefiltered envmap sampler
                 vkb::initializers::write_descriptor_set(
                     descriptor_sets.direct_pass,
                     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                     3,
-                    &desc_envmap_texture),
+                    &desc_prefiltered_envmap),
                 // Biding 4 : Fragment shader, depth buffer sampler
                 vkb::initializers::write_descriptor_set(
                     descriptor_sets.direct_pass,
                     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                     4,
                     &desc_depth_buffer),
+                // Binding 5 : Fragment shader, depth-compare sampler of shadow map
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.direct_pass,
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    5,
+                    &desc_depth_compare),
+                // Binding 6 : Fragment shader, split-sum BRDF LUT sampler
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.direct_pass,
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    6,
+                    &desc_brdf_lut),
             };
 
         vkUpdateDescriptorSets(get_device().get_handle(), static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
@@ -3414,9 +6933,24 @@ void LinSSScatter::update_descriptor_set()
     // Gaussian filter
     {
         const uint32_t mip_levels = max_mip_levels_surface();
+
+        // Kernel table for the tiled filter and the single-pass pyramid (sigma does not depend on MIP level)
+        {
+            const uint32_t     ksize = std::min(bssrdf.ksize, MAX_GAUSS_KERNEL_SIZE);
+            std::vector<float> kernel(ksize);
+            for (uint32_t k = 0; k < ksize; k++)
+            {
+                kernel[k] = gauss((float) k, push_const_gauss_cs.sigma * 2.0f);
+            }
+            storage_buffer_gauss_kernel->update(kernel.data(), sizeof(float) * ksize);
+        }
+
+        VkDescriptorBufferInfo desc_tile_lists = create_descriptor(*tile_lists.buffer);
+        VkDescriptorBufferInfo desc_gbuffer    = create_descriptor(*uniform_buffer_gbuffer);
+        VkDescriptorBufferInfo desc_kernel     = create_descriptor(*storage_buffer_gauss_kernel);
         for (uint32_t i = 0; i < mip_levels; i++)
         {
-            // Update descriptor set
+
             VkDescriptorImageInfo desc_in_image;
             desc_in_image.imageView   = in_image_mip_level_views[i];
             desc_in_image.sampler     = VkSampler{};
@@ -3442,117 +6976,233 @@ void LinSSScatter::update_descriptor_set()
             desc_normal_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
             desc_normal_texture.sampler     = fbos.direct_pass.sampler;
 
-            VkDescriptorImageInfo desc_depth_texture;
-            desc_depth_texture.imageView   = fbos.direct_pass.views[4].get_handle();
-            desc_depth_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            desc_depth_texture.sampler     = fbos.direct_pass.sampler;
+            VkDescriptorImageInfo desc_depth_texture = gbuffer_depth_descriptor();
+
+            // Update descriptor set (shared by horizontal and vertical filters)
+            std::vector<VkWriteDescriptorSet> write_descriptor_sets =
+                {
+                    // Binding 0 : input image
+                    vkb::initializers::write_descriptor_set(
+                        descriptor_sets.gauss_filter[i],
+                        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                        0,
+                        &desc_in_image),
+                    // Binding 1 : output image
+                    vkb::initializers::write_descriptor_set(
+                        descriptor_sets.gauss_filter[i],
+                        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                        1,
+                        &desc_out_image),
+                    // Binding 2 : buffer image
+                    vkb::initializers::write_descriptor_set(
+                        descriptor_sets.gauss_filter[i],
+                        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                        2,
+                        &desc_buf_image),
+                    // Binding 4 : position texture
+                    vkb::initializers::write_descriptor_set(
+                        descriptor_sets.gauss_filter[i],
+                        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        4,
+                        &desc_position_texture),
+                    // Binding 5 : normal texture
+                    vkb::initializers::write_descriptor_set(
+                        descriptor_sets.gauss_filter[i],
+                        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        5,
+                        &desc_normal_texture),
+                    // Binding 6 : depth texture
+                    vkb::initializers::write_descriptor_set(
+                        descriptor_sets.gauss_filter[i],
+                        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        6,
+                        &desc_depth_texture),
+                    // Binding 7 : kernel table
+                    vkb::initializers::write_descriptor_set(
+                        descriptor_sets.gauss_filter[i],
+                        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                        7,
+                        &desc_kernel),
+                    // Binding 8 : tile lists
+                    vkb::initializers::write_descriptor_set(
+                        descriptor_sets.gauss_filter[i],
+                        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                        8,
+                        &desc_tile_lists),
+                    // Binding 9 : G-buffer decoding
+                    vkb::initializers::write_descriptor_set(
+                        descriptor_sets.gauss_filter[i],
+                        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                        9,
+                        &desc_gbuffer)};
+
+            vkUpdateDescriptorSets(get_device().get_handle(), static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
+        }
+    }
+
+    // Gaussian pyramid (single pass)
+    {
+        // Unused array elements refer to the last MIP level
+        const uint32_t                     mip_levels = max_mip_levels_surface();
+        std::vector<VkDescriptorImageInfo> desc_in_images(MAX_MIP_LEVELS);
+        std::vector<VkDescriptorImageInfo> desc_out_images(MAX_MIP_LEVELS);
+        for (uint32_t i = 0; i < MAX_MIP_LEVELS; i++)
+        {
+            const uint32_t level = std::min(i, mip_levels - 1);
+
+            desc_in_images[i].imageView   = in_image_mip_level_views[level];
+            desc_in_images[i].sampler     = VkSampler{};
+            desc_in_images[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            desc_out_images[i].imageView   = out_image_mip_level_views[level];
+            desc_out_images[i].sampler     = VkSampler{};
+            desc_out_images[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        }
+
+        VkDescriptorImageInfo desc_position_texture;
+        desc_position_texture.imageView   = fbos.direct_pass.views[2].get_handle();
+        desc_position_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        desc_position_texture.sampler     = fbos.direct_pass.sampler;
+
+        VkDescriptorImageInfo desc_normal_texture;
+        desc_normal_texture.imageView   = fbos.direct_pass.views[3].get_handle();
+        desc_normal_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        desc_normal_texture.sampler     = fbos.direct_pass.sampler;
+
+        VkDescriptorImageInfo desc_depth_texture = gbuffer_depth_descriptor();
 
-            // Update descriptor set
+        ubo_gauss_pyramid_cs.num_levels = mip_levels;
+        uniform_buffer_gauss_pyramid_cs->convert_and_update(ubo_gauss_pyramid_cs);
+        VkDescriptorBufferInfo desc_ubo_gauss_pyramid = create_descriptor(*uniform_buffer_gauss_pyramid_cs);
+        VkDescriptorBufferInfo desc_kernel            = create_descriptor(*storage_buffer_gauss_kernel);
+        VkDescriptorBufferInfo desc_counter           = create_descriptor(*storage_buffer_gauss_pyramid_counter);
+        VkDescriptorBufferInfo desc_gbuffer           = create_descriptor(*uniform_buffer_gbuffer);
+
+        std::vector<VkWriteDescriptorSet> write_descriptor_sets =
             {
-                ubo_gauss_cs.direction = 0;
-                uniform_buffer_gauss_horz_cs->convert_and_update(ubo_gauss_cs);
-                VkDescriptorBufferInfo desc_ubo_gauss_horz = create_descriptor(*uniform_buffer_gauss_horz_cs);
+                // Binding 0 : input images
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.gauss_pyramid,
+                    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    0,
+                    desc_in_images.data(),
+                    MAX_MIP_LEVELS),
+                // Binding 1 : output images
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.gauss_pyramid,
+                    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    1,
+                    desc_out_images.data(),
+                    MAX_MIP_LEVELS),
+                // Binding 2 : uniform buffer object
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.gauss_pyramid,
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    2,
+                    &desc_ubo_gauss_pyramid),
+                // Binding 3 : position texture
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.gauss_pyramid,
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    3,
+                    &desc_position_texture),
+                // Binding 4 : normal texture
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.gauss_pyramid,
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    4,
+                    &desc_normal_texture),
+                // Binding 5 : depth texture
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.gauss_pyramid,
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    5,
+                    &desc_depth_texture),
+                // Binding 6 : kernel tables
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.gauss_pyramid,
+                    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    6,
+                    &desc_kernel),
+                // Binding 7 : tile counter
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.gauss_pyramid,
+                    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    7,
+                    &desc_counter),
+                // Binding 8 : G-buffer decoding
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.gauss_pyramid,
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    8,
+                    &desc_gbuffer)};
 
-                std::vector<VkWriteDescriptorSet> write_descriptor_sets =
-                    {
-                        // Binding 0 : input image
-                        vkb::initializers::write_descriptor_set(
-                            descriptor_sets.gauss_horz_filter[i],
-                            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-                            0,
-                            &desc_in_image),
-                        // Binding 0 : input image
-                        vkb::initializers::write_descriptor_set(
-                            descriptor_sets.gauss_horz_filter[i],
-                            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-                            1,
-                            &desc_out_image),
-                        // Binding 2 : buffer image
-                        vkb::initializers::write_descriptor_set(
-                            descriptor_sets.gauss_horz_filter[i],
-                            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-                            2,
-                            &desc_buf_image),
-                        // Binding 3 : uniform buffer object
-                        vkb::initializers::write_descriptor_set(
-                            descriptor_sets.gauss_horz_filter[i],
-                            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                            3,
-                            &desc_ubo_gauss_horz),
-                        // Binding 4 : position texture
-                        vkb::initializers::write_descriptor_set(
-                            descriptor_sets.gauss_horz_filter[i],
-                            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                            4,
-                            &desc_position_texture),
-                        // Binding 5 : normal texture
-                        vkb::initializers::write_descriptor_set(
-                            descriptor_sets.gauss_horz_filter[i],
-                            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                            5,
-                            &desc_normal_texture),
-                        // Binding 6 : depth texture
-                        vkb::initializers::write_descriptor_set(
-                            descriptor_sets.gauss_horz_filter[i],
-                            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                            6,
-                            &desc_depth_texture)};
-
-                vkUpdateDescriptorSets(get_device().get_handle(), static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
-            }
+        vkUpdateDescriptorSets(get_device().get_handle(), static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
+    }
 
+    // Tile classification
+    {
+        VkDescriptorImageInfo desc_depth_texture = gbuffer_depth_descriptor();
+
+        VkDescriptorBufferInfo desc_tile_lists = create_descriptor(*tile_lists.buffer);
+        VkDescriptorBufferInfo desc_gbuffer    = create_descriptor(*uniform_buffer_gbuffer);
+
+        std::vector<VkWriteDescriptorSet> write_descriptor_sets =
             {
-                ubo_gauss_cs.direction = 1;
-                uniform_buffer_gauss_vert_cs->convert_and_update(ubo_gauss_cs);
-                VkDescriptorBufferInfo desc_ubo_gauss_vert = create_descriptor(*uniform_buffer_gauss_vert_cs);
+                // Binding 0 : depth texture
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.tile_classify,
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    0,
+                    &desc_depth_texture),
+                // Binding 1 : tile lists
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.tile_classify,
+                    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    1,
+                    &desc_tile_lists),
+                // Binding 2 : G-buffer decoding
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.tile_classify,
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    2,
+                    &desc_gbuffer)};
 
-                std::vector<VkWriteDescriptorSet> write_descriptor_sets =
-                    {
-                        // Binding 0 : input image
-                        vkb::initializers::write_descriptor_set(
-                            descriptor_sets.gauss_vert_filter[i],
-                            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-                            0,
-                            &desc_in_image),
-                        // Binding 0 : input image
-                        vkb::initializers::write_descriptor_set(
-                            descriptor_sets.gauss_vert_filter[i],
-                            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-                            1,
-                            &desc_out_image),
-                        // Binding 2 : buffer image
-                        vkb::initializers::write_descriptor_set(
-                            descriptor_sets.gauss_vert_filter[i],
-                            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-                            2,
-                            &desc_buf_image),
-                        // Binding 3 : uniform buffer object
-                        vkb::initializers::write_descriptor_set(
-                            descriptor_sets.gauss_vert_filter[i],
-                            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                            3,
-                            &desc_ubo_gauss_vert),
-                        // Binding 4 : position texture
-                        vkb::initializers::write_descriptor_set(
-                            descriptor_sets.gauss_vert_filter[i],
-                            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                            4,
-                            &desc_position_texture),
-                        // Binding 5 : normal texture
-                        vkb::initializers::write_descriptor_set(
-                            descriptor_sets.gauss_vert_filter[i],
-                            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                            5,
-                            &desc_normal_texture),
-                        // Binding 6 : depth texture
-                        vkb::initializers::write_descriptor_set(
-                            descriptor_sets.gauss_vert_filter[i],
-                            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                            6,
-                            &desc_depth_texture)};
-
-                vkUpdateDescriptorSets(get_device().get_handle(), static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
-            }
+        vkUpdateDescriptorSets(get_device().get_handle(), static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
+    }
+
+    // Channel-separated Gaussian pyramid
+    {
+        const uint32_t mip_levels = max_mip_levels_surface();
+
+        VkDescriptorImageInfo desc_tex_G_ast_Phi;
+        desc_tex_G_ast_Phi.imageView   = G_ast_Phi_texture.view;
+        desc_tex_G_ast_Phi.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        desc_tex_G_ast_Phi.sampler     = G_ast_Phi_texture.sampler;
+
+        for (uint32_t i = 0; i < mip_levels; i++)
+        {
+            VkDescriptorImageInfo desc_out_image;
+            desc_out_image.imageView   = fbos.gauss_pyramid_split.views[i + 1].get_handle();
+            desc_out_image.sampler     = VkSampler{};
+            desc_out_image.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            std::vector<VkWriteDescriptorSet> write_descriptor_sets =
+                {
+                    // Binding 0 : G * Phi texture
+                    vkb::initializers::write_descriptor_set(
+                        descriptor_sets.gauss_pyramid_split[i],
+                        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        0,
+                        &desc_tex_G_ast_Phi),
+                    // Binding 1 : output image
+                    vkb::initializers::write_descriptor_set(
+                        descriptor_sets.gauss_pyramid_split[i],
+                        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                        1,
+                        &desc_out_image)};
+
+            vkUpdateDescriptorSets(get_device().get_handle(), static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
         }
     }
 
@@ -3565,6 +7215,8 @@ void LinSSScatter::update_descriptor_set()
         desc_out_image.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
         VkDescriptorBufferInfo desc_ubo_linsss = create_descriptor(*uniform_buffer_linsss_cs);
+        VkDescriptorBufferInfo desc_tile_lists = create_descriptor(*tile_lists.buffer);
+        VkDescriptorBufferInfo desc_gbuffer    = create_descriptor(*uniform_buffer_gbuffer);
 
         VkDescriptorImageInfo desc_tex_W;
         desc_tex_W.imageView   = bssrdf.view_W;
@@ -3581,6 +7233,11 @@ void LinSSScatter::update_descriptor_set()
         desc_tex_G_ast_Phi.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
         desc_tex_G_ast_Phi.sampler     = G_ast_Phi_texture.sampler;
 
+        VkDescriptorImageInfo desc_tex_G_ast_Phi_split;
+        desc_tex_G_ast_Phi_split.imageView   = fbos.gauss_pyramid_split.views[0].get_handle();
+        desc_tex_G_ast_Phi_split.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        desc_tex_G_ast_Phi_split.sampler     = fbos.gauss_pyramid_split.sampler;
+
         VkDescriptorImageInfo desc_position_texture;
         desc_position_texture.imageView   = fbos.direct_pass.views[2].get_handle();
         desc_position_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -3591,10 +7248,7 @@ void LinSSScatter::update_descriptor_set()
         desc_normal_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
         desc_normal_texture.sampler     = fbos.direct_pass.sampler;
 
-        VkDescriptorImageInfo desc_depth_texture;
-        desc_depth_texture.imageView   = fbos.direct_pass.views[4].get_handle();
-        desc_depth_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        desc_depth_texture.sampler     = fbos.direct_pass.sampler;
+        VkDescriptorImageInfo desc_depth_texture = gbuffer_depth_descriptor();
 
         // Descriptor set write information
         std::vector<VkWriteDescriptorSet> write_descriptor_sets =
@@ -3646,7 +7300,25 @@ void LinSSScatter::update_descriptor_set()
                     descriptor_sets.linsss,
                     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                     7,
-                    &desc_depth_texture)};
+                    &desc_depth_texture),
+                // Binding 8 : channel-separated (G * Phi)
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.linsss,
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    8,
+                    &desc_tex_G_ast_Phi_split),
+                // Binding 9 : tile lists
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.linsss,
+                    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    9,
+                    &desc_tile_lists),
+                // Binding 10 : G-buffer decoding
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.linsss,
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    10,
+                    &desc_gbuffer)};
 
         vkUpdateDescriptorSets(get_device().get_handle(), static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
     }
@@ -3658,14 +7330,16 @@ void LinSSScatter::update_descriptor_set()
         VkDescriptorBufferInfo desc_ubo_tsm_fs = create_descriptor(*uniform_buffer_tsm_fs);
 
         VkDescriptorImageInfo desc_irr_texture;
-        desc_irr_texture.imageView   = fbos.shadow_map.views[0].get_handle();
+        desc_irr_texture.imageView   = fbos.shadow_map.views[4].get_handle();
         desc_irr_texture.sampler     = fbos.shadow_map.sampler;
         desc_irr_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
+        // Position is reconstructed from depth unless it is rendered
+        const bool            pos_from_depth = light_pass_targets.active_format != LightPassFormat::FullPrecision;
         VkDescriptorImageInfo desc_pos_texture;
-        desc_pos_texture.imageView   = fbos.shadow_map.views[1].get_handle();
+        desc_pos_texture.imageView   = pos_from_depth ? fbos.shadow_map.views[3].get_handle() : fbos.shadow_map.views[5].get_handle();
         desc_pos_texture.sampler     = fbos.shadow_map.sampler;
-        desc_pos_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        desc_pos_texture.imageLayout = pos_from_depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
         VkDescriptorImageInfo desc_norm_texture;
         desc_norm_texture.imageView   = fbos.shadow_map.views[2].get_handle();
@@ -3677,6 +7351,16 @@ void LinSSScatter::update_descriptor_set()
         desc_bssrdf_texture.sampler     = bssrdf.sampler;
         desc_bssrdf_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
+        VkDescriptorImageInfo desc_profile_lut;
+        desc_profile_lut.imageView   = tsm_profile.lut_view->get_handle();
+        desc_profile_lut.sampler     = tsm_profile.sampler;
+        desc_profile_lut.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkDescriptorImageInfo desc_profile_codes;
+        desc_profile_codes.imageView   = tsm_profile.codes_view->get_handle();
+        desc_profile_codes.sampler     = tsm_profile.sampler;
+        desc_profile_codes.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
         // Ping
         {
             VkDescriptorImageInfo desc_accum_texture;
@@ -3725,7 +7409,17 @@ void LinSSScatter::update_descriptor_set()
                         descriptor_sets.trans_sm[0],
                         VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                         7,
-                        &desc_bssrdf_texture)};
+                        &desc_bssrdf_texture),
+                    vkb::initializers::write_descriptor_set(
+                        descriptor_sets.trans_sm[0],
+                        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        8,
+                        &desc_profile_lut),
+                    vkb::initializers::write_descriptor_set(
+                        descriptor_sets.trans_sm[0],
+                        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        9,
+                        &desc_profile_codes)};
 
             vkUpdateDescriptorSets(get_device().get_handle(), static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
         }
@@ -3777,10 +7471,95 @@ void LinSSScatter::update_descriptor_set()
                         descriptor_sets.trans_sm[1],
                         VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                         7,
-                        &desc_bssrdf_texture)};
+                        &desc_bssrdf_texture),
+                    vkb::initializers::write_descriptor_set(
+                        descriptor_sets.trans_sm[1],
+                        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        8,
+                        &desc_profile_lut),
+                    vkb::initializers::write_descriptor_set(
+                        descriptor_sets.trans_sm[1],
+                        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        9,
+                        &desc_profile_codes)};
+
+            vkUpdateDescriptorSets(get_device().get_handle(), static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
+        }
+    }
+
+    // TSM variance
+    {
+        VkDescriptorImageInfo desc_accum_texture;
+        desc_accum_texture.imageView   = tsm_texture.view;
+        desc_accum_texture.sampler     = tsm_texture.sampler;
+        desc_accum_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkDescriptorBufferInfo desc_moments     = create_descriptor(*tsm_accumulation.moments);
+        VkDescriptorBufferInfo desc_tile_errors = create_descriptor(*tsm_accumulation.tile_errors);
+
+        std::vector<VkWriteDescriptorSet> write_descriptor_sets =
+            {
+                // Binding 0 : accumulated TSM
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.tsm_variance,
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    0,
+                    &desc_accum_texture),
+                // Binding 1 : per-pixel moments
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.tsm_variance,
+                    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    1,
+                    &desc_moments),
+                // Binding 2 : per-tile errors
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.tsm_variance,
+                    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    2,
+                    &desc_tile_errors)};
 
-            vkUpdateDescriptorSets(get_device().get_handle(), static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
+        vkUpdateDescriptorSets(get_device().get_handle(), static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
+    }
+
+    // Environment prefilter and BRDF LUT
+    {
+        VkDescriptorImageInfo desc_radiance;
+        desc_radiance.imageView   = env_prefilter.radiance_view->get_handle();
+        desc_radiance.sampler     = env_prefilter.sampler;
+        desc_radiance.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        std::vector<VkDescriptorImageInfo> desc_out_images(ENV_PREFILTER_LEVELS + 1);
+        for (uint32_t i = 0; i < ENV_PREFILTER_LEVELS; i++)
+        {
+            desc_out_images[i].imageView   = env_prefilter.level_views[i].get_handle();
+            desc_out_images[i].sampler     = VkSampler{};
+            desc_out_images[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        }
+        desc_out_images.back().imageView   = env_prefilter.brdf_lut_view->get_handle();
+        desc_out_images.back().sampler     = VkSampler{};
+        desc_out_images.back().imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        std::vector<VkWriteDescriptorSet> write_descriptor_sets;
+        for (uint32_t i = 0; i <= ENV_PREFILTER_LEVELS; i++)
+        {
+            VkDescriptorSet descriptor_set = i < ENV_PREFILTER_LEVELS ? descriptor_sets.env_prefilter[i] : descriptor_sets.brdf_lut;
+            // Binding 0 : radiance of the environment
+            write_descriptor_sets.push_back(
+                vkb::initializers::write_descriptor_set(
+                    descriptor_set,
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    0,
+                    &desc_radiance));
+            // Binding 1 : output image
+            write_descriptor_sets.push_back(
+                vkb::initializers::write_descriptor_set(
+                    descriptor_set,
+                    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    1,
+                    &desc_out_images[i]));
         }
+
+        vkUpdateDescriptorSets(get_device().get_handle(), static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
     }
 
     // Deferred shading
@@ -3788,16 +7567,45 @@ void LinSSScatter::update_descriptor_set()
         VkDescriptorBufferInfo desc_ubo_vs = create_descriptor(*uniform_buffer_vs);
         VkDescriptorBufferInfo desc_ubo_fs = create_descriptor(*uniform_buffer_fs);
 
+        // Background reads the original envmap (see "update_envmap_descriptor")
         VkDescriptorImageInfo desc_envmap_texture;
         desc_envmap_texture.imageView   = envmap_texture.view;
         desc_envmap_texture.sampler     = envmap_texture.sampler;
         desc_envmap_texture.imageLayout = envmap_texture.image_layout;
 
+        // LinSSS image (not read by the fused pipelines, see "fusedLinsss" in deferred_pass.frag)
         VkDescriptorImageInfo desc_sss_texture;
         desc_sss_texture.imageView   = fbos.linsss.views[0].get_handle();
         desc_sss_texture.sampler     = fbos.linsss.sampler;
         desc_sss_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
+        VkDescriptorBufferInfo desc_ubo_linsss = create_descriptor(*uniform_buffer_linsss_cs);
+
+        VkDescriptorImageInfo desc_tex_W;
+        desc_tex_W.imageView   = bssrdf.view_W;
+        desc_tex_W.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        desc_tex_W.sampler     = bssrdf.sampler;
+
+        VkDescriptorImageInfo desc_tex_G_ast_W;
+        desc_tex_G_ast_W.imageView   = bssrdf.view_G_ast_W;
+        desc_tex_G_ast_W.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        desc_tex_G_ast_W.sampler     = bssrdf.sampler;
+
+        VkDescriptorImageInfo desc_tex_G_ast_Phi;
+        desc_tex_G_ast_Phi.imageView   = G_ast_Phi_texture.view;
+        desc_tex_G_ast_Phi.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        desc_tex_G_ast_Phi.sampler     = G_ast_Phi_texture.sampler;
+
+        VkDescriptorImageInfo desc_tex_G_ast_Phi_split;
+        desc_tex_G_ast_Phi_split.imageView   = fbos.gauss_pyramid_split.views[0].get_handle();
+        desc_tex_G_ast_Phi_split.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        desc_tex_G_ast_Phi_split.sampler     = fbos.gauss_pyramid_split.sampler;
+
+        VkDescriptorImageInfo desc_position_texture;
+        desc_position_texture.imageView   = fbos.direct_pass.views[2].get_handle();
+        desc_position_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        desc_position_texture.sampler     = fbos.direct_pass.sampler;
+
         VkDescriptorImageInfo desc_tsm_texture;
         desc_tsm_texture.imageView   = tsm_texture.view;
         desc_tsm_texture.sampler     = tsm_texture.sampler;
@@ -3808,10 +7616,9 @@ void LinSSScatter::update_descriptor_set()
         desc_spec_buffer.sampler     = fbos.direct_pass.sampler;
         desc_spec_buffer.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-        VkDescriptorImageInfo desc_depth_buffer;
-        desc_depth_buffer.imageView   = fbos.direct_pass.views[4].get_handle();
-        desc_depth_buffer.sampler     = fbos.direct_pass.sampler;
-        desc_depth_buffer.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        VkDescriptorImageInfo desc_depth_buffer = gbuffer_depth_descriptor();
+
+        VkDescriptorBufferInfo desc_gbuffer = create_descriptor(*uniform_buffer_gbuffer);
 
         // Descriptor set write information
         std::vector<VkWriteDescriptorSet> write_descriptor_sets =
@@ -3858,6 +7665,48 @@ void LinSSScatter::update_descriptor_set()
                     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                     6,
                     &desc_depth_buffer),
+                // Binding 7 : Fragment shader, LinSSS uniform buffer
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.deferred,
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    7,
+                    &desc_ubo_linsss),
+                // Binding 8 : Fragment shader, W texture sampler
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.deferred,
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    8,
+                    &desc_tex_W),
+                // Binding 9 : Fragment shader, (G * W) texture sampler
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.deferred,
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    9,
+                    &desc_tex_G_ast_W),
+                // Binding 10 : Fragment shader, (G * Phi) texture sampler
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.deferred,
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    10,
+                    &desc_tex_G_ast_Phi),
+                // Binding 11 : Fragment shader, channel-separated (G * Phi) texture sampler
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.deferred,
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    11,
+                    &desc_tex_G_ast_Phi_split),
+                // Binding 12 : Fragment shader, position buffer sampler
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.deferred,
+                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    12,
+                    &desc_position_texture),
+                // Binding 13 : Fragment shader, G-buffer decoding
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.deferred,
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    13,
+                    &desc_gbuffer),
             };
 
         vkUpdateDescriptorSets(get_device().get_handle(), static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
@@ -3868,10 +7717,15 @@ void LinSSScatter::update_descriptor_set()
         VkDescriptorBufferInfo desc_ubo_postproc_vs = create_descriptor(*uniform_buffer_postproc_vs);
 
         VkDescriptorImageInfo desc_source_texture;
-        desc_source_texture.imageView   = fbos.deferred.views[0].get_handle();
+        desc_source_texture.imageView   = VK_NULL_HANDLE;
         desc_source_texture.sampler     = fbos.deferred.sampler;
         desc_source_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
+        VkDescriptorImageInfo desc_input_attachment;
+        desc_input_attachment.imageView   = subpass_merge.color_view->get_handle();
+        desc_input_attachment.sampler     = VK_NULL_HANDLE;
+        desc_input_attachment.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
         // Descriptor set write information
         std::vector<VkWriteDescriptorSet> write_descriptor_sets =
             {
@@ -3881,20 +7735,37 @@ void LinSSScatter::update_descriptor_set()
                     VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
                     0,
                     &desc_ubo_postproc_vs),
-                // Binding 1 : Fragment shader, envmap texture sampler
+                // Binding 2 : Fragment shader, deferred color of the first subpass
+                vkb::initializers::write_descriptor_set(
+                    descriptor_sets.postprocess,
+                    VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
+                    2,
+                    &desc_input_attachment)};
+
+        // Binding 1 : Fragment shader, deferred color of separate passes (merged subpasses have no such image,
+        // and their pipeline does not use the binding)
+        if (!fbos.deferred.views.empty())
+        {
+            desc_source_texture.imageView = fbos.deferred.views[0].get_handle();
+            write_descriptor_sets.push_back(
                 vkb::initializers::write_descriptor_set(
                     descriptor_sets.postprocess,
                     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                     1,
-                    &desc_source_texture)};
+                    &desc_source_texture));
+        }
 
         vkUpdateDescriptorSets(get_device().get_handle(), static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
     }
 }
 
-void LinSSScatter::prepare_pipelines()
+void LinSSScatter::prepare_light_pass_pipeline()
 {
-    // Common settings for all the pipelines
+    // Render targets depend on the active format (see "light_pass_formats")
+    const int                     format     = light_pass_targets.active_format;
+    const std::array<VkFormat, 3> formats    = light_pass_formats(format);
+    const uint32_t                num_colors = static_cast<uint32_t>(std::count_if(formats.begin(), formats.end(), [](VkFormat f) { return f != VK_FORMAT_UNDEFINED; }));
+
     VkPipelineInputAssemblyStateCreateInfo input_assembly_state =
         vkb::initializers::pipeline_input_assembly_state_create_info(
             VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
@@ -3908,15 +7779,107 @@ void LinSSScatter::prepare_pipelines()
             VK_FRONT_FACE_COUNTER_CLOCKWISE,
             0);
 
-    VkPipelineColorBlendAttachmentState blend_attachment_state =
-        vkb::initializers::pipeline_color_blend_attachment_state(
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_state =
+        vkb::initializers::pipeline_depth_stencil_state_create_info(
+            VK_TRUE,
+            VK_TRUE,
+            VK_COMPARE_OP_LESS);
+
+    VkPipelineViewportStateCreateInfo viewport_state =
+        vkb::initializers::pipeline_viewport_state_create_info(1, 1, 0);
+
+    VkPipelineMultisampleStateCreateInfo multisample_state =
+        vkb::initializers::pipeline_multisample_state_create_info(
+            VK_SAMPLE_COUNT_1_BIT,
+            0);
+
+    std::vector<VkDynamicState> dynamic_state_enables = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR};
+
+    VkPipelineDynamicStateCreateInfo dynamic_state =
+        vkb::initializers::pipeline_dynamic_state_create_info(
+            dynamic_state_enables.data(),
+            static_cast<uint32_t>(dynamic_state_enables.size()),
+            0);
+
+    // Multiple render targets
+    std::vector<VkPipelineColorBlendAttachmentState> multi_blend_attachment_states(num_colors);
+    for (uint32_t i = 0; i < num_colors; i++)
+    {
+        multi_blend_attachment_states[i] = vkb::initializers::pipeline_color_blend_attachment_state(
             0xf,
             VK_FALSE);
-
-    VkPipelineColorBlendStateCreateInfo color_blend_state =
+    }
+    VkPipelineColorBlendStateCreateInfo multi_color_blend_state =
         vkb::initializers::pipeline_color_blend_state_create_info(
-            1,
-            &blend_attachment_state);
+            num_colors,
+            multi_blend_attachment_states.data());
+
+    // Load shaders (depth-only pass has no fragment shader)
+    std::vector<VkPipelineShaderStageCreateInfo> shader_stages;
+    shader_stages.push_back(load_spirv("linsss/light_pass.vert.spv", VK_SHADER_STAGE_VERTEX_BIT));
+    if (format == LightPassFormat::FullPrecision)
+    {
+        shader_stages.push_back(load_spirv("linsss/light_pass.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT));
+    }
+    else if (format == LightPassFormat::Compact)
+    {
+        shader_stages.push_back(load_spirv("linsss/light_pass_compact.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT));
+    }
+
+    // Vertex bindings and attributes
+    const std::vector<VkVertexInputBindingDescription> vertex_input_bindings = {
+        vkb::initializers::vertex_input_binding_description(0, sizeof(LinSSScatterVertexStructure), VK_VERTEX_INPUT_RATE_VERTEX),
+    };
+    const std::vector<VkVertexInputAttributeDescription> vertex_input_attributes = {
+        vkb::initializers::vertex_input_attribute_description(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(LinSSScatterVertexStructure, pos)),
+        vkb::initializers::vertex_input_attribute_description(0, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(LinSSScatterVertexStructure, uv)),
+        vkb::initializers::vertex_input_attribute_description(0, 2, VK_FORMAT_R32G32B32_SFLOAT, offsetof(LinSSScatterVertexStructure, normal)),
+    };
+    VkPipelineVertexInputStateCreateInfo vertex_input_state = vkb::initializers::pipeline_vertex_input_state_create_info();
+    vertex_input_state.vertexBindingDescriptionCount        = static_cast<uint32_t>(vertex_input_bindings.size());
+    vertex_input_state.pVertexBindingDescriptions           = vertex_input_bindings.data();
+    vertex_input_state.vertexAttributeDescriptionCount      = static_cast<uint32_t>(vertex_input_attributes.size());
+    vertex_input_state.pVertexAttributeDescriptions         = vertex_input_attributes.data();
+
+    VkGraphicsPipelineCreateInfo pipeline_create_info =
+        vkb::initializers::pipeline_create_info(
+            pipeline_layouts.light_pass,
+            render_passes.light_pass,
+            0);
+
+    pipeline_create_info.pVertexInputState   = &vertex_input_state;
+    pipeline_create_info.pInputAssemblyState = &input_assembly_state;
+    pipeline_create_info.pRasterizationState = &rasterization_state;
+    pipeline_create_info.pColorBlendState    = &multi_color_blend_state;
+    pipeline_create_info.pMultisampleState   = &multisample_state;
+    pipeline_create_info.pViewportState      = &viewport_state;
+    pipeline_create_info.pDepthStencilState  = &depth_stencil_state;
+    pipeline_create_info.pDynamicState       = &dynamic_state;
+    pipeline_create_info.stageCount          = static_cast<uint32_t>(shader_stages.size());
+    pipeline_create_info.pStages             = shader_stages.data();
+
+    VK_CHECK(vkCreateGraphicsPipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.light_pass));
+}
+
+void LinSSScatter::prepare_direct_pass_pipeline()
+{
+    // Render targets that are not used by the active profile are written to no attachment (see "setup_direct_pass_render_pass")
+    const bool packed_normal = gbuffer_targets.active_profile != GBufferProfile::Float32;
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly_state =
+        vkb::initializers::pipeline_input_assembly_state_create_info(
+            VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+            0,
+            VK_FALSE);
+
+    VkPipelineRasterizationStateCreateInfo rasterization_state =
+        vkb::initializers::pipeline_rasterization_state_create_info(
+            VK_POLYGON_MODE_FILL,
+            VK_CULL_MODE_NONE,
+            VK_FRONT_FACE_COUNTER_CLOCKWISE,
+            0);
 
     VkPipelineDepthStencilStateCreateInfo depth_stencil_state =
         vkb::initializers::pipeline_depth_stencil_state_create_info(
@@ -3942,115 +7905,135 @@ void LinSSScatter::prepare_pipelines()
             static_cast<uint32_t>(dynamic_state_enables.size()),
             0);
 
-    // Pipeline for light pass
+    // Multiple render targets
+    std::array<VkPipelineColorBlendAttachmentState, 5> multi_blend_attachment_states = {};
+    for (uint32_t i = 0; i < static_cast<uint32_t>(multi_blend_attachment_states.size()); i++)
     {
-        // Multiple render targets
-        std::array<VkPipelineColorBlendAttachmentState, 3> multi_blend_attachment_states = {};
-        for (uint32_t i = 0; i < static_cast<uint32_t>(multi_blend_attachment_states.size()); i++)
-        {
-            multi_blend_attachment_states[i] = vkb::initializers::pipeline_color_blend_attachment_state(
-                0xf,
-                VK_FALSE);
-        }
-        VkPipelineColorBlendStateCreateInfo multi_color_blend_state =
-            vkb::initializers::pipeline_color_blend_state_create_info(
-                multi_blend_attachment_states.size(),
-                multi_blend_attachment_states.data());
+        multi_blend_attachment_states[i] = vkb::initializers::pipeline_color_blend_attachment_state(
+            0xf,
+            VK_FALSE);
+    }
+    VkPipelineColorBlendStateCreateInfo multi_color_blend_state =
+        vkb::initializers::pipeline_color_blend_state_create_info(
+            multi_blend_attachment_states.size(),
+            multi_blend_attachment_states.data());
 
-        // Load shaders
-        std::array<VkPipelineShaderStageCreateInfo, 2> shader_stages = {};
-        shader_stages[0]                                             = load_spirv("linsss/light_pass.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-        shader_stages[1]                                             = load_spirv("linsss/light_pass.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+    // Load shaders
+    std::array<VkPipelineShaderStageCreateInfo, 2> shader_stages = {};
+    shader_stages[0]                                             = load_spirv("linsss/direct_pass.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+    shader_stages[1]                                             = load_spirv("linsss/direct_pass.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 
-        // Vertex bindings and attributes
-        const std::vector<VkVertexInputBindingDescription> vertex_input_bindings = {
-            vkb::initializers::vertex_input_binding_description(0, sizeof(LinSSScatterVertexStructure), VK_VERTEX_INPUT_RATE_VERTEX),
-        };
-        const std::vector<VkVertexInputAttributeDescription> vertex_input_attributes = {
-            vkb::initializers::vertex_input_attribute_description(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(LinSSScatterVertexStructure, pos)),
-            vkb::initializers::vertex_input_attribute_description(0, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(LinSSScatterVertexStructure, uv)),
-            vkb::initializers::vertex_input_attribute_description(0, 2, VK_FORMAT_R32G32B32_SFLOAT, offsetof(LinSSScatterVertexStructure, normal)),
-        };
-        VkPipelineVertexInputStateCreateInfo vertex_input_state = vkb::initializers::pipeline_vertex_input_state_create_info();
-        vertex_input_state.vertexBindingDescriptionCount        = static_cast<uint32_t>(vertex_input_bindings.size());
-        vertex_input_state.pVertexBindingDescriptions           = vertex_input_bindings.data();
-        vertex_input_state.vertexAttributeDescriptionCount      = static_cast<uint32_t>(vertex_input_attributes.size());
-        vertex_input_state.pVertexAttributeDescriptions         = vertex_input_attributes.data();
+    // Normal is written in octahedral coordinates by the reduced profiles, which have no position and depth targets
+    struct SpecializationData
+    {
+        VkBool32 packed_normal;
+        VkBool32 store_position;
+    } specialization_data;
+
+    std::vector<VkSpecializationMapEntry> specialization_map_entries;
+    specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(0, offsetof(SpecializationData, packed_normal), sizeof(VkBool32)));
+    specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(1, offsetof(SpecializationData, store_position), sizeof(VkBool32)));
+
+    specialization_data.packed_normal  = packed_normal ? VK_TRUE : VK_FALSE;
+    specialization_data.store_position = packed_normal ? VK_FALSE : VK_TRUE;
+
+    VkSpecializationInfo specialization_info = vkb::initializers::specialization_info(static_cast<uint32_t>(specialization_map_entries.size()),
+                                                                                      specialization_map_entries.data(),
+                                                                                      sizeof(SpecializationData),
+                                                                                      &specialization_data);
+
+    shader_stages[1].pSpecializationInfo = &specialization_info;
+
+    // Vertex bindings and attributes
+    const std::vector<VkVertexInputBindingDescription> vertex_input_bindings = {
+        vkb::initializers::vertex_input_binding_description(0, sizeof(LinSSScatterVertexStructure), VK_VERTEX_INPUT_RATE_VERTEX),
+    };
+    const std::vector<VkVertexInputAttributeDescription> vertex_input_attributes = {
+        vkb::initializers::vertex_input_attribute_description(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(LinSSScatterVertexStructure, pos)),
+        vkb::initializers::vertex_input_attribute_description(0, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(LinSSScatterVertexStructure, uv)),
+        vkb::initializers::vertex_input_attribute_description(0, 2, VK_FORMAT_R32G32B32_SFLOAT, offsetof(LinSSScatterVertexStructure, normal)),
+    };
+    VkPipelineVertexInputStateCreateInfo vertex_input_state = vkb::initializers::pipeline_vertex_input_state_create_info();
+    vertex_input_state.vertexBindingDescriptionCount        = static_cast<uint32_t>(vertex_input_bindings.size());
+    vertex_input_state.pVertexBindingDescriptions           = vertex_input_bindings.data();
+    vertex_input_state.vertexAttributeDescriptionCount      = static_cast<uint32_t>(vertex_input_attributes.size());
+    vertex_input_state.pVertexAttributeDescriptions         = vertex_input_attributes.data();
+
+    VkGraphicsPipelineCreateInfo pipeline_create_info =
+        vkb::initializers::pipeline_create_info(
+            pipeline_layouts.direct_pass,
+            render_passes.direct_pass,
+            0);
 
-        VkGraphicsPipelineCreateInfo pipeline_create_info =
-            vkb::initializers::pipeline_create_info(
-                pipeline_layouts.light_pass,
-                render_passes.light_pass,
-                0);
+    pipeline_create_info.pVertexInputState   = &vertex_input_state;
+    pipeline_create_info.pInputAssemblyState = &input_assembly_state;
+    pipeline_create_info.pRasterizationState = &rasterization_state;
+    pipeline_create_info.pColorBlendState    = &multi_color_blend_state;
+    pipeline_create_info.pMultisampleState   = &multisample_state;
+    pipeline_create_info.pViewportState      = &viewport_state;
+    pipeline_create_info.pDepthStencilState  = &depth_stencil_state;
+    pipeline_create_info.pDynamicState       = &dynamic_state;
+    pipeline_create_info.stageCount          = static_cast<uint32_t>(shader_stages.size());
+    pipeline_create_info.pStages             = shader_stages.data();
+
+    VK_CHECK(vkCreateGraphicsPipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.direct_pass));
+}
 
-        pipeline_create_info.pVertexInputState   = &vertex_input_state;
-        pipeline_create_info.pInputAssemblyState = &input_assembly_state;
-        pipeline_create_info.pRasterizationState = &rasterization_state;
-        pipeline_create_info.pColorBlendState    = &multi_color_blend_state;
-        pipeline_create_info.pMultisampleState   = &multisample_state;
-        pipeline_create_info.pViewportState      = &viewport_state;
-        pipeline_create_info.pDepthStencilState  = &depth_stencil_state;
-        pipeline_create_info.pDynamicState       = &dynamic_state;
-        pipeline_create_info.stageCount          = static_cast<uint32_t>(shader_stages.size());
-        pipeline_create_info.pStages             = shader_stages.data();
+void LinSSScatter::prepare_pipelines()
+{
+    // Common settings for all the pipelines
+    VkPipelineInputAssemblyStateCreateInfo input_assembly_state =
+        vkb::initializers::pipeline_input_assembly_state_create_info(
+            VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+            0,
+            VK_FALSE);
 
-        VK_CHECK(vkCreateGraphicsPipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.light_pass));
-    }
+    VkPipelineRasterizationStateCreateInfo rasterization_state =
+        vkb::initializers::pipeline_rasterization_state_create_info(
+            VK_POLYGON_MODE_FILL,
+            VK_CULL_MODE_NONE,
+            VK_FRONT_FACE_COUNTER_CLOCKWISE,
+            0);
 
-    // Pipeline for direct illumination
-    {
-        // Multiple render targets
-        std::array<VkPipelineColorBlendAttachmentState, 5> multi_blend_attachment_states = {};
-        for (uint32_t i = 0; i < static_cast<uint32_t>(multi_blend_attachment_states.size()); i++)
-        {
-            multi_blend_attachment_states[i] = vkb::initializers::pipeline_color_blend_attachment_state(
-                0xf,
-                VK_FALSE);
-        }
-        VkPipelineColorBlendStateCreateInfo multi_color_blend_state =
-            vkb::initializers::pipeline_color_blend_state_create_info(
-                multi_blend_attachment_states.size(),
-                multi_blend_attachment_states.data());
+    VkPipelineColorBlendAttachmentState blend_attachment_state =
+        vkb::initializers::pipeline_color_blend_attachment_state(
+            0xf,
+            VK_FALSE);
 
-        // Load shaders
-        std::array<VkPipelineShaderStageCreateInfo, 2> shader_stages = {};
-        shader_stages[0]                                             = load_spirv("linsss/direct_pass.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-        shader_stages[1]                                             = load_spirv("linsss/direct_pass.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+    VkPipelineColorBlendStateCreateInfo color_blend_state =
+        vkb::initializers::pipeline_color_blend_state_create_info(
+            1,
+            &blend_attachment_state);
 
-        // Vertex bindings and attributes
-        const std::vector<VkVertexInputBindingDescription> vertex_input_bindings = {
-            vkb::initializers::vertex_input_binding_description(0, sizeof(LinSSScatterVertexStructure), VK_VERTEX_INPUT_RATE_VERTEX),
-        };
-        const std::vector<VkVertexInputAttributeDescription> vertex_input_attributes = {
-            vkb::initializers::vertex_input_attribute_description(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(LinSSScatterVertexStructure, pos)),
-            vkb::initializers::vertex_input_attribute_description(0, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(LinSSScatterVertexStructure, uv)),
-            vkb::initializers::vertex_input_attribute_description(0, 2, VK_FORMAT_R32G32B32_SFLOAT, offsetof(LinSSScatterVertexStructure, normal)),
-        };
-        VkPipelineVertexInputStateCreateInfo vertex_input_state = vkb::initializers::pipeline_vertex_input_state_create_info();
-        vertex_input_state.vertexBindingDescriptionCount        = static_cast<uint32_t>(vertex_input_bindings.size());
-        vertex_input_state.pVertexBindingDescriptions           = vertex_input_bindings.data();
-        vertex_input_state.vertexAttributeDescriptionCount      = static_cast<uint32_t>(vertex_input_attributes.size());
-        vertex_input_state.pVertexAttributeDescriptions         = vertex_input_attributes.data();
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_state =
+        vkb::initializers::pipeline_depth_stencil_state_create_info(
+            VK_TRUE,
+            VK_TRUE,
+            VK_COMPARE_OP_LESS);
 
-        VkGraphicsPipelineCreateInfo pipeline_create_info =
-            vkb::initializers::pipeline_create_info(
-                pipeline_layouts.direct_pass,
-                render_passes.direct_pass,
-                0);
+    VkPipelineViewportStateCreateInfo viewport_state =
+        vkb::initializers::pipeline_viewport_state_create_info(1, 1, 0);
 
-        pipeline_create_info.pVertexInputState   = &vertex_input_state;
-        pipeline_create_info.pInputAssemblyState = &input_assembly_state;
-        pipeline_create_info.pRasterizationState = &rasterization_state;
-        pipeline_create_info.pColorBlendState    = &multi_color_blend_state;
-        pipeline_create_info.pMultisampleState   = &multisample_state;
-        pipeline_create_info.pViewportState      = &viewport_state;
-        pipeline_create_info.pDepthStencilState  = &depth_stencil_state;
-        pipeline_create_info.pDynamicState       = &dynamic_state;
-        pipeline_create_info.stageCount          = static_cast<uint32_t>(shader_stages.size());
-        pipeline_create_info.pStages             = shader_stages.data();
+    VkPipelineMultisampleStateCreateInfo multisample_state =
+        vkb::initializers::pipeline_multisample_state_create_info(
+            VK_SAMPLE_COUNT_1_BIT,
+            0);
 
-        VK_CHECK(vkCreateGraphicsPipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.direct_pass));
-    }
+    std::vector<VkDynamicState> dynamic_state_enables = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR};
+
+    VkPipelineDynamicStateCreateInfo dynamic_state =
+        vkb::initializers::pipeline_dynamic_state_create_info(
+            dynamic_state_enables.data(),
+            static_cast<uint32_t>(dynamic_state_enables.size()),
+            0);
+
+    // Pipeline for light pass
+    prepare_light_pass_pipeline();
+
+    // Pipeline for direct illumination
+    prepare_direct_pass_pipeline();
 
     // Gaussian filter
     {
@@ -4058,7 +8041,7 @@ void LinSSScatter::prepare_pipelines()
         VkComputePipelineCreateInfo pipeline_create_info = vkb::initializers::compute_pipeline_create_info(pipeline_layouts.gauss_filter, 0);
 
         // Load shaders
-        pipeline_create_info.stage = load_spirv("linsss/gauss_filter.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+        pipeline_create_info.stage = load_spirv("linsss/gauss_filter_tiled.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
 
         // Set shader constant parameters
         struct SpecializationData
@@ -4087,36 +8070,69 @@ void LinSSScatter::prepare_pipelines()
 
         pipeline_create_info.stage.pSpecializationInfo = &specialization_info;
 
-        VK_CHECK(vkCreateComputePipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.gauss_filter));
-    }
+        // Tiled filter keeps irradiance and geometry of a strip and its apron in shared memory
+        const auto &   gpu              = get_device().get_gpu();
+        const uint32_t tile_radius      = (bssrdf.ksize - 1) / 2;
+        const uint32_t tile_span        = GAUSS_TILE_LENGTH + 4 * tile_radius;
+        const uint32_t tile_shared_size = 2 * GAUSS_TILE_ROWS * tile_span * sizeof(glm::vec4);
+        gauss_tiled_supported           = tile_shared_size <= gpu.get_properties().limits.maxComputeSharedMemorySize &&
+                                bssrdf.ksize <= MAX_GAUSS_KERNEL_SIZE;
+        if (gauss_tiled_supported)
+        {
+            VK_CHECK(vkCreateComputePipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.gauss_filter_tiled));
+        }
+
+        // Recursive variant does not depend on the kernel size
+        pipeline_create_info.stage = load_spirv("linsss/gauss_filter_recursive.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
 
-    // LinSSS accumulation
-    {
-        // Compute pipeline
-        VkComputePipelineCreateInfo pipeline_create_info = vkb::initializers::compute_pipeline_create_info(pipeline_layouts.linsss, 0);
+        VK_CHECK(vkCreateComputePipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.gauss_filter_recursive));
 
-        // Load shaders
-        pipeline_create_info.stage = load_spirv("linsss/linsss.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+        // Single-pass pyramid needs dynamic indexing of storage images and
+        // shared memory for horizontally filtered rows of a tile and its apron.
+        const uint32_t radius      = (bssrdf.ksize - 1) / 2;
+        const uint32_t row_span    = GAUSS_PYRAMID_TILE_SIZE + 4 * radius;
+        const uint32_t shared_size = row_span * GAUSS_PYRAMID_TILE_SIZE * sizeof(glm::vec4) + sizeof(uint32_t);
+        gauss_pyramid_supported    = gpu.get_features().shaderStorageImageArrayDynamicIndexing &&
+                                  shared_size <= gpu.get_properties().limits.maxComputeSharedMemorySize &&
+                                  bssrdf.ksize <= MAX_GAUSS_KERNEL_SIZE;
+        if (gauss_pyramid_supported)
+        {
+            VkComputePipelineCreateInfo pyramid_pipeline_create_info = vkb::initializers::compute_pipeline_create_info(pipeline_layouts.gauss_pyramid, 0);
+            pyramid_pipeline_create_info.stage                       = load_spirv("linsss/gauss_pyramid.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+            pyramid_pipeline_create_info.stage.pSpecializationInfo   = &specialization_info;
 
-        // Set shader constant parameters
-        struct SpecializationData
+            VK_CHECK(vkCreateComputePipelines(get_device().get_handle(), pipeline_cache, 1, &pyramid_pipeline_create_info, nullptr, &pipelines.gauss_pyramid));
+        }
+        else
         {
-            int n_gauss;
-        } specialization_data;
+            LOGW("Single-pass Gaussian pyramid is not supported on this device.");
+            pipelines.gauss_pyramid = VK_NULL_HANDLE;
+        }
 
-        std::vector<VkSpecializationMapEntry> specialization_map_entries;
-        specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(0, offsetof(SpecializationData, n_gauss), sizeof(int)));
+        // Channel-separated copy of the pyramid (output format is fixed in the shader)
+        VkComputePipelineCreateInfo split_pipeline_create_info = vkb::initializers::compute_pipeline_create_info(pipeline_layouts.gauss_pyramid_split, 0);
+        split_pipeline_create_info.stage                       = pyramid_split_format == VK_FORMAT_R16_SFLOAT ?
+                                                               load_spirv("linsss/gauss_pyramid_split_r16f.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT) :
+                                                               load_spirv("linsss/gauss_pyramid_split_r32f.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
 
-        specialization_data.n_gauss = bssrdf.n_gauss;
+        VK_CHECK(vkCreateComputePipelines(get_device().get_handle(), pipeline_cache, 1, &split_pipeline_create_info, nullptr, &pipelines.gauss_pyramid_split));
 
-        VkSpecializationInfo specialization_info = vkb::initializers::specialization_info(static_cast<uint32_t>(specialization_map_entries.size()),
-                                                                                          specialization_map_entries.data(),
-                                                                                          sizeof(SpecializationData),
-                                                                                          &specialization_data);
+        // Windowed filters are specialized on demand. Those for the current kernel are created here.
+        get_gauss_filter_pipeline(0, static_cast<int>(radius));
+        get_gauss_filter_pipeline(1, static_cast<int>(radius));
+    }
 
-        pipeline_create_info.stage.pSpecializationInfo = &specialization_info;
+    // Tile classification
+    {
+        VkComputePipelineCreateInfo pipeline_create_info = vkb::initializers::compute_pipeline_create_info(pipeline_layouts.tile_classify, 0);
+        pipeline_create_info.stage                       = load_spirv("linsss/tile_classify.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+
+        VK_CHECK(vkCreateComputePipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.tile_classify));
+    }
 
-        VK_CHECK(vkCreateComputePipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.linsss));
+    // LinSSS accumulation
+    {
+        pipelines.linsss = create_linsss_pipeline();
     }
 
     // Translucent shadow maps
@@ -4141,6 +8157,27 @@ void LinSSScatter::prepare_pipelines()
         vertex_input_state.vertexAttributeDescriptionCount      = static_cast<uint32_t>(vertex_input_attributes.size());
         vertex_input_state.pVertexAttributeDescriptions         = vertex_input_attributes.data();
 
+        // Taps of each frame are shared with the MIP statistics (see "update_tsm_mipmap_stats")
+        struct SpecializationData
+        {
+            int   samples;
+            float max_radius;
+        } specialization_data;
+
+        std::vector<VkSpecializationMapEntry> specialization_map_entries;
+        specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(0, offsetof(SpecializationData, samples), sizeof(int)));
+        specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(1, offsetof(SpecializationData, max_radius), sizeof(float)));
+
+        specialization_data.samples    = static_cast<int>(TSM_SAMPLES);
+        specialization_data.max_radius = TSM_MAX_RADIUS;
+
+        VkSpecializationInfo specialization_info = vkb::initializers::specialization_info(static_cast<uint32_t>(specialization_map_entries.size()),
+                                                                                          specialization_map_entries.data(),
+                                                                                          sizeof(SpecializationData),
+                                                                                          &specialization_data);
+
+        shader_stages[1].pSpecializationInfo = &specialization_info;
+
         VkGraphicsPipelineCreateInfo pipeline_create_info =
             vkb::initializers::pipeline_create_info(
                 pipeline_layouts.trans_sm,
@@ -4159,6 +8196,33 @@ void LinSSScatter::prepare_pipelines()
         pipeline_create_info.pStages             = shader_stages.data();
 
         VK_CHECK(vkCreateGraphicsPipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.trans_sm));
+
+        // Half-precision variant
+        pipelines.trans_sm_float16 = VK_NULL_HANDLE;
+        if (float16_supported)
+        {
+            shader_stages[1]                     = load_spirv("linsss/translucent_shadow_maps_fp16.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+            shader_stages[1].pSpecializationInfo = &specialization_info;
+            VK_CHECK(vkCreateGraphicsPipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.trans_sm_float16));
+        }
+    }
+
+    // TSM variance
+    {
+        VkComputePipelineCreateInfo pipeline_create_info = vkb::initializers::compute_pipeline_create_info(pipeline_layouts.tsm_variance, 0);
+        pipeline_create_info.stage                       = load_spirv("linsss/tsm_variance.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+
+        VK_CHECK(vkCreateComputePipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.tsm_variance));
+    }
+
+    // Environment prefilter and BRDF LUT
+    {
+        VkComputePipelineCreateInfo pipeline_create_info = vkb::initializers::compute_pipeline_create_info(pipeline_layouts.env_prefilter, 0);
+        pipeline_create_info.stage                       = load_spirv("linsss/envmap_prefilter.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+        VK_CHECK(vkCreateComputePipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.env_prefilter));
+
+        pipeline_create_info.stage = load_spirv("linsss/brdf_lut.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+        VK_CHECK(vkCreateComputePipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.brdf_lut));
     }
 
     // Pipeline for background
@@ -4199,6 +8263,10 @@ void LinSSScatter::prepare_pipelines()
         pipeline_create_info.pStages             = shader_stages.data();
 
         VK_CHECK(vkCreateGraphicsPipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.background));
+
+        // Same pipeline for the first subpass of merged subpasses (see "setup_render_pass")
+        pipeline_create_info.renderPass = subpass_merge.render_pass;
+        VK_CHECK(vkCreateGraphicsPipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.background_subpass));
     }
 
     // Pipeline for deferred shading
@@ -4241,6 +8309,40 @@ void LinSSScatter::prepare_pipelines()
         pipeline_create_info.pStages             = shader_stages.data();
 
         VK_CHECK(vkCreateGraphicsPipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.deferred));
+
+        pipeline_create_info.renderPass = subpass_merge.render_pass;
+        VK_CHECK(vkCreateGraphicsPipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.deferred_subpass));
+        pipeline_create_info.renderPass = render_passes.deferred;
+
+        // Fused LinSSS accumulation (specialized for each pyramid layout)
+        struct SpecializationData
+        {
+            int      n_gauss;
+            VkBool32 split_pyramid;
+            VkBool32 fused_linsss;
+        } specialization_data;
+
+        std::vector<VkSpecializationMapEntry> specialization_map_entries;
+        specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(0, offsetof(SpecializationData, n_gauss), sizeof(int)));
+        specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(1, offsetof(SpecializationData, split_pyramid), sizeof(VkBool32)));
+        specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(2, offsetof(SpecializationData, fused_linsss), sizeof(VkBool32)));
+
+        VkSpecializationInfo specialization_info = vkb::initializers::specialization_info(static_cast<uint32_t>(specialization_map_entries.size()),
+                                                                                          specialization_map_entries.data(),
+                                                                                          sizeof(SpecializationData),
+                                                                                          &specialization_data);
+
+        shader_stages[1].pSpecializationInfo = &specialization_info;
+        for (int layout : {PyramidLayout::Interleaved, PyramidLayout::Split})
+        {
+            specialization_data.n_gauss       = bssrdf.n_gauss;
+            specialization_data.split_pyramid = layout == PyramidLayout::Split ? VK_TRUE : VK_FALSE;
+            specialization_data.fused_linsss  = VK_TRUE;
+            pipeline_create_info.renderPass   = render_passes.deferred;
+            VK_CHECK(vkCreateGraphicsPipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.deferred_fused[layout]));
+            pipeline_create_info.renderPass = subpass_merge.render_pass;
+            VK_CHECK(vkCreateGraphicsPipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.deferred_fused_subpass[layout]));
+        }
     }
 
     // Pipeline for postprocess
@@ -4281,7 +8383,141 @@ void LinSSScatter::prepare_pipelines()
         pipeline_create_info.pStages             = shader_stages.data();
 
         VK_CHECK(vkCreateGraphicsPipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.postprocess));
+
+        // Pass-through of the input attachment (merged subpasses cannot sample neighbors for FXAA)
+        shader_stages[1]                = load_spirv("linsss/postprocess_subpass.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+        pipeline_create_info.renderPass = subpass_merge.render_pass;
+        pipeline_create_info.subpass    = 1;
+        VK_CHECK(vkCreateGraphicsPipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipelines.postprocess_subpass));
+
+        // UI is drawn by the postprocess subpass of merged subpasses, too
+        subpass_merge.ui_pipeline = gui->create_pipeline(pipeline_cache, subpass_merge.render_pass,
+                                                         {load_shader("uioverlay/uioverlay.vert", VK_SHADER_STAGE_VERTEX_BIT),
+                                                          load_shader("uioverlay/uioverlay.frag", VK_SHADER_STAGE_FRAGMENT_BIT)},
+                                                         1);
+    }
+}
+
+VkPipeline LinSSScatter::get_gauss_filter_pipeline(int direction, int radius)
+{
+    const auto key = std::make_pair(direction, radius);
+    const auto it  = gauss_filter_pipelines.find(key);
+    if (it != gauss_filter_pipelines.end())
+    {
+        return it->second;
     }
+
+    // Compute pipeline
+    VkComputePipelineCreateInfo pipeline_create_info = vkb::initializers::compute_pipeline_create_info(pipeline_layouts.gauss_filter, 0);
+
+    // Load shaders
+    pipeline_create_info.stage = enable_float16 ?
+                               load_spirv("linsss/gauss_filter_fp16.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT) :
+                               load_spirv("linsss/gauss_filter.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+
+    // Set shader constant parameters (kernel size, workgroup shape and direction are compile-time constants)
+    struct SpecializationData
+    {
+        float    sss_level;
+        float    correction;
+        float    maxdd;
+        int      ksize;
+        uint32_t local_size_x;
+        uint32_t local_size_y;
+        int      direction;
+        VkBool32 tile_listed;
+    } specialization_data;
+
+    std::vector<VkSpecializationMapEntry> specialization_map_entries;
+    specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(0, offsetof(SpecializationData, sss_level), sizeof(float)));
+    specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(1, offsetof(SpecializationData, correction), sizeof(float)));
+    specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(2, offsetof(SpecializationData, maxdd), sizeof(float)));
+    specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(3, offsetof(SpecializationData, ksize), sizeof(int)));
+    specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(4, offsetof(SpecializationData, local_size_x), sizeof(uint32_t)));
+    specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(5, offsetof(SpecializationData, local_size_y), sizeof(uint32_t)));
+    specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(6, offsetof(SpecializationData, direction), sizeof(int)));
+    specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(7, offsetof(SpecializationData, tile_listed), sizeof(VkBool32)));
+
+    const VkExtent2D local_size      = gauss_filter_local_size();
+    specialization_data.sss_level    = 31.5f;
+    specialization_data.correction   = 800.0f;
+    specialization_data.maxdd        = 0.001f;
+    specialization_data.ksize        = 2 * radius + 1;
+    specialization_data.local_size_x = local_size.width;
+    specialization_data.local_size_y = local_size.height;
+    specialization_data.direction    = direction;
+    specialization_data.tile_listed  = enable_tile_lists ? VK_TRUE : VK_FALSE;
+
+    VkSpecializationInfo specialization_info = vkb::initializers::specialization_info(static_cast<uint32_t>(specialization_map_entries.size()),
+                                                                                      specialization_map_entries.data(),
+                                                                                      sizeof(SpecializationData),
+                                                                                      &specialization_data);
+
+    pipeline_create_info.stage.pSpecializationInfo = &specialization_info;
+
+    VkPipeline pipeline;
+    VK_CHECK(vkCreateComputePipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipeline));
+    gauss_filter_pipelines[key] = pipeline;
+
+    return pipeline;
+}
+
+VkPipeline LinSSScatter::create_linsss_pipeline()
+{
+    // Compute pipeline
+    VkComputePipelineCreateInfo pipeline_create_info = vkb::initializers::compute_pipeline_create_info(pipeline_layouts.linsss, 0);
+
+    // Load shaders
+    pipeline_create_info.stage = enable_float16 ?
+                               load_spirv("linsss/linsss_fp16.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT) :
+                               load_spirv("linsss/linsss.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+
+    // Set shader constant parameters
+    struct SpecializationData
+    {
+        int      n_gauss;
+        uint32_t local_size_x;
+        uint32_t local_size_y;
+        VkBool32 split_pyramid;
+        VkBool32 tile_listed;
+    } specialization_data;
+
+    std::vector<VkSpecializationMapEntry> specialization_map_entries;
+    specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(0, offsetof(SpecializationData, n_gauss), sizeof(int)));
+    specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(1, offsetof(SpecializationData, local_size_x), sizeof(uint32_t)));
+    specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(2, offsetof(SpecializationData, local_size_y), sizeof(uint32_t)));
+    specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(3, offsetof(SpecializationData, split_pyramid), sizeof(VkBool32)));
+    specialization_map_entries.push_back(vkb::initializers::specialization_map_entry(4, offsetof(SpecializationData, tile_listed), sizeof(VkBool32)));
+
+    const VkExtent2D local_size       = linsss_local_size();
+    specialization_data.n_gauss       = bssrdf.n_gauss;
+    specialization_data.local_size_x  = local_size.width;
+    specialization_data.local_size_y  = local_size.height;
+    specialization_data.split_pyramid = pyramid_layout == PyramidLayout::Split ? VK_TRUE : VK_FALSE;
+    specialization_data.tile_listed   = enable_tile_lists ? VK_TRUE : VK_FALSE;
+
+    VkSpecializationInfo specialization_info = vkb::initializers::specialization_info(static_cast<uint32_t>(specialization_map_entries.size()),
+                                                                                      specialization_map_entries.data(),
+                                                                                      sizeof(SpecializationData),
+                                                                                      &specialization_data);
+
+    pipeline_create_info.stage.pSpecializationInfo = &specialization_info;
+
+    VkPipeline pipeline;
+    VK_CHECK(vkCreateComputePipelines(get_device().get_handle(), pipeline_cache, 1, &pipeline_create_info, nullptr, &pipeline));
+
+    return pipeline;
+}
+
+VkExtent2D LinSSScatter::gauss_filter_local_size()
+{
+    // Workgroups of the tile lists cover a tile each
+    return enable_tile_lists ? VkExtent2D{TILE_LIST_TILE_SIZE, TILE_LIST_TILE_SIZE} : workgroup_sizes.gauss_filter;
+}
+
+VkExtent2D LinSSScatter::linsss_local_size()
+{
+    return enable_tile_lists ? VkExtent2D{TILE_LIST_TILE_SIZE, TILE_LIST_TILE_SIZE} : workgroup_sizes.linsss;
 }
 
 void LinSSScatter::prepare_uniform_buffers()
@@ -4304,16 +8540,29 @@ void LinSSScatter::prepare_uniform_buffers()
                                                             VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
                                                             VMA_MEMORY_USAGE_CPU_TO_GPU);
 
-    // Gaussian filter uniform buffer block
-    uniform_buffer_gauss_horz_cs = std::make_unique<vkb::core::Buffer>(get_device(),
-                                                                       sizeof(ubo_gauss_cs),
-                                                                       VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                                                                       VMA_MEMORY_USAGE_CPU_TO_GPU);
+    // G-buffer reconstruction uniform buffer block
+    uniform_buffer_gbuffer = std::make_unique<vkb::core::Buffer>(get_device(),
+                                                                 sizeof(ubo_gbuffer),
+                                                                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                                                 VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+    // Gaussian pyramid uniform buffer block
+    uniform_buffer_gauss_pyramid_cs = std::make_unique<vkb::core::Buffer>(get_device(),
+                                                                          sizeof(ubo_gauss_pyramid_cs),
+                                                                          VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                                                          VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+    // Tile counter of single-pass Gaussian pyramid
+    storage_buffer_gauss_pyramid_counter = std::make_unique<vkb::core::Buffer>(get_device(),
+                                                                               sizeof(uint32_t),
+                                                                               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                                               VMA_MEMORY_USAGE_GPU_ONLY);
 
-    uniform_buffer_gauss_vert_cs = std::make_unique<vkb::core::Buffer>(get_device(),
-                                                                       sizeof(ubo_gauss_cs),
-                                                                       VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                                                                       VMA_MEMORY_USAGE_CPU_TO_GPU);
+    // Kernel table of Gaussian filter (shared by all the MIP levels)
+    storage_buffer_gauss_kernel = std::make_unique<vkb::core::Buffer>(get_device(),
+                                                                      sizeof(float) * MAX_GAUSS_KERNEL_SIZE,
+                                                                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                                      VMA_MEMORY_USAGE_CPU_TO_GPU);
 
     // LinSSS accumulation
     uniform_buffer_linsss_cs = std::make_unique<vkb::core::Buffer>(get_device(),
@@ -4336,6 +8585,98 @@ void LinSSScatter::prepare_uniform_buffers()
     update_uniform_buffers();
 }
 
+bool LinSSScatter::project_envmap_sh(const std::string &hdr_filename, const std::string &sph_filename, std::array<glm::vec4, 9> &coefs)
+{
+    int    width = 0, height = 0;
+    float *pixels = stbi_loadf(hdr_filename.c_str(), &width, &height, nullptr, STBI_rgb_alpha);
+    if (!pixels)
+    {
+        LOGE("Failed to load image file: {}", hdr_filename);
+        return false;
+    }
+
+    vkb::Timer timer;
+    timer.start();
+    const std::array<glm::vec3, 9> sh = vkb::project_sh9(pixels, width, height);
+    const double                   ms = timer.stop<vkb::Timer::Milliseconds>();
+    stbi_image_free(pixels);
+
+    LOGI("Projected {} ({}x{}) onto spherical harmonics in {:.2f} ms", hdr_filename, width, height, ms);
+
+    for (int i = 0; i < 9; i++)
+    {
+        coefs[i] = glm::vec4(sh[i], 0.0f);
+    }
+
+    // Coefficients are saved in the format of "env2sph.py", so that the projection runs only once
+    std::ofstream writer(sph_filename.c_str(), std::ios::out);
+    if (writer.fail())
+    {
+        LOGW("Failed to write file: {}", sph_filename);
+        return true;
+    }
+    writer << std::fixed;
+    for (int i = 0; i < 9; i++)
+    {
+        writer << sh[i].x << " " << sh[i].y << " " << sh[i].z << std::endl;
+    }
+    writer.close();
+    return true;
+}
+
+void LinSSScatter::load_sh_registry()
+{
+    // Harmonics coefficients of each environment are parsed once, so that no file is read on camera and UI updates.
+    // A ".sph" file of "env2sph.py" next to the environment map is used if it exists. Otherwise, the coefficients
+    // are projected from the environment map once, and kept in the temporary directory instead of the assets.
+    for (int light_type : {LightType::Uffizi, LightType::Grace})
+    {
+        const std::string name       = envmap_name(light_type);
+        const std::string filename   = "scenes/envmap/" + name + ".sph";
+        const std::string cache_name = vkb::fs::path::get(vkb::fs::path::Type::Temp) + "linsss_" + name + ".sph";
+
+        std::array<glm::vec4, 9> coefs = {};
+        std::ifstream            reader(filename.c_str(), std::ios::in);
+        if (reader.fail())
+        {
+            reader.open(cache_name.c_str(), std::ios::in);
+        }
+        if (!reader.fail())
+        {
+            for (int i = 0; i < 9; i++)
+            {
+                glm::vec4 &c = coefs[i];
+                reader >> c.x >> c.y >> c.z;
+            }
+            reader.close();
+        }
+        else if (!project_envmap_sh("scenes/envmap/" + name + ".hdr", cache_name, coefs))
+        {
+            LOGE("Failed to open file: {}", filename);
+            continue;
+        }
+
+        for (glm::vec4 &c : coefs)
+        {
+            c *= ENVMAP_SCALE;
+        }
+        sh_registry[name] = coefs;
+    }
+}
+
+void LinSSScatter::update_ubo_fs()
+{
+    // Upload only when the lighting (or the shadow filter) changes
+    const uint64_t hash = hash_value(HASH_SEED, ubo_fs);
+    if (hash == ubo_fs_hash)
+    {
+        return;
+    }
+    ubo_fs_hash = hash;
+
+    uniform_buffer_fs->convert_and_update(ubo_fs);
+}
+
 void LinSSScatter::update_uniform_buffers()
 {
     static const glm::vec3 light_pos   = glm::vec3(5.0f, 5.0f, 0.0f);
@@ -4382,46 +8723,40 @@ void LinSSScatter::update_uniform_buffers()
 
         ubo_vs.sm_mvp = ubo_sm_vs.projection * ubo_sm_vs.model;
 
-        ubo_vs.view_pos  = glm::vec4(0.0f, 0.0f, -zoom, 0.0f);
-        ubo_vs.light_pos = glm::vec4(light_pos, 0.0f);
+        ubo_vs.view_pos     = glm::vec4(0.0f, 0.0f, -zoom, 0.0f);
+        ubo_vs.light_pos    = glm::vec4(light_pos, 0.0f);
+        ubo_vs.view_pos_obj = glm::inverse(ubo_vs.model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
 
-        // Fragment shader
-        if (ubo_fs.light_type != LightType::Point)
+        // Fragment shader (harmonics coefficients are taken from the registry)
+        const char *envmap = envmap_name(ubo_fs.light_type);
+        if (envmap != nullptr)
         {
-            std::string filename = "";
-            if (ubo_fs.light_type == LightType::Uffizi)
-                filename = "scenes/envmap/uffizi.sph";
-            if (ubo_fs.light_type == LightType::Grace)
-                filename = "scenes/envmap/grace.sph";
-
-            // Load harmonics coefficients
-            std::ifstream reader(filename.c_str(), std::ios::in);
-            if (reader.fail())
-            {
-                LOGE("Failed to open file: {}", filename);
-            }
-
-            for (int i = 0; i < 9; i++)
+            auto it = sh_registry.find(envmap);
+            if (it != sh_registry.end())
             {
-                glm::vec4 &c = ubo_fs.sphere_harm_coefs[i];
-                reader >> c.x >> c.y >> c.z;
-                c *= ENVMAP_SCALE;
+                ubo_fs.sphere_harm_coefs = it->second;
             }
-            reader.close();
         }
         ubo_fs.light_power = glm::vec4(light_power, 1.0);
 
         uniform_buffer_vs->convert_and_update(ubo_vs);
-        uniform_buffer_fs->convert_and_update(ubo_fs);
+        update_ubo_fs();
+
+        // G-buffer readers reconstruct object-space position and linear depth from the depth buffer
+        ubo_gbuffer.inv_projection = glm::inverse(ubo_vs.projection);
+        ubo_gbuffer.inv_model_view = glm::inverse(ubo_vs.model);
+        ubo_gbuffer.reconstruct    = gbuffer_targets.active_profile != GBufferProfile::Float32 ? 1 : 0;
+        uniform_buffer_gbuffer->convert_and_update(ubo_gbuffer);
     }
 
     // Translucent shadow maps
     {
         ubo_tsm_fs.mvp           = ubo_vs.projection * ubo_vs.model;
         ubo_tsm_fs.sm_mvp        = ubo_sm_vs.projection * ubo_sm_vs.model;
+        ubo_tsm_fs.sm_inv_mvp    = glm::inverse(ubo_tsm_fs.sm_mvp);
         ubo_tsm_fs.n_gauss       = bssrdf.n_gauss;
         ubo_tsm_fs.ksize         = bssrdf.ksize;
-        ubo_tsm_fs.sigma_scale   = ubo_gauss_cs.sigma;
+        ubo_tsm_fs.sigma_scale   = push_const_gauss_cs.sigma;
         ubo_tsm_fs.screen_extent = glm::vec2(win_width, win_height);
         ubo_tsm_fs.bssrdf_extent = glm::vec2(bssrdf.width, bssrdf.height);
         ubo_tsm_fs.seed          = glm::vec2(0.5f, 0.5f);
@@ -4451,11 +8786,19 @@ bool LinSSScatter::prepare(vkb::Platform &platform)
 
     load_model("scenes/models/fertility.ply");
     prepare_primitive_objects();
+    load_sh_registry();
     prepare_uniform_buffers();
     setup_descriptor_set_layout();
+    load_workgroup_sizes();
     prepare_pipelines();
     setup_descriptor_set();
+    prepare_shadow_compare_sampler();
+    prepare_env_prefilter();
     update_descriptor_set();
+    prefilter_environment();
+    prepare_timestamp_queries();
+    prepare_tsm_resolution();
+    update_tsm_mipmap_stats();
     build_command_buffers();
 
     prepared = true;
@@ -4464,19 +8807,176 @@ bool LinSSScatter::prepare(vkb::Platform &platform)
 
 void LinSSScatter::setup_render_pass()
 {
+    // Swapchain pass of separate passes is the one of the framework
     ApiVulkanSample::setup_render_pass();
+
+    // Swapchain pass of merged subpasses has two subpasses: deferred shading into a transient color attachment,
+    // and postprocess (with UI) reading it as an input attachment
+    std::array<VkAttachmentDescription, 3> attachments = {};
+    // Color attachment (swapchain)
+    attachments[0].format         = render_context->get_format();
+    attachments[0].samples        = VK_SAMPLE_COUNT_1_BIT;
+    attachments[0].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[0].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[0].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[0].finalLayout    = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // Color attachment (deferred shading, never stored)
+    attachments[1].format         = VK_FORMAT_R8G8B8A8_UNORM;
+    attachments[1].samples        = VK_SAMPLE_COUNT_1_BIT;
+    attachments[1].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[1].storeOp        = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[1].finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    // Depth attachment
+    attachments[2].format         = depth_format;
+    attachments[2].samples        = VK_SAMPLE_COUNT_1_BIT;
+    attachments[2].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[2].storeOp        = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[2].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[2].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[2].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[2].finalLayout    = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference deferred_color_reference = {};
+    deferred_color_reference.attachment            = 1;
+    deferred_color_reference.layout                = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference depth_reference = {};
+    depth_reference.attachment            = 2;
+    depth_reference.layout                = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference swapchain_color_reference = {};
+    swapchain_color_reference.attachment            = 0;
+    swapchain_color_reference.layout                = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference input_reference = {};
+    input_reference.attachment            = 1;
+    input_reference.layout                = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    std::array<VkSubpassDescription, 2> subpass_descriptions = {};
+
+    // Subpass 0 : deferred shading
+    subpass_descriptions[0].pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass_descriptions[0].colorAttachmentCount    = 1;
+    subpass_descriptions[0].pColorAttachments       = &deferred_color_reference;
+    subpass_descriptions[0].pDepthStencilAttachment = &depth_reference;
+
+    // Subpass 1 : postprocess and UI
+    subpass_descriptions[1].pipelineBindPoint    = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass_descriptions[1].colorAttachmentCount = 1;
+    subpass_descriptions[1].pColorAttachments    = &swapchain_color_reference;
+    subpass_descriptions[1].inputAttachmentCount = 1;
+    subpass_descriptions[1].pInputAttachments    = &input_reference;
+
+    // Subpass dependencies for layout transitions
+    std::array<VkSubpassDependency, 3> dependencies;
+
+    dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass      = 0;
+    dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    dependencies[0].dstStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].srcAccessMask   = VK_ACCESS_MEMORY_READ_BIT;
+    dependencies[0].dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+    // Deferred color is read at the same pixel, so that the dependency is by region
+    dependencies[1].srcSubpass      = 0;
+    dependencies[1].dstSubpass      = 1;
+    dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[1].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstAccessMask   = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+    dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+    dependencies[2].srcSubpass      = 1;
+    dependencies[2].dstSubpass      = VK_SUBPASS_EXTERNAL;
+    dependencies[2].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[2].dstStageMask    = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    dependencies[2].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[2].dstAccessMask   = VK_ACCESS_MEMORY_READ_BIT;
+    dependencies[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+    VkRenderPassCreateInfo render_pass_create_info = {};
+    render_pass_create_info.sType                  = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_create_info.attachmentCount        = static_cast<uint32_t>(attachments.size());
+    render_pass_create_info.pAttachments           = attachments.data();
+    render_pass_create_info.subpassCount           = static_cast<uint32_t>(subpass_descriptions.size());
+    render_pass_create_info.pSubpasses             = subpass_descriptions.data();
+    render_pass_create_info.dependencyCount        = static_cast<uint32_t>(dependencies.size());
+    render_pass_create_info.pDependencies          = dependencies.data();
+
+    VK_CHECK(vkCreateRenderPass(get_device().get_handle(), &render_pass_create_info, nullptr, &subpass_merge.render_pass));
+
     setup_custom_render_passes();
 }
 
 void LinSSScatter::setup_framebuffer()
 {
     ApiVulkanSample::setup_framebuffer();
+
+    const VkExtent2D &extent = get_render_context().get_surface_extent();
+
+    // Deferred color lives only in the swapchain pass (lazily allocated if the device has such memory)
+    subpass_merge.color_view.reset();
+    subpass_merge.color      = std::make_unique<vkb::core::Image>(get_device(),
+                                                             VkExtent3D{extent.width, extent.height, 1},
+                                                             VK_FORMAT_R8G8B8A8_UNORM,
+                                                             VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+                                                             VMA_MEMORY_USAGE_GPU_ONLY);
+    subpass_merge.color_view = std::make_unique<vkb::core::ImageView>(*subpass_merge.color, VK_IMAGE_VIEW_TYPE_2D);
+
+    VmaAllocationInfo allocation_info = {};
+    vmaGetAllocationInfo(get_device().get_memory_allocator(), subpass_merge.color->get_memory(), &allocation_info);
+    const VkPhysicalDeviceMemoryProperties memory_properties = get_device().get_gpu().get_memory_properties();
+    subpass_merge.lazily_allocated                           = (memory_properties.memoryTypes[allocation_info.memoryType].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+    LOGI("Deferred color attachment: {}", subpass_merge.lazily_allocated ? "lazily allocated" : "not lazily allocated");
+
+    std::array<VkImageView, 3> attachments;
+    attachments[1] = subpass_merge.color_view->get_handle();
+    attachments[2] = depth_stencil.view;
+
+    VkFramebufferCreateInfo framebuffer_create_info = {};
+    framebuffer_create_info.sType                   = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_create_info.pNext                   = nullptr;
+    framebuffer_create_info.renderPass              = subpass_merge.render_pass;
+    framebuffer_create_info.attachmentCount         = static_cast<uint32_t>(attachments.size());
+    framebuffer_create_info.pAttachments            = attachments.data();
+    framebuffer_create_info.width                   = extent.width;
+    framebuffer_create_info.height                  = extent.height;
+    framebuffer_create_info.layers                  = 1;
+
+    // Create frame buffers of merged subpasses for every swap chain image
+    subpass_merge.framebuffers.resize(framebuffers.size());
+    for (uint32_t i = 0; i < subpass_merge.framebuffers.size(); i++)
+    {
+        attachments[0] = swapchain_buffers[i].view;
+        VK_CHECK(vkCreateFramebuffer(get_device().get_handle(), &framebuffer_create_info, nullptr, &subpass_merge.framebuffers[i]));
+    }
+
     setup_custom_framebuffers();
+    prepare_tile_lists();
+    prepare_tsm_accumulation();
+}
+
+void LinSSScatter::destroy_merged_framebuffers()
+{
+    for (VkFramebuffer framebuffer : subpass_merge.framebuffers)
+    {
+        vkDestroyFramebuffer(get_device().get_handle(), framebuffer, nullptr);
+    }
+    subpass_merge.framebuffers.clear();
 }
 
 void LinSSScatter::resize(const uint32_t width, const uint32_t height)
 {
+    invalidate_irradiance_cache();
+    invalidate_shadow_cache();
     destroy_custom_framebuffers();
+    destroy_merged_framebuffers();
     ApiVulkanSample::resize(width, height);
 }
 
@@ -4484,56 +8984,38 @@ void LinSSScatter::render(float delta_time)
 {
     if (!prepared)
         return;
+    shadow_cache.window_seconds += delta_time;
     draw();
 }
 
-void LinSSScatter::update(float delta_time)
-{
-    // Accumulate TSM sampling
-    ubo_tsm_fs.seed = glm::vec2(frame_count);
-    uniform_buffer_tsm_fs->convert_and_update(ubo_tsm_fs);
-    ApiVulkanSample::update(delta_time);
-}
-
 void LinSSScatter::view_changed()
 {
-    // Clear TSM accumulation
-    VkCommandBuffer command_buffer = get_device().create_command_buffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-    VkClearColorValue       clear_color{{0.0f, 0.0f, 0.0f, 1.0f}};
-    VkImageSubresourceRange subresource_range;
-    subresource_range.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-    subresource_range.baseMipLevel   = 0;
-    subresource_range.levelCount     = 1;
-    subresource_range.baseArrayLayer = 0;
-    subresource_range.layerCount     = 1;
-
-    vkCmdClearColorImage(
-        command_buffer,
-        fbos.trans_sm[0].images[0].get_handle(),
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        &clear_color,
-        1,
-        &subresource_range);
-
-    vkCmdClearColorImage(
-        command_buffer,
-        fbos.trans_sm[1].images[0].get_handle(),
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        &clear_color,
-        1,
-        &subresource_range);
-
-    get_device().flush_command_buffer(command_buffer, queue, true);
+    clear_tsm_accumulation();
 
     // Update uniform buffers
     update_uniform_buffers();
 }
 
+void LinSSScatter::clear_tsm_accumulation()
+{
+    // Called on every camera update, so the reset is folded into the next frame
+    // instead of clearing the images with a one-shot command buffer.
+    tsm_reset_pending = true;
+
+    // Converged TSM draw is recorded again
+    tsm_accumulation.frames = 0;
+    if (tsm_accumulation.converged)
+    {
+        tsm_accumulation.converged = false;
+        build_command_buffers();
+    }
+}
+
 void LinSSScatter::on_update_ui_overlay(vkb::Drawer &drawer)
 {
-    static int bssrdf_type = BSSRDFType::Heart;
-    static int mesh_type   = MeshType::Fertility;
+    static int                 bssrdf_type      = BSSRDFType::Heart;
+    static int                 mesh_type        = MeshType::Fertility;
+    static std::array<bool, 2> recursive_filter = {false, false};
 
     if (drawer.header("Settings"))
     {
@@ -4543,6 +9025,10 @@ void LinSSScatter::on_update_ui_overlay(vkb::Drawer &drawer)
         // Light type
         const int prev_light_type = ubo_fs.light_type;
         update_ubo |= drawer.combo_box("Light", &ubo_fs.light_type, {"Point", "Uffizi", "Grace"});
+        if (ubo_fs.light_type != LightType::Point)
+        {
+            drawer.text("Envmap prefilter: %.2f ms", env_prefilter.ms);
+        }
 
         // Mesh type
         const int prev_mesh_type = mesh_type;
@@ -4557,10 +9043,185 @@ void LinSSScatter::on_update_ui_overlay(vkb::Drawer &drawer)
         update_ubo |= drawer.slider_float("UV scale", &ubo_linsss_cs.tex_scale, 0.5f, 2.0f);
         update_ubo |= drawer.slider_float("U offset", &ubo_linsss_cs.tex_offset_x, -1.0f, 1.0f);
         update_ubo |= drawer.slider_float("V offset", &ubo_linsss_cs.tex_offset_y, -1.0f, 1.0f);
-        update_ubo |= drawer.slider_float("Sigma scale", &ubo_gauss_cs.sigma, 0.0f, 16.0f);
+        update_ubo |= drawer.slider_float("Sigma scale", &push_const_gauss_cs.sigma, 0.0f, 16.0f);
+
+        // Render targets of the light pass ("Depth only" is used while TSM is disabled)
+        drawer.combo_box("Light targets", &light_pass_targets.format, {"RGBA32F", "Compact", "Depth only"});
 
         // TSM
         drawer.checkbox("TSM", &enable_tsm);
+        update_light_pass_format();
+
+        // Memory, writes and GPU time of the light pass targets in use
+        const int light_format = light_pass_targets.active_format;
+        drawer.text("Light pass %.1f MiB, %.1f MiB/frame, %.3f ms",
+                    light_pass_targets.memory_mib[light_format], light_pass_targets.write_mib[light_format], light_pass_targets.ms[light_format]);
+
+        // Render targets of the direct pass (reduced profiles reconstruct position and depth from the depth buffer)
+        drawer.combo_box("G-buffer", &gbuffer_targets.profile, {"RGBA32F", "Half", "Packed"});
+        update_gbuffer_profile();
+        const int active_profile = gbuffer_targets.active_profile;
+        drawer.text("G-buffer %.1f MiB, %.1f MiB/frame, %.3f ms",
+                    gbuffer_targets.memory_mib[active_profile], gbuffer_targets.write_mib[active_profile], gbuffer_targets.ms[active_profile]);
+
+        // Transient render targets share heaps (see "prepare_transient_images")
+        drawer.text("Render targets %.1f MiB (%.1f MiB without aliasing)", transient_images.memory_mib, transient_images.unaliased_mib);
+
+        bool reset_tsm = drawer.combo_box("TSM sampling", &tsm_sampling, {"White noise", "R2 + IGN"});
+        reset_tsm |= drawer.checkbox("TSM radius importance", &tsm_radius_importance);
+        reset_tsm |= drawer.checkbox("TSM profile LUT", &tsm_profile.enabled);
+        if (tsm_profile.enabled)
+        {
+            drawer.text("Profile error %.2e, exact %.2f / LUT %.2f ms/Mpix",
+                        tsm_profile.rel_error, tsm_profile.ms_per_mpix[0], tsm_profile.ms_per_mpix[1]);
+        }
+        reset_tsm |= drawer.checkbox("TSM mipmaps", &tsm_mipmap.enabled);
+        if (tsm_mipmap.enabled)
+        {
+            reset_tsm |= drawer.slider_float("TSM mip bias", &tsm_mipmap.mip_bias, -4.0f, 0.0f);
+            drawer.text("Mean LOD %.2f, est. disk %.0f / %.0f KiB, base %.2f / MIP %.2f ms/Mpix",
+                        tsm_mipmap.mean_lod, tsm_mipmap.working_set_kib, tsm_mipmap.base_working_kib,
+                        tsm_mipmap.ms_per_mpix[0], tsm_mipmap.ms_per_mpix[1]);
+        }
+        if (reset_tsm)
+        {
+            update_tsm_mipmap_stats();
+            clear_tsm_accumulation();
+        }
+
+        // TSM accumulation stops once the samples are enough
+        bool restart_tsm = drawer.combo_box("TSM stop", &tsm_accumulation.stop_condition, {"Never", "Sample count", "Error threshold"});
+        if (tsm_accumulation.stop_condition == TSMStopCondition::SampleCount)
+        {
+            restart_tsm |= drawer.slider_int("TSM max frames", &tsm_accumulation.max_frames, 16, 4096);
+        }
+        else if (tsm_accumulation.stop_condition == TSMStopCondition::ErrorThreshold)
+        {
+            restart_tsm |= drawer.slider_float("TSM max error", &tsm_accumulation.error_threshold, 0.001f, 0.1f);
+        }
+        if (restart_tsm)
+        {
+            clear_tsm_accumulation();
+        }
+
+        // TSM render area follows the GPU time of the TSM pass
+        if (tsm_resolution.query_pool)
+        {
+            if (drawer.checkbox("TSM dynamic resolution", &tsm_resolution.enabled) && !tsm_resolution.enabled && tsm_resolution.steps != TSM_DEFAULT_RESOLUTION_STEPS)
+            {
+                set_tsm_resolution_steps(TSM_DEFAULT_RESOLUTION_STEPS);
+            }
+            if (tsm_resolution.enabled)
+            {
+                drawer.slider_float("TSM budget (ms)", &tsm_resolution.budget_ms, 0.5f, 16.0f);
+            }
+            const VkExtent2D extent = tsm_render_extent();
+            drawer.text("TSM %ux%u: %.3f ms", extent.width, extent.height, tsm_resolution.tsm_ms);
+        }
+        if (enable_tsm)
+        {
+            drawer.text("TSM frames %u, max error %.2e, converged tiles %.1f%%%s",
+                        tsm_accumulation.frames, tsm_accumulation.max_error, 100.0f * tsm_accumulation.converged_tiles,
+                        tsm_accumulation.converged ? " (converged)" : "");
+        }
+        if (tsm_convergence.valid)
+        {
+            drawer.text("Frames at RMSE %.2e: white noise %u / R2 + IGN %u",
+                        tsm_convergence.target_rmse, tsm_convergence.frames[0], tsm_convergence.frames[1]);
+        }
+        if (tsm_convergence.stage != 0)
+        {
+            drawer.text("Measuring TSM convergence... (%u)", tsm_convergence.frame);
+        }
+        else if (drawer.button("Measure TSM convergence"))
+        {
+            start_tsm_convergence_measurement();
+        }
+
+        // Gaussian filter
+        drawer.combo_box("Gauss filter", &gauss_filter_mode, {"Windowed", "Tiled", "Single pass"});
+
+        // Recursive filter is selected for each BSSRDF
+        drawer.checkbox("Recursive filter", &recursive_filter[bssrdf_type]);
+
+        // Irradiance pyramid layout (LinSSS accumulation is specialized for it)
+        if (drawer.combo_box("Pyramid layout", &pyramid_layout, {"RGBA", "Split R/G/B"}))
+        {
+            vkDestroyPipeline(get_device().get_handle(), pipelines.linsss, nullptr);
+            pipelines.linsss = create_linsss_pipeline();
+        }
+
+        // LinSSS accumulation in a compute pass or in deferred shading
+        drawer.combo_box("LinSSS accumulation", &linsss_mode, {"Separate pass", "Fused"});
+
+        // Deferred shading and postprocess in two render passes, or in two subpasses with a transient attachment
+        drawer.combo_box("Postprocess", &subpass_merge.mode, {"Separate passes (FXAA)", "Merged subpasses (no FXAA)"});
+        update_postprocess_mode();
+        drawer.text("Deferred color: %s", subpass_merge.lazily_allocated ? "lazily allocated" : "device local");
+        if (subpass_merge.query_pool)
+        {
+            const auto &ms = subpass_merge.ms;
+            drawer.text("Separate (FXAA): deferred %.3f ms / postprocess %.3f ms / total %.3f ms",
+                        ms[PostprocessMode::SeparatePasses][0], ms[PostprocessMode::SeparatePasses][1], ms[PostprocessMode::SeparatePasses][2]);
+            drawer.text("Merged (no FXAA): total %.3f ms", ms[PostprocessMode::MergedSubpasses][2]);
+        }
+
+        // Half-precision arithmetic (compute pipelines are specialized for it)
+        if (float16_supported && drawer.checkbox("Half precision", &enable_float16))
+        {
+            apply_workgroup_sizes();
+        }
+
+        // Masked passes are dispatched only over the tiles covered by the object
+        if (drawer.checkbox("Tile lists", &enable_tile_lists))
+        {
+            apply_workgroup_sizes();
+        }
+
+        // Reuse irradiance while view, light and material are unchanged
+        drawer.checkbox("Reuse static irradiance", &irradiance_cache.enabled);
+        if (irradiance_cache.total_frames > 0)
+        {
+            const float skip_rate = 100.0f * irradiance_cache.skipped_frames / irradiance_cache.total_frames;
+            drawer.text("Skipped frames: %.1f%%", skip_rate);
+        }
+
+        // Reuse shadow map and light-space buffers while the light and the model are unchanged
+        drawer.checkbox("Reuse static shadow map", &shadow_cache.enabled);
+        drawer.text("Shadow map updates: %.1f/s", shadow_cache.updates_per_second);
+
+        // Shadow filter of the direct pass, with GPU times and errors against a dense reference
+        update_ubo |= drawer.combo_box("Shadow filter", &ubo_fs.shadow_filter, {"Jittered", "Hardware PCF"});
+        drawer.text("Direct pass: jittered %.3f ms / PCF %.3f ms", shadow_pcf.ms[0], shadow_pcf.ms[1]);
+        if (shadow_pcf.valid)
+        {
+            drawer.text("Shadow error: jittered %.3f%% / PCF %.3f%%", shadow_pcf.rel_error[0], shadow_pcf.rel_error[1]);
+        }
+        if (shadow_pcf.stage != 0)
+        {
+            drawer.text("Measuring shadow filter error...");
+        }
+        else if (drawer.button("Measure shadow filter error"))
+        {
+            start_shadow_filter_measurement();
+        }
+
+        // Error of the half-precision path against 32-bit floats
+        if (float16_supported)
+        {
+            if (float16_error.valid)
+            {
+                drawer.text("Half precision error: max %.2e / mean %.3f%%", float16_error.max_abs_error, float16_error.mean_rel_error);
+            }
+            if (float16_error.stage != 0)
+            {
+                drawer.text("Measuring half precision error...");
+            }
+            else if (drawer.button("Measure half precision error"))
+            {
+                start_float16_error_measurement();
+            }
+        }
 
         if (update_ubo)
         {
@@ -4573,6 +9234,8 @@ void LinSSScatter::on_update_ui_overlay(vkb::Drawer &drawer)
                     prepare_texture(envmap_texture, "scenes/envmap/uffizi.hdr", false, ENVMAP_SCALE);
                 if (ubo_fs.light_type == LightType::Grace)
                     prepare_texture(envmap_texture, "scenes/envmap/grace.hdr", false, ENVMAP_SCALE);
+                prefilter_environment();
+                update_envmap_descriptor();
             }
 
             if (bssrdf_type != prev_bssrdf_type)
@@ -4599,8 +9262,49 @@ void LinSSScatter::on_update_ui_overlay(vkb::Drawer &drawer)
                     load_model("scenes/models/fertility.ply");
                 if (mesh_type == MeshType::Armadillo)
                     load_model("scenes/models/armadillo.ply");
+
+                // Buffer handles of the new mesh may equal the freed ones
+                invalidate_irradiance_cache();
+                invalidate_shadow_cache();
             }
         }
+
+        bssrdf.recursive_filter = recursive_filter[bssrdf_type];
+    }
+
+    if (gauss_filter_timer.query_pool && drawer.header("Gauss filter timings"))
+    {
+        const auto &level_ms = gauss_filter_timer.level_ms;
+        const auto &total_ms = gauss_filter_timer.total_ms;
+        const auto &setup_ms = gauss_filter_timer.setup_ms;
+        drawer.text("Level: windowed / tiled [ms]");
+        drawer.text("Setup: %.3f / %.3f", setup_ms[GaussFilterMode::Windowed], setup_ms[GaussFilterMode::Tiled]);
+        for (uint32_t i = 1; i < gauss_filter_timer.mip_levels; i++)
+        {
+            drawer.text("%2d: %.3f / %.3f", i, level_ms[GaussFilterMode::Windowed][i], level_ms[GaussFilterMode::Tiled][i]);
+        }
+        drawer.text("Total: %.3f / %.3f", total_ms[GaussFilterMode::Windowed], total_ms[GaussFilterMode::Tiled]);
+        drawer.text("Single pass: %.3f", total_ms[GaussFilterMode::SinglePass]);
+        drawer.text("Recursive: %.3f", total_ms[GaussFilterMode::Recursive]);
+        drawer.text("LinSSS accumulation (RGBA / split): %.3f / %.3f",
+                    gauss_filter_timer.linsss_ms[PyramidLayout::Interleaved], gauss_filter_timer.linsss_ms[PyramidLayout::Split]);
+
+        // Kernel approximation errors with unit sampling step
+        const glm::vec2 errors = gaussKernelErrors(push_const_gauss_cs.sigma * 2.0f, bssrdf.ksize);
+        drawer.text("Kernel L1 error: windowed %.4f / recursive %.4f", errors.x, errors.y);
+
+        // Workgroup sizes
+        drawer.text("Workgroup: gauss filter %ux%u / linsss %ux%u",
+                    workgroup_sizes.gauss_filter.width, workgroup_sizes.gauss_filter.height,
+                    workgroup_sizes.linsss.width, workgroup_sizes.linsss.height);
+        if (workgroup_tuner.active)
+        {
+            drawer.text("Tuning... (%u / %u)", workgroup_tuner.candidate + 1, static_cast<uint32_t>(workgroup_tuner.candidates.size()));
+        }
+        else if (drawer.button("Auto-tune workgroup sizes"))
+        {
+            start_workgroup_tuning();
+        }
     }
 }
 
@@ -8,8 +8,11 @@
 #pragma once
 
 #include <ktx.h>
+#include <map>
 
 #include "api_vulkan_sample.h"
+#include "core/query_pool.h"
+#include "frame_graph.h"
 
 // Enumeration for light type
 enum LightType : int
@@ -33,6 +36,99 @@ enum BSSRDFType : int
     Marble = 0x01
 };
 
+// Enumeration for Gaussian filter implementations
+enum GaussFilterMode : int
+{
+    Windowed   = 0x00,
+    Tiled      = 0x01,
+    SinglePass = 0x02,
+    Recursive  = 0x03
+};
+
+// Enumeration for irradiance pyramid layouts
+enum PyramidLayout : int
+{
+    Interleaved = 0x00,
+    Split       = 0x01
+};
+
+// Enumeration for LinSSS accumulation (separate compute pass or fused into deferred shading)
+enum LinsssMode : int
+{
+    Separate = 0x00,
+    Fused    = 0x01
+};
+
+// Enumeration for sampling schemes of translucent shadow maps
+enum TSMSampling : int
+{
+    WhiteNoise     = 0x00,
+    LowDiscrepancy = 0x01
+};
+
+// Enumeration for stop conditions of TSM accumulation
+enum TSMStopCondition : int
+{
+    NoStop         = 0x00,
+    SampleCount    = 0x01,
+    ErrorThreshold = 0x02
+};
+
+// Enumeration for render targets of the light pass
+enum LightPassFormat : int
+{
+    FullPrecision = 0x00,        // RGBA32F irradiance, position and normal
+    Compact       = 0x01,        // B10G11R11 irradiance (position from depth)
+    DepthOnly     = 0x02         // Depth for shadows only (while TSM is disabled)
+};
+
+// Enumeration for shadow filters of the direct pass
+enum ShadowFilter : int
+{
+    Jittered    = 0x00,        // Point samples of a fixed jitter table with a manual depth test
+    HardwarePCF = 0x01,        // Depth-compare taps on a rotated Poisson disk (4 or 16 taps)
+    Reference   = 0x02         // Dense grid of depth-compare taps (for error measurement)
+};
+
+// Enumeration for deferred shading and postprocess
+enum PostprocessMode : int
+{
+    SeparatePasses  = 0x00,        // Deferred shading into "fbos.deferred", and FXAA in the swapchain pass
+    MergedSubpasses = 0x01         // Subpasses of the swapchain pass with a transient input attachment (no FXAA)
+};
+
+// Enumeration for G-buffer precision of the direct pass
+enum GBufferProfile : int
+{
+    Float32 = 0x00,        // RGBA32F diffuse, specular, position, normal and linear depth
+    Float16 = 0x01,        // RGBA16F diffuse and specular, and octahedral RG16 normal (position and depth from D32)
+    Packed  = 0x02         // B10G11R11 diffuse and specular, and octahedral RG16 normal (position and depth from D32)
+};
+
+// Enumeration for transient images, which share memory when their lifetimes in a frame do not overlap
+enum TransientImage : int
+{
+    DirectDiffuse = 0x00,        // Diffuse of the direct pass (copied to the irradiance pyramid)
+    DirectDepth   = 0x01,        // Depth of the direct pass (only with the RGBA32F G-buffer, which has linear depth)
+    GaussInput    = 0x02,        // Irradiance pyramid read by the Gaussian filter
+    GaussBuffer   = 0x03,        // Intermediate of the separable Gaussian filter
+    TSMDepth0     = 0x04,        // Depth of the TSM pass (ping)
+    TSMDepth1     = 0x05,        // Depth of the TSM pass (pong)
+    DeferredColor = 0x06,        // Output of deferred shading (read by postprocess, only with separate passes)
+    DeferredDepth = 0x07         // Depth of deferred shading (only with separate passes)
+};
+
+// Enumeration for passes of a frame in their execution order (see "prepare_transient_images")
+enum FramePass : int
+{
+    DirectPass       = 0x00,
+    IrradianceMipmap = 0x01,
+    GaussianFilter   = 0x02,
+    TSMPass          = 0x03,
+    DeferredShading  = 0x04,
+    PostprocessPass  = 0x05
+};
+
 // Vertex layout for this example
 struct LinSSScatterVertexStructure
 {
@@ -97,6 +193,9 @@ class LinSSScatter : public ApiVulkanSample
         VkDeviceMemory device_memory_G_ast_W;
 
         VkSampler sampler;
+
+        // Wide profiles use the recursive Gaussian filter for the irradiance pyramid
+        bool recursive_filter = false;
     };
     BSSRDF bssrdf;
 
@@ -146,20 +245,42 @@ class LinSSScatter : public ApiVulkanSample
         glm::vec4 view_pos;
         glm::vec4 light_pos;
         glm::mat4 sm_mvp;
+        glm::vec4 view_pos_obj;        // Eye in object space, where the environment is looked up
     } ubo_vs;
 
     struct
     {
         std::array<glm::vec4, 9> sphere_harm_coefs;
         glm::vec4                light_power;
-        int                      light_type = (int) LightType::Uffizi;
+        int                      light_type    = (int) LightType::Uffizi;
+        int                      shadow_filter = ShadowFilter::Jittered;
     } ubo_fs;
 
+    // Spherical harmonics of the environment lights (keyed by the environment name, loaded once), and
+    // the hash of "ubo_fs" last uploaded, so that the buffer is written only when the lighting changes
+    std::map<std::string, std::array<glm::vec4, 9>> sh_registry;
+    uint64_t                                        ubo_fs_hash = 0;
+
+    // Push constants
+    struct
+    {
+        float    sigma     = 4.0f;
+        int      direction = 0;
+        uint32_t tile_base = 0;
+    } push_const_gauss_cs;
+
     struct
     {
-        float sigma     = 4.0f;
-        int   direction = 0;
-    } ubo_gauss_cs;
+        glm::ivec2 level_zero_size;
+        int        num_levels;
+        uint32_t   total_tiles;
+    } push_const_tile_classify_cs;
+
+    struct
+    {
+        float roughness   = 0.0f;
+        int   num_samples = 0;
+    } push_const_env_prefilter_cs;
 
     struct
     {
@@ -174,14 +295,35 @@ class LinSSScatter : public ApiVulkanSample
     {
         glm::mat4 mvp;
         glm::mat4 sm_mvp;
+        glm::mat4 sm_inv_mvp;
         glm::vec2 screen_extent;
         glm::vec2 bssrdf_extent;
         glm::vec2 seed;
         int       n_gauss;
         int       ksize;
         float     sigma_scale;
+        int       sampling;
+        int       radius_importance;
+        int       reset;
+        int       profile_lut;
+        float     profile_max_radius;
+        int       mipmaps;
+        float     mip_bias;
+        int       pos_from_depth;
     } ubo_tsm_fs;
 
+    struct
+    {
+        int num_levels;
+    } ubo_gauss_pyramid_cs;
+
+    struct
+    {
+        glm::mat4 inv_projection;
+        glm::mat4 inv_model_view;
+        int       reconstruct;
+    } ubo_gbuffer;
+
     struct
     {
         int win_width;
@@ -191,14 +333,289 @@ class LinSSScatter : public ApiVulkanSample
     std::unique_ptr<vkb::core::Buffer> uniform_buffer_sm_vs;
     std::unique_ptr<vkb::core::Buffer> uniform_buffer_vs;
     std::unique_ptr<vkb::core::Buffer> uniform_buffer_fs;
-    std::unique_ptr<vkb::core::Buffer> uniform_buffer_gauss_horz_cs;
-    std::unique_ptr<vkb::core::Buffer> uniform_buffer_gauss_vert_cs;
+    std::unique_ptr<vkb::core::Buffer> uniform_buffer_gauss_pyramid_cs;
     std::unique_ptr<vkb::core::Buffer> uniform_buffer_linsss_cs;
     std::unique_ptr<vkb::core::Buffer> uniform_buffer_tsm_fs;
     std::unique_ptr<vkb::core::Buffer> uniform_buffer_postproc_vs;
+    std::unique_ptr<vkb::core::Buffer> uniform_buffer_gbuffer;
+
+    // Kernel table of the Gaussian filter (sigma is the same for all the MIP levels, so they share the table)
+    std::unique_ptr<vkb::core::Buffer> storage_buffer_gauss_kernel;
+
+    // Tile counter for the single-pass pyramid
+    std::unique_ptr<vkb::core::Buffer> storage_buffer_gauss_pyramid_counter;
+
+    // Lists of 8x8 tiles covered by the object for each MIP level (see "tile_classify.comp").
+    // The buffer holds indirect dispatch arguments, followed by per-tile flags and the lists.
+    struct
+    {
+        std::unique_ptr<vkb::core::Buffer> buffer;
+        std::vector<uint32_t>              level_offsets;
+        uint32_t                           total_tiles = 0;
+    } tile_lists;
 
     // Other parameters
-    bool enable_tsm = false;
+    bool enable_tsm              = false;
+    int  gauss_filter_mode       = GaussFilterMode::Windowed;
+    bool gauss_tiled_supported   = false;
+    bool gauss_pyramid_supported = false;
+    bool enable_tile_lists       = false;
+
+    // Irradiance pyramid is copied to a single-channel image array (R, G, B layers) in "Split" layout
+    int      pyramid_layout       = PyramidLayout::Interleaved;
+    VkFormat pyramid_split_format = VK_FORMAT_R32_SFLOAT;
+
+    // In "Fused" mode, deferred shading samples the irradiance pyramid and "fbos.linsss" is not used
+    int linsss_mode = LinsssMode::Separate;
+
+    // Sampling of the TSM disk (see "translucent_shadow_maps.glsl")
+    int  tsm_sampling          = TSMSampling::LowDiscrepancy;
+    bool tsm_radius_importance = true;
+
+    // TSM accumulation is restarted by the next frame (see "clear_tsm_accumulation")
+    bool tsm_reset_pending = false;
+
+    // Convergence of TSM accumulation. Relative standard errors of 8x8 tiles are computed by
+    // "tsm_variance.comp", and the TSM draw is removed from the frame once the accumulation converges.
+    struct
+    {
+        int                                stop_condition  = TSMStopCondition::ErrorThreshold;
+        int                                max_frames      = 1024;
+        float                              error_threshold = 0.01f;
+        uint32_t                           frames          = 0;
+        float                              max_error       = 0.0f;
+        float                              converged_tiles = 0.0f;        // Ratio of the tiles below the threshold
+        bool                               converged       = false;
+        uint32_t                           num_tiles_x     = 0;
+        uint32_t                           num_tiles_y     = 0;
+        std::unique_ptr<vkb::core::Buffer> moments;
+        std::unique_ptr<vkb::core::Buffer> tile_errors;
+    } tsm_accumulation;
+
+    // Dynamic resolution of TSM. The render area inside the attachments is changed
+    // in steps so that the GPU time of the TSM pass stays within the budget.
+    struct
+    {
+        bool                            enabled          = true;
+        float                           budget_ms        = 2.0f;
+        uint32_t                        steps            = 4;        // Render area is steps / 8 of the attachments
+        float                           tsm_ms           = 0.0f;
+        uint32_t                        frames           = 0;        // Frames since the last change
+        bool                            timed            = false;
+        float                           timestamp_period = 1.0f;
+        std::unique_ptr<vkb::QueryPool> query_pool;
+    } tsm_resolution;
+
+    // Prefiltered environment for the split-sum approximation (see "prefilter_environment"). The environment is
+    // blitted to a half-float MIP chain, and level i of "prefiltered" is convolved with GGX of roughness
+    // i / (levels - 1). The BRDF LUT does not depend on the environment, so it is computed only once.
+    struct
+    {
+        std::unique_ptr<vkb::core::Image>     radiance;
+        std::unique_ptr<vkb::core::ImageView> radiance_view;
+        std::unique_ptr<vkb::core::Image>     prefiltered;
+        std::unique_ptr<vkb::core::ImageView> prefiltered_view;
+        std::vector<vkb::core::ImageView>     level_views;
+        std::unique_ptr<vkb::core::Image>     brdf_lut;
+        std::unique_ptr<vkb::core::ImageView> brdf_lut_view;
+        VkSampler                             sampler     = VK_NULL_HANDLE;
+        VkSampler                             lut_sampler = VK_NULL_HANDLE;
+        bool                                  lut_ready   = false;
+        float                                 ms          = 0.0f;
+    } env_prefilter;
+
+    // Deferred shading and postprocess merged into the subpasses of a swapchain pass (see "setup_render_pass"), while
+    // separate passes keep "render_pass". Deferred color is a transient input attachment, so that it need not be stored
+    // to memory on tiled GPUs.
+    struct
+    {
+        int                                   mode             = PostprocessMode::SeparatePasses;
+        int                                   active_mode      = PostprocessMode::SeparatePasses;
+        VkRenderPass                          render_pass      = VK_NULL_HANDLE;        // Swapchain pass of merged subpasses
+        std::vector<VkFramebuffer>            framebuffers;
+        VkPipeline                            ui_pipeline      = VK_NULL_HANDLE;        // UI in the postprocess subpass
+        bool                                  lazily_allocated = false;
+        std::unique_ptr<vkb::core::Image>     color;
+        std::unique_ptr<vkb::core::ImageView> color_view;
+        float                                 timestamp_period = 1.0f;
+        std::array<std::array<float, 3>, 2>   ms               = {};        // GPU time of deferred shading, postprocess and both for each mode
+        std::unique_ptr<vkb::QueryPool>       query_pool;
+    } subpass_merge;
+
+    // Radial profiles of TSM baked for quantized weights of the Gaussians (see "prepare_tsm_profile").
+    // Rows of the LUT are the codes, and columns are the distances in units of sigma scale.
+    struct
+    {
+        bool                                  enabled     = false;
+        float                                 max_radius  = 0.0f;
+        float                                 rel_error   = 0.0f;        // Area-weighted relative L2 error of the profiles
+        std::array<float, 2>                  ms_per_mpix = {};          // GPU time of TSM pass per megapixel (0: exact, 1: LUT)
+        std::unique_ptr<vkb::core::Image>     lut;
+        std::unique_ptr<vkb::core::ImageView> lut_view;
+        std::unique_ptr<vkb::core::Image>     codes;
+        std::unique_ptr<vkb::core::ImageView> codes_view;
+        VkSampler                             sampler = VK_NULL_HANDLE;
+    } tsm_profile;
+
+    // Render targets of the light pass (see "light_pass_formats"). "DepthOnly" is replaced by "Compact"
+    // while TSM is enabled, and the targets are created again when the active format changes.
+    struct
+    {
+        int                             format            = LightPassFormat::FullPrecision;
+        int                             active_format     = LightPassFormat::FullPrecision;
+        bool                            compact_supported = false;
+        float                           timestamp_period  = 1.0f;
+        std::array<float, 3>            memory_mib        = {};        // Memory of the render targets for each format
+        std::array<float, 3>            write_mib         = {};        // Base-level bytes written by the light pass
+        std::array<float, 3>            ms                = {};        // GPU time of the light pass for each format
+        std::unique_ptr<vkb::QueryPool> query_pool;
+    } light_pass_targets;
+
+    // Render targets of the direct pass (see "gbuffer_formats"). Reduced profiles sample the depth buffer with
+    // "depth_sampler" to reconstruct position and linear depth, and the targets are created again when the profile changes.
+    struct
+    {
+        int                  profile        = GBufferProfile::Float32;
+        int                  active_profile = GBufferProfile::Float32;
+        VkSampler            depth_sampler  = VK_NULL_HANDLE;
+        std::array<float, 3> memory_mib     = {};        // Memory of the render targets for each profile
+        std::array<float, 3> write_mib      = {};        // Bytes written by the direct pass
+        std::array<float, 3> ms             = {};        // GPU time of the direct pass for each profile
+    } gbuffer_targets;
+
+    // Transient images bound to shared heaps by the frame graph (see "TransientImage"). Images kept across frames,
+    // e.g., for the irradiance and shadow caches or TSM accumulation, have their own allocations.
+    struct
+    {
+        vkb::FrameGraph                  graph;
+        std::array<VkImage, 8>           images        = {};
+        std::array<VkImageCreateInfo, 8> infos         = {};
+        std::vector<VkDeviceMemory>      heaps;
+        float                            memory_mib    = 0.0f;        // Memory of all the render targets
+        float                            unaliased_mib = 0.0f;        // Same without aliasing of the transient images
+    } transient_images;
+
+    // Depth-compare sampler of the shadow map, and GPU time of the direct pass and error of each shadow filter
+    struct
+    {
+        VkSampler                       compare_sampler  = VK_NULL_HANDLE;
+        float                           timestamp_period = 1.0f;
+        std::array<float, 3>            ms               = {};
+        std::array<float, 2>            rel_error        = {};        // Against "ShadowFilter::Reference"
+        int                             stage            = 0;         // 0: idle, 1: reference, 2: jittered, 3: hardware PCF
+        int                             restore          = ShadowFilter::Jittered;
+        bool                            valid            = false;
+        std::vector<glm::vec4>          reference;
+        std::unique_ptr<vkb::QueryPool> query_pool;
+    } shadow_pcf;
+
+    // MIP pyramid of the light-space irradiance and position maps. Distant taps of TSM read coarser
+    // levels, and the footprints of the taps are estimated by "update_tsm_mipmap_stats".
+    struct
+    {
+        bool                 enabled          = true;
+        float                mip_bias         = -2.0f;        // Offset of the MIP level from the tap spacing
+        float                mean_lod         = 0.0f;
+        float                working_set_kib  = 0.0f;         // Estimated texels covered by the taps of a fragment
+        float                base_working_kib = 0.0f;         // Same for the base level only
+        std::array<float, 2> ms_per_mpix      = {};           // GPU time of TSM pass per megapixel (0: base level, 1: MIP)
+    } tsm_mipmap;
+
+    // Frames for each TSM sampling scheme to reach the RMSE of white noise after a fixed number of frames.
+    // Errors are measured against a long accumulation of white noise with its own seeds.
+    struct
+    {
+        int                               stage             = 0;        // 0: idle, 1: reference, 2: white noise, 3: low-discrepancy
+        uint32_t                          frame             = 0;
+        int                               sampling          = TSMSampling::LowDiscrepancy;
+        bool                              radius_importance = true;
+        bool                              valid             = false;
+        float                             target_rmse       = 0.0f;
+        std::array<uint32_t, 2>           frames            = {};
+        std::array<std::vector<float>, 2> rmse;
+        std::vector<glm::vec4>            reference;
+    } tsm_convergence;
+
+    // Half-precision arithmetic of Gaussian filter, LinSSS accumulation and TSM (see "precision.glsl")
+    bool float16_supported = false;
+    bool enable_float16    = false;
+
+    // Error of the half-precision path, measured against "fbos.linsss" rendered with 32-bit floats
+    struct
+    {
+        int                    stage          = 0;            // 0: idle, 1: 32-bit reference, 2: half precision
+        bool                   restore        = false;        // User's choices restored after the measurement
+        int                    restore_mode   = LinsssMode::Separate;
+        bool                   valid          = false;
+        float                  max_abs_error  = 0.0f;
+        float                  mean_rel_error = 0.0f;
+        std::vector<glm::vec4> reference;
+    } float16_error;
+
+    // GPU timings of Gaussian filter for each MIP level
+    struct
+    {
+        std::unique_ptr<vkb::QueryPool>   query_pool;
+        uint32_t                          queries_per_frame = 0;
+        uint32_t                          mip_levels        = 0;
+        int                               mode              = GaussFilterMode::Windowed;
+        float                             timestamp_period  = 1.0f;
+        std::array<std::vector<float>, 4> level_ms;
+        std::array<float, 4>              setup_ms  = {};        // Clearing before the first level (tile lists)
+        std::array<float, 4>              total_ms  = {};
+        std::array<float, 2>              linsss_ms = {};
+    } gauss_filter_timer;
+
+    // Dirty tracking of view, light and material. While they are unchanged, the light pass,
+    // irradiance pyramid and LinSSS accumulation are skipped and "fbos.linsss" is reused.
+    struct
+    {
+        bool     enabled        = true;
+        bool     reuse          = false;
+        bool     valid          = false;
+        uint64_t view_hash      = 0;
+        uint64_t light_hash     = 0;
+        uint64_t material_hash  = 0;
+        uint64_t total_frames   = 0;
+        uint64_t skipped_frames = 0;
+    } irradiance_cache;
+
+    // Dirty tracking of the light pass. Shadow map and light-space buffers depend only on the light,
+    // the model transform and the mesh, so they are kept across camera changes.
+    struct
+    {
+        bool     enabled            = true;
+        bool     reuse              = false;
+        bool     valid              = false;
+        uint64_t hash               = 0;
+        uint64_t total_updates      = 0;
+        uint32_t window_updates     = 0;
+        float    window_seconds     = 0.0f;
+        float    updates_per_second = 0.0f;
+    } shadow_cache;
+
+    // Workgroup sizes of windowed Gaussian filter and LinSSS accumulation
+    struct
+    {
+        VkExtent2D gauss_filter = {32, 32};
+        VkExtent2D linsss       = {32, 32};
+    } workgroup_sizes;
+
+    // Auto-tuner of workgroup sizes (each candidate is timed for several frames)
+    struct
+    {
+        bool                    active    = false;
+        uint32_t                candidate = 0;
+        uint32_t                frame     = 0;
+        std::vector<VkExtent2D> candidates;
+        std::vector<float>      gauss_filter_ms;
+        std::vector<float>      linsss_ms;
+        int                     gauss_filter_mode = GaussFilterMode::Windowed;        // User's choices restored after tuning
+        int                     linsss_mode       = LinsssMode::Separate;
+        bool                    tile_lists        = false;
+        VkExtent2D              gauss_filter_size = {32, 32};        // Sizes restored when tuning is canceled
+        VkExtent2D              linsss_size       = {32, 32};
+    } workgroup_tuner;
 
     // Textures
     Texture Ks_texture;
@@ -211,22 +628,45 @@ class LinSSScatter : public ApiVulkanSample
     {
         VkPipeline light_pass;
         VkPipeline direct_pass;
-        VkPipeline gauss_filter;
+        VkPipeline gauss_filter_tiled = VK_NULL_HANDLE;        // Only if "gauss_tiled_supported"
+        VkPipeline gauss_filter_recursive;
+        VkPipeline gauss_pyramid      = VK_NULL_HANDLE;        // Only if "gauss_pyramid_supported"
+        VkPipeline gauss_pyramid_split;
+        VkPipeline tile_classify;
         VkPipeline linsss;
         VkPipeline trans_sm;
+        VkPipeline trans_sm_float16;
+        VkPipeline tsm_variance;
+        VkPipeline env_prefilter;
+        VkPipeline brdf_lut;
         VkPipeline background;
         VkPipeline deferred;
+        VkPipeline deferred_fused[2];        // One for each pyramid layout
         VkPipeline postprocess;
+
+        // Subpasses of the swapchain pass (see "PostprocessMode::MergedSubpasses")
+        VkPipeline background_subpass;
+        VkPipeline deferred_subpass;
+        VkPipeline deferred_fused_subpass[2];
+        VkPipeline postprocess_subpass;
     } pipelines;
 
+    // Windowed Gaussian filter pipelines for each (direction, radius)
+    std::map<std::pair<int, int>, VkPipeline> gauss_filter_pipelines;
+
     // Descriptor pools
     struct
     {
         VkDescriptorPool light_pass;
         VkDescriptorPool direct_pass;
         VkDescriptorPool gauss_filter;
+        VkDescriptorPool gauss_pyramid;
+        VkDescriptorPool gauss_pyramid_split;
+        VkDescriptorPool tile_classify;
         VkDescriptorPool linsss;
         VkDescriptorPool trans_sm;
+        VkDescriptorPool tsm_variance;
+        VkDescriptorPool env_prefilter;
         VkDescriptorPool deferred;
         VkDescriptorPool postprocess;
     } descriptor_pools;
@@ -246,6 +686,7 @@ class LinSSScatter : public ApiVulkanSample
         FBO shadow_map;
         FBO direct_pass;
         FBO gauss_filter_buffer;
+        FBO gauss_pyramid_split;
         FBO linsss;
         FBO trans_sm[2];
         FBO deferred;
@@ -262,8 +703,13 @@ class LinSSScatter : public ApiVulkanSample
         VkPipelineLayout light_pass;
         VkPipelineLayout direct_pass;
         VkPipelineLayout gauss_filter;
+        VkPipelineLayout gauss_pyramid;
+        VkPipelineLayout gauss_pyramid_split;
+        VkPipelineLayout tile_classify;
         VkPipelineLayout linsss;
         VkPipelineLayout trans_sm;
+        VkPipelineLayout tsm_variance;
+        VkPipelineLayout env_prefilter;        // Shared by "brdf_lut.comp"
         VkPipelineLayout deferred;
         VkPipelineLayout postprocess;
     } pipeline_layouts;
@@ -272,10 +718,15 @@ class LinSSScatter : public ApiVulkanSample
     {
         VkDescriptorSet              light_pass;
         VkDescriptorSet              direct_pass;
-        std::vector<VkDescriptorSet> gauss_horz_filter;
-        std::vector<VkDescriptorSet> gauss_vert_filter;
+        std::vector<VkDescriptorSet> gauss_filter;
+        VkDescriptorSet              gauss_pyramid;
+        std::vector<VkDescriptorSet> gauss_pyramid_split;
+        VkDescriptorSet              tile_classify;
         VkDescriptorSet              linsss;
         VkDescriptorSet              trans_sm[2];
+        VkDescriptorSet              tsm_variance;
+        std::vector<VkDescriptorSet> env_prefilter;        // One for each level
+        VkDescriptorSet              brdf_lut;
         VkDescriptorSet              deferred;
         VkDescriptorSet              postprocess;
     } descriptor_sets;
@@ -285,8 +736,13 @@ class LinSSScatter : public ApiVulkanSample
         VkDescriptorSetLayout light_pass;
         VkDescriptorSetLayout direct_pass;
         VkDescriptorSetLayout gauss_filter;
+        VkDescriptorSetLayout gauss_pyramid;
+        VkDescriptorSetLayout gauss_pyramid_split;
+        VkDescriptorSetLayout tile_classify;
         VkDescriptorSetLayout linsss;
         VkDescriptorSetLayout trans_sm;
+        VkDescriptorSetLayout tsm_variance;
+        VkDescriptorSetLayout env_prefilter;
         VkDescriptorSetLayout deferred;
         VkDescriptorSetLayout postprocess;
     } descriptor_set_layouts;
@@ -303,28 +759,98 @@ class LinSSScatter : public ApiVulkanSample
     void destroy_texture(Texture texture);
     void prepare_bssrdf(const std::string &filename);
     void destroy_bssrdf(BSSRDF bssrdf);
+    void prepare_tsm_profile(const float *weights);
+    void prepare_env_prefilter();
+    void prefilter_environment();
 
     void setup_render_pass() override;
+    void setup_light_pass_render_pass();
+    void setup_direct_pass_render_pass();
     void setup_custom_render_passes();
+    void setup_shadow_map_framebuffer();
+    void setup_direct_pass_framebuffer();
+    void prepare_transient_images();
+    void destroy_transient_images();
+    void emplace_transient_image(FBO &fbo, int image);
+    void insert_aliasing_barrier(VkCommandBuffer command_buffer, int pass);
+    void update_render_target_footprint();
     void destroy_custom_framebuffers();
     void setup_custom_framebuffers();
     void setup_framebuffer() override;
+    void destroy_merged_framebuffers();
     void destroy_custom_render_passes();
 
     void setup_descriptor_set_layout();
     void setup_descriptor_set();
+    void update_envmap_descriptor();
     void update_descriptor_set();
     void prepare_pipelines();
+    void prepare_light_pass_pipeline();
+    void prepare_direct_pass_pipeline();
     void prepare_primitive_objects();
     void prepare_uniform_buffers();
     void update_uniform_buffers();
     bool prepare(vkb::Platform &platform) override;
     void generate_mipmap(VkCommandBuffer cmd_buffer, VkImage image, uint32_t image_width, uint32_t image_height, VkFormat format, uint32_t mip_levels);
-    void gauss_filter_to_mipmap_compute(VkCommandBuffer cmd_buffer, uint32_t image_width, uint32_t image_height, uint32_t mip_levels);
-    void linsss_accumulate_compute(VkCommandBuffer cmd_buffer);
+    void gauss_filter_to_mipmap_compute(VkCommandBuffer cmd_buffer, uint32_t image_width, uint32_t image_height, uint32_t mip_levels, uint32_t first_query);
+    void gauss_pyramid_compute(VkCommandBuffer cmd_buffer, uint32_t image_width, uint32_t image_height, uint32_t mip_levels);
+    bool gauss_pyramid_split_compute(VkCommandBuffer cmd_buffer);
+    void prepare_tile_lists();
+    void prepare_tsm_accumulation();
+    void tsm_variance_compute(VkCommandBuffer cmd_buffer);
+    void update_tsm_accumulation();
+    void prepare_tsm_resolution();
+    void update_tsm_resolution();
+    void set_tsm_resolution_steps(uint32_t steps);
+    void generate_tsm_mipmaps(VkCommandBuffer cmd_buffer);
+    void update_tsm_mipmap_stats();
+    void tile_classify_compute(VkCommandBuffer cmd_buffer);
+    void prepare_timestamp_queries();
+    void fetch_timestamp_queries();
+    void fetch_light_pass_queries();
+    void update_light_pass_format();
+    void update_gbuffer_profile();
+    void update_postprocess_mode();
+    void prepare_shadow_compare_sampler();
+    void fetch_direct_pass_queries();
+
+    VkDescriptorImageInfo gbuffer_depth_descriptor();
+    void fetch_postprocess_queries();
+    void linsss_accumulate_compute(VkCommandBuffer cmd_buffer, uint32_t first_query);
+    void draw_deferred_shading(VkCommandBuffer cmd_buffer, VkPipeline background_pipeline, VkPipeline object_pipeline, VkPipeline fused_pipeline, const glm::vec2 &tsm_uv_scale);
+    void draw_postprocess(VkCommandBuffer cmd_buffer, VkPipeline postprocess_pipeline, VkPipeline ui_pipeline);
+
+    VkPipeline get_gauss_filter_pipeline(int direction, int radius);
+    VkPipeline create_linsss_pipeline();
+    VkExtent2D gauss_filter_local_size();
+    VkExtent2D linsss_local_size();
+    VkExtent2D tsm_render_extent() const;
+
+    std::string workgroup_sizes_filename();
+    void        load_workgroup_sizes();
+    void        save_workgroup_sizes();
+    void        apply_workgroup_sizes();
+    void        start_workgroup_tuning();
+    void        update_workgroup_tuner(float gauss_filter_ms, float linsss_ms);
+    void        stop_workgroup_tuning();
+    bool        project_envmap_sh(const std::string &hdr_filename, const std::string &sph_filename, std::array<glm::vec4, 9> &coefs);
+    void        load_sh_registry();
+    void        update_ubo_fs();
+    void        update_irradiance_cache();
+    void        invalidate_irradiance_cache();
+    void        update_shadow_cache();
+    void        invalidate_shadow_cache();
+    void        init_placeholder_layouts(const std::vector<VkImage> &images);
+    void        read_color_image(const vkb::core::Image &image, VkImageLayout layout, std::vector<glm::vec4> &pixels);
+    void        start_float16_error_measurement();
+    void        update_float16_error_measurement();
+    void        start_shadow_filter_measurement();
+    void        update_shadow_filter_measurement();
+    void        clear_tsm_accumulation();
+    void        start_tsm_convergence_measurement();
+    void        update_tsm_convergence_measurement();
 
     virtual void render(float delta_time) override;
-    virtual void update(float delta_time) override;
     virtual void view_changed() override;
     virtual void on_update_ui_overlay(vkb::Drawer &drawer) override;
 
@@ -334,6 +860,32 @@ class LinSSScatter : public ApiVulkanSample
         uint32_t h = get_render_context().get_surface_extent().height;
         return std::ceil(std::log2(std::max(w, h)));
     }
+
+    // Render targets of the light pass in use (TSM needs irradiance and position)
+    int light_pass_format() const
+    {
+        int format = light_pass_targets.format;
+        if (format == LightPassFormat::DepthOnly && enable_tsm)
+        {
+            format = LightPassFormat::Compact;
+        }
+        if (format == LightPassFormat::Compact && !light_pass_targets.compact_supported)
+        {
+            format = LightPassFormat::FullPrecision;
+        }
+        return format;
+    }
+
+    // G-buffer profile in use (octahedral normals need the same formats as the compact light pass)
+    int gbuffer_profile() const
+    {
+        int profile = gbuffer_targets.profile;
+        if (profile != GBufferProfile::Float32 && !light_pass_targets.compact_supported)
+        {
+            profile = GBufferProfile::Float32;
+        }
+        return profile;
+    }
 };
 
 std::unique_ptr<vkb::Application> create_linsss();
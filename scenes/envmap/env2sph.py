@@ -8,6 +8,15 @@ N_THETA_DIVIDES = 128
 N_PHI_DIVIDES = 256
 
 
+def real_sph_harm(m, l, phi, theta):
+    # Real spherical harmonics (same basis as "vkb::project_sh9", which is used when no .sph file exists)
+    if m > 0:
+        return np.sqrt(2.0) * (-1) ** m * np.real(sph_harm(m, l, phi, theta))
+    if m < 0:
+        return np.sqrt(2.0) * (-1) ** m * np.imag(sph_harm(-m, l, phi, theta))
+    return np.real(sph_harm(0, l, phi, theta))
+
+
 def main(filename):
     base, ext = os.path.splitext(filename)
     sph_file = base + '.sph'
@@ -25,6 +34,7 @@ def main(filename):
     image = cv2.imread(filename, cv2.IMREAD_UNCHANGED)
     if image is None:
         raise Exception('Failed to load image: %s' % (filename))
+    image = cv2.cvtColor(image, cv2.COLOR_BGR2RGB)
 
     height, width, _ = image.shape
     for l, m, k in indices:
@@ -41,16 +51,16 @@ def main(filename):
                 v = max(0, min(v, height - 1))
 
                 color = image[v, u, :]
-                w = np.real(sph_harm(m, l, phi, theta))
+                w = real_sph_harm(m, l, phi, theta)
                 value += 4.0 * np.pi * w * color
 
         coeffs[k] = value / (float)(N_THETA_DIVIDES * N_PHI_DIVIDES)
 
     with open(sph_file, 'w') as fp:
         for c in coeffs:
-            fp.write('{0:f} {0:f} {0:f}\n'.format(c[0], c[1], c[2]))
+            fp.write('{0:f} {1:f} {2:f}\n'.format(c[0], c[1], c[2]))
 
-    printf('Finish!')
+    print('Finish!')
 
 
 if __name__ == '__main__':
@@ -14,6 +14,39 @@ layout (binding = 4) uniform sampler2D tsmTex;
 layout (binding = 5) uniform sampler2D specTex;
 layout (binding = 6) uniform sampler2D depthTex;
 
+// Inputs of LinSSS accumulation (used only in the fused mode)
+layout (binding = 7) uniform UBO {
+    vec4 sigmas[8];
+    float texOffsetX;
+    float texOffsetY;
+    float texScale;
+    float irrScale;
+} ubo;
+
+layout (binding = 8) uniform sampler3D tex_W;
+layout (binding = 9) uniform sampler3D tex_G_ast_W;
+layout (binding = 10) uniform sampler2D tex_G_ast_Phi;
+layout (binding = 11) uniform sampler2DArray tex_G_ast_Phi_split;
+layout (binding = 12) uniform sampler2D posTex;
+
+#define GBUFFER_BINDING 13
+#include "gbuffer.glsl"
+
+// Push constants
+layout (push_constant) uniform PushConstants {
+    vec2 tsmUVScale;    // Render area of TSM relative to "tsmTex"
+} pc;
+
+layout (constant_id = 0) const int numGauss = 8;
+
+// Irradiance pyramid layout (false: RGBA, true: R, G and B in separate layers)
+layout (constant_id = 1) const bool splitPyramid = false;
+
+// LinSSS accumulation is evaluated here instead of being read from "sssTex"
+layout (constant_id = 2) const bool fusedLinsss = false;
+
+#include "linsss.glsl"
+
 // eta = 1.5
 // Fdr = -1.4399 / (eta * eta) + 0.7099 / eta + 0.6681 + 0.0636 * eta;
 const float FRESNEL_DIFFUSE = 0.59681111;
@@ -29,8 +62,23 @@ void main() {
 
     float Ft = 1.0 - fresnelDielectric(cosThetaO, 1.0, 1.5);
     float Fdr = 1.0 - FRESNEL_DIFFUSE;
-    vec3 sssNear = texture(sssTex, inUV).rgb;
-    vec3 sssFar = texture(tsmTex, inUV).rgb / texture(tsmTex, inUV).a;
+    vec3 sssNear = vec3(0.0, 0.0, 0.0);
+    if (fusedLinsss) {
+        // Same pixel centers as "linsss.comp"
+        const vec2 pixelUV = gl_FragCoord.xy / vec2(textureSize(depthTex, 0));
+        const float depth = texture(depthTex, pixelUV).x;
+        if (gbufferCovered(depth)) {
+            const vec2 uvW = bssrdfUV(gbufferPosition(posTex, depth, pixelUV).xy);
+            for (int h = 0; h < numGauss; h++) {
+                sssNear += linsssTerm(h, pixelUV, uvW, gaussMipLevel(ubo.sigmas[h].xyz));
+            }
+        }
+    } else {
+        sssNear = texture(sssTex, inUV).rgb;
+    }
+    // Texels outside the TSM render area are not filtered in
+    const vec2 tsmUV = min(inUV * pc.tsmUVScale, pc.tsmUVScale - 0.5 / vec2(textureSize(tsmTex, 0)));
+    vec3 sssFar = texture(tsmTex, tsmUV).rgb / texture(tsmTex, tsmUV).a;
     vec3 sss = (sssNear + sssFar) * Ft * Fdr * M_INV_PI;
 
     vec3 specular = texture(specTex, inUV).rgb;
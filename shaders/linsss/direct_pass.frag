@@ -10,6 +10,7 @@ layout (location = 4) in vec3 inOrigNormal;
 layout (location = 5) in vec3 inViewVec;
 layout (location = 6) in vec3 inLightVec;
 layout (location = 7) in vec4 inPosScreenSM;
+layout (location = 8) in vec3 inViewVecObj;
 
 layout (location = 0) out vec4 outFragColor;
 layout (location = 1) out vec4 outSpecColor;
@@ -21,11 +22,28 @@ layout (binding = 1) uniform UBO {
     vec4 sphereHarmCoefs[9];
     vec4 lightPower;
     int lightType;
+    int shadowFilter;
 } ubo;
 
 layout (binding = 2) uniform sampler2D texKs;
 layout (binding = 3) uniform sampler2D texEnvmap;
 layout (binding = 4) uniform sampler2D depthBuffer;
+layout (binding = 5) uniform sampler2DShadow depthCompare;
+layout (binding = 6) uniform sampler2D brdfLUT;
+
+// G-buffer profile (see "gbuffer.glsl"). Reduced profiles keep the normal as RG16 octahedral
+// coordinates, and have no position and depth targets, so that they are not computed.
+layout (constant_id = 0) const bool packedNormal = false;
+layout (constant_id = 1) const bool storePosition = true;
+
+// Shadow filters (see "ShadowFilter" in "linsss.h")
+#define SHADOW_FILTER_JITTERED 0
+#define SHADOW_FILTER_HARDWARE_PCF 1
+#define SHADOW_FILTER_REFERENCE 2
+
+// Depth bias, and the radius of every filter in UV of the shadow map
+const float shadowBias = 0.005;
+const float pcfRadius = 0.005;
 
 const int nPCFSamples = 16;
 vec3 samples[] = vec3[32](
@@ -63,9 +81,36 @@ vec3 samples[] = vec3[32](
     vec3(-0.017620, -0.016803, 0.095556)
 );
 
+// Poisson disk in the unit disk. The first four samples are the outermost ones of the quadrants.
+const int nPoissonSamples = 16;
+const int nPoissonEarlySamples = 4;
+const vec2 poissonDisk[16] = vec2[](
+    vec2(0.559225, 0.779148),
+    vec2(-0.223652, 0.880030),
+    vec2(-0.275155, -0.828982),
+    vec2(0.173990, -0.913038),
+    vec2(0.325385, 0.452917),
+    vec2(0.710182, 0.347562),
+    vec2(-0.476749, 0.536070),
+    vec2(-0.235756, -0.011023),
+    vec2(0.296483, -0.565514),
+    vec2(0.734742, -0.250481),
+    vec2(-0.768278, -0.379529),
+    vec2(-0.718203, 0.202772),
+    vec2(0.222939, 0.100404),
+    vec2(-0.176288, -0.466727),
+    vec2(-0.082228, 0.481552),
+    vec2(0.193201, 0.889587)
+);
+
+// Interleaved gradient noise by Jimenez, "Next Generation Post Processing in Call of Duty: Advanced Warfare"
+float interleavedGradientNoise(in vec2 pixel) {
+    return fract(52.9829189 * fract(dot(pixel, vec2(0.06711056, 0.00583715))));
+}
+
 float visibility(in vec3 n, in vec3 l, vec3 jitter) {
     float ndotl = max(0.0, dot(n, l));
-    float bias = 0.005;
+    float bias = shadowBias;
 
     float zValue = inPosScreenSM.z / inPosScreenSM.w;
     vec2 uv = (inPosScreenSM.xy / inPosScreenSM.w) * 0.5 + 0.5;
@@ -81,12 +126,56 @@ float visibility(in vec3 n, in vec3 l, vec3 jitter) {
 float visibilityPCF(in vec3 n, in vec3 l) {
     float vis = 0.0;
     for (int i = 0; i < nPCFSamples; i++) {
-        vec3 jitter = samples[i] * 0.005;
+        vec3 jitter = samples[i] * pcfRadius;
         vis += visibility(n, l, jitter);
     }
     return vis / float(nPCFSamples);
 }
 
+// Each tap of the depth-compare sampler is a bilinear PCF of 2x2 texels. The disk is rotated per pixel,
+// and the remaining taps are taken only at penumbrae, i.e., when the first taps partially pass. The
+// explicit LOD keeps the taps valid in the non-uniform control flow (the shadow map has no MIP levels).
+float visibilityPoissonPCF() {
+    const vec2 uv = (inPosScreenSM.xy / inPosScreenSM.w) * 0.5 + 0.5;
+    const float zRef = inPosScreenSM.z / inPosScreenSM.w - shadowBias;
+
+    const float angle = M_TWO_PI * interleavedGradientNoise(gl_FragCoord.xy);
+    const mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle)) * pcfRadius;
+
+    float vis = 0.0;
+    for (int i = 0; i < nPoissonEarlySamples; i++) {
+        vis += textureLod(depthCompare, vec3(uv + rotation * poissonDisk[i], zRef), 0.0);
+    }
+    if (vis == 0.0 || vis == float(nPoissonEarlySamples)) {
+        return vis / float(nPoissonEarlySamples);
+    }
+
+    for (int i = nPoissonEarlySamples; i < nPoissonSamples; i++) {
+        vis += textureLod(depthCompare, vec3(uv + rotation * poissonDisk[i], zRef), 0.0);
+    }
+    return vis / float(nPoissonSamples);
+}
+
+// Dense grid of depth-compare taps over the same disk (reference of the error measurement)
+float visibilityReferencePCF() {
+    const vec2 uv = (inPosScreenSM.xy / inPosScreenSM.w) * 0.5 + 0.5;
+    const float zRef = inPosScreenSM.z / inPosScreenSM.w - shadowBias;
+    const int n = 8;
+
+    float vis = 0.0;
+    float count = 0.0;
+    for (int y = -n; y <= n; y++) {
+        for (int x = -n; x <= n; x++) {
+            const vec2 offset = vec2(x, y) / float(n);
+            if (dot(offset, offset) <= 1.0) {
+                vis += textureLod(depthCompare, vec3(uv + offset * pcfRadius, zRef), 0.0);
+                count += 1.0;
+            }
+        }
+    }
+    return vis / count;
+}
+
 void main()
 {
     vec3 n = normalize(inNormal);
@@ -116,19 +205,36 @@ void main()
         specular = Ks * F * fr * cosThetaI * ubo.lightPower.rgb;
 
         // Shadow
-        float vis = visibilityPCF(n, wi);
+        float vis = 1.0;
+        if (ubo.shadowFilter == SHADOW_FILTER_HARDWARE_PCF) {
+            vis = visibilityPoissonPCF();
+        } else if (ubo.shadowFilter == SHADOW_FILTER_REFERENCE) {
+            vis = visibilityReferencePCF();
+        } else {
+            vis = visibilityPCF(n, wi);
+        }
         diffuse *= vis;
         specular *= vis;
     } else {
         // Environment map
         vec3 no = normalize(inOrigNormal);
         diffuse = computeSH(vec4(no.x, -no.z, no.y, 1.0), ubo.sphereHarmCoefs).rgb;
-        specular = vec3(0.0);
+
+        // Split-sum approximation with the prefiltered envmap (roughness = sqrt(alpha), F0 = 0.04 for IOR 1.5)
+        vec3 woObj = normalize(inViewVecObj);
+        vec3 wr = reflect(-woObj, no);
+        float roughness = sqrt(alpha);
+        float lod = roughness * float(textureQueryLevels(texEnvmap) - 1);
+        vec3 prefiltered = textureLod(texEnvmap, envmapUV(wr), lod).rgb;
+        vec2 AB = textureLod(brdfLUT, vec2(max(cosThetaV, 0.0), roughness), 0.0).xy;
+        specular = Ks * prefiltered * (0.04 * AB.x + AB.y);
     }
 
     outFragColor = vec4(diffuse, 1.0);
     outSpecColor = vec4(specular, 1.0);
-    outPos = vec4(inPos, 1.0);
-    outNormal = vec4(inOrigNormal, 1.0);
-    outDepth = vec4(vec3(-inPosCamSpace.z), 1.0);
+    outNormal = packedNormal ? vec4(octEncode(normalize(inOrigNormal)), 0.0, 0.0) : vec4(inOrigNormal, 1.0);
+    if (storePosition) {
+        outPos = vec4(inPos, 1.0);
+        outDepth = vec4(vec3(-inPosCamSpace.z), 1.0);
+    }
 }
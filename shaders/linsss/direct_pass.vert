@@ -11,6 +11,7 @@ layout (binding = 0) uniform UBO
     vec4 viewPos;
     vec4 lightPos;
     mat4 smModelViewProj;
+    vec4 viewPosObj;
 } ubo;
 
 layout (location = 0) out vec3 outPos;
@@ -21,6 +22,7 @@ layout (location = 4) out vec3 outOrigNormal;
 layout (location = 5) out vec3 outViewVec;
 layout (location = 6) out vec3 outLightVec;
 layout (location = 7) out vec4 outPosScreenSM;
+layout (location = 8) out vec3 outViewVecObj;
 
 out gl_PerVertex
 {
@@ -44,4 +46,7 @@ void main()
     outViewVec = ubo.viewPos.xyz - pos.xyz;
 
     outPosScreenSM = ubo.smModelViewProj * vec4(inPos.xyz, 1.0);
+
+    // View vector in object space, where the environment is looked up
+    outViewVecObj = ubo.viewPosObj.xyz / ubo.viewPosObj.w - inPos;
 }
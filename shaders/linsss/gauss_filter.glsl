@@ -0,0 +1,161 @@
+// Separable Gaussian filter of the irradiance (one direction per dispatch).
+// The includer enables GL_EXT_control_flow_attributes, and also defines
+// USE_FLOAT16 for the half-precision variant (see "precision.glsl").
+
+#include "utils.glsl"
+#include "precision.glsl"
+
+// Workgroup shape is given by specialization constants 4 and 5
+layout(local_size_x_id = 4, local_size_y_id = 5) in;
+
+// Input/output image storages
+layout (rgba32f, binding = 0) uniform readonly image2D inImage;
+layout (rgba32f, binding = 1) uniform writeonly image2D outImage;
+layout (rgba32f, binding = 2) uniform coherent image2D bufImage;
+
+// Push constants (sigma and the first tile of the MIP level)
+layout (push_constant) uniform PushConstants {
+    float sigma;
+    layout (offset = 8) uint tileBase;
+} pc;
+
+// Image samplers
+layout (binding = 4) uniform sampler2D posTex;
+layout (binding = 5) uniform sampler2D normTex;
+layout (binding = 6) uniform sampler2D depthTex;
+
+// SSSSS parameters
+layout (constant_id = 0) const float sssLevel = 31.5;
+layout (constant_id = 1) const float correction = 800.0;
+layout (constant_id = 2) const float maxdd = 0.001;
+layout (constant_id = 3) const int ksize = 31;
+
+// Filter direction (0: horizontal, 1: vertical)
+layout (constant_id = 6) const int direction = 0;
+
+// Workgroups only run on the tiles covered by the object (see "tile_classify.comp")
+layout (constant_id = 7) const bool tileListed = false;
+
+layout (std430, binding = 8) readonly buffer TileList {
+    uint dispatchArgs[48];
+    uint data[];
+} tileList;
+
+#define GBUFFER_BINDING 9
+#include "gbuffer.glsl"
+
+shared real kernel[ksize];
+
+float gauss(in float x, in float s) {
+	const float invs = 1.0 / s;
+    return M_INV_SQRT_TWO_PI * invs * exp(-0.5 * x * x * invs * invs);
+}
+
+real depthWeight(real dz) {
+	return exp(real(-4.0) * dz * dz);
+}
+
+real normWeight(real3 n1, real3 n2) {
+	return exp(dot(n1, n2) - real(1.0));
+}
+
+vec2 to_uv(in float x, in float y, in float w, in float h) {
+	return vec2((x + 0.5) / w, (y + 0.5) / h);
+}
+
+ivec2 workGroupOrigin() {
+    if (tileListed) {
+        const uint tile = tileList.data[pc.tileBase + gl_WorkGroupID.x];
+        return ivec2(tile & 0xffff, tile >> 16) * ivec2(gl_WorkGroupSize.xy);
+    }
+    return ivec2(gl_WorkGroupID.xy * gl_WorkGroupSize.xy);
+}
+
+void main() {
+	const ivec2 threadIdx = ivec2(gl_LocalInvocationID);
+	const ivec2 blockSize = ivec2(gl_WorkGroupSize);
+    const ivec2 globalIdx = workGroupOrigin() + threadIdx;
+    const ivec2 outSize = imageSize(outImage);
+    const int radius = (ksize - 1) / 2;
+
+	const int x0 = globalIdx.x;
+	const int y0 = globalIdx.y;
+	const int width = outSize.x;
+	const int height = outSize.y;
+	const bool isInsideFrame = (x0 >= 0 && y0 >= 0 && x0 < width && y0 < height);
+
+	// Compute kernel table
+	const int groupSize = blockSize.x * blockSize.y;
+	for (int k = threadIdx.y * blockSize.x + threadIdx.x; k < ksize; k += groupSize) {
+		kernel[k] = real(gauss(k, pc.sigma * 2.0));
+	}
+	memoryBarrierShared();
+    barrier();
+
+    // Consider object geometry
+    // See the article "Screen-space Subsurface Scattering" in GPU Pro.
+    const vec2 texelSize = vec2(1.0 / width, 1.0 / height);
+    float depth = gbufferDepth(depthTex, to_uv(x0, y0, width, height)) * 0.25;
+    float dzdx = gbufferDepthGrad(depthTex, to_uv(x0, y0, width, height), vec2(texelSize.x, 0.0));
+    float dzdy = gbufferDepthGrad(depthTex, to_uv(x0, y0, width, height), vec2(0.0, texelSize.y));
+    float s_x = sssLevel / (depth + correction * min(abs(dzdx), maxdd));
+    float s_y = sssLevel / (depth + correction * min(abs(dzdy), maxdd));
+    s_x = max(0.5, min(s_x, 2.0));
+    s_y = max(0.5, min(s_y, 2.0));
+
+    // Central parameters
+    vec2 uv0 = to_uv(x0, y0, width, height);
+    bool isMaskedCenter;
+    float zCenter = gbufferTapDepth(depthTex, uv0, isMaskedCenter);
+    vec3 normCenter = gbufferNormal(normTex, uv0);
+
+    // Horizontal filter
+    if (direction == 0) {
+        if (isMaskedCenter) {
+		    real3 sum = real3(0.0, 0.0, 0.0);
+            real sumWgt = real(0.0);
+            [[unroll]] for (int i = -radius; i <= radius; i++) {
+			    const float x = x0 + i * s_x;
+                const vec2 uv = to_uv(x, y0, width, height);
+            
+                bool covered;
+                const real dz = real(gbufferTapDepth(depthTex, uv, covered) - zCenter);
+                const vec3 norm = gbufferNormal(normTex, uv);
+
+                const real maskBit = covered ? real(1.0) : real(0.0);
+                const real G = kernel[abs(i)] * maskBit * depthWeight(dz) * normWeight(real3(norm), real3(normCenter));
+                sum += G * real3(imageLoad(inImage, ivec2(x, y0)).rgb);
+                sumWgt += G;
+            }
+            sum /= (sumWgt + real(M_EPS));
+            imageStore(bufImage, globalIdx, vec4(vec3(sum), 1.0));
+        } else {
+            imageStore(bufImage, globalIdx, vec4(0.0, 0.0, 0.0, 1.0));
+        }
+    }
+
+    // Vertical filter
+    if (direction == 1) {
+        if (isMaskedCenter) {
+		    real3 sum = real3(0.0, 0.0, 0.0);
+		    real sumWgt = real(0.0);
+            [[unroll]] for (int i = -radius; i <= radius; i++) {
+			    const float y = y0 + i * s_y;
+                const vec2 uv = to_uv(x0, y, width, height);
+
+                bool covered;
+                const real dz = real(gbufferTapDepth(depthTex, uv, covered) - zCenter);
+                const vec3 norm = gbufferNormal(normTex, uv);
+
+                const real maskBit = covered ? real(1.0) : real(0.0);
+                const real G = kernel[abs(i)] * maskBit * depthWeight(dz) * normWeight(real3(norm), real3(normCenter));
+                sum += G * real3(imageLoad(bufImage, ivec2(x0, y)).rgb);
+                sumWgt += G;
+            }
+            sum /= (sumWgt + real(M_EPS));
+            imageStore(outImage, globalIdx, vec4(vec3(sum), 1.0));
+        } else {
+            imageStore(outImage, globalIdx, vec4(0.0, 0.0, 0.0, 1.0));        
+        }
+    }
+}
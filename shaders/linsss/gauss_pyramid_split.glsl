@@ -0,0 +1,29 @@
+// Copies R, G and B channels of the irradiance pyramid to separate layers of
+// a single-channel image array, so that LinSSS accumulation fetches only the
+// channel it uses. SPLIT_FORMAT must be defined before including this file.
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+// Filtered irradiance (all MIP levels)
+layout (binding = 0) uniform sampler2D tex_G_ast_Phi;
+
+// Output image storage (one layer for each channel)
+layout (SPLIT_FORMAT, binding = 1) uniform writeonly image2DArray outImage;
+
+// Push constants
+layout (push_constant) uniform PushConstants {
+    int level;
+} pc;
+
+void main() {
+    const ivec2 pixelPos = ivec2(gl_GlobalInvocationID.xy);
+    const ivec2 outSize = imageSize(outImage).xy;
+    if (pixelPos.x >= outSize.x || pixelPos.y >= outSize.y) {
+        return;
+    }
+
+    const vec3 L = texelFetch(tex_G_ast_Phi, pixelPos, pc.level).rgb;
+    imageStore(outImage, ivec3(pixelPos, 0), vec4(L.r, 0.0, 0.0, 1.0));
+    imageStore(outImage, ivec3(pixelPos, 1), vec4(L.g, 0.0, 0.0, 1.0));
+    imageStore(outImage, ivec3(pixelPos, 2), vec4(L.b, 0.0, 0.0, 1.0));
+}
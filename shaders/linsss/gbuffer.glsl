@@ -0,0 +1,71 @@
+// G-buffer of the direct pass (see "GBufferProfile" in "linsss.h").
+// The includer defines GBUFFER_BINDING for the uniform block below, and
+// passes its samplers of position, normal and depth to the readers.
+// With the float32 profile, these are RGBA32F targets and "depthTex" has the
+// linear depth (zero outside the object). Otherwise, "depthTex" is the D32
+// depth buffer, normal is octahedral RG16, and position and linear depth are
+// reconstructed from depth.
+
+layout (binding = GBUFFER_BINDING) uniform GBuffer {
+    mat4 invProjection;
+    mat4 invModelView;
+    int reconstruct;
+} gbuffer;
+
+// True if the raw texel of "depthTex" is covered by the object
+bool gbufferCovered(in float depth) {
+    return gbuffer.reconstruct != 0 ? depth < 1.0 : depth > 0.0;
+}
+
+// View-space z of a D32 texel (only z and w of the inverse projection are needed)
+float gbufferViewZ(in float depth, in vec2 uv) {
+    const vec4 ndc = vec4(uv * 2.0 - 1.0, depth, 1.0);
+    const mat4 m = gbuffer.invProjection;
+    return dot(vec4(m[0].z, m[1].z, m[2].z, m[3].z), ndc) / dot(vec4(m[0].w, m[1].w, m[2].w, m[3].w), ndc);
+}
+
+// Linear depth of the camera view (zero outside the object)
+float gbufferDepth(in sampler2D depthTex, in vec2 uv) {
+    const float depth = texture(depthTex, uv).x;
+    if (gbuffer.reconstruct == 0) {
+        return depth;
+    }
+    if (depth >= 1.0) {
+        return 0.0;
+    }
+    return -gbufferViewZ(depth, uv);
+}
+
+// Central difference of the linear depth over "duv"
+float gbufferDepthGrad(in sampler2D depthTex, in vec2 uv, in vec2 duv) {
+    return 0.5 * (gbufferDepth(depthTex, uv + duv) - gbufferDepth(depthTex, uv - duv));
+}
+
+// Object-space position from the raw texel "depth" of "depthTex", which the caller has fetched
+vec3 gbufferPosition(in sampler2D posTex, in float depth, in vec2 uv) {
+    if (gbuffer.reconstruct == 0) {
+        return texture(posTex, uv).xyz;
+    }
+    const vec4 pos = gbuffer.invProjection * vec4(uv * 2.0 - 1.0, depth, 1.0);
+    return (gbuffer.invModelView * vec4(pos.xyz / pos.w, 1.0)).xyz;
+}
+
+// Depth compared by the depth weights of the Gaussian filters, and the coverage from the same texel.
+// Every profile compares the linear depth of the camera view, so that the weights do not depend on
+// the profile, and the taps take a single depth fetch.
+float gbufferTapDepth(in sampler2D depthTex, in vec2 uv, out bool covered) {
+    const float depth = texture(depthTex, uv).x;
+    covered = gbufferCovered(depth);
+    if (gbuffer.reconstruct == 0) {
+        return depth;
+    }
+    return -gbufferViewZ(depth, uv);
+}
+
+// Object-space normal
+vec3 gbufferNormal(in sampler2D normTex, in vec2 uv) {
+    if (gbuffer.reconstruct == 0) {
+        return texture(normTex, uv).xyz;
+    }
+    return octDecode(texture(normTex, uv).xy);
+}
@@ -0,0 +1,21 @@
+#version 450
+
+#include "utils.glsl"
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec4 inPosScreen;
+layout (location = 2) in vec3 inNormal;
+layout (location = 3) in vec3 inLightPos;
+layout (location = 4) in vec3 inLightPower;
+
+// Compact variant of "light_pass.frag". Irradiance is stored in B10G11R11, and position
+// is reconstructed from depth by the readers. Normal is not read by TSM, so it is not stored.
+layout (location = 0) out vec4 outFragColor;
+
+void main()
+{
+	vec3 n = normalize(inNormal);
+	vec3 l = normalize(inLightPos - inPos);
+
+	outFragColor = vec4(inLightPower * vec3(max(0.0, dot(n, l))), 1.0);
+}
@@ -0,0 +1,52 @@
+#ifndef GLSL_LINSSS_GLSL
+#define GLSL_LINSSS_GLSL
+
+// LinSSS accumulation shared by "linsss_accumulate.glsl" and the fused mode of "deferred_pass.frag".
+// The includer declares the uniform block "ubo", the samplers "tex_W", "tex_G_ast_W",
+// "tex_G_ast_Phi" and "tex_G_ast_Phi_split", and the constants "numGauss" and "splitPyramid".
+
+#include "precision.glsl"
+
+// MIP level of the irradiance pyramid for Gaussian sigmas
+vec3 gaussMipLevel(in vec3 s) {
+    vec3 level;
+    level.x = s.x >= 1.0 ? log2(s.x) + 1.0 : s.x;
+    level.y = s.y >= 1.0 ? log2(s.y) + 1.0 : s.y;
+    level.z = s.z >= 1.0 ? log2(s.z) + 1.0 : s.z;
+
+    // Since access to high mip level causes flickering artifact,
+    // 2.0 is multiplied to sigma used in Gaussian filtering (in gauss_filter.comp).
+    // Alternatively, 0.5 is multiplied to the mip level.
+    return level * 0.5;
+}
+
+// Texture coordinates of W and (G * W) for the surface position
+vec2 bssrdfUV(in vec2 pos) {
+    // Necessary to change W's UV space
+    vec2 uv = pos * 0.5 * ubo.texScale + 0.5;
+    uv.x += ubo.texOffsetX;
+    uv.y += ubo.texOffsetY;
+    return uv;
+}
+
+// Contribution of the h-th Gaussian
+real3 linsssTerm(in int h, in vec2 pixelUV, in vec2 uvW, in vec3 mipLevel) {
+    // G x (W o E)
+    vec3 G_ast_Phi = vec3(0.0, 0.0, 0.0);
+    if (splitPyramid) {
+        G_ast_Phi.x = textureLod(tex_G_ast_Phi_split, vec3(pixelUV, 0.0), mipLevel.x).x;
+        G_ast_Phi.y = textureLod(tex_G_ast_Phi_split, vec3(pixelUV, 1.0), mipLevel.y).x;
+        G_ast_Phi.z = textureLod(tex_G_ast_Phi_split, vec3(pixelUV, 2.0), mipLevel.z).x;
+    } else {
+        G_ast_Phi.x = textureLod(tex_G_ast_Phi, pixelUV, mipLevel.x).x;
+        G_ast_Phi.y = textureLod(tex_G_ast_Phi, pixelUV, mipLevel.y).y;
+        G_ast_Phi.z = textureLod(tex_G_ast_Phi, pixelUV, mipLevel.z).z;
+    }
+
+    const vec3 uvw = vec3(uvW, (h + 0.5) / float(numGauss));
+    const real3 W = real3(texture(tex_W, uvw).rgb);
+    const real3 G_ast_W = real3(texture(tex_G_ast_W, uvw).rgb);
+    return real(0.5) * (G_ast_W + W) * real3(G_ast_Phi) * real(ubo.irrScale);
+}
+
+#endif  // GLSL_LINSSS_GLSL
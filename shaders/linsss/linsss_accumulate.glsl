@@ -0,0 +1,95 @@
+// LinSSS accumulation of the filtered irradiance pyramid into "fbos.linsss".
+// The half-precision variant defines USE_FLOAT16 (see "precision.glsl").
+
+#include "utils.glsl"
+
+// Workgroup shape is given by specialization constants 1 and 2
+layout(local_size_x_id = 1, local_size_y_id = 2) in;
+
+layout(rgba32f, binding = 0) uniform writeonly image2D outImage;
+
+layout (binding = 1) uniform UBO {
+    vec4 sigmas[8];
+    float texOffsetX;
+    float texOffsetY;
+    float texScale;
+    float irrScale;
+} ubo;
+
+layout (binding = 2) uniform sampler3D tex_W;
+layout (binding = 3) uniform sampler3D tex_G_ast_W;
+layout (binding = 4) uniform sampler2D tex_G_ast_Phi;
+layout (binding = 5) uniform sampler2D posTex;
+layout (binding = 6) uniform sampler2D normTex;
+layout (binding = 7) uniform sampler2D depthTex;
+layout (binding = 8) uniform sampler2DArray tex_G_ast_Phi_split;
+
+layout (constant_id = 0) const int numGauss = 8;
+
+// Irradiance pyramid layout (false: RGBA, true: R, G and B in separate layers)
+layout (constant_id = 3) const bool splitPyramid = false;
+
+// Workgroups only run on the tiles covered by the object (see "tile_classify.comp")
+layout (constant_id = 4) const bool tileListed = false;
+
+layout (std430, binding = 9) readonly buffer TileList {
+    uint dispatchArgs[48];
+    uint data[];
+} tileList;
+
+// Push constants (first tile of the full-resolution level)
+layout (push_constant) uniform PushConstants {
+    uint tileBase;
+} pc;
+
+#define GBUFFER_BINDING 10
+#include "gbuffer.glsl"
+
+#include "linsss.glsl"
+
+shared vec3 mipLevels[numGauss];
+
+ivec2 workGroupOrigin() {
+    if (tileListed) {
+        const uint tile = tileList.data[pc.tileBase + gl_WorkGroupID.x];
+        return ivec2(tile & 0xffff, tile >> 16) * ivec2(gl_WorkGroupSize.xy);
+    }
+    return ivec2(gl_WorkGroupID.xy * gl_WorkGroupSize.xy);
+}
+
+void main(void) {
+	const ivec2 threadIdx = ivec2(gl_LocalInvocationID);
+	const ivec2 blockSize = ivec2(gl_WorkGroupSize);
+    const ivec2 frameSize = imageSize(outImage);
+
+    const ivec2 pixelPos = workGroupOrigin() + threadIdx;
+    const vec2 pixelUV = vec2((pixelPos.x + 0.5) / float(frameSize.x), (pixelPos.y + 0.5) / float(frameSize.y)); 
+
+	// Sigmas
+    const int k = threadIdx.y * blockSize.x + threadIdx.x;
+	if (k < numGauss) {
+        mipLevels[k] = gaussMipLevel(ubo.sigmas[k].xyz);
+	}
+    memoryBarrierShared();
+    barrier();
+
+    // Convolution
+    if (pixelPos.x >= 0 && pixelPos.y >= 0 && pixelPos.x < frameSize.x && pixelPos.y < frameSize.y) {
+        const float depth = texture(depthTex, pixelUV).x;
+        const bool isMasked = gbufferCovered(depth);
+
+        vec3 res = vec3(0.0, 0.0, 0.0);
+        if (isMasked) {
+            const vec2 uvW = bssrdfUV(gbufferPosition(posTex, depth, pixelUV).xy);
+
+            real3 accum = real3(0.0, 0.0, 0.0);
+            for (int h = 0; h < numGauss; h++) {
+                accum += linsssTerm(h, pixelUV, uvW, mipLevels[h]);
+            }
+
+        	imageStore(outImage, pixelPos, vec4(vec3(accum), 1.0));
+        } else {
+            imageStore(outImage, pixelPos, vec4(0.0, 0.0, 0.0, 1.0));
+        }
+    }
+}
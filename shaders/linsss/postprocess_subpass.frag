@@ -0,0 +1,11 @@
+#version 450
+
+// Postprocess of the merged subpasses. Input attachment only gives the
+// texel at the current fragment, so that FXAA (see "postprocess.frag") is skipped.
+layout (input_attachment_index = 0, binding = 2) uniform subpassInput inputColor;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() {
+    outFragColor = vec4(subpassLoad(inputColor).rgb, 1.0);
+}
@@ -0,0 +1,20 @@
+#ifndef GLSL_PRECISION_GLSL
+#define GLSL_PRECISION_GLSL
+
+// Arithmetic types of the half-precision path. The "_fp16" shader variants
+// enable GL_EXT_shader_explicit_arithmetic_types_float16 and define USE_FLOAT16
+// before including the shader body. Coordinates and MIP levels are always
+// computed in 32 bits, and images and buffers keep their 32-bit formats.
+#ifdef USE_FLOAT16
+#define real float16_t
+#define real3 f16vec3
+#define real4 f16vec4
+#define REAL_MAX 65504.0
+#else
+#define real float
+#define real3 vec3
+#define real4 vec4
+#define REAL_MAX 3.402823466e+38
+#endif
+
+#endif  // GLSL_PRECISION_GLSL
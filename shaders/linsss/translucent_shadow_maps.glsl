@@ -0,0 +1,224 @@
+// Translucent shadow maps. The half-precision variant defines USE_FLOAT16
+// (see "precision.glsl"). Diffuse reflectance "diffRef" stays in 32 bits,
+// because the Gaussians of small sigmas exceed the half-precision range.
+
+#include "utils.glsl"
+#include "precision.glsl"
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec4 inPosScreen;
+
+layout (location = 0) out vec4 outFragColor;
+
+layout (binding = 1) uniform UBOSSS {
+    vec4 sigmas[8];
+    float texOffsetX;
+    float texOffsetY;
+    float texScale;
+    float irrScale;
+} ubo_sss;
+
+layout (binding = 2) uniform UBOTSM {
+	mat4 mvpMat;
+	mat4 smMvpMat;
+	mat4 smInvMvpMat;
+	vec2 screenExtent;
+	vec2 bssrdfExtent;
+	vec2 seed;
+	int numGauss;
+	int ksize;
+	float sigmaScale;
+	int sampling;
+	int radiusImportance;
+	int reset;
+	int profileLut;
+	float profileMaxRadius;
+	int mipmaps;
+	float mipBias;
+	int posFromDepth;
+} ubo_tsm;
+
+layout (binding = 3) uniform sampler2D accumTex;
+
+// Irradiance and position have MIP levels, which are read by explicit LODs (see "tapLod").
+// Alpha of position is the coverage, so that positions are normalized at the silhouettes.
+// With compact light pass targets, "tsmPosTex" is the depth of the light view (see "tsmPosition").
+layout (binding = 4) uniform sampler2D tsmIrrTex;
+layout (binding = 5) uniform sampler2D tsmPosTex;
+layout (binding = 6) uniform sampler2D tsmNormTex;
+layout (binding = 7) uniform sampler3D bssrdfTex;
+
+// Radial profiles for quantized weights (rows: codes, columns: sqrt of distance / profileMaxRadius)
+layout (binding = 8) uniform sampler2D profileLutTex;
+layout (binding = 9) uniform sampler2D profileCodeTex;
+
+float eta = 1.5;
+
+vec3 sigmas[32];
+
+vec3 gauss(in float x, in vec3 s) {
+	const vec3 invs = 1.0 / s;
+	const vec3 xdivs = vec3(x) * invs;
+    return M_INV_TWO_PI * exp(-0.5 * xdivs * xdivs) * invs * invs;
+}
+
+vec3 getGaussWeight(in vec2 pos, in int h) {
+    vec2 uv = pos * 0.5 * ubo_sss.texScale + 0.5;
+	uv.x += ubo_sss.texOffsetX;
+	uv.y += ubo_sss.texOffsetY;
+    float w = float(h + 0.5) / ubo_tsm.numGauss;
+    return texture(bssrdfTex, vec3(uv, w)).xyz;
+}
+
+vec3 diffRef(in vec3 p0, in vec3 p1) {
+	float r = length(p0 - p1);
+	vec3 Px = vec3(0.0, 0.0, 0.0);
+	vec3 Py = vec3(0.0, 0.0, 0.0);
+	for (int i = 0; i < ubo_tsm.numGauss; i++) {
+		const vec3 G =  gauss(r, sigmas[i]);
+		Px += getGaussWeight(p0.xy, i) * G;
+		Py += getGaussWeight(p1.xy, i) * G;
+	}
+    return sqrt(max(vec3(0.0), Px * Py));
+}
+
+// Radial profile at distance sqrt(u) * profileMaxRadius for the weights at "pos"
+vec3 radialProfile(in vec2 pos, in float u) {
+    vec2 uv = pos * 0.5 * ubo_sss.texScale + 0.5;
+	uv.x += ubo_sss.texOffsetX;
+	uv.y += ubo_sss.texOffsetY;
+	const ivec2 codeSize = textureSize(profileCodeTex, 0);
+	const ivec2 codePos = min(ivec2(fract(uv) * vec2(codeSize)), codeSize - 1);
+	const float code = texelFetch(profileCodeTex, codePos, 0).r;
+
+	const vec2 lutSize = vec2(textureSize(profileLutTex, 0));
+	const vec2 lutUV = vec2((u * (lutSize.x - 1.0) + 0.5) / lutSize.x, (code + 0.5) / lutSize.y);
+	return texture(profileLutTex, lutUV).rgb;
+}
+
+// Same as "diffRef" with the baked profiles. Sigmas are scaled by "c", which scales
+// the distance by 1 / c and the profiles by 1 / c^2.
+vec3 diffRefLut(in vec3 p0, in vec3 p1, in float c) {
+	const float rho = length(p0 - p1) / c;
+	if (rho >= ubo_tsm.profileMaxRadius) {
+		return vec3(0.0);
+	}
+	const float u = sqrt(rho / ubo_tsm.profileMaxRadius);
+	const vec3 Px = radialProfile(p0.xy, u);
+	const vec3 Py = radialProfile(p1.xy, u);
+	return sqrt(max(vec3(0.0), Px * Py)) / (c * c);
+}
+
+// Taps of each frame and the radius of the disk in UV (set by "TSM_SAMPLES" and "TSM_MAX_RADIUS" of the sample)
+layout (constant_id = 0) const int TSM_SAMPLES = 8;
+layout (constant_id = 1) const float TSM_MAX_RADIUS = 0.1;
+
+// MIP level for a tap at distance "r" (in UV) from the center. Taps of a frame are
+// 2 pi r / TSM_SAMPLES apart on the circle, so that distant taps read coarser levels.
+// Random taps give no meaningful derivatives, so the base level is otherwise read explicitly.
+float tapLod(in float r) {
+	if (ubo_tsm.mipmaps == 0) {
+		return 0.0;
+	}
+	const float size = float(textureSize(tsmPosTex, 0).x);
+	const float spacing = 2.0 * M_PI * r * size / float(TSM_SAMPLES);
+	return max(0.0, log2(max(spacing, 1.0)) + ubo_tsm.mipBias);
+}
+
+// Object-space position at "texcoord" of the light view
+vec3 tsmPosition(in vec2 texcoord, in float lod) {
+	if (ubo_tsm.posFromDepth != 0) {
+		const float depth = textureLod(tsmPosTex, texcoord, 0.0).r;
+		const vec4 pos = ubo_tsm.smInvMvpMat * vec4(texcoord * 2.0 - 1.0, depth, 1.0);
+		return pos.xyz / pos.w;
+	}
+	const vec4 pos = textureLod(tsmPosTex, texcoord, lod);
+	return pos.xyz / max(pos.w, M_EPS);
+}
+
+// Sampling schemes of the TSM disk (same as "TSMSampling" in "linsss.h")
+#define TSM_SAMPLING_WHITE_NOISE 0
+#define TSM_SAMPLING_LOW_DISCREPANCY 1
+
+vec2 randState;
+
+float rand() {
+    float a = 12.9898;
+    float b = 78.233;
+    float c = 43758.5453;
+    randState.x = fract(sin(float(dot(randState.xy - ubo_tsm.seed, vec2(a, b)))) * c);
+    randState.y = fract(sin(float(dot(randState.xy - ubo_tsm.seed, vec2(a, b)))) * c);
+    return randState.x;
+}
+
+// R2 sequence in 32-bit fixed point, so that it stays stratified over many frames.
+// See M. Roberts, "The unreasonable effectiveness of quasirandom sequences", 2018.
+vec2 r2Sequence(in uint n) {
+    const uvec2 alpha = uvec2(3242174889u, 2447445414u);
+    return vec2(alpha * n + 0x80000000u) * (1.0 / 4294967296.0);
+}
+
+// Interleaved gradient noise offsets of the sequence for each pixel.
+// See J. Jimenez, "Next generation post processing in Call of Duty: Advanced Warfare", 2014.
+float interleavedGradientNoise(in vec2 pixel) {
+    return fract(52.9829189 * fract(dot(pixel, vec2(0.06711056, 0.00583715))));
+}
+
+void main() {
+	float scale = max(ubo_tsm.bssrdfExtent.x, ubo_tsm.bssrdfExtent.y);
+	const bool useProfileLut = ubo_tsm.profileLut != 0;
+	const float sigmaFactor = max(ubo_tsm.sigmaScale / scale, M_EPS);
+	if (!useProfileLut) {
+		for (int i = 0; i < ubo_tsm.numGauss; i++) {
+			sigmas[i] = ubo_tsm.sigmaScale * ubo_sss.sigmas[i].xyz / scale;
+		}
+	}
+
+	vec4 posTsmSpace = ubo_tsm.smMvpMat * vec4(inPos, 1.0);
+	vec2 st = (posTsmSpace.xy / posTsmSpace.w) * 0.5 + 0.5;
+
+	vec2 screenUV = ((inPosScreen.xy / inPosScreen.w) * 0.5 + 0.5);
+	randState = screenUV;
+
+	// Number of accumulated frames (alpha is cleared to 1.0).
+	// Ping and pong share the render area, which may be a part of the attachments.
+	// On reset, the previous accumulation is ignored instead of being cleared.
+	vec4 accum = ubo_tsm.reset != 0 ? vec4(0.0, 0.0, 0.0, 1.0) : texelFetch(accumTex, ivec2(gl_FragCoord.xy), 0);
+	const uint frame = uint(max(accum.w - 1.0, 0.0));
+	const vec2 pixelOffset = vec2(interleavedGradientNoise(gl_FragCoord.xy),
+	                              interleavedGradientNoise(gl_FragCoord.yx + vec2(17.0, 23.0)));
+
+	real3 rgb = real3(0.0);
+	real sumWgt = real(0.0);
+	for (int i = 0; i < TSM_SAMPLES; i++) {
+		const float r_max = TSM_MAX_RADIUS;
+		vec2 u;
+		if (ubo_tsm.sampling == TSM_SAMPLING_LOW_DISCREPANCY) {
+			u = fract(r2Sequence(frame * uint(TSM_SAMPLES) + uint(i)) + pixelOffset);
+		} else {
+			u.x = rand();
+			u.y = rand();
+		}
+
+		// Samples are weighted by squared radius, which can be importance sampled with pdf(xi1) = 3 xi1^2
+		float xi1 = ubo_tsm.radiusImportance != 0 ? pow(u.x, 1.0 / 3.0) : u.x;
+		float xi2 = u.y;
+
+	    vec2 texcoord;
+		texcoord.x = st.x + r_max * xi1 * sin(2.0 * M_PI * xi2);
+		texcoord.y = st.y + r_max * xi1 * cos(2.0 * M_PI * xi2);
+		
+		const float lod = tapLod(r_max * xi1);
+		vec3 xi = tsmPosition(texcoord, lod);
+		vec3 xo = inPos;
+		vec3 Rd = useProfileLut ? diffRefLut(xo, xi, sigmaFactor) : diffRef(xo, xi);
+		real3 irr = real3(textureLod(tsmIrrTex, texcoord, lod).rgb);
+		real3 Mo = irr * real3(min(ubo_sss.irrScale * Rd, vec3(REAL_MAX / TSM_SAMPLES)));
+		real wgt = ubo_tsm.radiusImportance != 0 ? real(1.0) : real(xi1 * xi1);
+		rgb += wgt * Mo;
+		sumWgt += wgt;
+	}
+
+	outFragColor = vec4(accum.rgb + vec3(rgb / (sumWgt + real(M_EPS))), accum.w + 1.0);
+}
@@ -0,0 +1,5 @@
+#version 450
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+
+#define USE_FLOAT16
+#include "translucent_shadow_maps.glsl"
@@ -66,6 +66,51 @@ vec4 computeSH(in vec4 N, in vec4 coefs[9]) {
     return vec4(r, g, b, 1.0);
 }
 
+// --------------------
+// environment maps
+// --------------------
+
+// Equirectangular coordinates of a direction (y-up, as the background of "envmap.frag")
+vec2 envmapUV(in vec3 dir) {
+    const vec3 d = clamp(dir, -1.0 + M_EPS, 1.0 - M_EPS);
+    const float phi = atan(d.z, d.x);
+    const float theta = acos(clamp(d.y, -1.0, 1.0));
+    return vec2((phi + M_PI) * M_INV_TWO_PI, theta * M_INV_PI);
+}
+
+vec3 envmapDir(in vec2 uv) {
+    const float phi = uv.x * M_TWO_PI - M_PI;
+    const float theta = uv.y * M_PI;
+    return vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+}
+
+// Hammersley point set
+vec2 hammersley(in uint i, in uint n) {
+    return vec2(float(i) / float(n), float(bitfieldReverse(i)) * 2.3283064365386963e-10);
+}
+
+// --------------------
+// normal encoding
+// --------------------
+
+// Octahedral mapping of unit vectors to [-1, 1]^2.
+// See Z. Cigolle et al., "A survey of efficient representations for independent unit vectors", JCGT, 2014.
+vec2 octEncode(in vec3 n) {
+    vec2 p = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+    if (n.z < 0.0) {
+        p = (1.0 - abs(p.yx)) * vec2(p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return p;
+}
+
+vec3 octDecode(in vec2 p) {
+    vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
 // --------------------
 // tonemap
 // --------------------